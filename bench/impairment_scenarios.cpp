@@ -0,0 +1,405 @@
+// Сценарии плохой сети для медиа-сессии клиента.
+//
+//   impairment_scenarios [script] [--seconds N] [--seed N]
+//
+// Две MediaSession, как два клиента за ретранслятором, связаны в процессе
+// моделями NetworkImpairment - по одной на направление, с одним описанием
+// и разными зернами. A отправляет тон, B - тишину; оба играют в темпе
+// буфера устройства, так что работают настоящие буфер воспроизведения,
+// FEC, маскировка и контроллер битрейта.
+//
+// Скрипт - строки "имя описание [секунды]", # - комментарий; описание как
+// у --impair. Без скрипта прогоняется встроенный набор. Зерно, не заданное
+// в описании, берется из --seed, поэтому потери повторяются от прогона к
+// прогону.
+//
+// Качество звука:
+//   resid    доля пакетов тона, замаскированных после FEC
+//   bad      доля буферов вывода B, уровень которых отличается от тона
+//            больше чем на 3 дБ (маскировка, голодание, тишина)
+//   MOS      оценка по E-модели ITU-T G.107 из resid и задержки
+// Задержка:
+//   owd      задержка сети A->B, p50/p95
+//   m2e      оценка "рот-ухо": пакетизация + owd p50 + очередь вывода
+//   rtt      RTT контроллера A по отчетам получателя
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MediaSession.hpp"
+#include "NetworkImpairment.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kBufferPeriod = std::chrono::microseconds(1000000LL * FRAMES_PER_BUFFER / SAMPLE_RATE);
+// Первые секунды не считаются: буфер вывода и контроллер входят в режим
+constexpr auto kWarmup = std::chrono::seconds(2);
+constexpr double kToneHz = 440.0;
+constexpr double kToneAmplitude = 8000.0;
+constexpr double kBadLevelDb = 3.0;
+
+struct Scenario {
+    std::string name;
+    std::string spec;
+    double seconds{0};
+};
+
+const Scenario kBuiltin[] = {
+    {"clean", "none"},
+    {"loss-2", "loss=2%"},
+    {"loss-10", "loss=10%"},
+    {"bursty", "burst=2%:25%"},
+    {"jitter-30", "delay=40ms,jitter=30ms"},
+    {"reorder", "delay=30ms,reorder=5%"},
+    {"duplicate", "dup=10%"},
+    {"cap-64k", "rate=64kbit,queue=150ms"},
+    {"wifi", "burst=1%:30%:70%,delay=20ms,jitter=25ms,reorder=1%,dup=0.5%"},
+};
+
+// Два направления между сессиями; свой поток отдает датаграммы в срок
+class Network {
+public:
+    enum Direction { kForward = 0, kBackward = 1 };
+
+    Network(const ImpairmentConfig& forward, const ImpairmentConfig& backward)
+        : links_{NetworkImpairment(forward), NetworkImpairment(backward)} {}
+    ~Network() { Stop(); }
+
+    // sinks[kForward] принимает то, что отправил A
+    void Start(MediaSession& b, MediaSession& a) {
+        sinks_[kForward] = &b;
+        sinks_[kBackward] = &a;
+        thread_ = std::thread(&Network::Loop, this);
+    }
+
+    void Stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_one();
+        thread_.join();
+    }
+
+    void Send(Direction direction, const uint8_t* data, size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            links_[direction].Submit(data, size, sockaddr_in{}, Clock::now());
+        }
+        ready_.notify_one();
+    }
+
+    NetworkImpairment::Stats GetStats(Direction direction) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return links_[direction].GetStats();
+    }
+
+    // Задержки аудиопакетов A->B, мс
+    std::vector<double> TakeDelays() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::move(delays_);
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    NetworkImpairment links_[2];
+    MediaSession* sinks_[2]{};
+    std::vector<double> delays_;
+    bool stopping_{false};
+    std::thread thread_;
+
+    void Loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        NetworkImpairment::Packet packet;
+        while (!stopping_) {
+            bool delivered = false;
+            for (int direction : {kForward, kBackward}) {
+                const auto now = Clock::now();
+                while (links_[direction].PopDue(now, packet)) {
+                    PacketType type;
+                    if (direction == kForward && PeekPacketType(packet.data.data(), packet.data.size(), type) &&
+                        type == PacketType::Audio) {
+                        delays_.push_back(std::chrono::duration<double, std::milli>(now - packet.submitted).count());
+                    }
+                    lock.unlock();
+                    sinks_[direction]->OnDatagram(packet.data.data(), packet.data.size());
+                    lock.lock();
+                    delivered = true;
+                }
+            }
+            if (delivered) {
+                continue;
+            }
+            const auto due = std::min(links_[kForward].NextDue(), links_[kBackward].NextDue());
+            if (due == Clock::time_point::max()) {
+                ready_.wait(lock);
+            } else {
+                ready_.wait_until(lock, due);
+            }
+        }
+    }
+};
+
+struct Result {
+    NetworkImpairment::Stats forward;
+    uint64_t audio_sent{0};
+    uint64_t recovered{0};
+    uint64_t concealed{0};
+    uint64_t underruns{0};
+    uint64_t buffers{0};
+    uint64_t bad_buffers{0};
+    double fill_buffers{0};
+    double owd_p50{0};
+    double owd_p95{0};
+    double rtt_ms{0};
+    uint32_t bitrate_bps{0};
+    uint8_t frames_per_packet{1};
+    uint8_t fec_group{0};
+};
+
+double Percentile(std::vector<double>& samples, double q) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[static_cast<size_t>(q * (samples.size() - 1))];
+}
+
+// E-модель ITU-T G.107 для кодека без собственных искажений (Ie = 0) и
+// устойчивости к потерям как у G.711 с маскировкой (Bpl = 25.1)
+double EstimateMos(double loss_percent, double burst_ratio, double delay_ms) {
+    constexpr double kBpl = 25.1;
+    const double ie_eff = 95.0 * loss_percent / (loss_percent / burst_ratio + kBpl);
+    double id = 0.024 * delay_ms;
+    if (delay_ms > 177.3) {
+        id += 0.11 * (delay_ms - 177.3);
+    }
+    const double r = 93.2 - id - ie_eff;
+    if (r <= 0) {
+        return 1.0;
+    }
+    if (r >= 100) {
+        return 4.5;
+    }
+    return 1.0 + 0.035 * r + r * (r - 60) * (100 - r) * 7e-6;
+}
+
+// Отношение средней длины пачки потерь к случайной, для Gilbert-Elliott
+// с потерей каждого пакета в Bad - 1 / (p + r)
+double BurstRatio(const ImpairmentConfig& config) {
+    if (config.burst_enter <= 0) {
+        return 1.0;
+    }
+    return std::max(1.0, 1.0 / (config.burst_enter + config.burst_exit));
+}
+
+const MediaReceiver::StreamStats* FindStream(const MediaSession::Stats& stats, uint32_t ssrc) {
+    for (const auto& stream : stats.streams) {
+        if (stream.ssrc == ssrc) {
+            return &stream;
+        }
+    }
+    return nullptr;
+}
+
+Result Run(const ImpairmentConfig& config, double seconds) {
+    ImpairmentConfig backward = config;
+    backward.seed = config.seed ^ 0x9e3779b97f4a7c15ULL;
+    Network network(config, backward);
+
+    uint64_t audio_sent = 0;
+    MediaSession a([&](const uint8_t* data, size_t size) {
+        PacketType type;
+        if (PeekPacketType(data, size, type) && type == PacketType::Audio) {
+            ++audio_sent;
+        }
+        network.Send(Network::kForward, data, size);
+    });
+    MediaSession b([&](const uint8_t* data, size_t size) { network.Send(Network::kBackward, data, size); });
+    network.Start(b, a);
+
+    const uint32_t tone_ssrc = a.GetStats().ssrc;
+    const double reference_rms = kToneAmplitude / std::sqrt(2.0);
+    const double step = 2.0 * M_PI * kToneHz / SAMPLE_RATE;
+    double phase = 0.0;
+
+    SAMPLE tone[BUF_SIZE];
+    SAMPLE silence[BUF_SIZE] = {};
+    SAMPLE out[BUF_SIZE];
+
+    Result result;
+    MediaReceiver::StreamStats warm{};
+    uint64_t warm_sent = 0;
+    bool warmed = false;
+
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    auto next = start;
+    while (next < end) {
+        std::this_thread::sleep_until(next);
+        next += kBufferPeriod;
+
+        for (auto& sample : tone) {
+            sample = static_cast<SAMPLE>(kToneAmplitude * std::sin(phase));
+            phase += step;
+        }
+        phase = std::fmod(phase, 2.0 * M_PI);
+        a.OnCapturedFrame(tone, BUF_SIZE);
+        b.OnCapturedFrame(silence, BUF_SIZE);
+
+        a.Mix(out, BUF_SIZE);
+        b.Mix(out, BUF_SIZE);
+
+        if (!warmed) {
+            if (next - start < kWarmup) {
+                continue;
+            }
+            warmed = true;
+            network.TakeDelays();
+            const auto stats = b.GetStats();
+            if (const auto* stream = FindStream(stats, tone_ssrc)) {
+                warm = *stream;
+            }
+            warm_sent = audio_sent;
+        }
+
+        double energy = 0.0;
+        for (SAMPLE sample : out) {
+            energy += static_cast<double>(sample) * sample;
+        }
+        const double rms = std::sqrt(energy / BUF_SIZE);
+        ++result.buffers;
+        if (rms <= 0 || std::abs(20.0 * std::log10(rms / reference_rms)) > kBadLevelDb) {
+            ++result.bad_buffers;
+        }
+    }
+
+    const auto a_stats = a.GetStats();
+    const auto b_stats = b.GetStats();
+    network.Stop();
+
+    result.forward = network.GetStats(Network::kForward);
+    result.audio_sent = audio_sent - warm_sent;
+    if (const auto* stream = FindStream(b_stats, tone_ssrc)) {
+        result.recovered = stream->recovered - warm.recovered;
+        result.concealed = stream->concealed - warm.concealed;
+        result.underruns = stream->playout.underruns - warm.playout.underruns;
+        result.fill_buffers = stream->playout.fill_frames;
+    }
+    auto delays = network.TakeDelays();
+    result.owd_p50 = Percentile(delays, 0.50);
+    result.owd_p95 = Percentile(delays, 0.95);
+    result.rtt_ms = a_stats.controller.rtt_ms;
+    result.bitrate_bps = a_stats.controller.bitrate_bps;
+    result.frames_per_packet = a_stats.controller.frames_per_packet;
+    result.fec_group = a_stats.controller.fec_group;
+    return result;
+}
+
+bool LoadScript(const std::string& path, std::vector<Scenario>& scenarios) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        const auto comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        Scenario scenario;
+        if (!(fields >> scenario.name >> scenario.spec)) {
+            continue;
+        }
+        fields >> scenario.seconds;
+        scenarios.push_back(scenario);
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string script;
+    double seconds = 10.0;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (script.empty() && arg[0] != '-') {
+            script = arg;
+        } else {
+            std::printf("Usage: %s [script] [--seconds N] [--seed N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Scenario> scenarios;
+    if (script.empty()) {
+        scenarios.assign(std::begin(kBuiltin), std::end(kBuiltin));
+    } else if (!LoadScript(script, scenarios)) {
+        std::fprintf(stderr, "Failed to read script %s\n", script.c_str());
+        return 1;
+    }
+
+    std::printf("%-12s %7s %7s %6s %6s %6s %7s %13s %7s %7s %6s %5s %5s\n", "scenario", "net", "resid", "recov",
+                "conc", "under", "bad", "owd p50/p95", "m2e", "rtt", "kbps", "fec", "MOS");
+    for (const auto& scenario : scenarios) {
+        ImpairmentConfig config;
+        std::string error;
+        // Зерно из описания перекрывает --seed
+        const std::string spec = "seed=" + std::to_string(seed) + "," + (scenario.spec == "none" ? "" : scenario.spec);
+        if (!ParseImpairment(spec, config, error)) {
+            std::fprintf(stderr, "%s: %s\n", scenario.name.c_str(), error.c_str());
+            return 1;
+        }
+        const double duration = scenario.seconds > 0 ? scenario.seconds : seconds;
+        if (duration <= std::chrono::duration<double>(kWarmup).count()) {
+            std::fprintf(stderr, "%s: scenario must be longer than the %lld s warmup\n", scenario.name.c_str(),
+                         static_cast<long long>(kWarmup.count()));
+            return 1;
+        }
+
+        const Result result = Run(config, duration);
+        const auto& net = result.forward;
+        const double net_loss = net.offered ? 100.0 * (net.lost + net.queue_dropped) / net.offered : 0.0;
+        const double resid = result.audio_sent ? 100.0 * result.concealed / result.audio_sent : 0.0;
+        const double bad = result.buffers ? 100.0 * result.bad_buffers / result.buffers : 0.0;
+        const double period_ms = std::chrono::duration<double, std::milli>(kBufferPeriod).count();
+        const double m2e = period_ms * result.frames_per_packet + result.owd_p50 + period_ms * result.fill_buffers;
+        const double mos = EstimateMos(resid, BurstRatio(config), m2e);
+
+        char fec[8] = "off";
+        if (result.fec_group > 0) {
+            std::snprintf(fec, sizeof(fec), "1/%u", result.fec_group);
+        }
+        std::printf("%-12s %6.2f%% %6.2f%% %6llu %6llu %6llu %6.2f%% %6.1f/%-6.1f %7.1f %7.1f %6u %5s %5.2f\n",
+                    scenario.name.c_str(), net_loss, resid, static_cast<unsigned long long>(result.recovered),
+                    static_cast<unsigned long long>(result.concealed),
+                    static_cast<unsigned long long>(result.underruns), bad, result.owd_p50, result.owd_p95, m2e,
+                    result.rtt_ms, result.bitrate_bps / 1000, fec, mos);
+        std::fflush(stdout);
+    }
+    return 0;
+}
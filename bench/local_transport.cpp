@@ -0,0 +1,271 @@
+// Локальный транспорт против UDP через петлю: конференция процессов на
+// одной машине с ретранслятором.
+//
+//   bench_local_transport [seconds] [--participants N] [--size B]
+//
+// Ретранслятор запускается в процессе; каждый участник - поток, который
+// шлет кадр раз в период и между кадрами принимает чужие, как бот или
+// запись рядом с сервером. Период - буфер аудио (256 отсчетов на 44.1
+// кГц) и 250 мкс для нагрузки в 23 раза выше. CPU - процессорное время
+// всего процесса, ретранслятор включительно, на доставленный кадр.
+// Системные вызовы: у клиентов все, у ретранслятора UDP - прием и
+// отправка без epoll_wait, у локального - ожидания потока колец и побудки.
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioRelay.hpp"
+#include "LocalTransport.hpp"
+#include "MediaPacket.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Порт на прогон: io_uring отпускает закрытый сокет не сразу
+constexpr int kRelayPort = 23461;
+int next_port = kRelayPort;
+constexpr size_t kReceiveBatch = 16;
+const char* const kLocalPath = "/tmp/zvonok-bench-local.sock";
+
+struct Config {
+    double seconds{3.0};
+    size_t participants{8};
+    size_t size{268};
+};
+
+struct Counters {
+    uint64_t sent{0};
+    uint64_t received{0};
+    uint64_t syscalls{0};
+};
+
+struct Result {
+    double seconds{0};
+    double cpu_seconds{0};
+    Counters clients;
+    uint64_t relay_syscalls{0};
+};
+
+double ProcessCpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+           usage.ru_stime.tv_usec / 1e6;
+}
+
+std::vector<uint8_t> MakeFrame(uint32_t ssrc, size_t size) {
+    MediaHeader header;
+    header.ssrc = ssrc;
+    std::vector<uint8_t> frame;
+    header.Serialize(frame);
+    frame.resize(std::max(size, frame.size()), 0x5a);
+    return frame;
+}
+
+// Кадр раз в period, между кадрами - прием; send и receive(до) считают
+// свои системные вызовы сами
+template <typename Send, typename Receive>
+void Participate(uint32_t ssrc, const Config& config, Clock::duration period, const std::atomic<bool>& running,
+                 Send send, Receive receive, Counters& counters) {
+    std::vector<uint8_t> frame = MakeFrame(ssrc, config.size);
+    auto next = Clock::now();
+    while (running.load(std::memory_order_relaxed)) {
+        if (Clock::now() >= next) {
+            send(frame.data(), frame.size());
+            ++counters.sent;
+            next += period;
+        }
+        receive(next);
+    }
+}
+
+Result RunUdp(const Config& config, Clock::duration period) {
+    const int port = next_port++;
+    AudioRelay relay(port);
+    relay.Start();
+
+    sockaddr_in relay_address{};
+    relay_address.sin_family = AF_INET;
+    relay_address.sin_port = htons(port);
+    relay_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    std::atomic<bool> running{true};
+    std::vector<Counters> counters(config.participants);
+    std::vector<std::thread> threads;
+    const double cpu_start = ProcessCpuSeconds();
+    const auto start = Clock::now();
+    for (size_t i = 0; i < config.participants; ++i) {
+        threads.emplace_back([&, i] {
+            const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            Counters& own = counters[i];
+            std::vector<uint8_t> buffers(kReceiveBatch * kMaxMediaDatagram);
+            iovec iov[kReceiveBatch];
+            mmsghdr messages[kReceiveBatch]{};
+            for (size_t j = 0; j < kReceiveBatch; ++j) {
+                iov[j] = {buffers.data() + j * kMaxMediaDatagram, kMaxMediaDatagram};
+                messages[j].msg_hdr.msg_iov = &iov[j];
+                messages[j].msg_hdr.msg_iovlen = 1;
+            }
+            const auto send = [&](const uint8_t* data, size_t size) {
+                sendto(fd, data, size, 0, (const sockaddr*)&relay_address, sizeof(relay_address));
+                ++own.syscalls;
+            };
+            const auto receive = [&](Clock::time_point until) {
+                const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(until - Clock::now());
+                timespec timeout{0, 0};
+                if (wait.count() > 0) {
+                    timeout.tv_sec = wait.count() / 1000000000;
+                    timeout.tv_nsec = wait.count() % 1000000000;
+                }
+                pollfd pfd{fd, POLLIN, 0};
+                ++own.syscalls;
+                if (ppoll(&pfd, 1, &timeout, nullptr) <= 0) {
+                    return;
+                }
+                int count = 0;
+                do {
+                    count = recvmmsg(fd, messages, kReceiveBatch, MSG_DONTWAIT, nullptr);
+                    ++own.syscalls;
+                    own.received += count > 0 ? count : 0;
+                } while (count == static_cast<int>(kReceiveBatch));
+            };
+            Participate(0x1000 + static_cast<uint32_t>(i), config, period, running, send, receive, own);
+            close(fd);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.cpu_seconds = ProcessCpuSeconds() - cpu_start;
+    for (const auto& own : counters) {
+        result.clients.sent += own.sent;
+        result.clients.received += own.received;
+        result.clients.syscalls += own.syscalls;
+    }
+    const auto stats = relay.GetStats();
+    result.relay_syscalls = stats.receive_calls + stats.send_calls;
+    relay.Stop();
+    return result;
+}
+
+Result RunLocal(const Config& config, Clock::duration period) {
+    AudioRelay relay(next_port++);
+    relay.SetLocalPath(kLocalPath);
+    relay.Start();
+
+    std::atomic<bool> running{true};
+    std::vector<Counters> counters(config.participants);
+    std::vector<std::unique_ptr<LocalMediaLink>> links;
+    for (size_t i = 0; i < config.participants; ++i) {
+        links.push_back(std::make_unique<LocalMediaLink>());
+        std::string error;
+        if (!links.back()->Connect(kLocalPath, error)) {
+            std::fprintf(stderr, "local connect failed: %s\n", error.c_str());
+            std::exit(1);
+        }
+    }
+    // Подключения принимает поток колец ретранслятора
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<std::thread> threads;
+    const double cpu_start = ProcessCpuSeconds();
+    const auto start = Clock::now();
+    for (size_t i = 0; i < config.participants; ++i) {
+        threads.emplace_back([&, i] {
+            LocalMediaLink& link = *links[i];
+            Counters& own = counters[i];
+            const auto send = [&](const uint8_t* data, size_t size) { link.Send(data, size); };
+            const auto receive = [&](Clock::time_point until) {
+                const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(until - Clock::now());
+                link.Receive([](const uint8_t*, size_t) {}, std::max(wait, std::chrono::microseconds(0)));
+            };
+            Participate(0x2000 + static_cast<uint32_t>(i), config, period, running, send, receive, own);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.cpu_seconds = ProcessCpuSeconds() - cpu_start;
+    for (size_t i = 0; i < links.size(); ++i) {
+        const auto stats = links[i]->GetStats();
+        result.clients.sent += counters[i].sent;
+        result.clients.received += stats.received;
+        result.clients.syscalls += stats.waits + stats.wakeups;
+    }
+    links.clear();
+    const auto stats = relay.GetStats();
+    result.relay_syscalls = stats.local_waits + stats.local_wakeups;
+    relay.Stop();
+    return result;
+}
+
+void Print(const char* transport, Clock::duration period, const Config& config, const Result& result) {
+    const double expected = static_cast<double>(result.clients.sent) * (config.participants - 1);
+    const double delivered = static_cast<double>(result.clients.received);
+    const double syscalls = static_cast<double>(result.clients.syscalls + result.relay_syscalls);
+    std::printf("%-8s %8.0f %12.0f %8.2f %12.2f %12.2f %12.2f\n", transport,
+                std::chrono::duration<double, std::micro>(period).count(), delivered / result.seconds,
+                expected > 0 ? 100.0 * (1.0 - delivered / expected) : 0.0,
+                delivered > 0 ? result.cpu_seconds * 1e6 / delivered : 0.0,
+                delivered > 0 ? static_cast<double>(result.clients.syscalls) / delivered : 0.0,
+                delivered > 0 ? syscalls / delivered : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--participants" && i + 1 < argc) {
+            config.participants = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--size" && i + 1 < argc) {
+            config.size = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            config.seconds = std::atof(argv[i]);
+        }
+    }
+    if (config.participants < 2) {
+        std::fprintf(stderr, "need at least 2 participants\n");
+        return 1;
+    }
+    // Журнал ретранслятора (подключения участников) не нужен в таблице
+    std::cout.setstate(std::ios::failbit);
+
+    std::printf("%zu participants, %zu-byte frames, %.1f s per run\n\n", config.participants, config.size,
+                config.seconds);
+    std::printf("%-8s %8s %12s %8s %12s %12s %12s\n", "path", "period", "delivered/s", "loss %", "cpu us/frm",
+                "client sc/f", "total sc/f");
+    const Clock::duration periods[] = {std::chrono::microseconds(5805), std::chrono::microseconds(250)};
+    for (const auto period : periods) {
+        Print("udp", period, config, RunUdp(config, period));
+        Print("shm", period, config, RunLocal(config, period));
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Шифрование медиа: нс на пакет и пакетов в секунду на ядро по наборам
+// шифров, размерам пакета и размеру пачки.
+//
+//   bench_media_crypto [seconds]
+//
+// Круг - шифрование и проверка пакета на месте, как у отправителя и
+// получателя; после круга буфер снова открытый и идет на следующий.
+// Отдельно меряется одно шифрование. Время - процессорное время потока.
+// Ретранслятор пакеты не расшифровывает: для него шифрование - только
+// kProtectionOverhead байт на пакет.
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "MediaCrypto.hpp"
+
+namespace {
+
+constexpr uint32_t kSsrc = 0x5eed0001;
+constexpr CipherSuite kSuites[] = {CipherSuite::Aes128Gcm, CipherSuite::Aes256Gcm, CipherSuite::ChaCha20Poly1305};
+// Отчет получателя, mu-law, PCM 16 бит и FEC по 256 отсчетов
+constexpr size_t kSizes[] = {36, 268, 524, 1036};
+constexpr size_t kBatches[] = {1, 32};
+
+double ThreadCpuSeconds() {
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+struct Result {
+    double round_trip_ns{0};
+    double protect_ns{0};
+    bool ok{true};
+};
+
+Result Run(CipherSuite suite, size_t size, size_t batch_size, double seconds) {
+    const MediaKey key = GenerateMediaKey(suite);
+    PacketProtector protector(kSsrc, key);
+    PacketUnprotector unprotector;
+    unprotector.SetKey(kSsrc, key);
+
+    std::vector<std::vector<uint8_t>> buffers(batch_size, std::vector<uint8_t>(size + kProtectionOverhead));
+    for (auto& buffer : buffers) {
+        MediaHeader header;
+        header.type = PacketType::Audio;
+        header.ssrc = kSsrc;
+        std::vector<uint8_t> bytes;
+        header.Serialize(bytes);
+        std::copy(bytes.begin(), bytes.end(), buffer.begin());
+    }
+    std::vector<CryptoPacket> batch(batch_size);
+
+    Result result;
+    uint64_t packets = 0;
+    const double start = ThreadCpuSeconds();
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        for (int round = 0; round < 64; ++round) {
+            for (size_t i = 0; i < batch_size; ++i) {
+                batch[i] = {buffers[i].data(), size};
+            }
+            protector.ProtectBatch(batch.data(), batch_size);
+            unprotector.UnprotectBatch(batch.data(), batch_size);
+            for (const auto& packet : batch) {
+                result.ok &= packet.size == size;
+            }
+            packets += batch_size;
+        }
+        elapsed = ThreadCpuSeconds() - start;
+    }
+    result.round_trip_ns = elapsed * 1e9 / packets;
+
+    // Одно шифрование: пакет шифруется повторно, флаг защиты снимается
+    packets = 0;
+    const double protect_start = ThreadCpuSeconds();
+    elapsed = 0;
+    while (elapsed < seconds / 2) {
+        for (int round = 0; round < 64; ++round) {
+            for (size_t i = 0; i < batch_size; ++i) {
+                buffers[i][0] &= static_cast<uint8_t>(~kProtectedFlag);
+                batch[i] = {buffers[i].data(), size};
+            }
+            protector.ProtectBatch(batch.data(), batch_size);
+            packets += batch_size;
+        }
+        elapsed = ThreadCpuSeconds() - protect_start;
+    }
+    result.protect_ns = elapsed * 1e9 / packets;
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const double seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+
+    std::printf("hardware AES: %s, preferred %.*s, %.1f s per case\n\n", HasHardwareAes() ? "yes" : "no",
+                static_cast<int>(CipherSuiteName(PreferredCipherSuite()).size()),
+                CipherSuiteName(PreferredCipherSuite()).data(), seconds);
+    std::printf("%-24s %6s %6s %12s %14s %12s %10s\n", "suite", "bytes", "batch", "protect ns", "round trip ns",
+                "Mpps/core", "Gbit/s");
+
+    bool ok = true;
+    for (const auto suite : kSuites) {
+        for (const auto size : kSizes) {
+            for (const auto batch : kBatches) {
+                const Result result = Run(suite, size, batch, seconds);
+                ok &= result.ok;
+                // Пакетов в секунду на ядро, если ядро и шифрует, и проверяет
+                const double mpps = 1e3 / result.round_trip_ns;
+                const auto name = CipherSuiteName(suite);
+                std::printf("%-24.*s %6zu %6zu %12.0f %14.0f %12.2f %10.2f\n", static_cast<int>(name.size()),
+                            name.data(), size, batch, result.protect_ns, result.round_trip_ns, mpps,
+                            mpps * 1e6 * size * 8 / 1e9);
+            }
+        }
+    }
+    if (!ok) {
+        std::printf("\nround trip FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,328 @@
+// Медиа прежде сигналинга: держится ли p99 медиа, когда сигналинг в том
+// же процессе (signaling_server --media) захлебывается штормом.
+//
+//   bench_plane_priority [seconds] [--participants N] [--storm-clients N]
+//
+// Медиа: участники шлют кадр раз в буфер аудио (256 отсчетов на 44.1 кГц),
+// в кадре - время отправки; задержка - от отправки до приема каждым
+// слушателем. Шторм: клиенты сигналинга регистрируются, входят в одну
+// комнату и без остановки шлют offer на всю комнату старым JSON, так что
+// каждое сообщение - разбор и рассылка всем остальным.
+//
+// Прогоны: без шторма; шторм, потоки планов на равных; шторм с
+// разделением планов (MediaFirstGate, приоритеты потоков). Генератор
+// шторма работает в SCHED_IDLE и забирает только оставшийся процессор,
+// потоки медиа-клиентов - в SCHED_FIFO, если хватает прав: конкуренция
+// за процессор - между потоками сервера, как на выделенной машине.
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioRelay.hpp"
+#include "MediaPacket.hpp"
+#include "SignalingServer.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kFramePeriod = std::chrono::microseconds(5805);
+constexpr size_t kFrameSize = 268;
+constexpr int kClientFifoPriority = 40;
+// Порты на прогон: io_uring отпускает закрытый сокет не сразу
+int next_port = 23521;
+
+struct Config {
+    double seconds{3.0};
+    size_t participants{8};
+    size_t storm_clients{64};
+};
+
+struct Percentiles {
+    size_t count{0};
+    double p50{0};
+    double p99{0};
+    double max{0};
+};
+
+Percentiles Summarize(std::vector<double>& samples) {
+    Percentiles result;
+    result.count = samples.size();
+    if (samples.empty()) {
+        return result;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto at = [&](double q) { return samples[static_cast<size_t>(q * (samples.size() - 1))]; };
+    result.p50 = at(0.50);
+    result.p99 = at(0.99);
+    result.max = samples.back();
+    return result;
+}
+
+struct Result {
+    Percentiles media;  // от отправки до приема, мкс
+    uint64_t expected{0};
+    PlaneStats relay;
+    PlaneStats signaling;
+    uint64_t storm_sent{0};
+};
+
+sockaddr_in Loopback(int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// "client_id" из ответа ClientRegistered
+std::string RegisteredId(const std::string& reply) {
+    size_t at = reply.find("\"client_id\"");
+    if (at == std::string::npos) {
+        return {};
+    }
+    at = reply.find('"', reply.find(':', at) + 1);
+    const size_t end = reply.find('"', at + 1);
+    return at == std::string::npos || end == std::string::npos ? std::string() : reply.substr(at + 1, end - at - 1);
+}
+
+class Storm {
+public:
+    bool Setup(const sockaddr_in& server, size_t clients) {
+        server_ = server;
+        char reply[2048];
+        for (size_t i = 0; i < clients; ++i) {
+            const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            timeval timeout{1, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            Send(fd, R"({"type":"hello"})");
+            const auto size = recv(fd, reply, sizeof(reply), 0);
+            const std::string id = size > 0 ? RegisteredId(std::string(reply, static_cast<size_t>(size))) : "";
+            if (id.empty()) {
+                close(fd);
+                return false;
+            }
+            Send(fd, R"({"type":"join_room","client_id":")" + id + R"(","room_id":"storm"})");
+            offers_.push_back(R"({"type":"offer","client_id":")" + id + R"(","data":{"type":"offer","sdp":")" +
+                              std::string(900, 'v') + R"("}})");
+            sockets_.push_back(fd);
+        }
+        return true;
+    }
+
+    ~Storm() {
+        Stop();
+        for (int fd : sockets_) {
+            close(fd);
+        }
+    }
+
+    void Start() {
+        running_ = true;
+        thread_ = std::thread([this] {
+            sched_param param{};
+            pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+            while (running_.load(std::memory_order_relaxed)) {
+                for (size_t i = 0; i < sockets_.size(); ++i) {
+                    Send(sockets_[i], offers_[i]);
+                    ++sent_;
+                }
+            }
+        });
+    }
+
+    void Stop() {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    uint64_t Sent() const { return sent_; }
+
+private:
+    sockaddr_in server_{};
+    std::vector<int> sockets_;
+    std::vector<std::string> offers_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    uint64_t sent_{0};
+
+    void Send(int fd, const std::string& message) {
+        sendto(fd, message.data(), message.size(), MSG_DONTWAIT, (const sockaddr*)&server_, sizeof(server_));
+    }
+};
+
+// Участники медиа в одном потоке: кадр от каждого раз в период, между
+// кадрами - прием
+std::vector<double> RunMedia(const Config& config, const sockaddr_in& relay) {
+    sched_param param{};
+    param.sched_priority = kClientFifoPriority;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    std::vector<pollfd> fds;
+    for (size_t i = 0; i < config.participants; ++i) {
+        fds.push_back({socket(AF_INET, SOCK_DGRAM, 0), POLLIN, 0});
+    }
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t i = 0; i < config.participants; ++i) {
+        MediaHeader header;
+        header.ssrc = 0x3000 + static_cast<uint32_t>(i);
+        std::vector<uint8_t> frame;
+        header.Serialize(frame);
+        frame.resize(kFrameSize, 0x5a);
+        frames.push_back(std::move(frame));
+    }
+
+    std::vector<double> latency_us;
+    // Первые кадры только знакомят ретранслятор с участниками
+    const auto warmup = Clock::now() + std::chrono::milliseconds(200);
+    const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                        std::chrono::duration<double>(config.seconds) + std::chrono::milliseconds(200));
+    auto next = Clock::now();
+    uint16_t sequence = 0;
+    uint8_t buffer[2048];
+    while (Clock::now() < end) {
+        if (Clock::now() >= next) {
+            ++sequence;
+            for (size_t i = 0; i < fds.size(); ++i) {
+                const int64_t sent = NowNs();
+                std::memcpy(frames[i].data() + 2, &sequence, sizeof(sequence));
+                std::memcpy(frames[i].data() + MediaHeader::kSize, &sent, sizeof(sent));
+                sendto(fds[i].fd, frames[i].data(), frames[i].size(), 0, (const sockaddr*)&relay, sizeof(relay));
+            }
+            next += kFramePeriod;
+        }
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+        if (poll(fds.data(), fds.size(), static_cast<int>(std::max<int64_t>(wait, 0))) <= 0) {
+            continue;
+        }
+        for (auto& pfd : fds) {
+            if (!(pfd.revents & POLLIN)) {
+                continue;
+            }
+            while (true) {
+                const auto size = recv(pfd.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (size < static_cast<ssize_t>(MediaHeader::kSize + sizeof(int64_t))) {
+                    break;
+                }
+                int64_t sent = 0;
+                std::memcpy(&sent, buffer + MediaHeader::kSize, sizeof(sent));
+                if (Clock::now() >= warmup) {
+                    latency_us.push_back(static_cast<double>(NowNs() - sent) / 1000);
+                }
+            }
+        }
+    }
+    for (auto& pfd : fds) {
+        close(pfd.fd);
+    }
+    return latency_us;
+}
+
+Result Run(const Config& config, bool storm, bool media_first) {
+    const int media_port = next_port++;
+    const int signaling_port = next_port++;
+    MediaFirstGate gate;
+    AudioRelay relay(media_port);
+    SignalingServer server(signaling_port);
+    if (media_first) {
+        relay.SetPlaneGate(&gate);
+        server.SetPlaneGate(&gate);
+    }
+    if (!relay.Start() || !server.Start()) {
+        std::fprintf(stderr, "failed to start servers on %d/%d\n", media_port, signaling_port);
+        std::exit(1);
+    }
+
+    Storm generator;
+    if (storm) {
+        if (!generator.Setup(Loopback(signaling_port), config.storm_clients)) {
+            std::fprintf(stderr, "storm clients failed to register\n");
+            std::exit(1);
+        }
+        generator.Start();
+    }
+
+    // Окна метрик планов - только время замера
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    relay.GetStats();
+    server.GetPlaneStats();
+
+    Result result;
+    std::vector<double> latency;
+    std::thread media([&] { latency = RunMedia(config, Loopback(media_port)); });
+    media.join();
+
+    result.relay = relay.GetStats().media;
+    result.signaling = server.GetPlaneStats();
+    generator.Stop();
+    result.storm_sent = generator.Sent();
+    result.expected = static_cast<uint64_t>(config.seconds / std::chrono::duration<double>(kFramePeriod).count()) *
+                      config.participants * (config.participants - 1);
+    result.media = Summarize(latency);
+    server.Stop();
+    relay.Stop();
+    return result;
+}
+
+void Print(const char* name, const Config& config, const Result& result) {
+    const double delivered = result.expected > 0 ? 100.0 * result.media.count / result.expected : 0.0;
+    std::printf("%-20s %9.0f %9.0f %9.0f %8.1f %10.0f %10.0f %11.0f %11.0f %9.0f %8.0f %7llu\n", name,
+                result.media.p50, result.media.p99, result.media.max, delivered, result.relay.latency_p99_us,
+                result.relay.queue_max, result.storm_sent / config.seconds,
+                result.signaling.packets / config.seconds, result.signaling.latency_p99_us,
+                result.signaling.queue_p99, static_cast<unsigned long long>(result.signaling.yields));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--participants" && i + 1 < argc) {
+            config.participants = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--storm-clients" && i + 1 < argc) {
+            config.storm_clients = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            config.seconds = std::atof(argv[i]);
+        }
+    }
+    if (config.participants < 2 || config.storm_clients < 2) {
+        std::fprintf(stderr, "need at least 2 participants and 2 storm clients\n");
+        return 1;
+    }
+    // Журнал серверов (регистрации, подключения) не нужен в таблице
+    std::cout.setstate(std::ios::failbit);
+    std::cerr.setstate(std::ios::failbit);
+
+    std::printf("%zu media participants, %zu storm clients in one room, %.1f s per run, %u CPUs\n\n",
+                config.participants, config.storm_clients, config.seconds, std::thread::hardware_concurrency());
+    std::printf("%-20s %9s %9s %9s %8s %10s %10s %11s %11s %9s %8s %7s\n", "run", "media p50", "p99 us", "max us",
+                "deliv %", "relay p99", "relay qmax", "storm msg/s", "handled/s", "sig p99", "sig q99", "yields");
+    Print("no storm", config, Run(config, false, true));
+    Print("storm, shared", config, Run(config, true, false));
+    Print("storm, media first", config, Run(config, true, true));
+    return 0;
+}
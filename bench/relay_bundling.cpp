@@ -0,0 +1,281 @@
+// Пачки ретранслятора: датаграммы и CPU на слушателя, когда кадры всех
+// говорящих за такт уходят ему одной датаграммой.
+//
+//   bench_relay_bundling [seconds] [--speakers K] [--listeners L] [--size B]
+//
+// Ретранслятор запускается в процессе. Говорящие шлют кадр раз в буфер
+// аудио (256 отсчетов на 44.1 кГц, ~172 пакета/с), фазы разнесены по
+// периоду, как у независимых клиентов; в кадре - время отправки. Слушатели
+// только принимают, разбирают пачки и считают задержку. CPU слушателей -
+// время их потока на слушателя; CPU ретранслятора - время процесса за
+// вычетом потоков говорящих и слушателей.
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioRelay.hpp"
+#include "MediaPacket.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kFramePeriod = std::chrono::microseconds(5805);
+constexpr size_t kReceiveBatch = 16;
+// Порт на прогон: io_uring отпускает закрытый сокет не сразу
+int next_port = 23581;
+
+struct Config {
+    double seconds{3.0};
+    size_t speakers{8};
+    size_t listeners{16};
+    size_t size{268};
+};
+
+struct Mode {
+    const char* name;
+    bool bundling;
+    Clock::duration tick;
+};
+
+struct Result {
+    double seconds{0};
+    uint64_t datagrams{0};  // у всех слушателей
+    uint64_t frames{0};
+    double listener_cpu{0};
+    double relay_cpu{0};
+    uint64_t relay_out{0};
+    uint64_t relay_send_calls{0};
+    std::vector<double> latency_us;
+};
+
+double ProcessCpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+           usage.ru_stime.tv_usec / 1e6;
+}
+
+double ThreadCpuSeconds() {
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+double Percentile(std::vector<double>& samples, double q) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[static_cast<size_t>(q * (samples.size() - 1))];
+}
+
+Result Run(const Config& config, const Mode& mode) {
+    const int port = next_port++;
+    AudioRelay relay(port);
+    if (mode.bundling) {
+        relay.SetBundling(mode.tick);
+    }
+    relay.Start();
+
+    sockaddr_in relay_address{};
+    relay_address.sin_family = AF_INET;
+    relay_address.sin_port = htons(port);
+    relay_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // Слушатели регистрируются приветствием, говорящие - первым кадром
+    std::vector<pollfd> listeners;
+    for (size_t i = 0; i < config.listeners; ++i) {
+        const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        const int buffer_size = 1 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+        const uint8_t hello[] = {0, kHelloAcceptsBundles};
+        sendto(fd, hello, sizeof(hello), 0, (const sockaddr*)&relay_address, sizeof(relay_address));
+        listeners.push_back({fd, POLLIN, 0});
+    }
+    std::vector<int> speakers;
+    for (size_t i = 0; i < config.speakers; ++i) {
+        speakers.push_back(socket(AF_INET, SOCK_DGRAM, 0));
+    }
+
+    std::atomic<bool> running{true};
+    std::atomic<bool> measuring{false};
+    double speaker_cpu = 0;
+    Result result;
+
+    std::thread speaker([&] {
+        std::vector<std::vector<uint8_t>> frames;
+        std::vector<Clock::time_point> next;
+        const auto start = Clock::now();
+        for (size_t i = 0; i < speakers.size(); ++i) {
+            MediaHeader header;
+            header.ssrc = 0x4000 + static_cast<uint32_t>(i);
+            std::vector<uint8_t> frame;
+            header.Serialize(frame);
+            frame.resize(std::max(config.size, MediaHeader::kSize + sizeof(int64_t)), 0x5a);
+            frames.push_back(std::move(frame));
+            next.push_back(start + kFramePeriod * i / speakers.size());
+        }
+        while (running.load(std::memory_order_relaxed)) {
+            const auto now = Clock::now();
+            auto earliest = now + kFramePeriod;
+            for (size_t i = 0; i < speakers.size(); ++i) {
+                if (now >= next[i]) {
+                    const int64_t sent = NowNs();
+                    std::memcpy(frames[i].data() + MediaHeader::kSize, &sent, sizeof(sent));
+                    sendto(speakers[i], frames[i].data(), frames[i].size(), 0, (const sockaddr*)&relay_address,
+                           sizeof(relay_address));
+                    next[i] += kFramePeriod;
+                }
+                earliest = std::min(earliest, next[i]);
+            }
+            std::this_thread::sleep_until(earliest);
+        }
+        speaker_cpu = ThreadCpuSeconds();
+    });
+
+    std::thread listener([&] {
+        std::vector<uint8_t> buffers(kReceiveBatch * kMaxMediaDatagram);
+        iovec iov[kReceiveBatch];
+        mmsghdr messages[kReceiveBatch]{};
+        for (size_t j = 0; j < kReceiveBatch; ++j) {
+            iov[j] = {buffers.data() + j * kMaxMediaDatagram, kMaxMediaDatagram};
+            messages[j].msg_hdr.msg_iov = &iov[j];
+            messages[j].msg_hdr.msg_iovlen = 1;
+        }
+        double cpu_start = 0;
+        bool counting = false;
+        const auto on_frame = [&](uint8_t* frame, size_t size) {
+            ++result.frames;
+            if (size >= MediaHeader::kSize + sizeof(int64_t)) {
+                int64_t sent = 0;
+                std::memcpy(&sent, frame + MediaHeader::kSize, sizeof(sent));
+                result.latency_us.push_back(static_cast<double>(NowNs() - sent) / 1000);
+            }
+        };
+        while (running.load(std::memory_order_relaxed)) {
+            if (!counting && measuring.load(std::memory_order_relaxed)) {
+                counting = true;
+                cpu_start = ThreadCpuSeconds();
+            }
+            if (poll(listeners.data(), listeners.size(), 10) <= 0) {
+                continue;
+            }
+            for (auto& pfd : listeners) {
+                if (!(pfd.revents & POLLIN)) {
+                    continue;
+                }
+                int count = 0;
+                do {
+                    count = recvmmsg(pfd.fd, messages, kReceiveBatch, MSG_DONTWAIT, nullptr);
+                    for (int j = 0; counting && j < count; ++j) {
+                        uint8_t* data = buffers.data() + j * kMaxMediaDatagram;
+                        ++result.datagrams;
+                        if (!ForEachBundled(data, messages[j].msg_len, on_frame)) {
+                            on_frame(data, messages[j].msg_len);
+                        }
+                    }
+                } while (count == static_cast<int>(kReceiveBatch));
+            }
+        }
+        result.listener_cpu = ThreadCpuSeconds() - cpu_start;
+    });
+
+    // Ретранслятор узнает участников и выходит на такт до замера
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const auto relay_before = relay.GetStats();
+    const double cpu_start = ProcessCpuSeconds();
+    const auto start = Clock::now();
+    measuring = true;
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    running = false;
+    speaker.join();
+    listener.join();
+
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const auto relay_after = relay.GetStats();
+    result.relay_out = relay_after.packets_out - relay_before.packets_out;
+    result.relay_send_calls = relay_after.send_calls - relay_before.send_calls;
+    // Поток говорящих работал и до замера; его доля за замер - пропорционально
+    result.relay_cpu = ProcessCpuSeconds() - cpu_start - result.listener_cpu -
+                       speaker_cpu * config.seconds / (config.seconds + 0.2);
+    relay.Stop();
+    for (auto& pfd : listeners) {
+        close(pfd.fd);
+    }
+    for (int fd : speakers) {
+        close(fd);
+    }
+    return result;
+}
+
+void Print(const Mode& mode, const Config& config, Result& result) {
+    const double listeners = static_cast<double>(config.listeners);
+    const double per_second = 1.0 / result.seconds;
+    const double p50 = Percentile(result.latency_us, 0.50);
+    const double p99 = Percentile(result.latency_us, 0.99);
+    std::printf("%-12s %11.0f %10.0f %10.2f %12.0f %10.0f %9.1f %9.0f %9.0f %8.2f\n", mode.name,
+                result.datagrams * per_second / listeners, result.frames * per_second / listeners,
+                result.listener_cpu * 1e6 * per_second / listeners, result.relay_out * per_second,
+                result.relay_send_calls * per_second, 100.0 * result.relay_cpu * per_second, p50, p99,
+                result.datagrams > 0 ? static_cast<double>(result.frames) / result.datagrams : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--speakers" && i + 1 < argc) {
+            config.speakers = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--listeners" && i + 1 < argc) {
+            config.listeners = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--size" && i + 1 < argc) {
+            config.size = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            config.seconds = std::atof(argv[i]);
+        }
+    }
+    if (config.speakers < 1 || config.listeners < 1) {
+        std::fprintf(stderr, "need at least 1 speaker and 1 listener\n");
+        return 1;
+    }
+    // Журнал ретранслятора (подключения участников) не нужен в таблице
+    std::cout.setstate(std::ios::failbit);
+
+    std::printf("%zu speakers, %zu listeners, %zu-byte frames, %.1f s per run\n\n", config.speakers,
+                config.listeners, config.size, config.seconds);
+    std::printf("%-12s %11s %10s %10s %12s %10s %9s %9s %9s %8s\n", "mode", "dgram/s/lst", "frm/s/lst",
+                "cpu us/s/l", "relay dgr/s", "send sc/s", "relay %", "lat p50", "lat p99", "frm/dgr");
+    const Mode modes[] = {
+        {"off", false, Clock::duration::zero()},
+        {"batch", true, Clock::duration::zero()},
+        {"tick 2.9ms", true, kFramePeriod / 2},
+        {"tick 5.8ms", true, kFramePeriod},
+    };
+    for (const auto& mode : modes) {
+        auto result = Run(config, mode);
+        Print(mode, config, result);
+    }
+    return 0;
+}
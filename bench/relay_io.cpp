@@ -0,0 +1,217 @@
+// Пакетов в секунду на ядро у бэкендов ввода-вывода ретранслятора.
+//
+//   bench_relay_io [seconds] [--senders N] [--fanout K] [--size B] [--sink-gro]
+//
+// Генератор в отдельном потоке засыпает ретранслятор датаграммами с N
+// сокетов, ретранслятор раздает каждую K получателям - как AudioRelay
+// раздает участникам. Делится на процессорное время потока
+// ретранслятора, поэтому результат не зависит от того, успевает ли
+// генератор. Получатели не читают сокеты: лишнее ядро выбрасывает.
+// Без --sink-gro ядро режет GSO на петле программно, как сетевая карта
+// без UDP offload; с ним - отдает получателю склейкой.
+
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PacketIo.hpp"
+
+namespace {
+
+struct Config {
+    double seconds{2.0};
+    size_t senders{16};
+    size_t fanout{8};
+    size_t size{160};
+    bool sink_gro{false};
+};
+
+struct Result {
+    double cpu_seconds{0};
+    PacketIo::Stats io;
+};
+
+int BindLoopback(int buffer_size) {
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (sockaddr*)&address, sizeof(address));
+    return fd;
+}
+
+sockaddr_in LocalAddress(int fd) {
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    getsockname(fd, (sockaddr*)&address, &length);
+    return address;
+}
+
+double ThreadCpuSeconds() {
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void Generate(const Config& config, const sockaddr_in& relay, const std::atomic<bool>& running) {
+    constexpr size_t kBurst = 32;
+    std::vector<int> sockets;
+    for (size_t i = 0; i < config.senders; ++i) {
+        sockets.push_back(BindLoopback(1 << 20));
+    }
+
+    std::vector<uint8_t> payload(config.size, 0x5a);
+    iovec iov{payload.data(), payload.size()};
+    std::vector<mmsghdr> messages(kBurst);
+    for (auto& message : messages) {
+        message.msg_hdr.msg_name = const_cast<sockaddr_in*>(&relay);
+        message.msg_hdr.msg_namelen = sizeof(relay);
+        message.msg_hdr.msg_iov = &iov;
+        message.msg_hdr.msg_iovlen = 1;
+    }
+
+    while (running.load(std::memory_order_relaxed)) {
+        for (int fd : sockets) {
+            sendmmsg(fd, messages.data(), kBurst, 0);
+        }
+    }
+    for (int fd : sockets) {
+        close(fd);
+    }
+}
+
+bool Run(const Config& config, IoBackend backend, bool gso, Result& result) {
+    const int relay_socket = BindLoopback(4 << 20);
+    std::vector<int> sinks;
+    std::vector<sockaddr_in> sink_addresses;
+    for (size_t i = 0; i < config.fanout; ++i) {
+        sinks.push_back(BindLoopback(256 << 10));
+        if (config.sink_gro) {
+            const int enable = 1;
+            setsockopt(sinks.back(), SOL_UDP, UDP_GRO, &enable, sizeof(enable));
+        }
+        sink_addresses.push_back(LocalAddress(sinks.back()));
+    }
+
+    PacketIoOptions options;
+    options.backend = backend;
+    options.gso = gso;
+    options.gro = false;
+    std::string error;
+    auto io = PacketIo::Create(relay_socket, options, error);
+    if (!io) {
+        std::printf("%-12s unavailable: %s\n", IoBackendName(backend), error.c_str());
+        close(relay_socket);
+        for (int fd : sinks) {
+            close(fd);
+        }
+        return false;
+    }
+
+    std::atomic<bool> running{true};
+    std::thread generator(Generate, std::cref(config), LocalAddress(relay_socket), std::cref(running));
+
+    // Прогрев: буферы, кольца и сокеты заполнены до начала замера
+    const auto handler = [&](const uint8_t* data, size_t size, const sockaddr_in&) {
+        for (const auto& sink : sink_addresses) {
+            io->Send(sink, data, size);
+        }
+    };
+    const auto warmup_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    while (std::chrono::steady_clock::now() < warmup_end) {
+        if (io->Wait(10)) {
+            io->Receive(handler);
+        }
+        io->Flush();
+    }
+
+    const PacketIo::Stats before = io->GetStats();
+    const double cpu_start = ThreadCpuSeconds();
+    const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(config.seconds);
+    while (std::chrono::steady_clock::now() < end) {
+        if (io->Wait(10)) {
+            io->Receive(handler);
+        }
+        io->Flush();
+    }
+    result.cpu_seconds = ThreadCpuSeconds() - cpu_start;
+    const PacketIo::Stats& after = io->GetStats();
+    result.io.datagrams_received = after.datagrams_received - before.datagrams_received;
+    result.io.datagrams_sent = after.datagrams_sent - before.datagrams_sent;
+    result.io.receive_calls = after.receive_calls - before.receive_calls;
+    result.io.send_calls = after.send_calls - before.send_calls;
+    result.io.gso_messages = after.gso_messages - before.gso_messages;
+
+    running = false;
+    generator.join();
+    io.reset();
+    close(relay_socket);
+    for (int fd : sinks) {
+        close(fd);
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--senders" && i + 1 < argc) {
+            config.senders = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--fanout" && i + 1 < argc) {
+            config.fanout = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--size" && i + 1 < argc) {
+            config.size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--sink-gro") {
+            config.sink_gro = true;
+        } else {
+            config.seconds = std::atof(arg.c_str());
+        }
+    }
+
+    std::printf("%zu senders, fanout %zu, %zu-byte datagrams, %.1f s per backend%s\n\n", config.senders,
+                config.fanout, config.size, config.seconds, config.sink_gro ? ", GRO sinks" : "");
+    std::printf("%-12s %12s %12s %12s %14s %12s\n", "backend", "rx pps/core", "tx pps/core", "total/core",
+                "syscalls/1k pkt", "gso msgs");
+
+    struct Variant {
+        IoBackend backend;
+        bool gso;
+        const char* name;
+    };
+    const Variant variants[] = {
+        {IoBackend::Epoll, false, "epoll"},
+        {IoBackend::Epoll, true, "epoll+gso"},
+        {IoBackend::Uring, false, "uring"},
+        {IoBackend::Uring, true, "uring+gso"},
+    };
+    for (const auto& variant : variants) {
+        Result result;
+        if (!Run(config, variant.backend, variant.gso, result)) {
+            continue;
+        }
+        const auto& io = result.io;
+        const double cpu = result.cpu_seconds > 0 ? result.cpu_seconds : 1e-9;
+        const uint64_t packets = io.datagrams_received + io.datagrams_sent;
+        std::printf("%-12s %12.0f %12.0f %12.0f %14.1f %12llu\n", variant.name, io.datagrams_received / cpu,
+                    io.datagrams_sent / cpu, packets / cpu,
+                    packets ? 1000.0 * (io.receive_calls + io.send_calls) / packets : 0.0,
+                    static_cast<unsigned long long>(io.gso_messages));
+    }
+    return 0;
+}
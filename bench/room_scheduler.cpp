@@ -0,0 +1,228 @@
+// Комнат на ядро у FrameScheduler при бюджете промахов по срокам.
+//
+//   bench_room_scheduler [--seconds N] [--workers N] [--participants N] [--budget P] [--no-pin]
+//
+// Задача комнаты - кадр микширующего сервера: декодировать mu-law
+// каждого участника, сложить, каждому собрать микс без его голоса и
+// закодировать обратно. Число комнат удваивается, пока доля промахов не
+// превысит бюджет (по умолчанию 1%), затем граница уточняется делением
+// пополам. На найденном числе комнат прогон повторяется без кражи задач,
+// чтобы было видно, что она дает.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameScheduler.hpp"
+#include "MediaCodec.hpp"
+
+namespace {
+
+constexpr auto kWarmup = std::chrono::milliseconds(500);
+constexpr CodecConfig kCodec{CodecId::MuLaw, 0};
+
+struct Config {
+    double seconds{2.0};
+    size_t workers{0};
+    size_t participants{4};
+    double budget{1.0};  // %
+    bool pin{true};
+};
+
+struct Result {
+    size_t rooms{0};
+    double miss_percent{0};
+    double worst_room_percent{0};
+    double busy_percent{0};
+    double steals_per_second{0};
+    double worst_lateness_ms{0};
+};
+
+class MixRoom {
+public:
+    MixRoom(size_t participants, size_t seed) : packets_(participants), decoders_(participants), decoded_(participants) {
+        std::vector<SAMPLE> tone(BUF_SIZE);
+        for (size_t p = 0; p < participants; ++p) {
+            const double hz = 200.0 + 50.0 * ((seed + p) % 16);
+            for (size_t i = 0; i < tone.size(); ++i) {
+                tone[i] = static_cast<SAMPLE>(4000.0 * std::sin(2.0 * M_PI * hz * i / SAMPLE_RATE));
+            }
+            EncodeAudio(tone.data(), FRAMES_PER_BUFFER, kCodec, packets_[p]);
+        }
+        mix_.resize(BUF_SIZE);
+        own_.resize(BUF_SIZE);
+    }
+
+    void Frame(uint64_t) {
+        std::fill(mix_.begin(), mix_.end(), 0);
+        for (size_t p = 0; p < packets_.size(); ++p) {
+            decoded_[p].clear();
+            decoders_[p].Decode(packets_[p].data(), packets_[p].size(), kCodec, decoded_[p]);
+            for (size_t i = 0; i < BUF_SIZE; ++i) {
+                mix_[i] += decoded_[p][i];
+            }
+        }
+        for (size_t p = 0; p < packets_.size(); ++p) {
+            for (size_t i = 0; i < BUF_SIZE; ++i) {
+                own_[i] = static_cast<SAMPLE>(std::clamp(mix_[i] - decoded_[p][i], -32768, 32767));
+            }
+            out_.clear();
+            EncodeAudio(own_.data(), FRAMES_PER_BUFFER, kCodec, out_);
+            checksum_ += out_[p % out_.size()];
+        }
+    }
+
+    uint64_t Checksum() const noexcept { return checksum_; }
+
+private:
+    std::vector<std::vector<uint8_t>> packets_;
+    std::vector<AudioDecoder> decoders_;
+    std::vector<std::vector<SAMPLE>> decoded_;
+    std::vector<int> mix_;
+    std::vector<SAMPLE> own_;
+    std::vector<uint8_t> out_;
+    uint64_t checksum_{0};
+};
+
+Result Run(const Config& config, size_t room_count, bool steal) {
+    FrameSchedulerOptions options;
+    options.workers = config.workers;
+    options.pin = config.pin;
+    options.steal = steal;
+    FrameScheduler scheduler(options);
+
+    std::vector<std::unique_ptr<MixRoom>> rooms;
+    for (size_t i = 0; i < room_count; ++i) {
+        rooms.push_back(std::make_unique<MixRoom>(config.participants, i));
+        scheduler.AddRoom([room = rooms.back().get()](uint64_t frame) { room->Frame(frame); });
+    }
+
+    scheduler.Start();
+    std::this_thread::sleep_for(kWarmup);
+    const FrameScheduler::Stats before = scheduler.GetStats();
+    const auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    const FrameScheduler::Stats after = scheduler.GetStats();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    scheduler.Stop();
+
+    // Комнаты не удалялись, поэтому порядок в обоих снимках один
+    Result result;
+    result.rooms = room_count;
+    uint64_t frames = 0;
+    uint64_t misses = 0;
+    for (size_t i = 0; i < after.rooms.size(); ++i) {
+        // Пропущенный кадр не выполнялся, но должен был
+        const uint64_t room_frames = after.rooms[i].frames - before.rooms[i].frames + after.rooms[i].skipped -
+                                     before.rooms[i].skipped;
+        const uint64_t room_misses = after.rooms[i].misses - before.rooms[i].misses;
+        frames += room_frames;
+        misses += room_misses;
+        if (room_frames > 0) {
+            result.worst_room_percent = std::max(result.worst_room_percent, 100.0 * room_misses / room_frames);
+        }
+        result.worst_lateness_ms = std::max(
+            result.worst_lateness_ms, std::chrono::duration<double, std::milli>(after.rooms[i].worst_lateness).count());
+    }
+    result.miss_percent = frames > 0 ? 100.0 * misses / frames : 100.0;
+
+    double busy = 0;
+    uint64_t steals = 0;
+    for (size_t i = 0; i < after.workers.size(); ++i) {
+        busy += std::chrono::duration<double>(after.workers[i].busy - before.workers[i].busy).count();
+        steals += after.workers[i].steals - before.workers[i].steals;
+    }
+    result.busy_percent = 100.0 * busy / (elapsed * after.workers.size());
+    result.steals_per_second = steals / elapsed;
+    return result;
+}
+
+void Print(const Result& result, size_t workers, const char* note) {
+    std::printf("%8zu %10.1f %8.2f%% %10.2f%% %7.1f%% %10.0f %10.2f  %s\n", result.rooms,
+                static_cast<double>(result.rooms) / workers, result.miss_percent, result.worst_room_percent,
+                result.busy_percent, result.steals_per_second, result.worst_lateness_ms, note);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc) {
+            config.seconds = std::atof(argv[++i]);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            config.workers = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--participants" && i + 1 < argc) {
+            config.participants = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--budget" && i + 1 < argc) {
+            config.budget = std::atof(argv[++i]);
+        } else if (arg == "--no-pin") {
+            config.pin = false;
+        } else {
+            std::printf("Usage: %s [--seconds N] [--workers N] [--participants N] [--budget P] [--no-pin]\n",
+                        argv[0]);
+            return 1;
+        }
+    }
+    const size_t workers = FrameScheduler(FrameSchedulerOptions{config.workers}).Workers();
+
+    MixRoom probe(config.participants, 0);
+    const auto probe_start = std::chrono::steady_clock::now();
+    constexpr int kProbeFrames = 2000;
+    for (int i = 0; i < kProbeFrames; ++i) {
+        probe.Frame(i);
+    }
+    const double frame_us =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - probe_start).count() /
+        kProbeFrames;
+    // Не дает компилятору выбросить пробные кадры
+    [[maybe_unused]] volatile uint64_t sink = probe.Checksum();
+    const double period_us = std::chrono::duration<double, std::micro>(FrameSchedulerOptions::kFramePeriod).count();
+
+    std::printf("%zu workers, %zu participants per room, frame every %.0f us, job %.1f us (ceiling %.0f rooms/core)\n",
+                workers, config.participants, period_us, frame_us, period_us / frame_us);
+    std::printf("miss budget %.1f%%, %.1f s per step\n\n", config.budget, config.seconds);
+    std::printf("%8s %10s %9s %11s %8s %10s %10s\n", "rooms", "rooms/core", "miss", "worst room", "busy",
+                "steals/s", "late ms");
+
+    // Удвоение до первого превышения бюджета, затем деление пополам до 5%
+    size_t good = 0;
+    size_t bad = 0;
+    for (size_t rooms = workers * 16; rooms <= (size_t{1} << 20); rooms *= 2) {
+        const Result result = Run(config, rooms, true);
+        Print(result, workers, "");
+        if (result.miss_percent > config.budget) {
+            bad = rooms;
+            break;
+        }
+        good = rooms;
+    }
+    while (bad > 0 && bad - good > std::max<size_t>(1, good / 20)) {
+        const size_t rooms = good + (bad - good) / 2;
+        const Result result = Run(config, rooms, true);
+        Print(result, workers, "");
+        if (result.miss_percent > config.budget) {
+            bad = rooms;
+        } else {
+            good = rooms;
+        }
+    }
+
+    if (good == 0) {
+        std::printf("\nno room count fits the %.1f%% budget\n", config.budget);
+        return 0;
+    }
+    if (workers > 1) {
+        Print(Run(config, good, false), workers, "no stealing");
+    }
+    std::printf("\n%zu rooms at %.1f%% miss budget: %.0f rooms per core\n", good, config.budget,
+                static_cast<double>(good) / workers);
+    return 0;
+}
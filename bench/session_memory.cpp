@@ -0,0 +1,178 @@
+// Память на сессию в реестре сигналинг-сервера: прежняя схема
+// (unordered_map строк и shared_ptr) против SessionRegistry.
+//
+//   bench_session_memory [sessions...] [--room-size N]
+//
+// По умолчанию 100000 и 1000000 сессий, комнаты по 8 участников.
+// Память считается по приросту занятой кучи (mallinfo2), время - на
+// регистрацию с входом в комнату и на поиск сессии по идентификатору.
+
+#include <arpa/inet.h>
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "SessionRegistry.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+size_t HeapInUse() {
+    return mallinfo2().uordblks;
+}
+
+double NsPerOp(Clock::duration elapsed, size_t ops) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(ops);
+}
+
+sockaddr_in MakeAddress(size_t i) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(0x0a000000 | static_cast<uint32_t>(i >> 16));
+    address.sin_port = htons(static_cast<uint16_t>(i));
+    return address;
+}
+
+std::string RoomName(size_t i, size_t room_size) {
+    return "room_" + std::to_string(i / room_size);
+}
+
+struct Result {
+    size_t heap_bytes;
+    double insert_ns;
+    double lookup_ns;
+};
+
+// Схема, которую заменил SessionRegistry
+struct LegacyClient {
+    std::string id;
+    std::string room_id;
+    int socket_fd;
+    sockaddr_in address;
+
+    LegacyClient(const std::string& client_id, int sock_fd, const sockaddr_in& addr)
+        : id(client_id), socket_fd(sock_fd), address(addr) {}
+};
+
+Result RunLegacy(size_t count, size_t room_size) {
+    std::mt19937 gen(1);
+    std::vector<std::string> ids;
+    ids.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        // Без коллизий, иначе счет сессий разъедется; прежний формат
+        // client_NNNNNN на таких объемах уже коллидирует
+        ids.push_back("client_" + std::to_string(100000 + i));
+    }
+
+    const size_t heap_before = HeapInUse();
+    const auto insert_start = Clock::now();
+    {
+        std::unordered_map<std::string, std::shared_ptr<LegacyClient>> clients;
+        std::unordered_map<std::string, std::unordered_set<std::string>> rooms;
+
+        for (size_t i = 0; i < count; ++i) {
+            auto client = std::make_shared<LegacyClient>(ids[i], 3, MakeAddress(i));
+            client->room_id = RoomName(i, room_size);
+            rooms[client->room_id].insert(ids[i]);
+            clients[ids[i]] = std::move(client);
+        }
+        const auto insert_end = Clock::now();
+        const size_t heap_bytes = HeapInUse() - heap_before;
+
+        std::uniform_int_distribution<size_t> pick(0, count - 1);
+        size_t found = 0;
+        const auto lookup_start = Clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            found += clients.count(ids[pick(gen)]);
+        }
+        const auto lookup_end = Clock::now();
+        if (found != count) {
+            std::fprintf(stderr, "legacy lookup mismatch\n");
+        }
+
+        return {heap_bytes, NsPerOp(insert_end - insert_start, count), NsPerOp(lookup_end - lookup_start, count)};
+    }
+}
+
+Result RunRegistry(size_t count, size_t room_size, size_t& accounted) {
+    std::mt19937 gen(1);
+    std::vector<std::string> room_names;
+    for (size_t i = 0; i < count; i += room_size) {
+        room_names.push_back(RoomName(i, room_size));
+    }
+    std::vector<SessionId> ids;
+    ids.reserve(count);
+
+    const size_t heap_before = HeapInUse();
+    SessionRegistry registry;
+    const auto insert_start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        Session& session = registry.Create(MakeAddress(i));
+        ids.push_back(session.id);
+        registry.JoinRoom(session, room_names[i / room_size]);
+    }
+    const auto insert_end = Clock::now();
+    // Без массива ids, который нужен только самому тесту
+    const size_t heap_bytes = HeapInUse() - heap_before - ids.capacity() * sizeof(SessionId);
+    accounted = registry.MemoryUsage();
+
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    size_t found = 0;
+    const auto lookup_start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        found += registry.Find(ids[pick(gen)]) != nullptr;
+    }
+    const auto lookup_end = Clock::now();
+    if (found != count || registry.SessionCount() != count) {
+        std::fprintf(stderr, "registry lookup mismatch\n");
+    }
+
+    return {heap_bytes, NsPerOp(insert_end - insert_start, count), NsPerOp(lookup_end - lookup_start, count)};
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> counts;
+    size_t room_size = 8;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--room-size" && i + 1 < argc) {
+            room_size = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else {
+            counts.push_back(std::strtoull(argv[i], nullptr, 10));
+        }
+    }
+    if (counts.empty()) {
+        counts = {100000, 1000000};
+    }
+
+    std::printf("%-10s %-9s %12s %12s %12s %12s\n", "sessions", "layout", "heap MB", "bytes/sess", "insert ns",
+                "lookup ns");
+    for (size_t count : counts) {
+        const Result legacy = RunLegacy(count, room_size);
+        malloc_trim(0);
+
+        size_t accounted = 0;
+        const Result flat = RunRegistry(count, room_size, accounted);
+        malloc_trim(0);
+
+        for (const auto& [name, result] : {std::pair{"legacy", legacy}, std::pair{"registry", flat}}) {
+            std::printf("%-10zu %-9s %12.1f %12.1f %12.1f %12.1f\n", count, name, result.heap_bytes / 1048576.0,
+                        static_cast<double>(result.heap_bytes) / count, result.insert_ns, result.lookup_ns);
+        }
+        std::printf("%-10s %-9s %12.1f %12.1f   (MemoryUsage of the registry)\n", "", "", accounted / 1048576.0,
+                    static_cast<double>(accounted) / count);
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Пропускная способность кодеков сигналинга: JSON против бинарной
+// кодировки на типичных сообщениях.
+//
+//   bench_signaling_codec [iterations] [--users N]
+//
+// Для каждого сообщения - размер в байтах и сообщений в секунду на
+// кодирование и на разбор (один поток). Затем пересылка offer/ice через
+// сервер: полный разбор и сборка нового сообщения против разбора на месте
+// с вклейкой полезной нагрузки.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "SignalingProtocol.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Не дает компилятору выбросить результат
+volatile size_t g_sink = 0;
+
+std::string MakeSdp() {
+    std::string sdp =
+        "v=0\r\no=- 4611731400430051336 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n"
+        "a=group:BUNDLE 0\r\na=msid-semantic: WMS\r\n"
+        "m=audio 9 UDP/TLS/RTP/SAVPF 111 63 9 0 8 13 110 126\r\nc=IN IP4 0.0.0.0\r\n"
+        "a=rtcp:9 IN IP4 0.0.0.0\r\na=ice-ufrag:8hhY\r\na=ice-pwd:asd88fgpdd777uzjYhagZg\r\n"
+        "a=ice-options:trickle\r\n"
+        "a=fingerprint:sha-256 D1:2C:BE:AD:0E:B5:1B:9C:E3:4A:56:8F:F4:8C:1A:73:"
+        "3E:20:7E:5A:91:88:CA:2B:77:42:D3:6C:A1:58:F2:09\r\n"
+        "a=setup:actpass\r\na=mid:0\r\na=sendrecv\r\na=rtcp-mux\r\n"
+        "a=rtpmap:111 opus/48000/2\r\na=rtcp-fb:111 transport-cc\r\n"
+        "a=fmtp:111 minptime=10;useinbandfec=1\r\n";
+    // Кандидаты в SDP доводят его до типичных ~3 КБ
+    for (int i = 0; sdp.size() < 3000; ++i) {
+        sdp += "a=candidate:" + std::to_string(842163049 + i) +
+               " 1 udp 1677729535 192.168.1." + std::to_string(i % 250) +
+               " 5" + std::to_string(1000 + i) + " typ srflx raddr 0.0.0.0 rport 0 generation 0\r\n";
+    }
+    return sdp;
+}
+
+std::vector<std::string> MakeIds(size_t count, uint64_t seed) {
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < count; ++i) {
+        ids.push_back(FormatSessionId(seed * 0x9e3779b97f4a7c15ULL + i * 0xbf58476d1ce4e5b9ULL));
+    }
+    return ids;
+}
+
+struct Case {
+    const char* name;
+    SignalingMessage message;
+};
+
+std::vector<Case> MakeCases(size_t users) {
+    std::vector<Case> cases;
+
+    SignalingMessage ice;
+    ice.type = SignalType::IceCandidate;
+    ice.sender = FormatSessionId(0x3f9a0c51d27e84b6ULL);
+    ice.target = FormatSessionId(0x81d4e0a7c9b25f13ULL);
+    ice.timestamp = 1760000000000;
+    ice.candidate = "candidate:842163049 1 udp 1677729535 203.0.113.7 51234 typ srflx raddr 0.0.0.0 rport 0";
+    cases.push_back({"ice_candidate", ice});
+
+    SignalingMessage offer;
+    offer.type = SignalType::Offer;
+    offer.sender = ice.sender;
+    offer.target = ice.target;
+    offer.timestamp = ice.timestamp;
+    offer.sdp = MakeSdp();
+    cases.push_back({"offer", offer});
+
+    SignalingMessage delta;
+    delta.type = SignalType::RosterDelta;
+    delta.room_id = "room_42";
+    delta.from_version = 17;
+    delta.version = 18;
+    delta.timestamp = ice.timestamp;
+    delta.joined = MakeIds(3, 1);
+    delta.left = MakeIds(1, 2);
+    cases.push_back({"roster_delta", delta});
+
+    SignalingMessage snapshot;
+    snapshot.type = SignalType::RoomSnapshot;
+    snapshot.room_id = "room_42";
+    snapshot.version = 18;
+    snapshot.pages = 1;
+    snapshot.timestamp = ice.timestamp;
+    snapshot.users = MakeIds(users, 3);
+    cases.push_back({"room_snapshot", snapshot});
+
+    return cases;
+}
+
+struct Result {
+    size_t bytes;
+    double encode_rate;
+    double decode_rate;
+};
+
+double Rate(Clock::duration elapsed, size_t ops) {
+    return static_cast<double>(ops) / std::chrono::duration<double>(elapsed).count();
+}
+
+Result Run(const SignalingMessage& message, SignalEncoding encoding, size_t iterations) {
+    const std::string encoded = EncodeSignal(message, encoding);
+
+    const auto encode_start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        g_sink = g_sink + EncodeSignal(message, encoding).size();
+    }
+    const auto encode_end = Clock::now();
+
+    SignalingMessage decoded;
+    const auto decode_start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        if (!DecodeSignal(encoded, decoded)) {
+            std::fprintf(stderr, "decode failed\n");
+            std::exit(1);
+        }
+        g_sink = g_sink + decoded.users.size();
+    }
+    const auto decode_end = Clock::now();
+
+    return {encoded.size(), Rate(encode_end - encode_start, iterations), Rate(decode_end - decode_start, iterations)};
+}
+
+// Путь сервера до разбора на месте: декодирование в SignalingMessage и
+// кодирование копии для получателя
+double RunDecodeForward(const std::string& wire, SignalEncoding out, size_t iterations) {
+    const auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        SignalingMessage message;
+        DecodeSignal(wire, message);
+        SignalingMessage forward;
+        forward.type = message.type;
+        forward.sender = FormatSessionId(7);
+        forward.timestamp = 1760000000;
+        forward.sdp = message.sdp;
+        forward.candidate = message.candidate;
+        g_sink = g_sink + EncodeSignal(forward, out).size();
+    }
+    return Rate(Clock::now() - start, iterations);
+}
+
+double RunScanForward(const std::string& wire, SignalEncoding out, size_t iterations) {
+    Arena arena;
+    const auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        arena.Reset();
+        SignalView view;
+        ScanSignal(wire, view, arena);
+        g_sink = g_sink + EncodeForwardSignal(view, view.type, 7, 1760000000, out, arena).size();
+    }
+    return Rate(Clock::now() - start, iterations);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t iterations = 200000;
+    size_t users = 200;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--users" && i + 1 < argc) {
+            users = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            iterations = std::max<size_t>(1, std::strtoull(argv[i], nullptr, 10));
+        }
+    }
+
+    std::printf("%-14s %-7s %9s %14s %14s\n", "message", "codec", "bytes", "encode msg/s", "decode msg/s");
+    for (const auto& test : MakeCases(users)) {
+        // Большие сообщения гоняем реже, чтобы прогон занимал секунды
+        const size_t count = test.message.users.size() > 50 || !test.message.sdp.empty() ? iterations / 10 : iterations;
+        const Result json = Run(test.message, SignalEncoding::Json, count);
+        const Result binary = Run(test.message, SignalEncoding::Binary, count);
+        for (const auto& [codec, result] : {std::pair{"json", json}, std::pair{"binary", binary}}) {
+            std::printf("%-14s %-7s %9zu %14.0f %14.0f\n", test.name, codec, result.bytes, result.encode_rate,
+                        result.decode_rate);
+        }
+        std::printf("%-14s %-7s %8.1fx %13.1fx %13.1fx\n", "", "gain", static_cast<double>(json.bytes) / binary.bytes,
+                    binary.encode_rate / json.encode_rate, binary.decode_rate / json.decode_rate);
+    }
+
+    std::printf("\n%-14s %-14s %14s %14s %8s\n", "forward", "in -> out", "decode msg/s", "in-place msg/s", "gain");
+    for (const auto& test : MakeCases(users)) {
+        if (test.message.sdp.empty() && test.message.candidate.empty()) {
+            continue;
+        }
+        const size_t count = test.message.sdp.empty() ? iterations : iterations / 10;
+        for (const auto in : {SignalEncoding::Json, SignalEncoding::Binary}) {
+            for (const auto out : {SignalEncoding::Json, SignalEncoding::Binary}) {
+                const std::string wire = EncodeSignal(test.message, in);
+                const double decode = RunDecodeForward(wire, out, count);
+                const double scan = RunScanForward(wire, out, count);
+                const std::string direction = std::string(in == SignalEncoding::Json ? "json" : "binary") + " -> " +
+                                              (out == SignalEncoding::Json ? "json" : "binary");
+                std::printf("%-14s %-14s %14.0f %14.0f %7.1fx\n", test.name, direction.c_str(), decode, scan,
+                            scan / decode);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,347 @@
+// Воспроизведение записи трафика (--capture сервера или ретранслятора)
+// на сервер через localhost.
+//
+//   trace_replay <trace> [--target host:port] [--speed N | --max]
+//                [--save file] [--baseline file]
+//
+// Каждый источник записи получает свой сокет на 127.0.0.1, поэтому сервер
+// видит столько же клиентов с теми же долями трафика. Датаграммы уходят в
+// записанные моменты, сжатые в N раз (по умолчанию 1), или подряд без
+// пауз (--max).
+//
+// Задержки:
+//   forward  датаграмма вернулась на какой-то сокет без изменений
+//            (ретранслятор раздал ее участникам): от ее отправки
+//   reply    первая датаграмма на сокет после его отправки (ответ сигналинга)
+//
+// --save сохраняет итоги, --baseline печатает разницу с сохраненными: так
+// сравниваются две сборки сервера на одной записи.
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Endpoint.hpp"
+#include "FlatMap.hpp"
+#include "TraceFile.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kDrainTime = std::chrono::milliseconds(500);
+// Поколение таблицы отправленных: совпадения ищутся в двух последних
+constexpr auto kGeneration = std::chrono::seconds(1);
+
+struct Source {
+    int fd{-1};
+    Clock::time_point last_send{};
+    bool answered{true};
+};
+
+struct Percentiles {
+    size_t count{0};
+    double p50{0};
+    double p90{0};
+    double p99{0};
+    double max{0};
+};
+
+Percentiles Summarize(std::vector<double>& samples) {
+    Percentiles result;
+    result.count = samples.size();
+    if (samples.empty()) {
+        return result;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto at = [&](double q) { return samples[static_cast<size_t>(q * (samples.size() - 1))]; };
+    result.p50 = at(0.50);
+    result.p90 = at(0.90);
+    result.p99 = at(0.99);
+    result.max = samples.back();
+    return result;
+}
+
+uint64_t Fnv1a(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t AddressKey(const sockaddr_in& address) {
+    return static_cast<uint64_t>(address.sin_addr.s_addr) << 16 | address.sin_port;
+}
+
+class Replayer {
+public:
+    explicit Replayer(const sockaddr_in& target) : target_(target) { epoll_ = epoll_create1(EPOLL_CLOEXEC); }
+
+    ~Replayer() {
+        for (const auto& source : sources_) {
+            close(source.fd);
+        }
+        close(epoll_);
+    }
+
+    void Send(const TraceReader::Record& record) {
+        Source& source = SourceFor(record.from);
+        const auto now = Clock::now();
+        if (sendto(source.fd, record.data, record.size, 0, (const sockaddr*)&target_, sizeof(target_)) < 0) {
+            ++send_errors_;
+            return;
+        }
+        ++sent_;
+        sent_bytes_ += record.size;
+        source.last_send = now;
+        source.answered = false;
+
+        if (now - generation_start_ >= kGeneration) {
+            generation_start_ = now;
+            current_ ^= 1;
+            sent_at_[current_].Clear();
+        }
+        const int64_t stamp = now.time_since_epoch().count();
+        auto [slot, inserted] = sent_at_[current_].Emplace(Fnv1a(record.data, record.size), stamp);
+        if (!inserted) {
+            *slot = stamp;
+        }
+    }
+
+    // Разбирает ответы сервера, ожидая не дольше timeout_ms
+    void Drain(int timeout_ms) {
+        epoll_event events[64];
+        const int count = epoll_wait(epoll_, events, 64, timeout_ms);
+        for (int i = 0; i < count; ++i) {
+            Source& source = sources_[events[i].data.u32];
+            uint8_t buffer[65536];
+            while (true) {
+                const auto bytes = recv(source.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (bytes < 0) {
+                    break;
+                }
+                OnReceived(source, buffer, static_cast<size_t>(bytes));
+            }
+        }
+    }
+
+    size_t Sources() const noexcept { return sources_.size(); }
+    uint64_t Sent() const noexcept { return sent_; }
+    uint64_t SentBytes() const noexcept { return sent_bytes_; }
+    uint64_t SendErrors() const noexcept { return send_errors_; }
+    uint64_t Received() const noexcept { return received_; }
+    std::vector<double>& Forward() { return forward_us_; }
+    std::vector<double>& Reply() { return reply_us_; }
+
+private:
+    sockaddr_in target_;
+    int epoll_{-1};
+    std::vector<Source> sources_;
+    FlatMap<uint64_t, uint32_t> source_index_;
+
+    FlatMap<uint64_t, int64_t> sent_at_[2];
+    int current_{0};
+    Clock::time_point generation_start_{Clock::now()};
+
+    uint64_t sent_{0};
+    uint64_t sent_bytes_{0};
+    uint64_t send_errors_{0};
+    uint64_t received_{0};
+    std::vector<double> forward_us_;
+    std::vector<double> reply_us_;
+
+    // Источник записи - свой локальный сокет, созданный при первой датаграмме
+    Source& SourceFor(const sockaddr_in& from) {
+        const uint64_t key = AddressKey(from);
+        if (const uint32_t* index = source_index_.Find(key)) {
+            return sources_[*index];
+        }
+
+        Source source;
+        source.fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(source.fd, (sockaddr*)&local, sizeof(local));
+
+        const auto index = static_cast<uint32_t>(sources_.size());
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u32 = index;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, source.fd, &event);
+        source_index_.Emplace(key, index);
+        sources_.push_back(source);
+        return sources_.back();
+    }
+
+    void OnReceived(Source& source, const uint8_t* data, size_t size) {
+        const auto now = Clock::now();
+        ++received_;
+
+        const uint64_t hash = Fnv1a(data, size);
+        for (int generation : {current_, current_ ^ 1}) {
+            if (const int64_t* stamp = sent_at_[generation].Find(hash)) {
+                const auto sent = Clock::time_point(Clock::duration(*stamp));
+                forward_us_.push_back(std::chrono::duration<double, std::micro>(now - sent).count());
+                return;
+            }
+        }
+        if (!source.answered) {
+            source.answered = true;
+            reply_us_.push_back(std::chrono::duration<double, std::micro>(now - source.last_send).count());
+        }
+    }
+};
+
+using Summary = std::map<std::string, double>;
+
+void PrintLatency(const char* name, const Percentiles& latency, Summary& summary) {
+    if (latency.count == 0) {
+        std::printf("  %-8s latency: no samples\n", name);
+        return;
+    }
+    std::printf("  %-8s latency us: p50 %.0f, p90 %.0f, p99 %.0f, max %.0f (%zu samples)\n", name, latency.p50,
+                latency.p90, latency.p99, latency.max, latency.count);
+    const std::string prefix = name;
+    summary[prefix + "_p50_us"] = latency.p50;
+    summary[prefix + "_p99_us"] = latency.p99;
+}
+
+bool LoadSummary(const std::string& path, Summary& summary) {
+    std::ifstream file(path);
+    std::string key;
+    double value = 0;
+    while (file >> key >> value) {
+        summary[key] = value;
+    }
+    return !summary.empty();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string trace_path;
+    std::string save_path;
+    std::string baseline_path;
+    sockaddr_in target{};
+    ParseEndpoint("127.0.0.1:12345", target);
+    double speed = 1.0;
+    bool max_speed = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--target" && i + 1 < argc) {
+            if (!ParseEndpoint(argv[++i], target)) {
+                std::fprintf(stderr, "Invalid target address: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (arg == "--speed" && i + 1 < argc) {
+            speed = std::atof(argv[++i]);
+        } else if (arg == "--max") {
+            max_speed = true;
+        } else if (arg == "--save" && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (trace_path.empty() && arg[0] != '-') {
+            trace_path = arg;
+        } else {
+            trace_path.clear();
+            break;
+        }
+    }
+    if (trace_path.empty() || speed <= 0) {
+        std::printf("Usage: %s <trace> [--target host:port] [--speed N | --max] [--save file] [--baseline file]\n",
+                    argv[0]);
+        return 1;
+    }
+
+    TraceReader trace;
+    std::string error;
+    if (!trace.Open(trace_path, error)) {
+        std::fprintf(stderr, "Failed to open trace: %s\n", error.c_str());
+        return 1;
+    }
+
+    Replayer replayer(target);
+    TraceReader::Record record;
+    std::chrono::microseconds trace_length{0};
+    const auto start = Clock::now();
+    while (trace.Next(record)) {
+        trace_length = record.time;
+        if (max_speed) {
+            if (replayer.Sent() % 64 == 0) {
+                replayer.Drain(0);
+            }
+        } else {
+            const auto due = start + std::chrono::duration_cast<Clock::duration>(record.time / speed);
+            // Ждем в epoll, последнюю миллисекунду - опросом
+            for (auto now = Clock::now(); now < due; now = Clock::now()) {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count();
+                replayer.Drain(left > 1 ? static_cast<int>(left - 1) : 0);
+            }
+        }
+        replayer.Send(record);
+    }
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    // Ответы на последние датаграммы
+    for (const auto drain_end = Clock::now() + kDrainTime; Clock::now() < drain_end;) {
+        replayer.Drain(10);
+    }
+
+    const double seconds = elapsed.count() > 0 ? elapsed.count() : 1e-9;
+    Summary summary;
+    summary["pps"] = replayer.Sent() / seconds;
+    summary["mbps"] = replayer.SentBytes() * 8 / seconds / 1e6;
+    summary["received"] = static_cast<double>(replayer.Received());
+
+    char mode[32] = "max speed";
+    if (!max_speed) {
+        std::snprintf(mode, sizeof(mode), "%gx", speed);
+    }
+    std::printf("Replayed %llu datagrams from %zu sources in %.2f s (trace %.2f s, %s)\n",
+                static_cast<unsigned long long>(replayer.Sent()), replayer.Sources(), elapsed.count(),
+                std::chrono::duration<double>(trace_length).count(), mode);
+    std::printf("  send: %.0f pkt/s, %.2f Mbit/s, %llu errors\n", summary["pps"], summary["mbps"],
+                static_cast<unsigned long long>(replayer.SendErrors()));
+    std::printf("  received: %llu datagrams\n", static_cast<unsigned long long>(replayer.Received()));
+    PrintLatency("forward", Summarize(replayer.Forward()), summary);
+    PrintLatency("reply", Summarize(replayer.Reply()), summary);
+
+    if (!baseline_path.empty()) {
+        Summary baseline;
+        if (!LoadSummary(baseline_path, baseline)) {
+            std::fprintf(stderr, "Failed to read baseline %s\n", baseline_path.c_str());
+        } else {
+            std::printf("Against %s:\n", baseline_path.c_str());
+            for (const auto& [key, value] : summary) {
+                const auto it = baseline.find(key);
+                if (it == baseline.end()) {
+                    continue;
+                }
+                const double delta = it->second != 0 ? (value - it->second) / it->second * 100 : 0.0;
+                std::printf("  %-16s %12.1f -> %12.1f  (%+.1f%%)\n", key.c_str(), it->second, value, delta);
+            }
+        }
+    }
+
+    if (!save_path.empty()) {
+        std::ofstream file(save_path);
+        for (const auto& [key, value] : summary) {
+            file << key << " " << value << "\n";
+        }
+    }
+    return 0;
+}
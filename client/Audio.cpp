@@ -1,28 +1,113 @@
 #include "Audio.hpp"
+#include "AudioEngine.hpp"
+#include "Timeline.hpp"
 
 #include <trantor/utils/Logger.h>
 
 #include <portaudio.h>
 
-Audio::Audio() {
-    Pa_Initialize();
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// Буфер устройства для ultra-low и предлагаемая задержка: PortAudio
+// округлит ее вверх до того, что умеет устройство
+constexpr unsigned long kUltraLowFrames = 64;
+constexpr double kUltraLowLatency = 0.003;
+// Автоподбор: шаг лестницы и нижняя граница - один блок приложения,
+// меньше не имеет смысла при записи блоками FRAMES_PER_BUFFER
+constexpr double kTuneStep = 0.7;
+constexpr double kTuneFloor = static_cast<double>(FRAMES_PER_BUFFER) / SAMPLE_RATE;
+
+struct LatencyParams {
+    double input;
+    double output;
+    unsigned long frames;
+};
+
+LatencyParams ProfileParams(LatencyProfile profile, const PaDeviceInfo* input, const PaDeviceInfo* output) {
+    switch (profile) {
+        case LatencyProfile::UltraLow:
+            return {kUltraLowLatency, kUltraLowLatency, kUltraLowFrames};
+        case LatencyProfile::Robust:
+            return {input ? input->defaultHighInputLatency : 0.0, output ? output->defaultHighOutputLatency : 0.0,
+                    2 * FRAMES_PER_BUFFER};
+        case LatencyProfile::Auto:
+            // Вывод стартует с высокой задержки и подбирается, ввод - как в balanced
+            return {input ? input->defaultLowInputLatency : 0.0, output ? output->defaultHighOutputLatency : 0.0,
+                    FRAMES_PER_BUFFER};
+        case LatencyProfile::Balanced:
+        default:
+            return {input ? input->defaultLowInputLatency : 0.0, output ? output->defaultLowOutputLatency : 0.0,
+                    FRAMES_PER_BUFFER};
+    }
+}
+
+}  // namespace
+
+const char* LatencyProfileName(LatencyProfile profile) {
+    switch (profile) {
+        case LatencyProfile::UltraLow:
+            return "ultra-low";
+        case LatencyProfile::Robust:
+            return "robust";
+        case LatencyProfile::Auto:
+            return "auto";
+        case LatencyProfile::Balanced:
+        default:
+            return "balanced";
+    }
+}
+
+bool ParseLatencyArg(int& index, int argc, char* argv[], LatencyProfile& profile) {
+    if (std::strcmp(argv[index], "--latency") != 0 || index + 1 >= argc) {
+        return false;
+    }
+    const char* value = argv[++index];
+    for (const auto candidate : {LatencyProfile::UltraLow, LatencyProfile::Balanced, LatencyProfile::Robust,
+                                 LatencyProfile::Auto}) {
+        if (std::strcmp(value, LatencyProfileName(candidate)) == 0) {
+            profile = candidate;
+            return true;
+        }
+    }
+    LOG_ERROR << "Unknown latency profile " << value << ", keeping " << LatencyProfileName(profile);
+    return true;
+}
+
+const char* LatencyUsage() {
+    return "  --latency PROFILE    audio device latency: ultra-low, balanced (default), robust,\n"
+           "                       auto (lower playout latency until underruns, then back off)\n";
+}
+
+// PortAudio поднимает AudioEngine: обычно она уже готова или почти
+// готова, пока клиент настраивал сеть
+Audio::Audio(LatencyProfile profile) : profile_(profile) {
     Init();
 }
 
 Audio::~Audio() {
     Clear();
-    Pa_Terminate();
 }
 
 void Audio::Clear() {
-    if (input_stream) {
-        Pa_StopStream(input_stream);
-    }
-    if (output_stream) {
-        Pa_StopStream(output_stream);
+    StopTuner();
+    for (auto* slot : {&pending_input_, &retired_input_, &pending_output_, &retired_output_}) {
+        CloseStream(slot->exchange(nullptr));
     }
+    CloseStream(input_stream.exchange(nullptr));
+    CloseStream(output_stream.exchange(nullptr));
+}
 
-    input_stream = output_stream = nullptr;
+void Audio::Init() {
+    if (!AudioEngine::Get().WaitReady()) {
+        LOG_ERROR << "PortAudio is not available, audio streams will not open";
+        return;
+    }
+    LOG_INFO << "Audio: " << DeviceCount() << " devices, latency profile " << LatencyProfileName(profile_);
 }
 
 int Audio::DeviceCount() const noexcept { return Pa_GetDeviceCount(); }
@@ -54,63 +139,336 @@ void Audio::CreateDefaultOutputStream() {
 }
 
 void Audio::CreateInputStream(const PaDeviceIndex device_index) {
-    PaStreamParameters input_params;
-    input_params.device = device_index;
-    input_params.channelCount = NUM_CHANNELS;
-    input_params.sampleFormat = paInt16;
-    input_params.suggestedLatency = GetDeviceInfo(device_index)->defaultLowInputLatency;
-    input_params.hostApiSpecificStreamInfo = nullptr;
+    const auto params = ProfileParams(profile_, GetDeviceInfo(device_index), nullptr);
+    CloseStream(input_stream.exchange(nullptr));
+    PaStream* stream = OpenStream(device_index, true, params.input, params.frames);
+    if (!stream) {
+        return;
+    }
+    input_device_ = device_index;
+    input_stream.store(stream, std::memory_order_release);
+    LOG_INFO << "Input stream" << device_index << " started, latency " << input_latency_.load() * 1000
+             << " ms (asked " << params.input * 1000 << " ms)";
+}
+
+void Audio::CreateOutputStream(const PaDeviceIndex device_index) {
+    output_device_ = device_index;
+    const auto params = ProfileParams(profile_, nullptr, GetDeviceInfo(device_index));
+
+    if (profile_ == LatencyProfile::Auto) {
+        tune_ladder_ = BuildTuneLadder(params.output);
+        tune_level_ = 0;
+    }
+    if (OpenOutputStream(params.output, params.frames)) {
+        LOG_INFO << "Output stream" << device_index << " started, latency " << output_latency_.load() * 1000
+                 << " ms (asked " << params.output * 1000 << " ms)";
+        if (profile_ == LatencyProfile::Auto && !tuner_.joinable()) {
+            tuner_running_ = true;
+            tuner_ = std::thread(&Audio::TunerLoop, this);
+        }
+    }
+}
+
+std::vector<double> Audio::BuildTuneLadder(double start) const {
+    std::vector<double> ladder;
+    for (double latency = start; latency > kTuneFloor; latency *= kTuneStep) {
+        ladder.push_back(latency);
+    }
+    ladder.push_back(kTuneFloor);
+    return ladder;
+}
 
+bool Audio::OpenOutputStream(double suggested_latency, unsigned long frames) {
+    CloseStream(output_stream.exchange(nullptr));
+    PaStream* stream = OpenStream(output_device_, false, suggested_latency, frames);
+    if (!stream) {
+        return false;
+    }
+    output_frames_ = frames;
+    tune_writes_ = 0;
+    tune_underflows_ = 0;
+    output_stream.store(stream, std::memory_order_release);
+    return true;
+}
+
+PaStream* Audio::OpenStream(const PaDeviceIndex device_index, bool input, double suggested_latency,
+                            unsigned long frames) {
+    const char* direction = input ? "input" : "output";
+    PaStreamParameters params;
+    params.device = device_index;
+    params.channelCount = NUM_CHANNELS;
+    params.sampleFormat = paInt16;
+    params.suggestedLatency = suggested_latency;
+    params.hostApiSpecificStreamInfo = nullptr;
+
+    PaStream* stream = nullptr;
     auto err = Pa_OpenStream(
-        &input_stream, &input_params, nullptr, SAMPLE_RATE, FRAMES_PER_BUFFER, paClipOff, nullptr, nullptr
+        &stream, input ? &params : nullptr, input ? nullptr : &params, SAMPLE_RATE, frames, paClipOff, nullptr,
+        nullptr
     );
     if (err != paNoError) {
-        LOG_ERROR << "Failed to open input stream: " << Pa_GetErrorText(err);
-        return;
+        LOG_ERROR << "Failed to open " << direction << " stream: " << Pa_GetErrorText(err);
+        return nullptr;
     }
 
-    Pa_StartStream(input_stream);
+    err = Pa_StartStream(stream);
     if (err != paNoError) {
-        LOG_ERROR << "Failed to start input stream: " << Pa_GetErrorText(err);
-        return;
+        LOG_ERROR << "Failed to start " << direction << " stream: " << Pa_GetErrorText(err);
+        Pa_CloseStream(stream);
+        return nullptr;
+    }
+    // Устройство могло дать не ту задержку, что просили
+    if (const PaStreamInfo* info = Pa_GetStreamInfo(stream)) {
+        (input ? input_latency_ : output_latency_) = input ? info->inputLatency : info->outputLatency;
     }
-    LOG_INFO << "Input stream" << device_index << " started";
+    return stream;
 }
 
-void Audio::CreateOutputStream(const PaDeviceIndex device_index) {
-    PaStreamParameters output_params;
-    output_params.device = device_index;
-    output_params.channelCount = NUM_CHANNELS;
-    output_params.sampleFormat = paInt16;
-    output_params.suggestedLatency = GetDeviceInfo(device_index)->defaultHighOutputLatency;
-    output_params.hostApiSpecificStreamInfo = nullptr;
+void Audio::CloseStream(PaStream* stream) {
+    if (stream) {
+        Pa_StopStream(stream);
+        Pa_CloseStream(stream);
+    }
+}
 
-    auto err = Pa_OpenStream(
-        &output_stream, nullptr, &output_params, SAMPLE_RATE, FRAMES_PER_BUFFER, paClipOff, nullptr, nullptr
-    );
-    if (err != paNoError) {
-        LOG_ERROR << "Failed to open output stream: " << Pa_GetErrorText(err);
+bool Audio::SwitchInputDevice(const PaDeviceIndex device_index) {
+    std::lock_guard<std::mutex> lock(switch_mutex_);
+    if (!input_stream) {
+        CreateInputStream(device_index);
+        return input_stream != nullptr;
+    }
+    const auto params = ProfileParams(profile_, GetDeviceInfo(device_index), nullptr);
+    PaStream* stream = OpenStream(device_index, true, params.input, params.frames);
+    if (!stream) {
+        return false;
+    }
+    pending_input_device_ = device_index;
+    pending_input_.store(stream, std::memory_order_release);
+    if (!RetireStream(pending_input_, retired_input_)) {
+        return false;
+    }
+    LOG_INFO << "Input switched to device " << device_index << ", latency " << input_latency_.load() * 1000
+             << " ms";
+    return true;
+}
+
+bool Audio::SwitchOutputDevice(const PaDeviceIndex device_index) {
+    std::lock_guard<std::mutex> lock(switch_mutex_);
+    if (!output_stream) {
+        CreateOutputStream(device_index);
+        return output_stream != nullptr;
+    }
+    const auto params = ProfileParams(profile_, nullptr, GetDeviceInfo(device_index));
+    PaStream* stream = OpenStream(device_index, false, params.output, params.frames);
+    if (!stream) {
+        return false;
+    }
+    // Другое устройство - подбор задержки заново; просьба подбора
+    // относилась к старому
+    if (profile_ == LatencyProfile::Auto) {
+        pending_ladder_ = BuildTuneLadder(params.output);
+        retune_latency_.store(0.0, std::memory_order_relaxed);
+    }
+    pending_retune_ = false;
+    pending_output_device_ = device_index;
+    pending_output_.store(stream, std::memory_order_release);
+    if (!RetireStream(pending_output_, retired_output_)) {
+        return false;
+    }
+    output_frames_ = params.frames;
+    LOG_INFO << "Output switched to device " << device_index << ", latency " << output_latency_.load() * 1000
+             << " ms";
+    return true;
+}
+
+bool Audio::RetireStream(std::atomic<PaStream*>& pending, std::atomic<PaStream*>& retired) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kSwitchWaitMs);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (PaStream* old = retired.exchange(nullptr, std::memory_order_acquire)) {
+            // Старый поток вывода доигрывает свой буфер в Pa_StopStream
+            CloseStream(old);
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Поток устройства не идет: забираем новый поток обратно. Если он
+    // успел его подхватить, старый появится в retired сразу следом
+    if (PaStream* stream = pending.exchange(nullptr, std::memory_order_acq_rel)) {
+        LOG_ERROR << "Audio device thread is not running, switch cancelled";
+        CloseStream(stream);
+        return false;
+    }
+    PaStream* old = nullptr;
+    while (!(old = retired.exchange(nullptr, std::memory_order_acquire))) {
+        std::this_thread::yield();
+    }
+    CloseStream(old);
+    return true;
+}
+
+void Audio::AdoptInput(SAMPLE* input_buffer) {
+    PaStream* next = pending_input_.exchange(nullptr, std::memory_order_acq_rel);
+    if (!next) {
         return;
     }
+    PaStream* old = input_stream.exchange(next, std::memory_order_acq_rel);
+    input_device_ = pending_input_device_;
+    ++switches_;
+    retired_input_.store(old, std::memory_order_release);
 
-    Pa_StartStream(output_stream);
-    if (err != paNoError) {
-        LOG_ERROR << "Failed to start output stream: " << Pa_GetErrorText(err);
+    // Новый поток копил отсчеты с запуска; больше одного буфера - лишняя
+    // задержка, ее выбрасываем
+    for (long available = Pa_GetStreamReadAvailable(next); available >= 2 * FRAMES_PER_BUFFER;
+         available -= FRAMES_PER_BUFFER) {
+        Pa_ReadStream(next, input_buffer, FRAMES_PER_BUFFER);
+        switch_dropped_ += FRAMES_PER_BUFFER;
+    }
+}
+
+void Audio::AdoptOutput() {
+    PaStream* next = pending_output_.exchange(nullptr, std::memory_order_acq_rel);
+    if (!next) {
+        return;
+    }
+    PaStream* old = output_stream.exchange(next, std::memory_order_acq_rel);
+    output_device_ = pending_output_device_;
+    // Первые записи нового потока заполняют его буфер
+    tune_writes_ = 0;
+    tune_underflows_ = 0;
+    if (pending_retune_) {
+        retired_output_.store(old, std::memory_order_release);
         return;
     }
-    LOG_INFO << "Output stream" << device_index << " started";
+    if (profile_ == LatencyProfile::Auto) {
+        tune_ladder_ = std::move(pending_ladder_);
+        tune_level_ = 0;
+        tuned_ = false;
+    }
+    ++switches_;
+    retired_output_.store(old, std::memory_order_release);
 }
 
 const void Audio::GetInputStreamBuffer(SAMPLE* input_buffer) {
-    const auto err = Pa_ReadStream(input_stream, input_buffer, FRAMES_PER_BUFFER);
-    if (err != paNoError) {
+    // Включает ожидание устройства: длинный интервал - поток захвата опоздал
+    TimelineScope scope("audio.capture");
+    AdoptInput(input_buffer);
+    const auto err = Pa_ReadStream(input_stream.load(std::memory_order_acquire), input_buffer, FRAMES_PER_BUFFER);
+    if (err == paInputOverflowed) {
+        ++input_overflows_;
+    } else if (err != paNoError) {
         LOG_ERROR << "Failed to read stream: " << Pa_GetErrorText(err);
     }
 }
 
 const void Audio::SetOutputStreamBuffer(const SAMPLE* output_buffer) {
-    const auto err = Pa_WriteStream(output_stream, output_buffer, FRAMES_PER_BUFFER);
-    if (err != paNoError) {
+    TimelineScope scope("audio.playout");
+    AdoptOutput();
+    PaStream* stream = output_stream.load(std::memory_order_acquire);
+    const auto err = Pa_WriteStream(stream, output_buffer, FRAMES_PER_BUFFER);
+    const bool underflow = err == paOutputUnderflowed;
+    if (underflow) {
+        ++output_underflows_;
+    } else if (err != paNoError) {
         LOG_ERROR << "Failed to write stream: " << Pa_GetErrorText(err);
     }
+
+    if (profile_ == LatencyProfile::Auto && stream) {
+        ++tune_writes_;
+        // Первые записи после открытия заполняют буфер устройства
+        if (underflow && tune_writes_ > kTuneGrace) {
+            ++tune_underflows_;
+        }
+        if (tune_writes_ >= kTuneWindow) {
+            TuneOutput();
+        }
+    }
+}
+
+// Окно без опустошений - ступень ниже; опустошения - ступень назад, и
+// ниже уже не спускаемся. Опустошения и после подбора тоже отодвигают
+// задержку: устройство могло стать загруженнее.
+void Audio::TuneOutput() {
+    const bool clean = tune_underflows_ == 0;
+    tune_writes_ = 0;
+    tune_underflows_ = 0;
+
+    size_t level = tune_level_;
+    if (clean && !tuned_) {
+        if (level + 1 < tune_ladder_.size()) {
+            ++level;
+        } else {
+            tuned_ = true;
+        }
+    } else if (!clean) {
+        if (level > 0) {
+            --level;
+        }
+        tuned_ = true;
+    }
+    if (level == tune_level_) {
+        return;
+    }
+
+    tune_level_ = level;
+    ++tune_steps_;
+    // Открытие и закрытие потоков устройства ждут его буфер: это делает
+    // поток подбора, а сюда новый поток придет через pending_output_
+    retune_latency_.store(tune_ladder_[level], std::memory_order_release);
+    retune_latency_.notify_one();
+}
+
+void Audio::TunerLoop() {
+    while (true) {
+        retune_latency_.wait(0.0, std::memory_order_acquire);
+        if (!tuner_running_) {
+            return;
+        }
+        const double latency = retune_latency_.exchange(0.0, std::memory_order_acq_rel);
+        if (latency <= 0.0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(switch_mutex_);
+        const PaDeviceIndex device = output_device_;
+        PaStream* stream = OpenStream(device, false, latency, FRAMES_PER_BUFFER);
+        if (!stream) {
+            LOG_ERROR << "Output latency " << latency * 1000 << " ms is not available, keeping the current stream";
+            continue;
+        }
+        pending_retune_ = true;
+        pending_output_device_ = device;
+        pending_output_.store(stream, std::memory_order_release);
+        if (RetireStream(pending_output_, retired_output_)) {
+            output_frames_ = FRAMES_PER_BUFFER;
+            LOG_INFO << "Output latency set to " << output_latency_.load() * 1000 << " ms (asked " << latency * 1000
+                     << " ms)";
+        }
+    }
+}
+
+void Audio::StopTuner() {
+    if (!tuner_.joinable()) {
+        return;
+    }
+    tuner_running_ = false;
+    retune_latency_.store(-1.0, std::memory_order_release);
+    retune_latency_.notify_one();
+    tuner_.join();
+    retune_latency_.store(0.0, std::memory_order_relaxed);
+}
+
+Audio::LatencyStats Audio::GetLatencyStats() const {
+    LatencyStats stats;
+    stats.profile = profile_;
+    stats.input_ms = input_latency_.load() * 1000;
+    stats.output_ms = output_latency_.load() * 1000;
+    stats.device_frames = output_frames_.load();
+    stats.input_overflows = input_overflows_.load();
+    stats.output_underflows = output_underflows_.load();
+    stats.tune_steps = tune_steps_.load();
+    stats.tuned = profile_ != LatencyProfile::Auto || tuned_.load();
+    stats.switches = switches_.load();
+    stats.switch_dropped = switch_dropped_.load();
+    return stats;
 }
\ No newline at end of file
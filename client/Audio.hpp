@@ -1,5 +1,9 @@
 #pragma once
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <portaudio.h>
@@ -13,12 +17,44 @@ using SAMPLE = short;
 
 #define BUF_SIZE (FRAMES_PER_BUFFER * NUM_CHANNELS)
 
+// Профиль задержки устройств: предлагаемая PortAudio задержка и буфер
+// устройства. Приложение читает и пишет блоками FRAMES_PER_BUFFER при
+// любом профиле.
+enum class LatencyProfile {
+    UltraLow,  // минимум, что даст устройство; буфер 64 отсчета
+    Balanced,  // низкая задержка устройства для обоих направлений
+    Robust,    // высокая задержка устройства, буфер вдвое больше
+    Auto,      // вывод с высокой задержки вниз до опустошений, потом шаг назад
+};
+
+const char* LatencyProfileName(LatencyProfile profile);
+// --latency ultra-low|balanced|robust|auto; сдвигает index за значение
+bool ParseLatencyArg(int& index, int argc, char* argv[], LatencyProfile& profile);
+const char* LatencyUsage();
+
 class Audio {
-    PaStream* input_stream{NULL};
-    PaStream* output_stream{NULL};
+    // Пишет поток устройства, а до первого открытия - и переключение
+    // устройства из потока команд: указатель публикуется последним
+    std::atomic<PaStream*> input_stream{nullptr};
+    std::atomic<PaStream*> output_stream{nullptr};
 
 public:
-    Audio();
+    // Задержки, которые устройства дали на самом деле (Pa_GetStreamInfo)
+    struct LatencyStats {
+        LatencyProfile profile{LatencyProfile::Balanced};
+        double input_ms{0.0};
+        double output_ms{0.0};
+        unsigned long device_frames{0};  // буфер устройства вывода
+        uint64_t input_overflows{0};
+        uint64_t output_underflows{0};
+        // Автоподбор: шагов вниз и назад; false - еще подбирает
+        uint32_t tune_steps{0};
+        bool tuned{false};
+        uint32_t switches{0};         // переключений устройств на ходу
+        uint64_t switch_dropped{0};  // отсчетов ввода, выброшенных при них
+    };
+
+    explicit Audio(LatencyProfile profile = LatencyProfile::Balanced);
     ~Audio();
 
     void Clear();
@@ -37,7 +73,77 @@ public:
     const void GetInputStreamBuffer(SAMPLE* input_buffer);
     const void SetOutputStreamBuffer(const SAMPLE* output_buffer);
 
+    // Переключение устройства на ходу. Новый поток открывается и
+    // запускается в вызывающем потоке, поток захвата или воспроизведения
+    // подхватывает его со следующего буфера, старый закрывается здесь же.
+    // false - устройство не открылось, работает старое
+    bool SwitchInputDevice(const PaDeviceIndex device_index);
+    bool SwitchOutputDevice(const PaDeviceIndex device_index);
+    PaDeviceIndex InputDevice() const noexcept { return input_device_; }
+    PaDeviceIndex OutputDevice() const noexcept { return output_device_; }
+
+    LatencyStats GetLatencyStats() const;
+
 private:
+    // Автоподбор: оценка раз в kTuneWindow буферов вывода; первые
+    // kTuneGrace после переоткрытия потока не считаются
+    static constexpr uint32_t kTuneWindow = 512;
+    static constexpr uint32_t kTuneGrace = 32;
+    // Сколько переключение ждет, пока поток устройства заберет новый поток
+    static constexpr int kSwitchWaitMs = 500;
+
+    const LatencyProfile profile_;
+    std::atomic<PaDeviceIndex> input_device_{paNoDevice};
+    std::atomic<PaDeviceIndex> output_device_{paNoDevice};
+    std::atomic<double> input_latency_{0.0};
+    std::atomic<double> output_latency_{0.0};
+    std::atomic<unsigned long> output_frames_{0};
+    std::atomic<uint64_t> input_overflows_{0};
+    std::atomic<uint64_t> output_underflows_{0};
+
+    // Лестница предлагаемых задержек вывода, от высокой к низкой; дальше
+    // только в потоке вывода
+    std::vector<double> tune_ladder_;
+    size_t tune_level_{0};
+    uint32_t tune_writes_{0};
+    uint64_t tune_underflows_{0};
+    std::atomic<uint32_t> tune_steps_{0};
+    std::atomic<bool> tuned_{false};
+
+    // Передача потока при переключении: pending_* кладет переключение,
+    // поток устройства меняет его на текущий и кладет старый в retired_*
+    std::mutex switch_mutex_;
+    std::atomic<PaStream*> pending_input_{nullptr};
+    std::atomic<PaStream*> retired_input_{nullptr};
+    std::atomic<PaStream*> pending_output_{nullptr};
+    std::atomic<PaStream*> retired_output_{nullptr};
+    PaDeviceIndex pending_input_device_{paNoDevice};
+    PaDeviceIndex pending_output_device_{paNoDevice};
+    std::vector<double> pending_ladder_;
+    bool pending_retune_{false};  // тот же вывод с другой задержкой, не переключение
+
+    // Шаг подбора: поток вывода кладет задержку (0 - просьбы нет), поток
+    // подбора открывает с ней новый поток и передает его как переключение
+    std::atomic<double> retune_latency_{0.0};
+    std::atomic<bool> tuner_running_{false};
+    std::thread tuner_;
+    std::atomic<uint32_t> switches_{0};
+    std::atomic<uint64_t> switch_dropped_{0};
+
     void Init();
     void CreateStream(const PaDeviceIndex device_index, PaStream* stream);
+    // Открытый и запущенный поток; nullptr при ошибке
+    PaStream* OpenStream(const PaDeviceIndex device_index, bool input, double suggested_latency,
+                         unsigned long frames);
+    static void CloseStream(PaStream* stream);
+    std::vector<double> BuildTuneLadder(double start) const;
+    bool OpenOutputStream(double suggested_latency, unsigned long frames);
+    // Поток устройства: подхватить поток, положенный переключением
+    void AdoptInput(SAMPLE* input_buffer);
+    void AdoptOutput();
+    // Ждет, пока поток устройства отдаст старый поток, и закрывает его
+    bool RetireStream(std::atomic<PaStream*>& pending, std::atomic<PaStream*>& retired);
+    void TuneOutput();
+    void TunerLoop();
+    void StopTuner();
 };
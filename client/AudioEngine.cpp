@@ -0,0 +1,305 @@
+#include "AudioEngine.hpp"
+
+#include <sys/stat.h>
+
+#include <trantor/utils/Logger.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Табуляции и переводы строк разделяют поля кэша
+std::string CleanField(const char* text) {
+    std::string field = text ? text : "";
+    for (auto& c : field) {
+        if (c == '\t' || c == '\n' || c == '\r') {
+            c = ' ';
+        }
+    }
+    return field;
+}
+
+}  // namespace
+
+AudioEngine& AudioEngine::Get() {
+    // Не разрушается при выходе: поток инициализации, которого выход
+    // не ждет, может закончить позже и заблокировать mutex_
+    static auto& engine = *new AudioEngine;
+    return engine;
+}
+
+AudioEngine::~AudioEngine() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) {
+        return;
+    }
+    // Выход до конца инициализации (--list-devices из кэша): прервать
+    // Pa_Initialize нельзя, а ждать ее незачем
+    if (!ready_) {
+        thread_.detach();
+        return;
+    }
+    lock.unlock();
+    thread_.join();
+    if (initialized_) {
+        Pa_Terminate();
+    }
+}
+
+void AudioEngine::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StartLocked();
+}
+
+void AudioEngine::StartLocked() {
+    if (started_) {
+        return;
+    }
+    started_ = true;
+    started_at_ = Clock::now();
+    devices_ = LoadCache();
+    thread_ = std::thread(&AudioEngine::Run, this);
+}
+
+bool AudioEngine::WaitReady() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    StartLocked();
+    if (!ready_) {
+        const auto start = Clock::now();
+        changed_.wait(lock, [this] { return ready_; });
+        stats_.waited_ms += MillisecondsSince(start);
+    }
+    return !failed_;
+}
+
+void AudioEngine::Run() {
+    std::vector<AudioDeviceEntry> devices;
+    const auto start = Clock::now();
+    const bool ok = Initialize(devices);
+    const double init_ms = MillisecondsSince(start);
+    if (ok) {
+        SaveCache(devices);
+        LOG_INFO << "PortAudio " << Pa_GetVersionText() << " ready in " << init_ms << " ms, " << devices.size()
+                 << " devices";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    initialized_ = ok;
+    failed_ = !ok;
+    ready_ = true;
+    if (ok) {
+        devices_ = std::move(devices);
+    }
+    stats_.init_ms = init_ms;
+    stats_.ready_at_ms = MillisecondsSince(started_at_);
+    changed_.notify_all();
+}
+
+bool AudioEngine::Initialize(std::vector<AudioDeviceEntry>& devices) {
+    const auto err = Pa_Initialize();
+    if (err != paNoError) {
+        LOG_ERROR << "Failed to initialize PortAudio: " << Pa_GetErrorText(err);
+        return false;
+    }
+
+    const PaDeviceIndex default_input = Pa_GetDefaultInputDevice();
+    const PaDeviceIndex default_output = Pa_GetDefaultOutputDevice();
+    const PaDeviceIndex count = Pa_GetDeviceCount();
+    for (PaDeviceIndex index = 0; index < count; ++index) {
+        const PaDeviceInfo* info = Pa_GetDeviceInfo(index);
+        if (!info) {
+            continue;
+        }
+        AudioDeviceEntry entry;
+        entry.index = index;
+        entry.name = CleanField(info->name);
+        if (const PaHostApiInfo* host = Pa_GetHostApiInfo(info->hostApi)) {
+            entry.host_api = CleanField(host->name);
+        }
+        entry.input_channels = info->maxInputChannels;
+        entry.output_channels = info->maxOutputChannels;
+        entry.default_input = index == default_input;
+        entry.default_output = index == default_output;
+        devices.push_back(std::move(entry));
+    }
+    return true;
+}
+
+std::vector<AudioDeviceEntry> AudioEngine::Devices() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return devices_;
+}
+
+PaDeviceIndex AudioEngine::FindDevice(const std::string& query, bool input) const {
+    const auto devices = Devices();
+    const auto usable = [input](const AudioDeviceEntry& entry) {
+        return (input ? entry.input_channels : entry.output_channels) > 0;
+    };
+
+    char* end = nullptr;
+    const long number = std::strtol(query.c_str(), &end, 10);
+    if (!query.empty() && *end == '\0') {
+        for (const auto& entry : devices) {
+            if (entry.index == number && usable(entry)) {
+                return entry.index;
+            }
+        }
+        return paNoDevice;
+    }
+    for (const auto& entry : devices) {
+        if (usable(entry) && entry.name.find(query) != std::string::npos) {
+            return entry.index;
+        }
+    }
+    return paNoDevice;
+}
+
+AudioEngine::Stats AudioEngine::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.devices = devices_.size();
+    stats.from_cache = !ready_ && !devices_.empty();
+    stats.ready = ready_;
+    stats.failed = failed_;
+    return stats;
+}
+
+std::string AudioEngine::CachePath() {
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+        return std::string(cache) + "/zvonok/audio-devices";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::string(home) + "/.cache/zvonok/audio-devices";
+    }
+    return {};
+}
+
+// Строка на устройство: номер, входы, выходы, флаги (i - по умолчанию
+// для ввода, o - для вывода), host API, имя; разделитель - табуляция
+std::vector<AudioDeviceEntry> AudioEngine::LoadCache() {
+    std::vector<AudioDeviceEntry> devices;
+    const auto path = CachePath();
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        AudioDeviceEntry entry;
+        std::string flags;
+        if (!(fields >> entry.index >> entry.input_channels >> entry.output_channels >> flags)) {
+            continue;
+        }
+        fields.ignore(1);
+        std::getline(fields, entry.host_api, '\t');
+        std::getline(fields, entry.name);
+        entry.default_input = flags.find('i') != std::string::npos;
+        entry.default_output = flags.find('o') != std::string::npos;
+        devices.push_back(std::move(entry));
+    }
+    return devices;
+}
+
+void AudioEngine::SaveCache(const std::vector<AudioDeviceEntry>& devices) {
+    const auto path = CachePath();
+    if (path.empty()) {
+        return;
+    }
+    // Каталоги кэша могут еще не существовать
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+
+    // Через временный файл: параллельный запуск не прочитает половину
+    const auto temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        for (const auto& entry : devices) {
+            std::string flags;
+            flags += entry.default_input ? "i" : "";
+            flags += entry.default_output ? "o" : "";
+            file << entry.index << '\t' << entry.input_channels << '\t' << entry.output_channels << '\t'
+                 << (flags.empty() ? "-" : flags) << '\t' << entry.host_api << '\t' << entry.name << '\n';
+        }
+        if (!file) {
+            return;
+        }
+    }
+    std::rename(temporary.c_str(), path.c_str());
+}
+
+bool ParseAudioDeviceArg(int& index, int argc, char* argv[], AudioDeviceOptions& options) {
+    const bool has_value = index + 1 < argc;
+    if (std::strcmp(argv[index], "--list-devices") == 0) {
+        options.list = true;
+    } else if (std::strcmp(argv[index], "--input-device") == 0 && has_value) {
+        options.input = argv[++index];
+    } else if (std::strcmp(argv[index], "--output-device") == 0 && has_value) {
+        options.output = argv[++index];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* AudioDeviceUsage() {
+    return "  --list-devices       print audio devices (cached list if PortAudio is still starting)\n"
+           "  --input-device DEV   capture device: number or part of the name\n"
+           "  --output-device DEV  playout device: number or part of the name\n";
+}
+
+void PrintAudioDevices() {
+    auto& engine = AudioEngine::Get();
+    auto devices = engine.Devices();
+    if (devices.empty()) {
+        engine.WaitReady();
+        devices = engine.Devices();
+    }
+    std::cout << "Audio devices" << (engine.GetStats().from_cache ? " (cached, PortAudio still starting)" : "")
+              << ":" << std::endl;
+    for (const auto& entry : devices) {
+        std::cout << "  " << entry.index << ": " << entry.name << " [" << entry.host_api << "] in "
+                  << entry.input_channels << ", out " << entry.output_channels
+                  << (entry.default_input ? ", default input" : "") << (entry.default_output ? ", default output" : "")
+                  << std::endl;
+    }
+}
+
+bool RunAudioDeviceCommand(const std::string& line, const std::function<bool(PaDeviceIndex)>& switch_input,
+                           const std::function<bool(PaDeviceIndex)>& switch_output) {
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+    if (command == "devices") {
+        PrintAudioDevices();
+        return true;
+    }
+    if (command != "input" && command != "output") {
+        return false;
+    }
+
+    const bool input = command == "input";
+    std::string query;
+    std::getline(words >> std::ws, query);
+    const PaDeviceIndex device = AudioEngine::Get().FindDevice(query, input);
+    if (device == paNoDevice) {
+        std::cout << "No " << command << " device matches '" << query << "'" << std::endl;
+        return true;
+    }
+    const bool switched = input ? switch_input(device) : switch_output(device);
+    std::cout << (switched ? "Switched " : "Failed to switch ") << command << " to device " << device << std::endl;
+    return true;
+}
+
+const char* AudioDeviceCommands() {
+    return "  devices              list audio devices\n"
+           "  input DEV            move capture to another device\n"
+           "  output DEV           move playout to another device\n";
+}
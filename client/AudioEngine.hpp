@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <portaudio.h>
+
+// PortAudio на весь процесс. Pa_Initialize опрашивает все host API и
+// устройства и на ALSA/JACK идет секундами, поэтому она запускается в
+// фоне первой строкой main, пока клиент поднимает сеть, и выполняется
+// один раз: Audio больше не инициализирует и не завершает PortAudio.
+//
+// Список устройств сохраняется в файл ($XDG_CACHE_HOME/zvonok/audio-devices):
+// при следующем запуске он доступен сразу, а фоновая инициализация
+// заменяет его свежим и переписывает файл. Открывать потоки можно только
+// после нее. PortAudio перечисляет устройства только в Pa_Initialize:
+// подключенное после запуска устройство появится при следующем запуске.
+struct AudioDeviceEntry {
+    PaDeviceIndex index{paNoDevice};
+    std::string name;
+    std::string host_api;
+    int input_channels{0};
+    int output_channels{0};
+    bool default_input{false};
+    bool default_output{false};
+};
+
+class AudioEngine {
+public:
+    struct Stats {
+        double init_ms{0.0};      // Pa_Initialize и перечисление в фоне
+        double waited_ms{0.0};    // сколько открытие устройств ее ждало
+        double ready_at_ms{0.0};  // от Start до готовности
+        size_t devices{0};
+        bool from_cache{false};  // список пока из файла
+        bool ready{false};
+        bool failed{false};
+    };
+
+    static AudioEngine& Get();
+
+    AudioEngine(const AudioEngine&) = delete;
+    AudioEngine& operator=(const AudioEngine&) = delete;
+
+    // Читает кэш и запускает инициализацию в фоне; повторный вызов ничего
+    // не делает
+    void Start();
+    // Ждет инициализации (и Start, если его не было); false - PortAudio
+    // не поднялась
+    bool WaitReady();
+
+    // Не ждет: до конца инициализации - список из кэша
+    std::vector<AudioDeviceEntry> Devices() const;
+    // Номер или часть имени; paNoDevice - нет подходящего устройства
+    // с каналами нужного направления
+    PaDeviceIndex FindDevice(const std::string& query, bool input) const;
+
+    Stats GetStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    AudioEngine() = default;
+    ~AudioEngine();
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::thread thread_;
+    bool started_{false};
+    bool ready_{false};
+    bool failed_{false};
+    bool initialized_{false};  // Pa_Initialize прошла, нужен Pa_Terminate
+    std::vector<AudioDeviceEntry> devices_;
+    Clock::time_point started_at_;
+    Stats stats_;
+
+    void StartLocked();
+    void Run();
+    static bool Initialize(std::vector<AudioDeviceEntry>& devices);
+    static std::string CachePath();
+    static std::vector<AudioDeviceEntry> LoadCache();
+    static void SaveCache(const std::vector<AudioDeviceEntry>& devices);
+};
+
+// Флаги клиентов: --list-devices, --input-device, --output-device
+struct AudioDeviceOptions {
+    bool list{false};
+    std::string input;
+    std::string output;
+};
+
+bool ParseAudioDeviceArg(int& index, int argc, char* argv[], AudioDeviceOptions& options);
+const char* AudioDeviceUsage();
+void PrintAudioDevices();
+
+// Команды консоли: devices, input ID|ИМЯ, output ID|ИМЯ.
+// false - строка не команда устройств
+bool RunAudioDeviceCommand(const std::string& line, const std::function<bool(PaDeviceIndex)>& switch_input,
+                           const std::function<bool(PaDeviceIndex)>& switch_output);
+const char* AudioDeviceCommands();
@@ -0,0 +1,101 @@
+#include "MediaCodec.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+// G.711 mu-law
+constexpr int kMuLawBias = 0x84;
+constexpr int kMuLawClip = 32635;
+
+uint8_t LinearToMuLaw(SAMPLE sample) {
+    int value = sample;
+    const int sign = value < 0 ? 0x80 : 0;
+    if (sign) {
+        value = -value;
+    }
+    if (value > kMuLawClip) {
+        value = kMuLawClip;
+    }
+    value += kMuLawBias;
+
+    int exponent = 7;
+    for (int mask = 0x4000; (value & mask) == 0 && exponent > 0; mask >>= 1) {
+        --exponent;
+    }
+    const int mantissa = (value >> (exponent + 3)) & 0x0f;
+    return static_cast<uint8_t>(~(sign | exponent << 4 | mantissa));
+}
+
+SAMPLE MuLawToLinear(uint8_t encoded) {
+    encoded = ~encoded;
+    const int sign = encoded & 0x80;
+    const int exponent = (encoded >> 4) & 0x07;
+    const int mantissa = encoded & 0x0f;
+    const int value = ((mantissa << 3) + kMuLawBias) << exponent;
+    return static_cast<SAMPLE>(sign ? kMuLawBias - value : value - kMuLawBias);
+}
+
+}  // namespace
+
+uint32_t CodecConfig::PayloadBitrate() const noexcept {
+    const uint32_t bits = id == CodecId::Pcm16 ? 16 : 8;
+    return (SAMPLE_RATE >> decimation_shift) * NUM_CHANNELS * bits;
+}
+
+void EncodeAudio(const SAMPLE* samples, size_t frames, CodecConfig config, std::vector<uint8_t>& out) {
+    const size_t factor = size_t{1} << config.decimation_shift;
+
+    for (size_t frame = 0; frame + factor <= frames; frame += factor) {
+        for (size_t ch = 0; ch < NUM_CHANNELS; ++ch) {
+            // Прореживание с усреднением как простейший ФНЧ
+            int sum = 0;
+            for (size_t i = 0; i < factor; ++i) {
+                sum += samples[(frame + i) * NUM_CHANNELS + ch];
+            }
+            const auto value = static_cast<SAMPLE>(sum / static_cast<int>(factor));
+
+            if (config.id == CodecId::MuLaw) {
+                out.push_back(LinearToMuLaw(value));
+            } else {
+                const auto raw = static_cast<uint16_t>(value);
+                out.push_back(static_cast<uint8_t>(raw >> 8));
+                out.push_back(static_cast<uint8_t>(raw));
+            }
+        }
+    }
+}
+
+bool AudioDecoder::Decode(const uint8_t* data, size_t size, CodecConfig config, std::vector<SAMPLE>& out) {
+    const size_t sample_size = config.id == CodecId::MuLaw ? 1 : 2;
+    if (config.id != CodecId::Pcm16 && config.id != CodecId::MuLaw) {
+        return false;
+    }
+    if (size % (sample_size * NUM_CHANNELS) != 0) {
+        return false;
+    }
+
+    const size_t factor = size_t{1} << config.decimation_shift;
+    const size_t frames = size / (sample_size * NUM_CHANNELS);
+    out.reserve(out.size() + frames * factor * NUM_CHANNELS);
+
+    for (size_t frame = 0; frame < frames; ++frame) {
+        SAMPLE current[NUM_CHANNELS];
+        for (size_t ch = 0; ch < NUM_CHANNELS; ++ch) {
+            const uint8_t* p = data + (frame * NUM_CHANNELS + ch) * sample_size;
+            current[ch] = config.id == CodecId::MuLaw ? MuLawToLinear(p[0])
+                                                      : static_cast<SAMPLE>(static_cast<uint16_t>(p[0] << 8 | p[1]));
+        }
+
+        // Линейная интерполяция от предыдущего сэмпла к текущему
+        for (size_t i = 1; i <= factor; ++i) {
+            for (size_t ch = 0; ch < NUM_CHANNELS; ++ch) {
+                const int delta = current[ch] - previous_[ch];
+                out.push_back(static_cast<SAMPLE>(previous_[ch] + delta * static_cast<int>(i) / static_cast<int>(factor)));
+            }
+        }
+        std::copy(current, current + NUM_CHANNELS, previous_);
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Audio.hpp"
+
+// Кодеки медиа-канала. Байт codec в заголовке пакета: младшие 4 бита -
+// CodecId, биты 4-5 - степень двойки прореживания относительно SAMPLE_RATE.
+enum class CodecId : uint8_t {
+    Pcm16 = 0,
+    MuLaw = 1,
+};
+
+struct CodecConfig {
+    CodecId id{CodecId::Pcm16};
+    uint8_t decimation_shift{0};
+
+    uint8_t ToByte() const noexcept { return static_cast<uint8_t>(id) | static_cast<uint8_t>(decimation_shift << 4); }
+    static CodecConfig FromByte(uint8_t value) noexcept {
+        return {static_cast<CodecId>(value & 0x0f), static_cast<uint8_t>((value >> 4) & 0x03)};
+    }
+    bool operator==(const CodecConfig&) const = default;
+
+    // Битрейт полезной нагрузки без заголовков
+    uint32_t PayloadBitrate() const noexcept;
+};
+
+// Кодирует frames кадров (по NUM_CHANNELS сэмплов) и дописывает в out
+void EncodeAudio(const SAMPLE* samples, size_t frames, CodecConfig config, std::vector<uint8_t>& out);
+
+// Декодер хранит последний сэмпл каждого канала, чтобы интерполяция
+// при повышении частоты не рвалась на границе пакетов
+class AudioDecoder {
+public:
+    // Дописывает в out сэмплы на полной частоте SAMPLE_RATE
+    bool Decode(const uint8_t* data, size_t size, CodecConfig config, std::vector<SAMPLE>& out);
+
+private:
+    SAMPLE previous_[NUM_CHANNELS]{};
+};
@@ -0,0 +1,182 @@
+#include "MediaKeySignaling.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "Endpoint.hpp"
+
+MediaKeySignaling::MediaKeySignaling(const sockaddr_in& server, std::string room, uint32_t ssrc, MediaKey key)
+    : server_(server), room_(std::move(room)), ssrc_(ssrc), key_line_(FormatKeyLine(ssrc, key)) {}
+
+MediaKeySignaling::~MediaKeySignaling() {
+    Stop();
+}
+
+void MediaKeySignaling::SetCallbacks(OnKey on_key, OnKeyRemoved on_key_removed) {
+    on_key_ = std::move(on_key);
+    on_key_removed_ = std::move(on_key_removed);
+}
+
+bool MediaKeySignaling::Start() {
+    socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_ < 0) {
+        std::cerr << "Failed to create signaling socket" << std::endl;
+        return false;
+    }
+    transport_ = std::make_unique<ReliableTransport>(socket_, [this](std::string_view message, const sockaddr_in& from) {
+        if (SameEndpoint(from, server_)) {
+            HandleMessage(message);
+        }
+    });
+
+    // hello всегда в JSON: кодировку сервера мы еще не знаем
+    SignalingMessage hello;
+    hello.type = SignalType::Hello;
+    hello.encoding = "binary";
+    transport_->Send(server_, EncodeJsonSignal(hello));
+
+    is_running_ = true;
+    thread_ = std::thread(&MediaKeySignaling::Loop, this);
+    return true;
+}
+
+void MediaKeySignaling::Stop() {
+    if (!is_running_) {
+        return;
+    }
+    is_running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    transport_.reset();
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+void MediaKeySignaling::Loop() {
+    while (is_running_) {
+        if (transport_->WaitReadable(std::chrono::milliseconds(100))) {
+            transport_->ReceiveAll();
+        }
+        transport_->Poll();
+    }
+
+    // Сессии на сервере не истекают: потерянный выход оставил бы нас в
+    // комнате. Ждем подтверждения с ретрансмитами, но не дольше kLeaveTimeout
+    if (!client_id_.empty()) {
+        SignalingMessage leave;
+        leave.type = SignalType::LeaveRoom;
+        Send(std::move(leave));
+        const auto deadline = std::chrono::steady_clock::now() + kLeaveTimeout;
+        transport_->Poll();
+        while (!transport_->Idle() && std::chrono::steady_clock::now() < deadline) {
+            if (transport_->WaitReadable(std::chrono::milliseconds(50))) {
+                transport_->ReceiveAll();
+            }
+            transport_->Poll();
+        }
+    }
+}
+
+void MediaKeySignaling::HandleMessage(std::string_view payload) {
+    SignalingMessage message;
+    if (!DecodeSignal(payload, message)) {
+        std::cerr << "Failed to parse signaling message" << std::endl;
+        return;
+    }
+
+    switch (message.type) {
+        case SignalType::ClientRegistered: {
+            client_id_ = message.client_id;
+            encoding_ = message.encoding == "binary" ? SignalEncoding::Binary : SignalEncoding::Json;
+            SignalingMessage join;
+            join.type = SignalType::JoinRoom;
+            join.room_id = room_;
+            Send(std::move(join));
+            // Транспорт сохраняет порядок: сервер разошлет ключ уже комнате
+            SendKey("");
+            std::cout << "Media keys: registered as " << client_id_ << ", room " << room_ << std::endl;
+            break;
+        }
+        case SignalType::MediaKey:
+            OnMediaKey(message);
+            break;
+        case SignalType::RosterDelta:
+            for (const auto& user : message.left) {
+                const auto it = peers_.find(user);
+                if (it == peers_.end()) {
+                    continue;
+                }
+                if (on_key_removed_) {
+                    on_key_removed_(it->second);
+                }
+                owners_.erase(it->second);
+                peers_.erase(it);
+            }
+            break;
+        case SignalType::Redirect:
+            // Кластер: комнату ведет другой узел, UDP клиент за ним не ходит
+            std::cerr << "Media keys: room " << room_ << " is served by " << message.address
+                      << ", pass that node to --signaling" << std::endl;
+            break;
+        default:
+            break;
+    }
+}
+
+void MediaKeySignaling::OnMediaKey(const SignalingMessage& message) {
+    uint32_t ssrc = 0;
+    MediaKey key;
+    if (!ParseKeyLine(message.sdp, ssrc, key)) {
+        std::cerr << "Media keys: malformed key from " << message.sender << std::endl;
+        return;
+    }
+    if (ssrc == ssrc_) {
+        return;
+    }
+    // Поток принадлежит первому, кто объявил его ключ: иначе участник
+    // комнаты подменил бы ключ чужого потока и говорил за него
+    if (const auto owner = owners_.find(ssrc); owner != owners_.end() && owner->second != message.sender) {
+        std::cerr << "Media keys: " << message.sender << " claims stream " << std::hex << ssrc << std::dec
+                  << " of " << owner->second << ", ignored" << std::endl;
+        return;
+    }
+
+    const auto it = peers_.find(message.sender);
+    const bool known = it != peers_.end() && it->second == ssrc;
+    if (it != peers_.end() && it->second != ssrc) {
+        owners_.erase(it->second);
+        if (on_key_removed_) {
+            on_key_removed_(it->second);
+        }
+    }
+    if (known) {
+        // Повтор того же ключа не должен сбрасывать окно повторов
+        return;
+    }
+    peers_[message.sender] = ssrc;
+    owners_[ssrc] = message.sender;
+    if (on_key_) {
+        on_key_(ssrc, key);
+    }
+    std::cout << "Media keys: " << CipherSuiteName(key.suite) << " key for stream " << std::hex << ssrc << std::dec
+              << " from " << message.sender << std::endl;
+    SendKey(message.sender);
+}
+
+void MediaKeySignaling::SendKey(const std::string& target) {
+    SignalingMessage message;
+    message.type = SignalType::MediaKey;
+    message.target = target;
+    message.sdp = key_line_;
+    Send(std::move(message));
+}
+
+void MediaKeySignaling::Send(SignalingMessage message) {
+    message.client_id = client_id_;
+    transport_->Send(server_, EncodeSignal(message, encoding_));
+}
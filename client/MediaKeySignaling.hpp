@@ -0,0 +1,72 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "MediaCrypto.hpp"
+#include "ReliableTransport.hpp"
+#include "SignalingProtocol.hpp"
+
+// Обмен ключами медиа-потоков UDP клиента через сигналинг сервер.
+//
+// Клиент регистрируется, входит в комнату и рассылает ей media_key со
+// строкой своего ключа. Участник, впервые получивший ключ от отправителя,
+// отвечает ему своим ключом адресно - так вошедший получает ключи тех,
+// кто был в комнате раньше, без хранения ключей на сервере. Выход
+// участника из комнаты (дельта состава) убирает его ключ. Поток (ssrc)
+// закрепляется за первым объявившим его участником до его выхода.
+//
+// Ключи защищены не лучше канала сигналинга: сервер и его сокет должны
+// быть доверенными (localhost, VPN или туннель).
+class MediaKeySignaling {
+public:
+    using OnKey = std::function<void(uint32_t ssrc, const MediaKey& key)>;
+    using OnKeyRemoved = std::function<void(uint32_t ssrc)>;
+
+    MediaKeySignaling(const sockaddr_in& server, std::string room, uint32_t ssrc, MediaKey key);
+    ~MediaKeySignaling();
+
+    // Колбэки вызываются из потока сигналинга; ставятся до Start
+    void SetCallbacks(OnKey on_key, OnKeyRemoved on_key_removed);
+
+    bool Start();
+    // Выходит из комнаты и ждет подтверждения сервера до kLeaveTimeout
+    void Stop();
+
+private:
+    static constexpr auto kLeaveTimeout = std::chrono::seconds(1);
+
+    const sockaddr_in server_;
+    const std::string room_;
+    const uint32_t ssrc_;
+    const std::string key_line_;
+    OnKey on_key_;
+    OnKeyRemoved on_key_removed_;
+
+    int socket_{-1};
+    std::unique_ptr<ReliableTransport> transport_;
+    std::atomic<bool> is_running_{false};
+    std::thread thread_;
+
+    // Дальше - только в потоке сигналинга
+    std::string client_id_;
+    SignalEncoding encoding_{SignalEncoding::Json};
+    // Отправитель -> ssrc его потока и обратно
+    std::unordered_map<std::string, uint32_t> peers_;
+    std::unordered_map<uint32_t, std::string> owners_;
+
+    void Loop();
+    void HandleMessage(std::string_view payload);
+    void OnMediaKey(const SignalingMessage& message);
+    void SendKey(const std::string& target);
+    void Send(SignalingMessage message);
+};
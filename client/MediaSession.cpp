@@ -0,0 +1,446 @@
+#include "MediaSession.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "Timeline.hpp"
+
+namespace {
+
+uint32_t NowMs(std::chrono::steady_clock::time_point now) {
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count()
+    );
+}
+
+uint32_t GenerateSsrc() {
+    static std::random_device rd;
+    static std::mt19937 gen(rd());
+    static std::uniform_int_distribution<uint32_t> dis(1, UINT32_MAX);
+    return dis(gen);
+}
+
+}  // namespace
+
+MediaSender::MediaSender(uint32_t ssrc, Transmit transmit)
+    : ssrc_(ssrc), transmit_(std::move(transmit)), profile_(controller_.Profile()) {}
+
+void MediaSender::OnCapturedFrame(const SAMPLE* samples, size_t count) {
+    const auto now = Clock::now();
+    pending_.insert(pending_.end(), samples, samples + count);
+
+    const size_t packet_frames = FRAMES_PER_BUFFER * profile_.frames_per_packet;
+    if (pending_.size() >= packet_frames * NUM_CHANNELS) {
+        SendAudioPacket(pending_.data(), packet_frames);
+        pending_.erase(pending_.begin(), pending_.begin() + packet_frames * NUM_CHANNELS);
+
+        // Новые решения контроллера применяем только на границе FEC-группы
+        if (fec_count_ == 0) {
+            profile_ = controller_.Profile();
+            fec_group_ = controller_.FecGroup();
+        }
+    }
+
+    MaybeSendSenderReport(now);
+}
+
+void MediaSender::OnReceiverReport(const ReceiverReport& report, Clock::time_point now) {
+    const double loss_fraction = report.fraction_lost / 256.0;
+    const double jitter_ms = report.jitter * 1000.0 / SAMPLE_RATE;
+
+    double rtt_ms = 0.0;
+    if (report.last_sr != 0) {
+        const uint32_t rtt = NowMs(now) - report.last_sr - report.delay_since_sr;
+        if (rtt < 60000) {
+            rtt_ms = rtt;
+        }
+    }
+
+    controller_.OnReport(report.reporter_ssrc, loss_fraction, jitter_ms, rtt_ms, now);
+}
+
+void MediaSender::SendAudioPacket(const SAMPLE* samples, size_t frames) {
+    MediaHeader header;
+    header.type = PacketType::Audio;
+    header.codec = profile_.codec.ToByte();
+    header.sequence = sequence_++;
+    header.timestamp = timestamp_;
+    header.ssrc = ssrc_;
+    timestamp_ += static_cast<uint32_t>(frames);
+
+    packet_.clear();
+    header.Serialize(packet_);
+    {
+        TimelineScope scope("media.encode", frames);
+        EncodeAudio(samples, frames, profile_.codec, packet_);
+    }
+    {
+        TimelineScope scope("media.send", header.sequence);
+        transmit_(packet_.data(), packet_.size());
+    }
+
+    ++packet_count_;
+    octet_count_ += static_cast<uint32_t>(packet_.size());
+
+    if (fec_group_ == 0) {
+        return;
+    }
+    if (fec_count_ == 0) {
+        fec_base_ = header.sequence;
+        fec_parity_.assign(packet_.size(), 0);
+    }
+    for (size_t i = 0; i < packet_.size(); ++i) {
+        fec_parity_[i] ^= packet_[i];
+    }
+    if (++fec_count_ == fec_group_) {
+        SendFecPacket();
+    }
+}
+
+void MediaSender::SendFecPacket() {
+    MediaHeader header;
+    header.type = PacketType::Fec;
+    header.codec = fec_count_;
+    header.sequence = fec_base_;
+    header.ssrc = ssrc_;
+
+    packet_.clear();
+    header.Serialize(packet_);
+    packet_.insert(packet_.end(), fec_parity_.begin(), fec_parity_.end());
+    TimelineScope scope("media.send_fec", fec_base_);
+    transmit_(packet_.data(), packet_.size());
+
+    fec_count_ = 0;
+}
+
+void MediaSender::MaybeSendSenderReport(Clock::time_point now) {
+    if (now - last_sender_report_ < std::chrono::seconds(1)) {
+        return;
+    }
+    last_sender_report_ = now;
+
+    SenderReport report;
+    report.ssrc = ssrc_;
+    report.send_time_ms = NowMs(now);
+    report.packet_count = packet_count_;
+    report.octet_count = octet_count_;
+
+    const auto bytes = report.Serialize();
+    transmit_(bytes.data(), bytes.size());
+}
+
+MediaReceiver::MediaReceiver(uint32_t local_ssrc) : local_ssrc_(local_ssrc) {}
+
+void MediaReceiver::OnMediaPacket(const uint8_t* data, size_t size, Clock::time_point now) {
+    MediaHeader header;
+    if (!MediaHeader::Parse(data, size, header)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stream = GetStream(header.ssrc, header.sequence);
+    stream.last_activity = now;
+
+    if (header.type == PacketType::Audio) {
+        const int64_t sequence = ExtendSequence(stream.max_sequence, header.sequence);
+        UpdateReception(stream, header, sequence, now);
+        if (sequence >= stream.next_sequence) {
+            stream.pending.emplace(sequence, std::vector<uint8_t>(data, data + size));
+        }
+    } else if (header.type == PacketType::Fec && header.codec > 0) {
+        stream.fec_group = header.codec;
+        const int64_t base = ExtendSequence(stream.max_sequence, header.sequence);
+        TryRecover(stream, base, header.codec, data + MediaHeader::kSize, size - MediaHeader::kSize);
+    }
+
+    Release(stream);
+}
+
+void MediaReceiver::OnSenderReport(const SenderReport& report, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = streams_.find(report.ssrc);
+    if (it != streams_.end()) {
+        it->second->last_sr = report.send_time_ms;
+        it->second->last_sr_arrival = now;
+    }
+}
+
+void MediaReceiver::Mix(SAMPLE* out, size_t count) {
+    TimelineScope scope("media.jitter_pop");
+    std::lock_guard<std::mutex> lock(mutex_);
+    scope.SetArg(streams_.size());
+
+    std::fill(out, out + count, 0);
+    mix_buffer_.resize(count);
+    for (auto& [ssrc, stream] : streams_) {
+        if (!stream->playout.Pop(mix_buffer_.data(), count)) {
+            Timeline::Instant("media.underrun", ssrc);
+            continue;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const int sum = out[i] + mix_buffer_[i];
+            out[i] = static_cast<SAMPLE>(std::clamp(sum, -32768, 32767));
+        }
+    }
+}
+
+std::vector<ReceiverReport> MediaReceiver::BuildReports(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::erase_if(streams_, [&](const auto& item) { return now - item.second->last_activity > kStreamTimeout; });
+
+    std::vector<ReceiverReport> reports;
+    reports.reserve(streams_.size());
+    for (auto& [ssrc, stream] : streams_) {
+        // Подсчет потерь как в RFC 3550, A.3
+        const uint64_t expected = static_cast<uint64_t>(stream->max_sequence - stream->base_sequence + 1);
+        const uint64_t expected_interval = expected - stream->expected_prior;
+        const uint64_t received_interval = stream->received - stream->received_prior;
+        stream->expected_prior = expected;
+        stream->received_prior = stream->received;
+
+        if (expected_interval == 0 || received_interval >= expected_interval) {
+            stream->fraction_lost = 0;
+        } else {
+            stream->fraction_lost =
+                static_cast<uint8_t>(((expected_interval - received_interval) << 8) / expected_interval);
+        }
+
+        ReceiverReport report;
+        report.reporter_ssrc = local_ssrc_;
+        report.media_ssrc = ssrc;
+        report.fraction_lost = stream->fraction_lost;
+        report.cumulative_lost = expected > stream->received ? static_cast<uint32_t>(expected - stream->received) : 0;
+        report.highest_sequence = static_cast<uint32_t>(stream->max_sequence);
+        report.jitter = static_cast<uint32_t>(stream->jitter);
+        if (stream->last_sr != 0) {
+            report.last_sr = stream->last_sr;
+            report.delay_since_sr = static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - stream->last_sr_arrival).count()
+            );
+        }
+        reports.push_back(report);
+    }
+    return reports;
+}
+
+std::vector<MediaReceiver::StreamStats> MediaReceiver::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<StreamStats> stats;
+    stats.reserve(streams_.size());
+    for (const auto& [ssrc, stream] : streams_) {
+        stats.push_back(StreamStats{
+            ssrc,
+            stream->fraction_lost / 256.0,
+            stream->jitter * 1000.0 / SAMPLE_RATE,
+            stream->received,
+            stream->recovered,
+            stream->concealed,
+            stream->playout.GetStats(),
+        });
+    }
+    return stats;
+}
+
+MediaReceiver::Stream& MediaReceiver::GetStream(uint32_t ssrc, uint16_t sequence) {
+    auto& stream = streams_[ssrc];
+    if (!stream) {
+        stream = std::make_unique<Stream>();
+        stream->base_sequence = stream->max_sequence = stream->next_sequence = sequence;
+    }
+    return *stream;
+}
+
+int64_t MediaReceiver::ExtendSequence(int64_t reference, uint16_t sequence) {
+    // Ближайшее к reference значение с такими же младшими 16 битами
+    int64_t extended = (reference & ~int64_t{0xffff}) | sequence;
+    if (extended > reference + 0x8000) {
+        extended -= 0x10000;
+    } else if (extended + 0x8000 < reference) {
+        extended += 0x10000;
+    }
+    return extended;
+}
+
+void MediaReceiver::UpdateReception(
+    Stream& stream,
+    const MediaHeader& header,
+    int64_t sequence,
+    Clock::time_point now
+) {
+    stream.max_sequence = std::max(stream.max_sequence, sequence);
+    ++stream.received;
+
+    // Межпакетный джиттер по RFC 3550, в сэмплах
+    const double arrival = std::chrono::duration<double>(now.time_since_epoch()).count() * SAMPLE_RATE;
+    const double transit = arrival - header.timestamp;
+    if (stream.have_transit) {
+        const double d = std::abs(transit - stream.last_transit);
+        stream.jitter += (d - stream.jitter) / 16.0;
+    }
+    stream.last_transit = transit;
+    stream.have_transit = true;
+}
+
+void MediaReceiver::TryRecover(Stream& stream, int64_t base, uint8_t count, const uint8_t* parity, size_t size) {
+    int64_t missing = -1;
+    for (int64_t sequence = base; sequence < base + count; ++sequence) {
+        if (stream.pending.count(sequence) == 0 && stream.history.count(sequence) == 0) {
+            if (missing >= 0) {
+                return;  // XOR восстанавливает не больше одной потери на группу
+            }
+            missing = sequence;
+        }
+    }
+    if (missing < stream.next_sequence) {
+        return;
+    }
+
+    std::vector<uint8_t> recovered(parity, parity + size);
+    for (int64_t sequence = base; sequence < base + count; ++sequence) {
+        if (sequence == missing) {
+            continue;
+        }
+        auto it = stream.pending.find(sequence);
+        const auto& packet = it != stream.pending.end() ? it->second : stream.history.at(sequence);
+        if (packet.size() != size) {
+            return;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            recovered[i] ^= packet[i];
+        }
+    }
+
+    stream.pending.emplace(missing, std::move(recovered));
+    ++stream.recovered;
+}
+
+void MediaReceiver::Release(Stream& stream) {
+    while (!stream.pending.empty()) {
+        auto it = stream.pending.begin();
+        if (it->first == stream.next_sequence) {
+            Play(stream, it->second);
+            stream.history.insert(stream.pending.extract(it));
+            ++stream.next_sequence;
+            continue;
+        }
+
+        // Дыра: ждем переупорядоченный пакет или FEC, пока очередь не
+        // уйдет дальше, чем на размер FEC-группы
+        const int64_t depth = stream.pending.rbegin()->first - stream.next_sequence;
+        if (depth < ReorderWait(stream)) {
+            break;
+        }
+        if (it->first - stream.next_sequence > kMaxConcealedGap) {
+            stream.next_sequence = it->first;
+            continue;
+        }
+        Conceal(stream);
+        ++stream.next_sequence;
+    }
+
+    while (stream.history.size() > kHistorySize) {
+        stream.history.erase(stream.history.begin());
+    }
+}
+
+void MediaReceiver::Play(Stream& stream, const std::vector<uint8_t>& packet) {
+    MediaHeader header;
+    if (!MediaHeader::Parse(packet.data(), packet.size(), header)) {
+        return;
+    }
+
+    stream.decoded.clear();
+    const auto config = CodecConfig::FromByte(header.codec);
+    if (!stream.decoder.Decode(
+            packet.data() + MediaHeader::kSize, packet.size() - MediaHeader::kSize, config, stream.decoded
+        )) {
+        return;
+    }
+
+    stream.playout.Push(stream.decoded.data(), stream.decoded.size());
+    stream.last_frame = stream.decoded;
+
+    // Пока ждем потерянный пакет, вывод не должен голодать
+    const size_t packet_frames = stream.decoded.size() / NUM_CHANNELS;
+    stream.playout.SetTargetFloor((ReorderWait(stream) + 1) * packet_frames);
+}
+
+int64_t MediaReceiver::ReorderWait(const Stream& stream) {
+    return stream.fec_group > 0 ? stream.fec_group + 1 : kReorderDepth;
+}
+
+void MediaReceiver::Conceal(Stream& stream) {
+    // Повторяем последний кадр с затуханием, чтобы серия потерь сходила на нет
+    if (stream.last_frame.empty()) {
+        return;
+    }
+    Timeline::Instant("media.conceal", static_cast<uint64_t>(stream.next_sequence));
+    for (auto& sample : stream.last_frame) {
+        sample = static_cast<SAMPLE>(sample / 2);
+    }
+    stream.playout.Push(stream.last_frame.data(), stream.last_frame.size());
+    ++stream.concealed;
+}
+
+MediaSession::MediaSession(Transmit transmit)
+    : transmit_(std::move(transmit)), sender_(GenerateSsrc(), transmit_), receiver_(sender_.Ssrc()) {}
+
+void MediaSession::OnCapturedFrame(const SAMPLE* samples, size_t count) {
+    sender_.OnCapturedFrame(samples, count);
+
+    const auto now = Clock::now();
+    if (now - last_reports_ < kReportInterval) {
+        return;
+    }
+    last_reports_ = now;
+
+    for (const auto& report : receiver_.BuildReports(now)) {
+        const auto bytes = report.Serialize();
+        transmit_(bytes.data(), bytes.size());
+    }
+}
+
+void MediaSession::OnDatagram(const uint8_t* data, size_t size) {
+    TimelineScope scope("media.receive", size);
+    PacketType type;
+    if (!PeekPacketType(data, size, type)) {
+        return;
+    }
+
+    const auto now = Clock::now();
+    switch (type) {
+        case PacketType::Audio:
+        case PacketType::Fec:
+            receiver_.OnMediaPacket(data, size, now);
+            break;
+        case PacketType::SenderReport: {
+            SenderReport report;
+            if (SenderReport::Parse(data, size, report)) {
+                receiver_.OnSenderReport(report, now);
+            }
+            break;
+        }
+        case PacketType::ReceiverReport: {
+            // Ретранслятор рассылает отчеты всем участникам - берем только свои
+            ReceiverReport report;
+            if (ReceiverReport::Parse(data, size, report) && report.media_ssrc == sender_.Ssrc()) {
+                sender_.OnReceiverReport(report, now);
+            }
+            break;
+        }
+        case PacketType::Bundle:
+            // Клиент с шифрованием разбирает пачки сам, до проверки кадров
+            ForEachBundled(data, size,
+                           [this](const uint8_t* frame, size_t frame_size) { OnDatagram(frame, frame_size); });
+            break;
+    }
+}
+
+void MediaSession::Mix(SAMPLE* out, size_t count) { receiver_.Mix(out, count); }
+
+MediaSession::Stats MediaSession::GetStats() const {
+    return Stats{sender_.Ssrc(), sender_.GetControllerState(), receiver_.GetStats()};
+}
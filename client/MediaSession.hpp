@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "MediaCodec.hpp"
+#include "MediaPacket.hpp"
+#include "PlayoutBuffer.hpp"
+#include "RateController.hpp"
+
+// Отправляющая половина медиа-сессии: кодирование, нумерация, FEC и SR
+class MediaSender {
+public:
+    using Transmit = std::function<void(const uint8_t*, size_t)>;
+    using Clock = std::chrono::steady_clock;
+
+    MediaSender(uint32_t ssrc, Transmit transmit);
+
+    // Вызывается потоком захвата на каждый буфер из count сэмплов
+    void OnCapturedFrame(const SAMPLE* samples, size_t count);
+    // Вызывается сетевым потоком
+    void OnReceiverReport(const ReceiverReport& report, Clock::time_point now);
+
+    uint32_t Ssrc() const noexcept { return ssrc_; }
+    RateController::State GetControllerState() const { return controller_.GetState(); }
+
+private:
+    const uint32_t ssrc_;
+    Transmit transmit_;
+    RateController controller_;
+
+    uint16_t sequence_{0};
+    uint32_t timestamp_{0};
+    MediaProfile profile_;
+    std::vector<SAMPLE> pending_;
+    std::vector<uint8_t> packet_;
+
+    // Текущая FEC-группа: XOR пакетов одинаковой длины, профиль внутри
+    // группы не меняется
+    uint8_t fec_group_{0};
+    uint8_t fec_count_{0};
+    uint16_t fec_base_{0};
+    std::vector<uint8_t> fec_parity_;
+
+    uint32_t packet_count_{0};
+    uint32_t octet_count_{0};
+    Clock::time_point last_sender_report_{};
+
+    void SendAudioPacket(const SAMPLE* samples, size_t frames);
+    void SendFecPacket();
+    void MaybeSendSenderReport(Clock::time_point now);
+};
+
+// Принимающая половина: статистика по потокам, восстановление по FEC,
+// упорядочивание, маскировка потерь и свой PlayoutBuffer на каждый поток
+class MediaReceiver {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct StreamStats {
+        uint32_t ssrc;
+        double loss_fraction;
+        double jitter_ms;
+        uint64_t received;
+        uint64_t recovered;
+        uint64_t concealed;
+        PlayoutBuffer::Stats playout;
+    };
+
+    explicit MediaReceiver(uint32_t local_ssrc);
+
+    // Audio и Fec пакеты
+    void OnMediaPacket(const uint8_t* data, size_t size, Clock::time_point now);
+    void OnSenderReport(const SenderReport& report, Clock::time_point now);
+
+    // Смешивает все активные потоки в out
+    void Mix(SAMPLE* out, size_t count);
+
+    std::vector<ReceiverReport> BuildReports(Clock::time_point now);
+    std::vector<StreamStats> GetStats() const;
+
+private:
+    static constexpr int64_t kReorderDepth = 3;
+    static constexpr int64_t kMaxConcealedGap = 50;
+    static constexpr size_t kHistorySize = 32;
+    static constexpr auto kStreamTimeout = std::chrono::seconds(5);
+
+    struct Stream {
+        PlayoutBuffer playout;
+        AudioDecoder decoder;
+        std::vector<SAMPLE> decoded;
+        std::vector<SAMPLE> last_frame;
+
+        // Расширенные (без переполнения) номера последовательности
+        int64_t base_sequence{0};
+        int64_t max_sequence{0};
+        int64_t next_sequence{0};
+        std::map<int64_t, std::vector<uint8_t>> pending;
+        std::map<int64_t, std::vector<uint8_t>> history;
+        uint8_t fec_group{0};
+
+        uint64_t received{0};
+        uint64_t recovered{0};
+        uint64_t concealed{0};
+        uint64_t expected_prior{0};
+        uint64_t received_prior{0};
+        uint8_t fraction_lost{0};
+
+        double jitter{0.0};
+        double last_transit{0.0};
+        bool have_transit{false};
+
+        uint32_t last_sr{0};
+        Clock::time_point last_sr_arrival{};
+        Clock::time_point last_activity{};
+    };
+
+    const uint32_t local_ssrc_;
+    mutable std::mutex mutex_;
+    std::unordered_map<uint32_t, std::unique_ptr<Stream>> streams_;
+    std::vector<SAMPLE> mix_buffer_;
+
+    Stream& GetStream(uint32_t ssrc, uint16_t sequence);
+    static int64_t ExtendSequence(int64_t reference, uint16_t sequence);
+    void UpdateReception(Stream& stream, const MediaHeader& header, int64_t sequence, Clock::time_point now);
+    void TryRecover(Stream& stream, int64_t base, uint8_t count, const uint8_t* parity, size_t size);
+    static int64_t ReorderWait(const Stream& stream);
+    void Release(Stream& stream);
+    void Play(Stream& stream, const std::vector<uint8_t>& packet);
+    void Conceal(Stream& stream);
+};
+
+// Медиа-сессия клиента поверх любого транспорта датаграмм:
+// UDP-сокета в client/main.cpp или аудио-трека в WebRTCAudio
+class MediaSession {
+public:
+    using Transmit = MediaSender::Transmit;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint32_t ssrc;
+        RateController::State controller;
+        std::vector<MediaReceiver::StreamStats> streams;
+    };
+
+    explicit MediaSession(Transmit transmit);
+
+    void OnCapturedFrame(const SAMPLE* samples, size_t count);
+    void OnDatagram(const uint8_t* data, size_t size);
+    void Mix(SAMPLE* out, size_t count);
+
+    Stats GetStats() const;
+
+private:
+    static constexpr auto kReportInterval = std::chrono::seconds(1);
+
+    Transmit transmit_;
+    MediaSender sender_;
+    MediaReceiver receiver_;
+    Clock::time_point last_reports_{};
+};
@@ -0,0 +1,196 @@
+#include "PlayoutBuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+void DriftEstimator::OnReceived(size_t frames, Clock::time_point now) {
+    received_frames_ += frames;
+    TakeSnapshot(now);
+}
+
+void DriftEstimator::OnPlayed(size_t frames, Clock::time_point now) {
+    played_frames_ += frames;
+    TakeSnapshot(now);
+}
+
+void DriftEstimator::TakeSnapshot(Clock::time_point now) {
+    if (history_size_ > 0 && now - last_snapshot_ < std::chrono::seconds(1)) {
+        return;
+    }
+    last_snapshot_ = now;
+
+    // Кольцевой буфер снимков за последние kWindowSeconds секунд
+    if (history_size_ < kWindowSeconds) {
+        history_[(history_head_ + history_size_) % kWindowSeconds] = {now, received_frames_, played_frames_};
+        ++history_size_;
+    } else {
+        history_[history_head_] = {now, received_frames_, played_frames_};
+        history_head_ = (history_head_ + 1) % kWindowSeconds;
+    }
+
+    const auto& oldest = history_[history_head_];
+    const auto& newest = history_[(history_head_ + history_size_ - 1) % kWindowSeconds];
+    if (newest.time - oldest.time < std::chrono::seconds(kMinWindowSeconds)) {
+        return;
+    }
+
+    const double received = static_cast<double>(newest.received - oldest.received);
+    const double played = static_cast<double>(newest.played - oldest.played);
+    if (played <= 0.0) {
+        return;
+    }
+
+    // Отклонение больше процента - это не дрейф кварца, а пауза в потоке:
+    // начинаем окно заново
+    const double ratio = received / played;
+    if (std::abs(ratio - 1.0) > 0.01) {
+        history_head_ = (history_head_ + history_size_ - 1) % kWindowSeconds;
+        history_size_ = 1;
+        return;
+    }
+
+    const double ppm = (ratio - 1.0) * 1e6;
+    drift_ppm_ = valid_ ? drift_ppm_ + 0.1 * (ppm - drift_ppm_) : ppm;
+    valid_ = true;
+}
+
+PlayoutBuffer::PlayoutBuffer(size_t target_buffers, size_t max_buffers)
+    : target_frames_(target_buffers * FRAMES_PER_BUFFER), max_frames_(max_buffers * FRAMES_PER_BUFFER) {}
+
+void PlayoutBuffer::Push(const SAMPLE* samples, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    queue_.insert(queue_.end(), samples, samples + count);
+    estimator_.OnReceived(count / NUM_CHANNELS, Clock::now());
+
+    // Переполнение: отбрасываем самое старое до целевого уровня
+    if (QueuedFrames() > std::max(max_frames_, 2 * TargetFrames())) {
+        const size_t drop = QueuedFrames() - TargetFrames();
+        queue_.erase(queue_.begin(), queue_.begin() + drop * NUM_CHANNELS);
+        dropped_frames_ += drop;
+        ++overflows_;
+        phase_ = 0.0;
+    }
+}
+
+bool PlayoutBuffer::Pop(SAMPLE* out, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const size_t frames = count / NUM_CHANNELS;
+    const auto now = Clock::now();
+
+    // После старта или опустошения ждем накопления целевого уровня,
+    // иначе каждое следующее чтение снова будет голодать
+    if (!primed_) {
+        if (QueuedFrames() < TargetFrames()) {
+            std::fill(out, out + count, 0);
+            return false;
+        }
+        primed_ = true;
+        last_pop_ = now;
+    }
+
+    estimator_.OnPlayed(frames, now);
+    UpdateCorrection(now);
+    SlipOnQuiet(frames);
+
+    const double ratio = 1.0 + correction_ppm_ * 1e-6;
+    const double end = phase_ + frames * ratio;
+    const size_t consumed = static_cast<size_t>(end);
+
+    // Последняя позиция при замедлении (ratio < 1) может попасть в кадр
+    // consumed, а интерполяции нужен и следующий за ней
+    if (QueuedFrames() < consumed + 2) {
+        const size_t available = std::min(queue_.size(), count);
+        std::copy(queue_.begin(), queue_.begin() + available, out);
+        std::fill(out + available, out + count, 0);
+        queue_.clear();
+        phase_ = 0.0;
+        primed_ = false;
+        ++underruns_;
+        return false;
+    }
+
+    // Линейная интерполяция с дробным шагом чтения
+    for (size_t i = 0; i < frames; ++i) {
+        const double pos = phase_ + i * ratio;
+        const size_t index = static_cast<size_t>(pos);
+        const double frac = pos - index;
+        for (size_t ch = 0; ch < NUM_CHANNELS; ++ch) {
+            const double a = queue_[index * NUM_CHANNELS + ch];
+            const double b = queue_[(index + 1) * NUM_CHANNELS + ch];
+            out[i * NUM_CHANNELS + ch] = static_cast<SAMPLE>(std::lround(a + (b - a) * frac));
+        }
+    }
+
+    queue_.erase(queue_.begin(), queue_.begin() + consumed * NUM_CHANNELS);
+    phase_ = end - consumed;
+    return true;
+}
+
+void PlayoutBuffer::SetTargetFloor(size_t frames) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    target_floor_ = frames;
+}
+
+PlayoutBuffer::Stats PlayoutBuffer::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Stats{
+        estimator_.DriftPpm(),
+        correction_ppm_,
+        fill_avg_ / FRAMES_PER_BUFFER,
+        underruns_,
+        overflows_,
+        inserted_frames_,
+        dropped_frames_,
+    };
+}
+
+void PlayoutBuffer::UpdateCorrection(Clock::time_point now) {
+    const double dt = std::chrono::duration<double>(now - last_pop_).count();
+    last_pop_ = now;
+
+    const double fill = static_cast<double>(QueuedFrames());
+    fill_avg_ = fill_avg_ == 0.0 ? fill : fill_avg_ + kFillSmoothing * (fill - fill_avg_);
+
+    // ПИ-регулятор по уровню заполнения поверх оценки дрейфа по времени
+    const double target = static_cast<double>(TargetFrames());
+    const double error = (fill_avg_ - target) / target;
+    integral_ppm_ = std::clamp(integral_ppm_ + kIntegralPpmPerSecond * error * dt, -kMaxIntegralPpm, kMaxIntegralPpm);
+
+    const double feed_forward = estimator_.IsValid() ? estimator_.DriftPpm() : 0.0;
+    correction_ppm_ =
+        std::clamp(feed_forward + kProportionalPpm * error + integral_ppm_, -kMaxCorrectionPpm, kMaxCorrectionPpm);
+}
+
+void PlayoutBuffer::SlipOnQuiet(size_t frames) {
+    // Ресемплинг в сотни ppm не догонит всплеск в несколько буферов,
+    // поэтому такие отклонения убираем на тихих участках, где это неслышно
+    const size_t fill = QueuedFrames();
+    const size_t target = TargetFrames();
+    const size_t slip = frames / 8;
+    if (slip == 0 || !IsQuiet(frames)) {
+        return;
+    }
+
+    if (fill > target + target / 2) {
+        queue_.erase(queue_.begin(), queue_.begin() + slip * NUM_CHANNELS);
+        dropped_frames_ += slip;
+    } else if (fill < target / 2 && fill >= slip) {
+        const std::vector<SAMPLE> head(queue_.begin(), queue_.begin() + slip * NUM_CHANNELS);
+        queue_.insert(queue_.begin(), head.begin(), head.end());
+        inserted_frames_ += slip;
+    }
+}
+
+bool PlayoutBuffer::IsQuiet(size_t frames) const {
+    const size_t samples = std::min(queue_.size(), frames * NUM_CHANNELS);
+    for (size_t i = 0; i < samples; ++i) {
+        if (std::abs(queue_[i]) > kQuietLevel) {
+            return false;
+        }
+    }
+    return true;
+}
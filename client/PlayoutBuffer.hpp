@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "Audio.hpp"
+
+// Оценка дрейфа часов отправителя относительно часов устройства вывода.
+// Обе скорости (принятые и проигранные кадры) меряются по одним локальным
+// steady_clock часам на длинном окне, поэтому сетевой джиттер усредняется.
+class DriftEstimator {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void OnReceived(size_t frames, Clock::time_point now);
+    void OnPlayed(size_t frames, Clock::time_point now);
+
+    // Отношение скорости отправителя к скорости устройства минус единица, в ppm
+    double DriftPpm() const noexcept { return drift_ppm_; }
+    bool IsValid() const noexcept { return valid_; }
+
+private:
+    static constexpr int kWindowSeconds = 60;
+    static constexpr int kMinWindowSeconds = 10;
+
+    struct Snapshot {
+        Clock::time_point time;
+        uint64_t received;
+        uint64_t played;
+    };
+
+    uint64_t received_frames_{0};
+    uint64_t played_frames_{0};
+    Snapshot history_[kWindowSeconds];
+    size_t history_size_{0};
+    size_t history_head_{0};
+    Clock::time_point last_snapshot_{};
+    double drift_ppm_{0.0};
+    bool valid_{false};
+
+    void TakeSnapshot(Clock::time_point now);
+};
+
+// Очередь воспроизведения между сетевым потоком и потоком вывода.
+// Держит уровень заполнения около целевого: медленный дрейф убирается
+// адаптивным ресемплингом (десятки ppm), а крупные отклонения после
+// сетевых всплесков - вставкой/удалением кадров на тихих участках.
+class PlayoutBuffer {
+public:
+    struct Stats {
+        double drift_ppm;       // оценка дрейфа по временным меткам
+        double correction_ppm;  // итоговая поправка ресемплера
+        double fill_frames;     // сглаженный уровень заполнения, в буферах
+        uint64_t underruns;
+        uint64_t overflows;
+        uint64_t inserted_frames;
+        uint64_t dropped_frames;
+    };
+
+    explicit PlayoutBuffer(size_t target_buffers = 4, size_t max_buffers = 32);
+
+    // Вызывается сетевым потоком; count - число сэмплов (с учетом каналов)
+    void Push(const SAMPLE* samples, size_t count);
+    // Вызывается потоком вывода; всегда заполняет out целиком.
+    // Возвращает false, если пришлось отдать тишину.
+    bool Pop(SAMPLE* out, size_t count);
+
+    // Нижняя граница целевого уровня от владельца буфера: запас должен
+    // перекрывать ожидание переупорядоченных пакетов и FEC
+    void SetTargetFloor(size_t frames);
+
+    Stats GetStats() const;
+
+private:
+    using Clock = DriftEstimator::Clock;
+
+    static constexpr double kMaxCorrectionPpm = 500.0;
+    static constexpr double kMaxIntegralPpm = 200.0;
+    static constexpr double kProportionalPpm = 100.0;
+    static constexpr double kIntegralPpmPerSecond = 2.0;
+    static constexpr double kFillSmoothing = 0.002;
+    static constexpr SAMPLE kQuietLevel = 500;
+
+    const size_t target_frames_;
+    const size_t max_frames_;
+    size_t target_floor_{0};
+
+    mutable std::mutex mutex_;
+    std::deque<SAMPLE> queue_;
+    DriftEstimator estimator_;
+
+    bool primed_{false};
+    double phase_{0.0};
+    double fill_avg_{0.0};
+    double integral_ppm_{0.0};
+    double correction_ppm_{0.0};
+    Clock::time_point last_pop_{};
+
+    uint64_t underruns_{0};
+    uint64_t overflows_{0};
+    uint64_t inserted_frames_{0};
+    uint64_t dropped_frames_{0};
+
+    size_t QueuedFrames() const noexcept { return queue_.size() / NUM_CHANNELS; }
+    size_t TargetFrames() const noexcept { return std::max(target_frames_, target_floor_); }
+    void UpdateCorrection(Clock::time_point now);
+    void SlipOnQuiet(size_t frames);
+    bool IsQuiet(size_t frames) const;
+};
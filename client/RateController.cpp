@@ -0,0 +1,139 @@
+#include "RateController.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include "MediaPacket.hpp"
+
+namespace {
+
+// От лучшего качества к худшему; нижние ступени заодно укрупняют пакеты,
+// чтобы на перегруженном канале меньше платить за заголовки
+constexpr MediaProfile kLadder[] = {
+    {{CodecId::Pcm16, 0}, 1},
+    {{CodecId::Pcm16, 1}, 1},
+    {{CodecId::MuLaw, 1}, 2},
+    {{CodecId::MuLaw, 2}, 2},
+    {{CodecId::MuLaw, 2}, 4},
+};
+constexpr size_t kLevels = std::size(kLadder);
+
+// IPv4 + UDP
+constexpr uint32_t kTransportOverhead = 28;
+
+}  // namespace
+
+RateController::RateController() = default;
+
+void RateController::OnReport(
+    uint32_t reporter,
+    double loss_fraction,
+    double jitter_ms,
+    double rtt_ms,
+    Clock::time_point now
+) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reports_[reporter] = {loss_fraction, jitter_ms, rtt_ms, now};
+    Evaluate(now);
+}
+
+MediaProfile RateController::Profile() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return kLadder[level_];
+}
+
+uint8_t RateController::FecGroup() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fec_group_;
+}
+
+RateController::State RateController::GetState() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto& profile = kLadder[level_];
+    const double packets_per_second =
+        static_cast<double>(SAMPLE_RATE) / (FRAMES_PER_BUFFER * profile.frames_per_packet);
+    double bitrate =
+        profile.codec.PayloadBitrate() + packets_per_second * (kTransportOverhead + MediaHeader::kSize) * 8;
+    if (fec_group_ > 0) {
+        bitrate *= 1.0 + 1.0 / fec_group_;
+    }
+
+    return State{
+        level_,
+        static_cast<uint32_t>(bitrate),
+        profile.frames_per_packet,
+        fec_group_,
+        loss_fraction_,
+        jitter_ms_,
+        rtt_ms_,
+        reports_.size(),
+        changes_,
+    };
+}
+
+void RateController::Evaluate(Clock::time_point now) {
+    std::erase_if(reports_, [&](const auto& item) { return now - item.second.time > kReportTimeout; });
+    if (reports_.empty()) {
+        return;
+    }
+
+    // В групповом звонке ориентируемся на худшего получателя
+    double loss = 0.0;
+    double jitter = 0.0;
+    double rtt = 0.0;
+    for (const auto& [reporter, report] : reports_) {
+        loss = std::max(loss, report.loss_fraction);
+        jitter = std::max(jitter, report.jitter_ms);
+        rtt = std::max(rtt, report.rtt_ms);
+    }
+    loss_fraction_ += 0.5 * (loss - loss_fraction_);
+    jitter_ms_ = jitter;
+    rtt_ms_ = rtt;
+
+    const bool congested = loss_fraction_ > kLossDown || jitter_ms_ > kJitterDownMs;
+    const bool clear = loss_fraction_ < kLossUp && jitter_ms_ < kJitterUpMs;
+
+    if (congested) {
+        last_congestion_ = now;
+        if (level_ + 1 < kLevels && now - last_change_ >= kMinChangeInterval) {
+            // Проба вверх не удалась - в следующий раз ждем дольше
+            if (last_step_up_ && now - last_change_ < probe_interval_) {
+                probe_interval_ = std::min<Clock::duration>(probe_interval_ * 2, kMaxProbeInterval);
+            }
+            ++level_;
+            ++changes_;
+            last_change_ = now;
+            last_step_up_ = false;
+        }
+    } else if (clear && level_ > 0 && now - last_change_ >= probe_interval_ &&
+               now - last_congestion_ >= probe_interval_) {
+        if (last_step_up_) {
+            probe_interval_ = kMinProbeInterval;
+        }
+        --level_;
+        ++changes_;
+        last_change_ = now;
+        last_step_up_ = true;
+    }
+
+    const uint8_t fec_group = FecGroupForLoss(loss_fraction_);
+    if (fec_group != fec_group_ && now - last_fec_change_ >= kMinChangeInterval) {
+        fec_group_ = fec_group;
+        ++changes_;
+        last_fec_change_ = now;
+    }
+}
+
+uint8_t RateController::FecGroupForLoss(double loss_fraction) {
+    if (loss_fraction < 0.01) {
+        return 0;
+    }
+    if (loss_fraction < 0.05) {
+        return 8;
+    }
+    if (loss_fraction < 0.15) {
+        return 4;
+    }
+    return 2;
+}
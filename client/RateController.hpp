@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "MediaCodec.hpp"
+
+// Профиль отправки: кодек и длительность пакета в буферах FRAMES_PER_BUFFER
+struct MediaProfile {
+    CodecConfig codec;
+    uint8_t frames_per_packet;
+};
+
+// Контроллер битрейта отправителя по отчетам получателей.
+// Идет по лестнице профилей вниз при потерях/джиттере и осторожно
+// возвращается вверх; избыточность FEC выбирается по доле потерь.
+class RateController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct State {
+        size_t level;
+        uint32_t bitrate_bps;  // с заголовками IP/UDP и FEC
+        uint8_t frames_per_packet;
+        uint8_t fec_group;     // 0 - FEC выключен, иначе 1 паритет на N пакетов
+        double loss_fraction;
+        double jitter_ms;
+        double rtt_ms;
+        size_t reporters;
+        uint64_t changes;
+    };
+
+    RateController();
+
+    void OnReport(uint32_t reporter, double loss_fraction, double jitter_ms, double rtt_ms, Clock::time_point now);
+
+    MediaProfile Profile() const;
+    uint8_t FecGroup() const;
+    State GetState() const;
+
+private:
+    static constexpr auto kReportTimeout = std::chrono::seconds(5);
+    static constexpr auto kMinChangeInterval = std::chrono::seconds(2);
+    static constexpr auto kMinProbeInterval = std::chrono::seconds(10);
+    static constexpr auto kMaxProbeInterval = std::chrono::seconds(60);
+    static constexpr double kLossDown = 0.10;
+    static constexpr double kLossUp = 0.02;
+    static constexpr double kJitterDownMs = 60.0;
+    static constexpr double kJitterUpMs = 20.0;
+
+    struct Report {
+        double loss_fraction;
+        double jitter_ms;
+        double rtt_ms;
+        Clock::time_point time;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uint32_t, Report> reports_;
+
+    size_t level_{0};
+    uint8_t fec_group_{0};
+    double loss_fraction_{0.0};
+    double jitter_ms_{0.0};
+    double rtt_ms_{0.0};
+    uint64_t changes_{0};
+    Clock::time_point last_change_{};
+    Clock::time_point last_fec_change_{};
+    Clock::time_point last_congestion_{};
+    bool last_step_up_{false};
+    Clock::duration probe_interval_{kMinProbeInterval};
+
+    void Evaluate(Clock::time_point now);
+    static uint8_t FecGroupForLoss(double loss_fraction);
+};
@@ -0,0 +1,202 @@
+#include "RealtimeThread.hpp"
+#include "Timeline.hpp"
+
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+std::vector<int> ParseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const auto dash = item.find('-');
+        if (dash == std::string::npos) {
+            cpus.push_back(std::atoi(item.c_str()));
+            continue;
+        }
+        // Диапазон вида 2-5
+        const int first = std::atoi(item.substr(0, dash).c_str());
+        const int last = std::atoi(item.substr(dash + 1).c_str());
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// Касается каждой страницы стека ниже текущей глубины, чтобы они были
+// отображены (и при mlockall(MCL_FUTURE) закреплены) до первого цикла
+void PrefaultStack(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    volatile unsigned char* stack = static_cast<unsigned char*>(alloca(bytes));
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for (size_t offset = 0; offset < bytes; offset += page) {
+        stack[offset] = 0;
+    }
+}
+
+}  // namespace
+
+bool ParseRealtimeArg(int& index, int argc, char* argv[], RealtimeConfig& config) {
+    const std::string arg = argv[index];
+    const bool has_value = index + 1 < argc;
+
+    if (arg == "--rt") {
+        config.enabled = true;
+    } else if (arg == "--rt-policy" && has_value) {
+        const std::string policy = argv[++index];
+        config.policy = policy == "rr" ? SCHED_RR : SCHED_FIFO;
+        config.enabled = true;
+    } else if (arg == "--rt-priority" && has_value) {
+        config.priority = std::atoi(argv[++index]);
+        config.enabled = true;
+    } else if (arg == "--rt-cpus" && has_value) {
+        config.cpus = ParseCpuList(argv[++index]);
+        config.enabled = true;
+    } else if (arg == "--rt-no-mlock") {
+        config.lock_memory = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* RealtimeUsage() {
+    return "  --rt                 realtime audio threads (SCHED_FIFO, mlockall)\n"
+           "  --rt-policy fifo|rr  scheduling policy\n"
+           "  --rt-priority N      priority 1..99 (default 70)\n"
+           "  --rt-cpus LIST       pin audio threads, e.g. 2,3 or 2-3\n"
+           "  --rt-no-mlock        do not lock process memory\n";
+}
+
+void PrepareRealtimeProcess(const RealtimeConfig& config) {
+    if (!config.enabled || !config.lock_memory) {
+        return;
+    }
+
+    // Освобожденная память остается в арене malloc, а не возвращается ядру,
+    // и крупные блоки не уходят в отдельные mmap - иначе прогрев ниже
+    // не переживет первый free
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    // Прогрев кучи: страницы отображаются сейчас, а не в аудио потоке
+    // при первом росте очереди воспроизведения
+    if (config.heap_prefault_bytes > 0) {
+        auto* reserve = static_cast<volatile unsigned char*>(std::malloc(config.heap_prefault_bytes));
+        if (reserve) {
+            const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            for (size_t offset = 0; offset < config.heap_prefault_bytes; offset += page) {
+                reserve[offset] = 0;
+            }
+            std::free(const_cast<unsigned char*>(reserve));
+        }
+    }
+
+    // С конечным RLIMIT_MEMLOCK флаг MCL_FUTURE опасен: после него любое
+    // mmap сверх лимита (стек нового потока, буфер PortAudio) падает с EAGAIN.
+    // Без привилегий закрепляем только уже прогретое.
+    rlimit limit{};
+    getrlimit(RLIMIT_MEMLOCK, &limit);
+    const bool unlimited = limit.rlim_cur == RLIM_INFINITY || geteuid() == 0;
+    const int flags = unlimited ? MCL_CURRENT | MCL_FUTURE : MCL_CURRENT;
+
+    if (mlockall(flags) != 0) {
+        std::cerr << "Realtime: mlockall failed (" << std::strerror(errno) << "), RLIMIT_MEMLOCK "
+                  << limit.rlim_cur << " bytes; continuing without locked memory" << std::endl;
+    } else if (!unlimited) {
+        std::cerr << "Realtime: RLIMIT_MEMLOCK is " << limit.rlim_cur
+                  << " bytes, later allocations are not locked" << std::endl;
+    }
+}
+
+bool EnterRealtime(const RealtimeConfig& config, const char* name, size_t slot) {
+    Timeline::SetThreadName(name);
+    if (!config.enabled) {
+        return false;
+    }
+
+    pthread_setname_np(pthread_self(), name);
+
+    if (!config.cpus.empty()) {
+        const int cpu = config.cpus[slot % config.cpus.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (result != 0) {
+            std::cerr << "Realtime: " << name << " cannot be pinned to CPU " << cpu << " ("
+                      << std::strerror(result) << ")" << std::endl;
+        }
+    }
+
+    PrefaultStack(config.stack_prefault_bytes);
+
+    sched_param param{};
+    param.sched_priority = std::clamp(config.priority, sched_get_priority_min(config.policy),
+                                      sched_get_priority_max(config.policy));
+    const int result = pthread_setschedparam(pthread_self(), config.policy, &param);
+    if (result != 0) {
+        // Нет CAP_SYS_NICE и RLIMIT_RTPRIO - хотя бы поднимаем nice
+        std::cerr << "Realtime: " << name << " stays SCHED_OTHER (" << std::strerror(result)
+                  << "); grant CAP_SYS_NICE or raise RLIMIT_RTPRIO" << std::endl;
+        setpriority(PRIO_PROCESS, 0, -10);
+        return false;
+    }
+
+    std::cout << "Realtime: " << name << " running " << (config.policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO")
+              << " priority " << param.sched_priority << std::endl;
+    return true;
+}
+
+DeadlineMonitor::DeadlineMonitor(const char* name, Clock::duration period)
+    : name_(name), period_(period), limit_(period + period / 2) {}
+
+void DeadlineMonitor::OnCycle(Clock::time_point now) {
+    if (last_cycle_ != Clock::time_point{}) {
+        const auto interval = now - last_cycle_;
+        Record(interval, interval > limit_);
+    }
+    last_cycle_ = now;
+}
+
+void DeadlineMonitor::OnWork(Clock::duration elapsed) {
+    Record(elapsed, elapsed > period_);
+}
+
+void DeadlineMonitor::Record(Clock::duration value, bool missed) {
+    cycles_.fetch_add(1, std::memory_order_relaxed);
+    if (missed) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Пишет только свой поток, поэтому достаточно load/store
+    const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(value).count();
+    if (ns > worst_ns_.load(std::memory_order_relaxed)) {
+        worst_ns_.store(ns, std::memory_order_relaxed);
+    }
+}
+
+DeadlineMonitor::Stats DeadlineMonitor::GetStats() const {
+    return {
+        name_,
+        cycles_.load(std::memory_order_relaxed),
+        misses_.load(std::memory_order_relaxed),
+        worst_ns_.load(std::memory_order_relaxed) / 1e6,
+    };
+}
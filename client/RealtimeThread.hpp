@@ -0,0 +1,79 @@
+#pragma once
+
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Режим реального времени для аудио потоков (по умолчанию выключен).
+// Без CAP_SYS_NICE / RLIMIT_RTPRIO / RLIMIT_MEMLOCK соответствующие шаги
+// пропускаются с предупреждением, поток продолжает работать как обычный.
+struct RealtimeConfig {
+    bool enabled{false};
+    int policy{SCHED_FIFO};  // SCHED_FIFO или SCHED_RR
+    int priority{70};        // 1..99; ниже приоритета IRQ-потоков ядра (50) ставить не стоит
+    // CPU для закрепления; потоки раскладываются по списку по кругу.
+    // Пустой список - без закрепления.
+    std::vector<int> cpus;
+    bool lock_memory{true};
+    size_t stack_prefault_bytes{256 * 1024};
+    size_t heap_prefault_bytes{8 * 1024 * 1024};
+};
+
+// Разбирает флаги --rt, --rt-policy fifo|rr, --rt-priority N, --rt-cpus 2,3.
+// Возвращает true, если argv[index] был таким флагом (index сдвигается на
+// последний использованный аргумент).
+bool ParseRealtimeArg(int& index, int argc, char* argv[], RealtimeConfig& config);
+const char* RealtimeUsage();
+
+// Для всего процесса, один раз до запуска аудио потоков: mlockall и
+// предварительный захват кучи, чтобы буферы воспроизведения и пакетов
+// не ловили page fault в процессе работы
+void PrepareRealtimeProcess(const RealtimeConfig& config);
+
+// Для вызывающего потока: приоритет, закрепление за CPU и прогрев стека.
+// slot - порядковый номер потока для выбора CPU из списка.
+// Возвращает true, если поток получил realtime-приоритет.
+bool EnterRealtime(const RealtimeConfig& config, const char* name, size_t slot);
+
+// Счетчик промахов дедлайна одного потока. Запись - только из своего
+// потока, чтение статистики - из любого.
+class DeadlineMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        const char* name;
+        uint64_t cycles;
+        uint64_t misses;
+        double worst_ms;  // худший интервал цикла или время обработки
+    };
+
+    // period - период цикла (для аудио - длительность одного буфера)
+    DeadlineMonitor(const char* name, Clock::duration period);
+
+    // Периодический поток: конец очередного цикла. Интервал больше
+    // полутора периодов означает, что устройство успело опустеть/переполниться.
+    void OnCycle(Clock::time_point now = Clock::now());
+    // Непериодический поток (прием из сети): обработка дольше периода
+    // задерживает все, что стоит за ней в очереди.
+    void OnWork(Clock::duration elapsed);
+
+    Stats GetStats() const;
+
+private:
+    const char* name_;
+    const Clock::duration period_;
+    const Clock::duration limit_;
+    Clock::time_point last_cycle_{};
+
+    std::atomic<uint64_t> cycles_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<int64_t> worst_ns_{0};
+
+    void Record(Clock::duration value, bool missed);
+};
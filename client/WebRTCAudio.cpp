@@ -2,23 +2,41 @@
 #include <iostream>
 #include <chrono>
 
-WebRTCAudio::WebRTCAudio() 
-    : is_capturing_(false) {
-    audio_device_ = std::make_unique<Audio>();
+namespace {
+
+// Длительность одного буфера - период аудио потоков
+constexpr auto kBufferPeriod = std::chrono::microseconds(1000000LL * FRAMES_PER_BUFFER / SAMPLE_RATE);
+
 }
 
+WebRTCAudio::WebRTCAudio() 
+    : media_session_([this](const uint8_t* data, size_t size) { SendToTrack(data, size); }),
+      capture_monitor_("audio-capture", kBufferPeriod),
+      playout_monitor_("audio-playout", kBufferPeriod),
+      is_capturing_(false) {}
+
 WebRTCAudio::~WebRTCAudio() {
     Cleanup();
 }
 
-bool WebRTCAudio::Initialize() {
+bool WebRTCAudio::Initialize(const WebRTCConfig& webrtc_config) {
     try {
         // Настройка конфигурации WebRTC
         rtc::Configuration config;
         
-        // Добавляем STUN серверы для NAT traversal
-        config.iceServers.emplace_back("stun:stun.l.google.com:19302");
-        config.iceServers.emplace_back("stun:stun1.l.google.com:19302");
+        // В LAN режиме без серверов собираются только host-кандидаты, и сбор
+        // заканчивается сразу, не дожидаясь таймаутов STUN
+        if (!webrtc_config.lan_only) {
+            for (const auto& server : webrtc_config.ice_servers) {
+                config.iceServers.emplace_back(server);
+            }
+            
+            // По умолчанию - публичные STUN серверы для NAT traversal
+            if (webrtc_config.ice_servers.empty()) {
+                config.iceServers.emplace_back("stun:stun.l.google.com:19302");
+                config.iceServers.emplace_back("stun:stun1.l.google.com:19302");
+            }
+        }
         
         // Создаем PeerConnection
         peer_connection_ = std::make_shared<rtc::PeerConnection>(config);
@@ -47,6 +65,26 @@ void WebRTCAudio::Cleanup() {
     audio_device_.reset();
 }
 
+void WebRTCAudio::PrepareAudio() {
+    std::lock_guard<std::mutex> lock(device_mutex_);
+    if (audio_device_) {
+        return;
+    }
+    
+    audio_device_ = std::make_unique<Audio>(latency_profile_);
+    const auto& engine = AudioEngine::Get();
+    const PaDeviceIndex input = audio_devices_.input.empty() ? audio_device_->GetDefaultInputDeviceIndex()
+                                                             : engine.FindDevice(audio_devices_.input, true);
+    const PaDeviceIndex output = audio_devices_.output.empty() ? audio_device_->GetDefaultOutputDeviceIndex()
+                                                               : engine.FindDevice(audio_devices_.output, false);
+    if (input == paNoDevice || output == paNoDevice) {
+        std::cerr << "No " << (input == paNoDevice ? "input" : "output")
+                  << " device matches, using the default one" << std::endl;
+    }
+    audio_device_->CreateInputStream(input == paNoDevice ? audio_device_->GetDefaultInputDeviceIndex() : input);
+    audio_device_->CreateOutputStream(output == paNoDevice ? audio_device_->GetDefaultOutputDeviceIndex() : output);
+}
+
 void WebRTCAudio::CreatePeerConnection(const std::string& remote_id) {
     // PeerConnection уже создан в Initialize()
     std::cout << "Setting up connection for remote: " << remote_id << std::endl;
@@ -61,9 +99,15 @@ void WebRTCAudio::SetLocalDescription(const std::string& sdp) {
     }
 }
 
-void WebRTCAudio::SetRemoteDescription(const std::string& sdp) {
+void WebRTCAudio::SetRemoteDescription(const std::string& sdp, const std::string& type) {
+    if (!peer_connection_) {
+        std::cerr << "Remote description received before WebRTC initialization" << std::endl;
+        return;
+    }
+    
     try {
-        rtc::Description desc(sdp, rtc::Description::Type::Answer);
+        // На offer libdatachannel сам сформирует answer и отдаст его в onLocalDescription
+        rtc::Description desc(sdp, type);
         peer_connection_->setRemoteDescription(desc);
     } catch (const std::exception& e) {
         std::cerr << "Failed to set remote description: " << e.what() << std::endl;
@@ -71,6 +115,10 @@ void WebRTCAudio::SetRemoteDescription(const std::string& sdp) {
 }
 
 void WebRTCAudio::AddIceCandidate(const std::string& candidate) {
+    if (!peer_connection_) {
+        return;
+    }
+    
     try {
         peer_connection_->addRemoteCandidate(rtc::Candidate(candidate));
     } catch (const std::exception& e) {
@@ -83,11 +131,11 @@ void WebRTCAudio::StartAudioCapture() {
         return;
     }
     
-    audio_device_->CreateDefaultInputStream();
-    audio_device_->CreateDefaultOutputStream();
+    PrepareAudio();
     
     is_capturing_ = true;
     audio_capture_thread_ = std::thread(&WebRTCAudio::AudioCaptureLoop, this);
+    audio_playout_thread_ = std::thread(&WebRTCAudio::AudioPlayoutLoop, this);
     
     std::cout << "Audio capture started" << std::endl;
 }
@@ -102,8 +150,16 @@ void WebRTCAudio::StopAudioCapture() {
     if (audio_capture_thread_.joinable()) {
         audio_capture_thread_.join();
     }
+    if (audio_playout_thread_.joinable()) {
+        audio_playout_thread_.join();
+    }
     
-    audio_device_->Clear();
+    // Устройства закрываются; PortAudio остается поднятой, и следующий
+    // StartAudioCapture откроет их заново за миллисекунды
+    {
+        std::lock_guard<std::mutex> lock(device_mutex_);
+        audio_device_.reset();
+    }
     std::cout << "Audio capture stopped" << std::endl;
 }
 
@@ -112,7 +168,47 @@ void WebRTCAudio::SetRemoteAudioCallback(OnRemoteAudioCallback callback) {
     remote_audio_callback_ = callback;
 }
 
-void WebRTCAudio::SetOnLocalDescription(std::function<void(std::string)> callback) {
+MediaSession::Stats WebRTCAudio::GetMediaStats() const {
+    return media_session_.GetStats();
+}
+
+void WebRTCAudio::SetRealtimeConfig(const RealtimeConfig& config) {
+    realtime_config_ = config;
+}
+
+std::vector<DeadlineMonitor::Stats> WebRTCAudio::GetThreadStats() const {
+    return {capture_monitor_.GetStats(), playout_monitor_.GetStats()};
+}
+
+void WebRTCAudio::SetLatencyProfile(LatencyProfile profile) {
+    latency_profile_ = profile;
+}
+
+void WebRTCAudio::SetAudioDevices(const AudioDeviceOptions& devices) {
+    audio_devices_ = devices;
+}
+
+bool WebRTCAudio::SwitchInputDevice(PaDeviceIndex device) {
+    std::lock_guard<std::mutex> lock(device_mutex_);
+    return audio_device_ && audio_device_->SwitchInputDevice(device);
+}
+
+bool WebRTCAudio::SwitchOutputDevice(PaDeviceIndex device) {
+    std::lock_guard<std::mutex> lock(device_mutex_);
+    return audio_device_ && audio_device_->SwitchOutputDevice(device);
+}
+
+Audio::LatencyStats WebRTCAudio::GetLatencyStats() const {
+    std::lock_guard<std::mutex> lock(device_mutex_);
+    if (!audio_device_) {
+        Audio::LatencyStats stats;
+        stats.profile = latency_profile_;
+        return stats;
+    }
+    return audio_device_->GetLatencyStats();
+}
+
+void WebRTCAudio::SetOnLocalDescription(std::function<void(std::string, std::string)> callback) {
     on_local_description_ = callback;
 }
 
@@ -120,30 +216,55 @@ void WebRTCAudio::SetOnIceCandidate(std::function<void(std::string)> callback) {
     on_ice_candidate_ = callback;
 }
 
+void WebRTCAudio::SetOnGatheringComplete(std::function<void()> callback) {
+    on_gathering_complete_ = callback;
+}
+
+void WebRTCAudio::SetOnConnected(std::function<void()> callback) {
+    on_connected_ = callback;
+}
+
+void WebRTCAudio::SetOnFirstAudio(std::function<void()> callback) {
+    on_first_audio_ = callback;
+}
+
 void WebRTCAudio::AudioCaptureLoop() {
+    EnterRealtime(realtime_config_, "audio-capture", 0);
+    
     SAMPLE buffer[BUF_SIZE];
     
     while (is_capturing_) {
         // Захватываем аудио с микрофона
         audio_device_->GetInputStreamBuffer(buffer);
         
-        // Конвертируем в байты для отправки через WebRTC
-        std::vector<uint8_t> audio_data(
-            reinterpret_cast<uint8_t*>(buffer),
-            reinterpret_cast<uint8_t*>(buffer) + sizeof(buffer)
-        );
-        
-        // Отправляем через WebRTC track
-        if (audio_track_) {
-            try {
-                audio_track_->send(audio_data);
-            } catch (const std::exception& e) {
-                std::cerr << "Failed to send audio data: " << e.what() << std::endl;
-            }
-        }
-        
-        // Небольшая задержка для контроля частоты кадров
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        // Кодирование и пакетизация по текущему профилю контроллера битрейта
+        media_session_.OnCapturedFrame(buffer, BUF_SIZE);
+        capture_monitor_.OnCycle();
+    }
+}
+
+void WebRTCAudio::SendToTrack(const uint8_t* data, size_t size) {
+    if (!audio_track_) {
+        return;
+    }
+    
+    try {
+        audio_track_->send(reinterpret_cast<const std::byte*>(data), size);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to send audio data: " << e.what() << std::endl;
+    }
+}
+
+void WebRTCAudio::AudioPlayoutLoop() {
+    EnterRealtime(realtime_config_, "audio-playout", 1);
+    
+    SAMPLE buffer[BUF_SIZE];
+    
+    // Темп задает блокирующая запись в устройство вывода
+    while (is_capturing_) {
+        media_session_.Mix(buffer, BUF_SIZE);
+        audio_device_->SetOutputStreamBuffer(buffer);
+        playout_monitor_.OnCycle();
     }
 }
 
@@ -157,9 +278,9 @@ void WebRTCAudio::SetupMediaTracks() {
             std::cout << "Received remote audio track" << std::endl;
             
             track->onMessage([this](rtc::binary message) {
-                std::vector<uint8_t> audio_data(message.begin(), message.end());
-                ProcessAudioOutput(audio_data);
-            });
+                const auto* bytes = reinterpret_cast<const uint8_t*>(message.data());
+                ProcessAudioOutput(std::vector<uint8_t>(bytes, bytes + message.size()));
+            }, nullptr);
         });
         
     } catch (const std::exception& e) {
@@ -171,7 +292,7 @@ void WebRTCAudio::SetupPeerConnectionCallbacks() {
     // Колбэк для локального SDP
     peer_connection_->onLocalDescription([this](rtc::Description description) {
         if (on_local_description_) {
-            on_local_description_(std::string(description));
+            on_local_description_(std::string(description), description.typeString());
         }
     });
     
@@ -182,8 +303,14 @@ void WebRTCAudio::SetupPeerConnectionCallbacks() {
         }
     });
     
+    peer_connection_->onGatheringStateChange([this](rtc::PeerConnection::GatheringState state) {
+        if (state == rtc::PeerConnection::GatheringState::Complete && on_gathering_complete_) {
+            on_gathering_complete_();
+        }
+    });
+    
     // Колбэк для состояния соединения
-    peer_connection_->onStateChange([](rtc::PeerConnection::State state) {
+    peer_connection_->onStateChange([this](rtc::PeerConnection::State state) {
         switch (state) {
             case rtc::PeerConnection::State::New:
                 std::cout << "PeerConnection: New" << std::endl;
@@ -193,6 +320,9 @@ void WebRTCAudio::SetupPeerConnectionCallbacks() {
                 break;
             case rtc::PeerConnection::State::Connected:
                 std::cout << "PeerConnection: Connected" << std::endl;
+                if (on_connected_) {
+                    on_connected_();
+                }
                 break;
             case rtc::PeerConnection::State::Disconnected:
                 std::cout << "PeerConnection: Disconnected" << std::endl;
@@ -210,16 +340,15 @@ void WebRTCAudio::SetupPeerConnectionCallbacks() {
 void WebRTCAudio::ProcessAudioOutput(const std::vector<uint8_t>& data) {
     std::lock_guard<std::mutex> lock(audio_mutex_);
     
-    // Конвертируем байты обратно в SAMPLE формат
-    if (data.size() >= sizeof(SAMPLE) * BUF_SIZE) {
-        const SAMPLE* samples = reinterpret_cast<const SAMPLE*>(data.data());
-        
-        // Воспроизводим полученное аудио
-        audio_device_->SetOutputStreamBuffer(samples);
-        
-        // Вызываем колбэк если установлен
-        if (remote_audio_callback_) {
-            remote_audio_callback_(data);
-        }
+    if (!first_audio_received_.exchange(true) && on_first_audio_) {
+        on_first_audio_();
+    }
+    
+    // Аудио, FEC и отчеты; воспроизведение идет из отдельного потока
+    media_session_.OnDatagram(data.data(), data.size());
+    
+    // Вызываем колбэк если установлен
+    if (remote_audio_callback_) {
+        remote_audio_callback_(data);
     }
 } 
\ No newline at end of file
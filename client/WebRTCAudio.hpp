@@ -7,8 +7,21 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <string>
 
 #include "Audio.hpp"
+#include "AudioEngine.hpp"
+#include "MediaSession.hpp"
+#include "RealtimeThread.hpp"
+
+// Параметры ICE для PeerConnection
+struct WebRTCConfig {
+    // STUN/TURN серверы в формате libdatachannel:
+    // "stun:host:port", "turn:user:password@host:port"
+    std::vector<std::string> ice_servers;
+    // Только host-кандидаты, без обращения к STUN/TURN - для изолированной сети
+    bool lan_only{false};
+};
 
 class WebRTCAudio {
 public:
@@ -19,23 +32,47 @@ public:
     ~WebRTCAudio();
 
     // Инициализация WebRTC компонентов
-    bool Initialize();
+    bool Initialize(const WebRTCConfig& config = {});
     void Cleanup();
+    
+    // Инициализация PortAudio и открытие устройств; долгая операция,
+    // поэтому ее можно запускать параллельно с сигналингом
+    void PrepareAudio();
 
     // Настройка P2P соединения
     void CreatePeerConnection(const std::string& remote_id);
     void SetLocalDescription(const std::string& sdp);
-    void SetRemoteDescription(const std::string& sdp);
+    void SetRemoteDescription(const std::string& sdp, const std::string& type);
     void AddIceCandidate(const std::string& candidate);
 
     // Аудио треки
     void StartAudioCapture();
     void StopAudioCapture();
     void SetRemoteAudioCallback(OnRemoteAudioCallback callback);
+    MediaSession::Stats GetMediaStats() const;
+    
+    // Режим реального времени для потоков захвата и воспроизведения;
+    // действует при следующем StartAudioCapture
+    void SetRealtimeConfig(const RealtimeConfig& config);
+    std::vector<DeadlineMonitor::Stats> GetThreadStats() const;
+
+    // Профиль задержки и устройства (--input-device/--output-device);
+    // действуют при следующем PrepareAudio
+    void SetLatencyProfile(LatencyProfile profile);
+    void SetAudioDevices(const AudioDeviceOptions& devices);
+    // Переключение устройства во время звонка, соединение не трогается
+    bool SwitchInputDevice(PaDeviceIndex device);
+    bool SwitchOutputDevice(PaDeviceIndex device);
+    Audio::LatencyStats GetLatencyStats() const;
 
     // Сигналинг колбэки
-    void SetOnLocalDescription(std::function<void(std::string)> callback);
+    void SetOnLocalDescription(std::function<void(std::string sdp, std::string type)> callback);
     void SetOnIceCandidate(std::function<void(std::string)> callback);
+    
+    // События установки соединения для замера времени до первого звука
+    void SetOnGatheringComplete(std::function<void()> callback);
+    void SetOnConnected(std::function<void()> callback);
+    void SetOnFirstAudio(std::function<void()> callback);
 
 private:
     // WebRTC компоненты
@@ -44,19 +81,33 @@ private:
     
     // Аудио компоненты
     std::unique_ptr<Audio> audio_device_;
+    MediaSession media_session_;
     
     // Потоки и синхронизация
     std::thread audio_capture_thread_;
+    std::thread audio_playout_thread_;
+    RealtimeConfig realtime_config_;
+    LatencyProfile latency_profile_{LatencyProfile::Balanced};
+    AudioDeviceOptions audio_devices_;
+    DeadlineMonitor capture_monitor_;
+    DeadlineMonitor playout_monitor_;
     std::atomic<bool> is_capturing_;
+    std::atomic<bool> first_audio_received_{false};
     std::mutex audio_mutex_;
+    mutable std::mutex device_mutex_;
     
     // Колбэки
     OnRemoteAudioCallback remote_audio_callback_;
-    std::function<void(std::string)> on_local_description_;
+    std::function<void(std::string, std::string)> on_local_description_;
     std::function<void(std::string)> on_ice_candidate_;
+    std::function<void()> on_gathering_complete_;
+    std::function<void()> on_connected_;
+    std::function<void()> on_first_audio_;
 
     // Приватные методы
     void AudioCaptureLoop();
+    void AudioPlayoutLoop();
+    void SendToTrack(const uint8_t* data, size_t size);
     void SetupMediaTracks();
     void SetupPeerConnectionCallbacks();
     
@@ -1,4 +1,5 @@
 #include <arpa/inet.h>
+#include <poll.h>
 #include <portaudio.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -7,45 +8,391 @@
 #include <thread>
 
 #include "Audio.hpp"
+#include "AudioEngine.hpp"
+#include "Endpoint.hpp"
+#include "MediaCrypto.hpp"
+#include "MediaKeySignaling.hpp"
+#include "MediaSession.hpp"
+#include "NetworkImpairment.hpp"
+#include "Planes.hpp"
+#include "RealtimeThread.hpp"
+#include "Timeline.hpp"
 
-#define PORT 12345
+// Длительность одного буфера - период аудио потоков
+constexpr auto kBufferPeriod = std::chrono::microseconds(1000000LL * FRAMES_PER_BUFFER / SAMPLE_RATE);
+
+// Датаграммы, которые поток приема забирает за один системный вызов
+constexpr size_t kReceiveBatch = 16;
+// Кадры, которые проверяются за один захват ключей: датаграммы и кадры
+// из пачек ретранслятора
+constexpr size_t kDeliverBatch = 64;
+
+// Шифрование медиа (--signaling): свой ключ и ключи участников комнаты,
+// пришедшие через сигналинг сервер. Без флага пусто.
+struct MediaProtection {
+    std::unique_ptr<PacketProtector> protector;
+    PacketUnprotector keys;
+    std::unique_ptr<MediaKeySignaling> signaling;
+
+    bool Enabled() const noexcept { return protector != nullptr; }
+};
+
+struct ThreadMonitors {
+    DeadlineMonitor sender{"audio-capture", kBufferPeriod};
+    DeadlineMonitor player{"audio-playout", kBufferPeriod};
+    DeadlineMonitor receiver{"net-receive", kBufferPeriod};
+};
+
+void sender(Audio& audio_client, MediaSession& session, const RealtimeConfig& rt, DeadlineMonitor& monitor) {
+    EnterRealtime(rt, "audio-capture", 0);
 
-void sender(int sock, sockaddr_in serverAddr, Audio& audio_client) {
     SAMPLE buffer[BUF_SIZE];
     while (true) {
         audio_client.GetInputStreamBuffer(buffer);
-        sendto(sock, buffer, sizeof(buffer), 0, (sockaddr*)&serverAddr, sizeof(serverAddr));
+        session.OnCapturedFrame(buffer, BUF_SIZE);
+        monitor.OnCycle();
     }
 }
 
-void receiver(int sock, Audio& audio_client) {
-    SAMPLE buffer[BUF_SIZE];
+void receiver(int sock, ImpairedSocket& link, MediaProtection& protection, MediaSession& session,
+              const RealtimeConfig& rt, DeadlineMonitor& monitor) {
+    EnterRealtime(rt, "net-receive", 2);
+
+    // Пачка кадров проверяется за один захват ключей
+    CryptoPacket batch[kDeliverBatch];
+    size_t pending = 0;
+    const auto deliver = [&] {
+        if (pending == 0) {
+            return;
+        }
+        const auto start = DeadlineMonitor::Clock::now();
+        if (protection.Enabled()) {
+            protection.keys.UnprotectBatch(batch, pending);
+        }
+        for (size_t i = 0; i < pending; ++i) {
+            if (batch[i].size > 0) {
+                session.OnDatagram(batch[i].data, batch[i].size);
+            }
+        }
+        pending = 0;
+        monitor.OnWork(DeadlineMonitor::Clock::now() - start);
+    };
+    // Пачка ретранслятора разбирается на кадры прямо в буфере приема:
+    // каждый проверяется и попадает в буфер своего потока как отдельная
+    // датаграмма
+    const auto push = [&](uint8_t* data, size_t size) {
+        batch[pending++] = {data, size};
+        if (pending == kDeliverBatch) {
+            deliver();
+        }
+    };
+    const auto add = [&](uint8_t* data, size_t size) {
+        if (!ForEachBundled(data, size, push)) {
+            push(data, size);
+        }
+    };
+
+    std::vector<uint8_t> buffers(kReceiveBatch * kMaxMediaDatagram);
+    iovec iov[kReceiveBatch];
+    mmsghdr messages[kReceiveBatch]{};
+    for (size_t i = 0; i < kReceiveBatch; ++i) {
+        iov[i] = {buffers.data() + i * kMaxMediaDatagram, kMaxMediaDatagram};
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    uint8_t* buffer = buffers.data();
+    NetworkImpairment::Packet packets[kReceiveBatch];
     while (true) {
-        recv(sock, buffer, sizeof(buffer), 0);
+        if (!link.ImpairsReceive()) {
+            const int count = recvmmsg(sock, messages, kReceiveBatch, MSG_WAITFORONE, nullptr);
+            for (int i = 0; i < count; ++i) {
+                add(buffers.data() + i * kMaxMediaDatagram, messages[i].msg_len);
+            }
+            deliver();
+            continue;
+        }
+
+        // Эмулятор держит датаграммы до их срока: сокет ждем не дольше
+        // ближайшего из них
+        pollfd fd{sock, POLLIN, 0};
+        const auto timeout = link.ReceiveTimeout(std::chrono::milliseconds(100));
+        if (poll(&fd, 1, static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(timeout).count())) > 0) {
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t bytes;
+            while ((bytes = recvfrom(sock, buffer, kMaxMediaDatagram, MSG_DONTWAIT, (sockaddr*)&from, &from_len)) > 0) {
+                link.OnReceived(buffer, bytes, from);
+            }
+        }
+        // Кадры ссылаются в packets: доставка до повторного заполнения
+        size_t count = 0;
+        while (link.PopReceived(packets[count])) {
+            add(packets[count].data.data(), packets[count].data.size());
+            if (++count == kReceiveBatch) {
+                deliver();
+                count = 0;
+            }
+        }
+        deliver();
+    }
+}
+
+void print_impairment(const char* direction, const NetworkImpairment::Stats& stats) {
+    std::cout << "Impaired " << direction << ": " << stats.offered << " offered, " << stats.lost << " lost ("
+              << stats.burst_lost << " in bursts), " << stats.queue_dropped << " queue drops, " << stats.reordered
+              << " reordered, " << stats.duplicated << " duplicated" << std::endl;
+}
+
+void print_stats(const MediaSession::Stats& stats, const Audio& audio_client, const ThreadMonitors& monitors,
+                 const ImpairedSocket& link, const MediaProtection& protection) {
+    const auto& controller = stats.controller;
+    std::cout << "Send " << std::hex << stats.ssrc << std::dec << ": level " << controller.level << ", "
+              << controller.bitrate_bps / 1000 << " kbps, " << int(controller.frames_per_packet)
+              << " buffers/packet, fec 1/" << int(controller.fec_group) << ", loss " << controller.loss_fraction * 100
+              << "%, jitter " << controller.jitter_ms << " ms, rtt " << controller.rtt_ms << " ms, changes "
+              << controller.changes << std::endl;
+
+    for (const auto& stream : stats.streams) {
+        std::cout << "Recv " << std::hex << stream.ssrc << std::dec << ": loss " << stream.loss_fraction * 100
+                  << "%, jitter " << stream.jitter_ms << " ms, recovered " << stream.recovered << ", concealed "
+                  << stream.concealed << ", drift " << stream.playout.drift_ppm << " ppm, correction "
+                  << stream.playout.correction_ppm << " ppm, fill " << stream.playout.fill_frames
+                  << " buffers, underruns " << stream.playout.underruns << std::endl;
+    }
+
+    const auto latency = audio_client.GetLatencyStats();
+    std::cout << "Audio " << LatencyProfileName(latency.profile) << ": input " << latency.input_ms << " ms, output "
+              << latency.output_ms << " ms (device buffer " << latency.device_frames << "), overflows "
+              << latency.input_overflows << ", underruns " << latency.output_underflows;
+    if (latency.profile == LatencyProfile::Auto) {
+        std::cout << ", tune steps " << latency.tune_steps << (latency.tuned ? ", tuned" : ", tuning");
+    }
+    if (latency.switches > 0) {
+        std::cout << ", device switches " << latency.switches << " (" << latency.switch_dropped
+                  << " input samples dropped)";
+    }
+    std::cout << std::endl;
+
+    for (const auto* monitor : {&monitors.sender, &monitors.player, &monitors.receiver}) {
+        const auto thread = monitor->GetStats();
+        std::cout << "Thread " << thread.name << ": cycles " << thread.cycles << ", deadline misses "
+                  << thread.misses << ", worst " << thread.worst_ms << " ms" << std::endl;
+    }
+
+    const auto network = link.GetStats();
+    if (network.in.offered > 0) {
+        print_impairment("in", network.in);
+    }
+    if (network.out.offered > 0) {
+        print_impairment("out", network.out);
+    }
+
+    if (protection.Enabled()) {
+        const auto keys = protection.keys.GetStats();
+        std::cout << "Crypto: " << protection.protector->Protected() << " protected, " << keys.accepted
+                  << " accepted, " << keys.keys << " peer keys, dropped " << keys.unknown_key << " without key, "
+                  << keys.auth_failed << " forged, " << keys.replayed << " replayed, " << keys.unprotected
+                  << " plaintext" << std::endl;
+    }
+}
+
+// Вывод идет в темпе часов звуковой карты, сеть - в темпе часов отправителя;
+// буферы воспроизведения в MediaSession компенсируют расхождение
+void player(Audio& audio_client, MediaSession& session, const RealtimeConfig& rt, ThreadMonitors& monitors,
+            const ImpairedSocket& link, const MediaProtection& protection) {
+    EnterRealtime(rt, "audio-playout", 1);
+
+    SAMPLE buffer[BUF_SIZE];
+    constexpr int stats_interval = SAMPLE_RATE / FRAMES_PER_BUFFER * 10;
+    for (int i = 1;; ++i) {
+        session.Mix(buffer, BUF_SIZE);
         audio_client.SetOutputStreamBuffer(buffer);
+        monitors.player.OnCycle();
+
+        if (i % stats_interval == 0) {
+            print_stats(session.GetStats(), audio_client, monitors, link, protection);
+        }
     }
 }
 
-int main() {
-    Audio audio_client;
+// Открывает устройства из --input-device/--output-device или по умолчанию
+bool open_devices(Audio& audio_client, const AudioDeviceOptions& devices) {
+    const auto& engine = AudioEngine::Get();
+    const PaDeviceIndex input = devices.input.empty() ? audio_client.GetDefaultInputDeviceIndex()
+                                                      : engine.FindDevice(devices.input, true);
+    const PaDeviceIndex output = devices.output.empty() ? audio_client.GetDefaultOutputDeviceIndex()
+                                                        : engine.FindDevice(devices.output, false);
+    if (input == paNoDevice || output == paNoDevice) {
+        std::cerr << "No " << (input == paNoDevice ? "input" : "output") << " device matches, see --list-devices"
+                  << std::endl;
+        return false;
+    }
+    audio_client.CreateInputStream(input);
+    audio_client.CreateOutputStream(output);
+    return true;
+}
 
-    audio_client.CreateDefaultInputStream();
-    audio_client.CreateDefaultOutputStream();
+int main(int argc, char* argv[]) {
+    // PortAudio поднимается секундами: в фоне, пока разбираются флаги и
+    // настраивается сеть
+    const auto launch = std::chrono::steady_clock::now();
+    AudioEngine::Get().Start();
+    const auto since_launch_ms = [launch] {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launch).count();
+    };
 
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    RealtimeConfig rt;
+    ImpairmentOptions impairment;
+    std::string timeline_path;
+    // Сигналинг сервер для обмена ключами; задан - медиа шифруется
+    sockaddr_in signalingAddr{};
+    bool encrypt = false;
+    std::string room = "default";
+    CipherSuite suite = PreferredCipherSuite();
+    LatencyProfile latency = LatencyProfile::Balanced;
+    AudioDeviceOptions devices;
+    // Ретранслятор; в каскаде клиент подключается к любому из них
     sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(PORT);
+    serverAddr.sin_port = htons(kDefaultMediaPort);
     inet_pton(AF_INET, "127.0.0.1", &serverAddr.sin_addr);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            if (!ParseEndpoint(argv[++i], serverAddr)) {
+                std::cerr << "Invalid server address: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            timeline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--signaling") == 0 && i + 1 < argc) {
+            if (!ParseEndpoint(argv[++i], signalingAddr)) {
+                std::cerr << "Invalid signaling address: " << argv[i] << std::endl;
+                return 1;
+            }
+            encrypt = true;
+        } else if (std::strcmp(argv[i], "--room") == 0 && i + 1 < argc) {
+            room = argv[++i];
+        } else if (std::strcmp(argv[i], "--cipher") == 0 && i + 1 < argc) {
+            if (!ParseCipherSuite(argv[++i], suite)) {
+                std::cerr << "Unknown cipher: " << argv[i] << " (aes128gcm, aes256gcm, chacha20)" << std::endl;
+                return 1;
+            }
+        } else if (!ParseLatencyArg(i, argc, argv, latency) && !ParseAudioDeviceArg(i, argc, argv, devices) &&
+                   !ParseRealtimeArg(i, argc, argv, rt) && !ParseImpairmentArg(i, argc, argv, impairment)) {
+            std::cout << "Usage: " << argv[0] << " [--server host:port] [--timeline file] [options]\n"
+                      << "  --signaling host:port  encrypt media, exchange keys via the signaling server\n"
+                      << "  --room id              room for the key exchange (default: default)\n"
+                      << "  --cipher name          aes128gcm, aes256gcm or chacha20 (default: by CPU)\n"
+                      << LatencyUsage() << AudioDeviceUsage() << RealtimeUsage() << ImpairmentUsage();
+            return 1;
+        }
+    }
+    if (devices.list) {
+        PrintAudioDevices();
+        return 0;
+    }
+    if (!impairment.error.empty()) {
+        std::cerr << "Invalid impairment " << impairment.error << std::endl;
+        return 1;
+    }
+    if (!timeline_path.empty()) {
+        std::string error;
+        if (!Timeline::Arm(timeline_path, error)) {
+            std::cerr << "Failed to enable timeline: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Timeline recording: SIGUSR1 writes " << timeline_path << ", SIGUSR2 pauses/resumes" << std::endl;
+    }
+
+    // До открытия устройств и создания буферов, чтобы они попали под mlockall
+    PrepareRealtimeProcess(rt);
 
-    sendto(sock, "", 1, 0, (sockaddr*)&serverAddr, sizeof(serverAddr));
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    // Медиа-план: EF, чтобы домашний маршрутизатор пропускал голос вперед загрузок
+    std::string mark_error;
+    if (!MarkMediaSocket(sock, mark_error)) {
+        std::cerr << "Media socket marking failed: " << mark_error << std::endl;
+    }
+
+    // Без --impair датаграммы идут прямо в sendto
+    ImpairedSocket link(sock, impairment);
+    if (impairment.Enabled()) {
+        std::cout << "Impaired network: in " << DescribeImpairment(impairment.in) << "; out "
+                  << DescribeImpairment(impairment.out) << std::endl;
+    }
 
-    std::thread sendThread(sender, sock, serverAddr, std::ref(audio_client));
-    std::thread recvThread(receiver, sock, std::ref(audio_client));
+    // Приветствие регистрирует клиента и просит пачки, если ретранслятор
+    // их собирает (--bundle); старый ретранслятор флаг не читает
+    const uint8_t hello[] = {0, kHelloAcceptsBundles};
+    link.SendTo(serverAddr, hello, sizeof(hello));
+
+    MediaProtection protection;
+    MediaSession session([&](const uint8_t* data, size_t size) {
+        if (!protection.Enabled()) {
+            link.SendTo(serverAddr, data, size);
+            return;
+        }
+        uint8_t packet[kMaxMediaDatagram + kProtectionOverhead];
+        if (size > kMaxMediaDatagram) {
+            return;
+        }
+        std::memcpy(packet, data, size);
+        const size_t protected_size = protection.protector->Protect(packet, size);
+        if (protected_size > 0) {
+            link.SendTo(serverAddr, packet, protected_size);
+        }
+    });
+
+    // Ключ потока живет, пока жив процесс: индексы пакетов кончатся через
+    // 2^32 пакетов, это больше 280 суток
+    if (encrypt) {
+        const uint32_t ssrc = session.GetStats().ssrc;
+        const MediaKey key = GenerateMediaKey(suite);
+        protection.protector = std::make_unique<PacketProtector>(ssrc, key);
+        protection.signaling = std::make_unique<MediaKeySignaling>(signalingAddr, room, ssrc, key);
+        protection.signaling->SetCallbacks(
+            [&protection](uint32_t peer, const MediaKey& peer_key) { protection.keys.SetKey(peer, peer_key); },
+            [&protection](uint32_t peer) { protection.keys.RemoveKey(peer); });
+        if (!protection.signaling->Start()) {
+            return 1;
+        }
+        std::cout << "Media encrypted with " << CipherSuiteName(suite)
+                  << (HasHardwareAes() ? " (hardware AES)" : " (no hardware AES)") << std::endl;
+    }
+
+    // Сеть готова; устройства ждут PortAudio, если она еще поднимается
+    const double network_ms = since_launch_ms();
+    Audio audio_client(latency);
+    if (!open_devices(audio_client, devices)) {
+        return 1;
+    }
+    const auto engine = AudioEngine::Get().GetStats();
+    std::cout << "Startup: network " << network_ms << " ms, PortAudio " << engine.init_ms << " ms in background"
+              << " (waited " << engine.waited_ms << " ms), audio ready " << since_launch_ms() << " ms after launch"
+              << std::endl;
+
+    ThreadMonitors monitors;
+    std::thread sendThread(sender, std::ref(audio_client), std::ref(session), std::cref(rt), std::ref(monitors.sender));
+    std::thread recvThread(receiver, sock, std::ref(link), std::ref(protection), std::ref(session), std::cref(rt),
+                           std::ref(monitors.receiver));
+    std::thread playThread(player, std::ref(audio_client), std::ref(session), std::cref(rt), std::ref(monitors),
+                           std::cref(link), std::cref(protection));
+
+    // Консоль: переключение устройств на ходу, сеть и сессия не трогаются
+    const auto switch_input = [&](PaDeviceIndex device) { return audio_client.SwitchInputDevice(device); };
+    const auto switch_output = [&](PaDeviceIndex device) { return audio_client.SwitchOutputDevice(device); };
+    std::cout << "Commands:\n" << AudioDeviceCommands() << std::flush;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (!line.empty() && !RunAudioDeviceCommand(line, switch_input, switch_output)) {
+            std::cout << "Unknown command: " << line << "\n" << AudioDeviceCommands() << std::flush;
+        }
+    }
 
     sendThread.join();
     recvThread.join();
+    playThread.join();
 
     close(sock);
     return 0;
-}
\ No newline at end of file
+}
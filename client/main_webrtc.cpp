@@ -1,21 +1,37 @@
 #include "WebRTCAudio.hpp"
+#include "Endpoint.hpp"
+#include "NetworkImpairment.hpp"
+#include "Planes.hpp"
+#include "ReliableTransport.hpp"
+#include "SignalingProtocol.hpp"
+#include "Timeline.hpp"
 #include <iostream>
 #include <thread>
 #include <string>
-#include <json/json.h>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 class SignalingClient {
 public:
-    SignalingClient(const std::string& server_ip, int server_port) 
-        : server_ip_(server_ip), server_port_(server_port), socket_(-1), client_id_("") {}
+    SignalingClient(const std::string& server_ip, int server_port, bool binary = true) 
+        : server_ip_(server_ip), server_port_(server_port), socket_(-1), client_id_(""), offer_binary_(binary) {}
     
     ~SignalingClient() {
         Disconnect();
     }
     
+    // Эмуляция плохой сети на сокете сигналинга; вызывается до Connect
+    void SetImpairment(const ImpairmentOptions& options) {
+        impairment_options_ = options;
+    }
+    
     bool Connect() {
         socket_ = socket(AF_INET, SOCK_DGRAM, 0);
         if (socket_ < 0) {
@@ -27,10 +43,28 @@ public:
         server_addr_.sin_port = htons(server_port_);
         inet_pton(AF_INET, server_ip_.c_str(), &server_addr_.sin_addr);
         
-        // Отправляем первое сообщение для регистрации
-        Json::Value hello_msg;
-        hello_msg["type"] = "hello";
-        SendMessage(hello_msg);
+        // Небольшая задержка отправки склеивает пачки ICE кандидатов в одну датаграмму.
+        // После redirect запоздавшие сообщения прежнего узла отбрасываются.
+        transport_ = std::make_unique<ReliableTransport>(
+            socket_,
+            [this](std::string_view message, const sockaddr_in& from) {
+                if (SameEndpoint(from, server_addr_)) {
+                    HandleMessage(message);
+                }
+            },
+            std::chrono::milliseconds(5)
+        );
+        if (impairment_options_.Enabled()) {
+            impairment_ = std::make_unique<ImpairedSocket>(socket_, impairment_options_);
+            transport_->SetImpairment(impairment_.get());
+        }
+        
+        // Отправляем первое сообщение для регистрации; остальные сообщения
+        // копятся до client_registered и уходят сразу после него
+        {
+            std::lock_guard<std::mutex> lock(registration_mutex_);
+            SendHello();
+        }
         
         // Запускаем поток для получения сообщений
         is_running_ = true;
@@ -46,50 +80,55 @@ public:
             receive_thread_.join();
         }
         
+        transport_.reset();
+        impairment_.reset();
+        
         if (socket_ >= 0) {
             close(socket_);
             socket_ = -1;
         }
     }
     
+    // Ждет client_registered не дольше timeout
+    bool WaitRegistered(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(registration_mutex_);
+        return registration_cv_.wait_for(lock, timeout, [this] { return registered_; });
+    }
+    
     void JoinRoom(const std::string& room_id) {
-        Json::Value join_msg;
-        join_msg["type"] = "join_room";
-        join_msg["room_id"] = room_id;
-        join_msg["client_id"] = client_id_;
-        SendMessage(join_msg);
+        SignalingMessage join_msg;
+        join_msg.type = SignalType::JoinRoom;
+        join_msg.room_id = room_id;
+        SendMessage(std::move(join_msg));
     }
     
     void SendOffer(const std::string& sdp, const std::string& target = "") {
-        Json::Value offer_msg;
-        offer_msg["type"] = "offer";
-        offer_msg["client_id"] = client_id_;
-        offer_msg["data"]["sdp"] = sdp;
-        if (!target.empty()) {
-            offer_msg["target"] = target;
-        }
-        SendMessage(offer_msg);
+        SignalingMessage offer_msg;
+        offer_msg.type = SignalType::Offer;
+        offer_msg.sdp = sdp;
+        offer_msg.target = target;
+        SendMessage(std::move(offer_msg));
     }
     
     void SendAnswer(const std::string& sdp, const std::string& target) {
-        Json::Value answer_msg;
-        answer_msg["type"] = "answer";
-        answer_msg["client_id"] = client_id_;
-        answer_msg["target"] = target;
-        answer_msg["data"]["sdp"] = sdp;
-        SendMessage(answer_msg);
+        SignalingMessage answer_msg;
+        answer_msg.type = SignalType::Answer;
+        answer_msg.target = target;
+        answer_msg.sdp = sdp;
+        SendMessage(std::move(answer_msg));
     }
     
-    void SendIceCandidate(const std::string& candidate, const std::string& target) {
-        Json::Value ice_msg;
-        ice_msg["type"] = "ice_candidate";
-        ice_msg["client_id"] = client_id_;
-        ice_msg["target"] = target;
-        ice_msg["data"]["candidate"] = candidate;
-        SendMessage(ice_msg);
+    // Пустой target - разослать всем в комнате
+    void SendIceCandidate(const std::string& candidate, const std::string& target = "") {
+        SignalingMessage ice_msg;
+        ice_msg.type = SignalType::IceCandidate;
+        ice_msg.target = target;
+        ice_msg.candidate = candidate;
+        SendMessage(std::move(ice_msg));
     }
     
     // Колбэки для WebRTC событий
+    std::function<void(std::string)> on_registered;
     std::function<void(std::string, std::string)> on_offer;
     std::function<void(std::string, std::string)> on_answer;
     std::function<void(std::string, std::string)> on_ice_candidate;
@@ -105,107 +144,361 @@ private:
     
     std::thread receive_thread_;
     std::atomic<bool> is_running_;
+    std::unique_ptr<ReliableTransport> transport_;
+    ImpairmentOptions impairment_options_;
+    std::unique_ptr<ImpairedSocket> impairment_;
+    
+    // Под registration_mutex_: состояние регистрации, а также адрес сервера
+    // и кодировка, которые меняются при redirect
+    std::mutex registration_mutex_;
+    std::condition_variable registration_cv_;
+    bool registered_{false};
+    std::vector<SignalingMessage> pending_messages_;
+    // Предлагать серверу бинарную кодировку; принятая сервером - в encoding_
+    const bool offer_binary_;
+    SignalEncoding encoding_{SignalEncoding::Json};
+    // Redirect подряд без успешного входа - защита от петли при
+    // рассогласованной конфигурации кластера
+    static constexpr int kMaxRedirects = 3;
+    int redirects_{0};
+    
+    // Состав комнаты по версиям сервера; только в потоке приема
+    std::string roster_room_;
+    uint64_t roster_version_{0};
+    bool roster_synced_{false};
+    std::unordered_set<std::string> roster_;
+    std::unordered_set<std::string> snapshot_;
+    
+    // Сообщения до регистрации откладываются: client_id еще неизвестен
+    void SendMessage(SignalingMessage message) {
+        std::lock_guard<std::mutex> lock(registration_mutex_);
+        if (!registered_) {
+            pending_messages_.push_back(std::move(message));
+            return;
+        }
+        message.client_id = client_id_;
+        SendNow(message);
+    }
     
-    void SendMessage(const Json::Value& message) {
-        Json::StreamWriterBuilder builder;
-        std::string json_string = Json::writeString(builder, message);
-        
-        sendto(socket_, json_string.c_str(), json_string.length(), 0,
-               (sockaddr*)&server_addr_, sizeof(server_addr_));
+    // Вызывается под registration_mutex_
+    void SendNow(const SignalingMessage& message) {
+        transport_->Send(server_addr_, EncodeSignal(message, encoding_));
+    }
+    
+    // hello всегда в JSON: кодировку сервера мы еще не знаем
+    void SendHello() {
+        SignalingMessage hello_msg;
+        hello_msg.type = SignalType::Hello;
+        hello_msg.redirect = true;
+        if (offer_binary_) {
+            hello_msg.encoding = "binary";
+        }
+        encoding_ = SignalEncoding::Json;
+        SendNow(hello_msg);
     }
     
     void ReceiveLoop() {
-        char buffer[4096];
-        
         while (is_running_) {
-            int bytes_received = recv(socket_, buffer, sizeof(buffer) - 1, 0);
-            
-            if (bytes_received > 0) {
-                buffer[bytes_received] = '\0';
-                HandleMessage(std::string(buffer));
+            if (transport_->WaitReadable(std::chrono::milliseconds(100))) {
+                transport_->ReceiveAll();
             }
+            transport_->Poll();
         }
     }
     
-    void HandleMessage(const std::string& message) {
+    void HandleMessage(std::string_view payload) {
         try {
-            Json::Value root;
-            Json::Reader reader;
-            
-            if (!reader.parse(message, root)) {
-                std::cerr << "Failed to parse JSON message" << std::endl;
+            // Кодировка определяется по первому байту каждого сообщения
+            SignalingMessage message;
+            if (!DecodeSignal(payload, message)) {
+                std::cerr << "Failed to parse signaling message" << std::endl;
                 return;
             }
             
-            std::string type = root.get("type", "").asString();
+            switch (message.type) {
+                case SignalType::ClientRegistered:
+                    OnRegistered(message);
+                    break;
+                case SignalType::Offer:
+                    if (on_offer) {
+                        on_offer(message.sdp, message.sender);
+                    }
+                    break;
+                case SignalType::Answer:
+                    if (on_answer) {
+                        on_answer(message.sdp, message.sender);
+                    }
+                    break;
+                case SignalType::IceCandidate:
+                    if (on_ice_candidate) {
+                        on_ice_candidate(message.candidate, message.sender);
+                    }
+                    break;
+                case SignalType::RoomSnapshot:
+                    HandleRosterSnapshot(message);
+                    break;
+                case SignalType::RosterDelta:
+                    HandleRosterDelta(message);
+                    break;
+                case SignalType::Redirect:
+                    OnRedirect(message);
+                    break;
+                default:
+                    break;
+            }
             
-            if (type == "client_registered") {
-                client_id_ = root.get("client_id", "").asString();
-                std::cout << "Registered with ID: " << client_id_ << std::endl;
-            } else if (type == "offer" && on_offer) {
-                std::string sender = root.get("sender", "").asString();
-                std::string sdp = root["data"].get("sdp", "").asString();
-                on_offer(sdp, sender);
-            } else if (type == "answer" && on_answer) {
-                std::string sender = root.get("sender", "").asString();
-                std::string sdp = root["data"].get("sdp", "").asString();
-                on_answer(sdp, sender);
-            } else if (type == "ice_candidate" && on_ice_candidate) {
-                std::string sender = root.get("sender", "").asString();
-                std::string candidate = root["data"].get("candidate", "").asString();
-                on_ice_candidate(candidate, sender);
-            } else if (type == "user_joined" && on_user_joined) {
-                std::string user_id = root.get("user_id", "").asString();
+        } catch (const std::exception& e) {
+            std::cerr << "Error handling message: " << e.what() << std::endl;
+        }
+    }
+    
+    // Снимок приходит страницами одной версии; события входа/выхода
+    // генерируются по разнице с тем, что клиент знал до него
+    void HandleRosterSnapshot(const SignalingMessage& message) {
+        if (message.page == 0) {
+            snapshot_.clear();
+        }
+        snapshot_.insert(message.users.begin(), message.users.end());
+        if (message.page + 1 < message.pages) {
+            return;
+        }
+        
+        for (const auto& user_id : roster_) {
+            if (!snapshot_.count(user_id) && on_user_left) {
+                on_user_left(user_id);
+            }
+        }
+        for (const auto& user_id : snapshot_) {
+            if (!roster_.count(user_id) && on_user_joined) {
+                on_user_joined(user_id);
+            }
+        }
+        roster_.swap(snapshot_);
+        snapshot_.clear();
+        roster_room_ = message.room_id;
+        roster_version_ = message.version;
+        roster_synced_ = true;
+        
+        std::lock_guard<std::mutex> lock(registration_mutex_);
+        redirects_ = 0;
+    }
+    
+    void HandleRosterDelta(const SignalingMessage& message) {
+        // До снимка и устаревшие дельты не нужны
+        if (!roster_synced_ || message.room_id != roster_room_ || message.version <= roster_version_) {
+            return;
+        }
+        
+        // Пропущена дельта - просим догнать с нашей версии
+        if (message.from_version > roster_version_) {
+            SignalingMessage sync_msg;
+            sync_msg.type = SignalType::RosterSync;
+            sync_msg.version = roster_version_;
+            sync_msg.has_version = true;
+            SendMessage(std::move(sync_msg));
+            return;
+        }
+        
+        // Операции идемпотентны, поэтому дельта с более ранней from_version
+        // тоже применима
+        for (const auto& user_id : message.joined) {
+            if (user_id != client_id_ && roster_.insert(user_id).second && on_user_joined) {
                 on_user_joined(user_id);
-            } else if (type == "user_left" && on_user_left) {
-                std::string user_id = root.get("user_id", "").asString();
+            }
+        }
+        for (const auto& user_id : message.left) {
+            if (roster_.erase(user_id) && on_user_left) {
                 on_user_left(user_id);
             }
+        }
+        roster_version_ = message.version;
+    }
+    
+    // Комнату обслуживает другой узел кластера: регистрируемся там заново
+    // и повторяем вход первым сообщением после регистрации
+    void OnRedirect(const SignalingMessage& message) {
+        sockaddr_in address{};
+        if (!ParseEndpoint(message.address, address)) {
+            std::cerr << "Invalid redirect address: " << message.address << std::endl;
+            return;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(registration_mutex_);
+            if (++redirects_ > kMaxRedirects) {
+                std::cerr << "Too many redirects, staying on the current node" << std::endl;
+                return;
+            }
             
-        } catch (const std::exception& e) {
-            std::cerr << "Error handling message: " << e.what() << std::endl;
+            server_addr_ = address;
+            registered_ = false;
+            client_id_.clear();
+            
+            SignalingMessage join_msg;
+            join_msg.type = SignalType::JoinRoom;
+            join_msg.room_id = message.room_id;
+            pending_messages_.insert(pending_messages_.begin(), std::move(join_msg));
+            SendHello();
+        }
+        
+        std::cout << "Room " << message.room_id << " is served by " << message.address << ", reconnecting" << std::endl;
+    }
+    
+    void OnRegistered(const SignalingMessage& message) {
+        const std::string client_id = message.client_id;
+        {
+            std::lock_guard<std::mutex> lock(registration_mutex_);
+            if (registered_) {
+                // Повтор ответа на hello
+                return;
+            }
+            client_id_ = client_id;
+            registered_ = true;
+            if (offer_binary_ && message.encoding == "binary") {
+                encoding_ = SignalEncoding::Binary;
+            }
+            
+            // Отложенные сообщения уходят одной пачкой и склеиваются транспортом;
+            // под блокировкой, чтобы новые сообщения не обогнали их
+            for (auto& pending : pending_messages_) {
+                pending.client_id = client_id;
+                SendNow(pending);
+            }
+            pending_messages_.clear();
+        }
+        registration_cv_.notify_all();
+        
+        std::cout << "Registered with ID: " << client_id
+                  << (encoding_ == SignalEncoding::Binary ? " (binary signaling)" : " (JSON signaling)") << std::endl;
+        
+        if (on_registered) {
+            on_registered(client_id);
         }
     }
 };
 
+static void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [server_ip] [server_port] [room_id] [--lan] [--ice <url>]..." << std::endl;
+    std::cout << "  --lan        only host candidates, no STUN/TURN" << std::endl;
+    std::cout << "  --ice <url>  STUN/TURN server, e.g. stun:host:3478 or turn:user:pass@host:3478" << std::endl;
+    std::cout << "  --json       JSON signaling only (readable in packet captures)" << std::endl;
+    std::cout << "  --timeline <file>  record event timeline; SIGUSR1 dumps, SIGUSR2 toggles" << std::endl;
+    std::cout << LatencyUsage() << AudioDeviceUsage() << RealtimeUsage();
+    std::cout << "Signaling socket only; media goes through libdatachannel:" << std::endl;
+    std::cout << ImpairmentUsage();
+}
+
 int main(int argc, char* argv[]) {
+    using Clock = std::chrono::steady_clock;
+    const auto start_time = Clock::now();
+    // PortAudio поднимается секундами: в фоне с самого запуска
+    AudioEngine::Get().Start();
+    auto elapsed_ms = [start_time] {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_time).count();
+    };
+    
     std::string server_ip = "127.0.0.1";
-    int server_port = 12345;
+    int server_port = kDefaultSignalingPort;
     std::string room_id = "default";
+    WebRTCConfig webrtc_config;
+    RealtimeConfig realtime_config;
+    LatencyProfile latency_profile = LatencyProfile::Balanced;
+    AudioDeviceOptions audio_devices;
+    bool binary_signaling = true;
+    ImpairmentOptions impairment;
+    std::string timeline_path;
+    
+    // Парсим аргументы командной строки: позиционные как раньше, плюс флаги
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--lan") {
+            webrtc_config.lan_only = true;
+        } else if (arg == "--json") {
+            binary_signaling = false;
+        } else if (arg == "--ice" && i + 1 < argc) {
+            webrtc_config.ice_servers.emplace_back(argv[++i]);
+        } else if (arg == "--timeline" && i + 1 < argc) {
+            timeline_path = argv[++i];
+        } else if (ParseLatencyArg(i, argc, argv, latency_profile)) {
+            continue;
+        } else if (ParseAudioDeviceArg(i, argc, argv, audio_devices)) {
+            continue;
+        } else if (ParseRealtimeArg(i, argc, argv, realtime_config)) {
+            continue;
+        } else if (ParseImpairmentArg(i, argc, argv, impairment)) {
+            continue;
+        } else if (arg == "--help" || arg == "-h") {
+            PrintUsage(argv[0]);
+            return 0;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (audio_devices.list) {
+        PrintAudioDevices();
+        return 0;
+    }
+    if (positional.size() > 0) server_ip = positional[0];
+    if (positional.size() > 1) server_port = std::atoi(positional[1].c_str());
+    if (positional.size() > 2) room_id = positional[2];
+    if (!impairment.error.empty()) {
+        std::cerr << "Invalid impairment " << impairment.error << std::endl;
+        return 1;
+    }
+    if (!timeline_path.empty()) {
+        std::string error;
+        if (!Timeline::Arm(timeline_path, error)) {
+            std::cerr << "Failed to enable timeline: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Timeline recording: SIGUSR1 writes " << timeline_path << ", SIGUSR2 pauses/resumes" << std::endl;
+    }
     
-    // Парсим аргументы командной строки
-    if (argc > 1) server_ip = argv[1];
-    if (argc > 2) server_port = std::atoi(argv[2]);
-    if (argc > 3) room_id = argv[3];
+    // До создания буферов и открытия устройств, чтобы они попали под mlockall
+    PrepareRealtimeProcess(realtime_config);
     
     std::cout << "Connecting to signaling server at " << server_ip << ":" << server_port << std::endl;
     
-    // Создаем сигналинг клиент
-    SignalingClient signaling_client(server_ip, server_port);
-    
-    if (!signaling_client.Connect()) {
-        std::cerr << "Failed to connect to signaling server" << std::endl;
-        return 1;
-    }
-    
-    // Создаем WebRTC аудио клиент
+    // Создаем сигналинг клиент и WebRTC аудио клиент; все колбэки ставятся
+    // до Connect, чтобы не потерять события, пришедшие сразу после него
+    SignalingClient signaling_client(server_ip, server_port, binary_signaling);
+    signaling_client.SetImpairment(impairment);
     WebRTCAudio webrtc_audio;
+    webrtc_audio.SetRealtimeConfig(realtime_config);
+    webrtc_audio.SetLatencyProfile(latency_profile);
+    webrtc_audio.SetAudioDevices(audio_devices);
+    
+    // Собеседник, от которого пришел offer; ответ и кандидаты идут ему
+    std::mutex remote_mutex;
+    std::string remote_id;
+    auto get_remote = [&] {
+        std::lock_guard<std::mutex> lock(remote_mutex);
+        return remote_id;
+    };
     
-    if (!webrtc_audio.Initialize()) {
-        std::cerr << "Failed to initialize WebRTC" << std::endl;
-        return 1;
-    }
+    signaling_client.on_registered = [&](const std::string&) {
+        std::cout << "[" << elapsed_ms() << " ms] registered" << std::endl;
+    };
     
     // Настраиваем колбэки между сигналинг клиентом и WebRTC
     signaling_client.on_offer = [&](const std::string& sdp, const std::string& sender) {
         std::cout << "Received offer from " << sender << std::endl;
-        webrtc_audio.SetRemoteDescription(sdp);
-        // Здесь должен быть код для создания answer
+        {
+            std::lock_guard<std::mutex> lock(remote_mutex);
+            remote_id = sender;
+        }
+        // Answer сформирует libdatachannel и отдаст в SetOnLocalDescription
+        webrtc_audio.SetRemoteDescription(sdp, "offer");
     };
     
     signaling_client.on_answer = [&](const std::string& sdp, const std::string& sender) {
         std::cout << "Received answer from " << sender << std::endl;
-        webrtc_audio.SetRemoteDescription(sdp);
+        {
+            std::lock_guard<std::mutex> lock(remote_mutex);
+            remote_id = sender;
+        }
+        webrtc_audio.SetRemoteDescription(sdp, "answer");
     };
     
     signaling_client.on_ice_candidate = [&](const std::string& candidate, const std::string& sender) {
@@ -224,30 +517,85 @@ int main(int argc, char* argv[]) {
     };
     
     // Настраиваем WebRTC колбэки
-    webrtc_audio.SetOnLocalDescription([&](const std::string& sdp) {
-        std::cout << "Generated local SDP" << std::endl;
-        signaling_client.SendOffer(sdp);
+    webrtc_audio.SetOnLocalDescription([&](const std::string& sdp, const std::string& type) {
+        std::cout << "[" << elapsed_ms() << " ms] local " << type << " ready" << std::endl;
+        if (type == "answer") {
+            signaling_client.SendAnswer(sdp, get_remote());
+        } else {
+            signaling_client.SendOffer(sdp, get_remote());
+        }
     });
     
+    // Кандидаты отправляются по мере сбора (trickle ICE), не дожидаясь конца сбора
     webrtc_audio.SetOnIceCandidate([&](const std::string& candidate) {
-        std::cout << "Generated ICE candidate" << std::endl;
-        // Здесь нужно определить target для отправки
-        signaling_client.SendIceCandidate(candidate, ""); 
+        signaling_client.SendIceCandidate(candidate, get_remote());
+    });
+    
+    webrtc_audio.SetOnGatheringComplete([&] {
+        std::cout << "[" << elapsed_ms() << " ms] ICE gathering complete" << std::endl;
     });
     
-    // Даем время на установку соединения
-    std::this_thread::sleep_for(std::chrono::seconds(2));
+    webrtc_audio.SetOnConnected([&] {
+        std::cout << "[" << elapsed_ms() << " ms] peer connected" << std::endl;
+    });
+    
+    webrtc_audio.SetOnFirstAudio([&] {
+        std::cout << "[" << elapsed_ms() << " ms] time to first audio" << std::endl;
+    });
     
-    // Присоединяемся к комнате
+    if (!signaling_client.Connect()) {
+        std::cerr << "Failed to connect to signaling server" << std::endl;
+        return 1;
+    }
+    
+    // Открытие аудио устройств занимает сотни миллисекунд, поэтому идет
+    // параллельно с регистрацией и сбором ICE
+    auto audio_ready = std::async(std::launch::async, [&] { webrtc_audio.PrepareAudio(); });
+    
+    // Колбэки сигналинга обращаются к peer connection, поэтому он создается
+    // до входа в комнату, после которого приходят offer и user_joined
+    if (!webrtc_audio.Initialize(webrtc_config)) {
+        std::cerr << "Failed to initialize WebRTC" << std::endl;
+        return 1;
+    }
+    
+    // Вход в комнату уходит сразу после регистрации, без фиксированных пауз
     std::cout << "Joining room: " << room_id << std::endl;
     signaling_client.JoinRoom(room_id);
     
+    audio_ready.get();
+    const auto engine = AudioEngine::Get().GetStats();
+    std::cout << "[" << elapsed_ms() << " ms] audio devices ready (PortAudio " << engine.init_ms
+              << " ms in background, waited " << engine.waited_ms << " ms)" << std::endl;
+    
     // Запускаем захват аудио
     std::cout << "Starting audio capture..." << std::endl;
     webrtc_audio.StartAudioCapture();
     
-    std::cout << "Voice chat client started. Press Enter to exit..." << std::endl;
-    std::cin.get();
+    if (!signaling_client.WaitRegistered(std::chrono::seconds(5))) {
+        std::cerr << "No response from signaling server yet, still waiting" << std::endl;
+    }
+    
+    // Пустая строка - выход, остальное - команды устройств
+    std::cout << "Voice chat client started. Press Enter to exit, or:\n" << AudioDeviceCommands() << std::flush;
+    const auto switch_input = [&](PaDeviceIndex device) { return webrtc_audio.SwitchInputDevice(device); };
+    const auto switch_output = [&](PaDeviceIndex device) { return webrtc_audio.SwitchOutputDevice(device); };
+    std::string line;
+    while (std::getline(std::cin, line) && !line.empty()) {
+        if (!RunAudioDeviceCommand(line, switch_input, switch_output)) {
+            std::cout << "Unknown command: " << line << "\n" << AudioDeviceCommands() << std::flush;
+        }
+    }
+    
+    for (const auto& thread : webrtc_audio.GetThreadStats()) {
+        std::cout << "Thread " << thread.name << ": cycles " << thread.cycles << ", deadline misses "
+                  << thread.misses << ", worst " << thread.worst_ms << " ms" << std::endl;
+    }
+    const auto latency = webrtc_audio.GetLatencyStats();
+    std::cout << "Audio " << LatencyProfileName(latency.profile) << ": input " << latency.input_ms << " ms, output "
+              << latency.output_ms << " ms, overflows " << latency.input_overflows << ", underruns "
+              << latency.output_underflows << ", tune steps " << latency.tune_steps << ", device switches "
+              << latency.switches << std::endl;
     
     // Очистка
     webrtc_audio.StopAudioCapture();
@@ -255,4 +603,4 @@ int main(int argc, char* argv[]) {
     signaling_client.Disconnect();
     
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Линейный распределитель для временных данных одного сообщения:
+// выделение - сдвиг указателя, Reset освобождает все разом. Блоки не
+// возвращаются в кучу, поэтому после прогрева обработка сообщения не
+// обращается к malloc. Не потокобезопасен.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 16 * 1024) : block_size_(block_size) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    char* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        while (current_ < blocks_.size()) {
+            Block& block = blocks_[current_];
+            const size_t offset = (used_ + align - 1) & ~(align - 1);
+            if (offset + size <= block.size) {
+                used_ = offset + size;
+                return block.data.get() + offset;
+            }
+            ++current_;
+            used_ = 0;
+        }
+
+        // Запрос больше блока получает собственный блок
+        const size_t size_needed = std::max(block_size_, size + align);
+        blocks_.push_back({std::make_unique<char[]>(size_needed), size_needed});
+        current_ = blocks_.size() - 1;
+        used_ = 0;
+        return Allocate(size, align);
+    }
+
+    std::string_view Copy(std::string_view text) {
+        char* data = Allocate(text.size(), 1);
+        std::memcpy(data, text.data(), text.size());
+        return {data, text.size()};
+    }
+
+    void Reset() noexcept {
+        current_ = 0;
+        used_ = 0;
+    }
+
+    size_t Capacity() const noexcept {
+        size_t total = 0;
+        for (const auto& block : blocks_) {
+            total += block.size;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    const size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t current_{0};
+    size_t used_{0};
+};
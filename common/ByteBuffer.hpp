@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Запись полей бинарных протоколов в сетевом порядке байт
+class ByteWriter {
+public:
+    explicit ByteWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void U8(uint8_t value) { out_.push_back(value); }
+    void U16(uint16_t value) {
+        U8(static_cast<uint8_t>(value >> 8));
+        U8(static_cast<uint8_t>(value));
+    }
+    void U32(uint32_t value) {
+        U16(static_cast<uint16_t>(value >> 16));
+        U16(static_cast<uint16_t>(value));
+    }
+    void U64(uint64_t value) {
+        U32(static_cast<uint32_t>(value >> 32));
+        U32(static_cast<uint32_t>(value));
+    }
+    void Bytes(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        out_.insert(out_.end(), bytes, bytes + size);
+    }
+    // LEB128: по 7 бит, младшие вперед
+    void Varint(uint64_t value) {
+        while (value >= 0x80) {
+            U8(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        U8(static_cast<uint8_t>(value));
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+};
+
+// Чтение полей с проверкой границ; при нехватке данных возвращает false
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    bool U8(uint8_t& value) {
+        if (Remaining() < 1) {
+            return false;
+        }
+        value = data_[offset_++];
+        return true;
+    }
+    bool U16(uint16_t& value) {
+        if (Remaining() < 2) {
+            return false;
+        }
+        value = static_cast<uint16_t>(data_[offset_] << 8 | data_[offset_ + 1]);
+        offset_ += 2;
+        return true;
+    }
+    bool U32(uint32_t& value) {
+        uint16_t high = 0;
+        uint16_t low = 0;
+        if (Remaining() < 4 || !U16(high) || !U16(low)) {
+            return false;
+        }
+        value = static_cast<uint32_t>(high) << 16 | low;
+        return true;
+    }
+    bool U64(uint64_t& value) {
+        uint32_t high = 0;
+        uint32_t low = 0;
+        if (Remaining() < 8 || !U32(high) || !U32(low)) {
+            return false;
+        }
+        value = static_cast<uint64_t>(high) << 32 | low;
+        return true;
+    }
+    bool Bytes(void* out, size_t size) {
+        if (Remaining() < size) {
+            return false;
+        }
+        std::memcpy(out, data_ + offset_, size);
+        offset_ += size;
+        return true;
+    }
+    // LEB128: по 7 бит, младшие вперед
+    bool Varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = 0;
+            if (!U8(byte)) {
+                return false;
+            }
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool Skip(size_t size) {
+        if (Remaining() < size) {
+            return false;
+        }
+        offset_ += size;
+        return true;
+    }
+
+    size_t Remaining() const noexcept { return size_ - offset_; }
+    const uint8_t* Position() const noexcept { return data_ + offset_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t offset_{0};
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <charconv>
+#include <string>
+#include <string_view>
+
+// Адрес вида "host:port" с IPv4 адресом; false, если разобрать не удалось
+inline bool ParseEndpoint(std::string_view text, sockaddr_in& address) {
+    const size_t colon = text.rfind(':');
+    if (colon == std::string_view::npos || colon == 0) {
+        return false;
+    }
+
+    unsigned port = 0;
+    const char* port_end = text.data() + text.size();
+    const auto result = std::from_chars(text.data() + colon + 1, port_end, port);
+    if (result.ec != std::errc() || result.ptr != port_end || port == 0 || port > 65535) {
+        return false;
+    }
+
+    std::string host(text.substr(0, colon));
+    if (host == "localhost") {
+        host = "127.0.0.1";
+    }
+    address = sockaddr_in{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    return inet_pton(AF_INET, host.c_str(), &address.sin_addr) == 1;
+}
+
+inline bool SameEndpoint(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Перемешивание 64-битного ключа (финализатор splitmix64): последовательные
+// идентификаторы и адреса не должны ложиться в соседние ячейки
+inline uint64_t MixHash(uint64_t x) noexcept {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+template <typename Key>
+struct FlatHash {
+    uint64_t operator()(const Key& key) const noexcept { return MixHash(static_cast<uint64_t>(key)); }
+};
+
+template <>
+struct FlatHash<std::string> {
+    uint64_t operator()(std::string_view key) const noexcept {
+        return MixHash(std::hash<std::string_view>{}(key));
+    }
+};
+
+// Хеш-таблица с открытой адресацией и линейным пробированием.
+// Ключи и значения лежат в одном непрерывном массиве, без узлов в куче;
+// удаление сдвигает хвост кластера назад, поэтому надгробий нет.
+// Указатели на значения живут до следующей вставки или удаления.
+template <typename Key, typename Value, typename Hash = FlatHash<Key>>
+class FlatMap {
+public:
+    FlatMap() = default;
+
+    size_t Size() const noexcept { return size_; }
+    bool Empty() const noexcept { return size_ == 0; }
+    size_t Capacity() const noexcept { return slots_.size(); }
+    // Память под таблицу (без памяти, на которую ссылаются сами ключи/значения)
+    size_t MemoryUsage() const noexcept { return slots_.capacity() * sizeof(Slot) + used_.capacity(); }
+
+    void Reserve(size_t count) {
+        size_t capacity = kMinCapacity;
+        while (capacity * kMaxLoadNum < count * kMaxLoadDen) {
+            capacity *= 2;
+        }
+        if (capacity > slots_.size()) {
+            Rehash(capacity);
+        }
+    }
+
+    template <typename K>
+    Value* Find(const K& key) noexcept {
+        if (size_ == 0) {
+            return nullptr;
+        }
+        for (size_t i = Home(key);; i = Next(i)) {
+            if (!used_[i]) {
+                return nullptr;
+            }
+            if (slots_[i].key == key) {
+                return &slots_[i].value;
+            }
+        }
+    }
+
+    template <typename K>
+    const Value* Find(const K& key) const noexcept {
+        return const_cast<FlatMap*>(this)->Find(key);
+    }
+
+    // Вставляет, если ключа нет. Возвращает значение и признак вставки.
+    std::pair<Value*, bool> Emplace(Key key, Value value) {
+        if ((size_ + 1) * kMaxLoadDen > slots_.size() * kMaxLoadNum) {
+            Rehash(slots_.empty() ? kMinCapacity : slots_.size() * 2);
+        }
+        size_t i = Home(key);
+        for (; used_[i]; i = Next(i)) {
+            if (slots_[i].key == key) {
+                return {&slots_[i].value, false};
+            }
+        }
+        used_[i] = 1;
+        slots_[i].key = std::move(key);
+        slots_[i].value = std::move(value);
+        ++size_;
+        return {&slots_[i].value, true};
+    }
+
+    template <typename K>
+    bool Erase(const K& key) {
+        if (size_ == 0) {
+            return false;
+        }
+        size_t hole = Home(key);
+        for (;; hole = Next(hole)) {
+            if (!used_[hole]) {
+                return false;
+            }
+            if (slots_[hole].key == key) {
+                break;
+            }
+        }
+
+        // Backward shift: переносим в дыру элементы кластера, которые
+        // могут в ней стоять, не нарушая порядка пробирования
+        for (size_t i = Next(hole); used_[i]; i = Next(i)) {
+            const size_t home = Home(slots_[i].key);
+            const bool movable = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+            if (movable) {
+                slots_[hole] = std::move(slots_[i]);
+                hole = i;
+            }
+        }
+        used_[hole] = 0;
+        slots_[hole] = Slot{};
+        --size_;
+        return true;
+    }
+
+    void Clear() {
+        slots_.clear();
+        used_.clear();
+        size_ = 0;
+    }
+
+    template <typename F>
+    void ForEach(F&& f) {
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            if (used_[i]) {
+                f(slots_[i].key, slots_[i].value);
+            }
+        }
+    }
+
+    template <typename F>
+    void ForEach(F&& f) const {
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            if (used_[i]) {
+                f(slots_[i].key, slots_[i].value);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kMinCapacity = 16;
+    // Максимальная загрузка 3/4: при линейном пробировании дальше
+    // длина кластеров растет слишком быстро
+    static constexpr size_t kMaxLoadNum = 3;
+    static constexpr size_t kMaxLoadDen = 4;
+
+    struct Slot {
+        Key key{};
+        Value value{};
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<uint8_t> used_;
+    size_t size_{0};
+
+    template <typename K>
+    size_t Home(const K& key) const noexcept {
+        return Hash{}(key) & (slots_.size() - 1);
+    }
+    size_t Next(size_t i) const noexcept { return (i + 1) & (slots_.size() - 1); }
+
+    void Rehash(size_t capacity) {
+        std::vector<Slot> old_slots(capacity);
+        std::vector<uint8_t> old_used(capacity, 0);
+        old_slots.swap(slots_);
+        old_used.swap(used_);
+        size_ = 0;
+        for (size_t i = 0; i < old_slots.size(); ++i) {
+            if (old_used[i]) {
+                Emplace(std::move(old_slots[i].key), std::move(old_slots[i].value));
+            }
+        }
+    }
+};
+
+// Пул объектов в непрерывном массиве со списком свободных индексов.
+// Индекс стабилен, пока объект не освобожден; сам массив может переехать
+// при росте, поэтому между вставками хранят индексы, а не указатели.
+template <typename T>
+class Slab {
+public:
+    uint32_t Allocate() {
+        if (!free_.empty()) {
+            const uint32_t index = free_.back();
+            free_.pop_back();
+            return index;
+        }
+        items_.emplace_back();
+        return static_cast<uint32_t>(items_.size() - 1);
+    }
+
+    void Free(uint32_t index) {
+        items_[index] = T{};
+        free_.push_back(index);
+    }
+
+    T& operator[](uint32_t index) noexcept { return items_[index]; }
+    const T& operator[](uint32_t index) const noexcept { return items_[index]; }
+
+    void Reserve(size_t count) {
+        items_.reserve(count);
+    }
+    void Clear() {
+        items_.clear();
+        free_.clear();
+    }
+
+    size_t Live() const noexcept { return items_.size() - free_.size(); }
+    size_t MemoryUsage() const noexcept {
+        return items_.capacity() * sizeof(T) + free_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    std::vector<T> items_;
+    std::vector<uint32_t> free_;
+};
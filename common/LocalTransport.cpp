@@ -0,0 +1,406 @@
+#include "LocalTransport.hpp"
+
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "MediaPacket.hpp"
+
+namespace {
+
+constexpr uint32_t kSegmentMagic = 0x5a564c54;  // "ZVLT"
+constexpr uint32_t kSegmentVersion = 1;
+// Заголовок сегмента занимает свою кэш-линию, за ним - кольцо к
+// ретранслятору, затем кольцо от него
+constexpr size_t kSegmentHeaderBytes = 64;
+constexpr size_t kLengthSize = 4;
+constexpr uint32_t kWrapMarker = UINT32_MAX;
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+};
+
+// Сообщение ретранслятора при подключении, к нему приложены memfd и eventfd
+struct AttachMessage {
+    uint32_t magic;
+    uint32_t id;
+    uint64_t capacity;
+};
+
+uint64_t Align(uint64_t size) {
+    return (size + 7) & ~uint64_t{7};
+}
+
+uint32_t* FutexWord(std::atomic<uint32_t>& word) {
+    return reinterpret_cast<uint32_t*>(&word);
+}
+
+size_t TotalSize(size_t capacity) {
+    return kSegmentHeaderBytes + 2 * LocalRing::SegmentSize(capacity);
+}
+
+}  // namespace
+
+LocalRing::LocalRing(void* memory, size_t capacity, int wake_fd)
+    : header_(static_cast<LocalRingHeader*>(memory)),
+      data_(static_cast<uint8_t*>(memory) + sizeof(LocalRingHeader)),
+      capacity_(capacity),
+      wake_fd_(wake_fd) {}
+
+size_t LocalRing::SegmentSize(size_t capacity) {
+    return sizeof(LocalRingHeader) + capacity;
+}
+
+bool LocalRing::Push(const uint8_t* data, size_t size) {
+    if (corrupt_ || size > kMaxMediaDatagram) {
+        return false;
+    }
+    const uint64_t record = Align(kLengthSize + size);
+    const uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    if (tail > position_ || position_ - tail > capacity_) {
+        corrupt_ = true;
+        return false;
+    }
+    const uint64_t used = position_ - tail;
+    uint64_t offset = position_ % capacity_;
+    const uint64_t padding = offset + record > capacity_ ? capacity_ - offset : 0;
+    if (used + padding + record > capacity_) {
+        return false;
+    }
+
+    if (padding > 0) {
+        std::memcpy(data_ + offset, &kWrapMarker, kLengthSize);
+        position_ += padding;
+        offset = 0;
+    }
+    const auto length = static_cast<uint32_t>(size);
+    std::memcpy(data_ + offset, &length, kLengthSize);
+    std::memcpy(data_ + offset + kLengthSize, data, size);
+    position_ += record;
+
+    // Публикация и проверка sleeping - обе seq_cst: в паре с
+    // PrepareSleep одна из сторон обязательно увидит другую
+    header_->head.store(position_, std::memory_order_seq_cst);
+    if (header_->sleeping.load(std::memory_order_seq_cst) != 0 && header_->sleeping.exchange(0) != 0) {
+        Wake();
+    }
+    return true;
+}
+
+size_t LocalRing::Drain(const Handler& handler) {
+    size_t count = 0;
+    while (!corrupt_) {
+        const uint64_t head = header_->head.load(std::memory_order_acquire);
+        if (head == position_) {
+            break;
+        }
+        if (head < position_ || head - position_ > capacity_) {
+            corrupt_ = true;
+            break;
+        }
+        while (position_ != head) {
+            const uint64_t offset = position_ % capacity_;
+            uint32_t length = 0;
+            std::memcpy(&length, data_ + offset, kLengthSize);
+            if (length == kWrapMarker) {
+                if (capacity_ - offset > head - position_) {
+                    corrupt_ = true;
+                    break;
+                }
+                position_ += capacity_ - offset;
+                continue;
+            }
+            const uint64_t record = Align(kLengthSize + length);
+            if (length > kMaxMediaDatagram || offset + record > capacity_ || record > head - position_) {
+                corrupt_ = true;
+                break;
+            }
+            handler(data_ + offset + kLengthSize, length);
+            ++count;
+            position_ += record;
+        }
+        // Место освобождается пачкой: писатель не ждет каждую запись
+        header_->tail.store(position_, std::memory_order_release);
+    }
+    return count;
+}
+
+bool LocalRing::Empty() const {
+    return header_->head.load(std::memory_order_acquire) == position_;
+}
+
+bool LocalRing::PrepareSleep() {
+    header_->sleeping.store(1, std::memory_order_seq_cst);
+    if (header_->head.load(std::memory_order_seq_cst) != position_) {
+        header_->sleeping.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void LocalRing::CancelSleep() {
+    header_->sleeping.store(0, std::memory_order_relaxed);
+}
+
+void LocalRing::WaitFutex(std::chrono::microseconds timeout) {
+    timespec wait{};
+    wait.tv_sec = timeout.count() / 1000000;
+    wait.tv_nsec = static_cast<long>(timeout.count() % 1000000) * 1000;
+    // Сегмент общий для двух процессов: futex не FUTEX_PRIVATE_FLAG
+    syscall(SYS_futex, FutexWord(header_->sleeping), FUTEX_WAIT, 1, &wait, nullptr, 0);
+    header_->sleeping.store(0, std::memory_order_relaxed);
+}
+
+void LocalRing::Wake() {
+    ++wakeups_;
+    if (wake_fd_ >= 0) {
+        const uint64_t one = 1;
+        [[maybe_unused]] const auto written = write(wake_fd_, &one, sizeof(one));
+        return;
+    }
+    syscall(SYS_futex, FutexWord(header_->sleeping), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+LocalMediaLink::~LocalMediaLink() {
+    Close();
+}
+
+bool LocalMediaLink::Connect(const std::string& path, std::string& error) {
+    Close();
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "socket path too long: " + path;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+
+    socket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0 || connect(socket_, (sockaddr*)&address, sizeof(address)) < 0) {
+        error = "connect " + path + ": " + std::strerror(errno);
+        Close();
+        return false;
+    }
+
+    AttachMessage message{};
+    iovec iov{&message, sizeof(message)};
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] = {};
+    msghdr header{};
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+    const auto received = recvmsg(socket_, &header, MSG_CMSG_CLOEXEC);
+
+    int fds[2] = {-1, -1};
+    const cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+    const int memory_fd = fds[0];
+    wake_fd_ = fds[1];
+    if (received != static_cast<ssize_t>(sizeof(message)) || message.magic != kSegmentMagic || memory_fd < 0 ||
+        wake_fd_ < 0 || message.capacity == 0 || message.capacity % 8 != 0) {
+        error = "relay did not send a shared memory segment";
+        if (memory_fd >= 0) {
+            close(memory_fd);
+        }
+        Close();
+        return false;
+    }
+
+    struct stat info{};
+    memory_size_ = TotalSize(message.capacity);
+    if (fstat(memory_fd, &info) != 0 || static_cast<size_t>(info.st_size) != memory_size_) {
+        error = "shared memory segment has unexpected size";
+        close(memory_fd);
+        Close();
+        return false;
+    }
+    memory_ = mmap(nullptr, memory_size_, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    close(memory_fd);
+    if (memory_ == MAP_FAILED) {
+        memory_ = nullptr;
+        error = std::string("mmap: ") + std::strerror(errno);
+        Close();
+        return false;
+    }
+
+    const auto* segment = static_cast<const SegmentHeader*>(memory_);
+    if (segment->magic != kSegmentMagic || segment->version != kSegmentVersion ||
+        segment->capacity != message.capacity) {
+        error = "shared memory segment version mismatch";
+        Close();
+        return false;
+    }
+
+    auto* base = static_cast<uint8_t*>(memory_) + kSegmentHeaderBytes;
+    uplink_ = LocalRing(base, message.capacity, wake_fd_);
+    downlink_ = LocalRing(base + LocalRing::SegmentSize(message.capacity), message.capacity, -1);
+    connected_ = true;
+    return true;
+}
+
+void LocalMediaLink::Close() {
+    connected_ = false;
+    uplink_ = LocalRing();
+    downlink_ = LocalRing();
+    if (memory_) {
+        munmap(memory_, memory_size_);
+        memory_ = nullptr;
+    }
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+        wake_fd_ = -1;
+    }
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+bool LocalMediaLink::Send(const uint8_t* data, size_t size) {
+    if (!Connected()) {
+        return false;
+    }
+    const uint64_t wakeups = uplink_.Wakeups();
+    if (!uplink_.Push(data, size)) {
+        ++send_dropped_;
+        if (uplink_.Corrupt()) {
+            connected_ = false;
+        }
+        return false;
+    }
+    ++sent_;
+    if (uplink_.Wakeups() != wakeups) {
+        ++wakeups_;
+    }
+    return true;
+}
+
+size_t LocalMediaLink::Receive(const Handler& handler, std::chrono::microseconds timeout) {
+    if (!Connected()) {
+        return 0;
+    }
+    size_t count = downlink_.Drain(handler);
+    if (count == 0 && timeout.count() > 0 && downlink_.PrepareSleep()) {
+        downlink_.WaitFutex(timeout);
+        ++waits_;
+        count = downlink_.Drain(handler);
+        // Тишина: проверяем, жив ли ретранслятор
+        if (count == 0) {
+            CheckSocket();
+        }
+    }
+    if (downlink_.Corrupt()) {
+        connected_ = false;
+    }
+    received_ += count;
+    return count;
+}
+
+LocalMediaLink::Stats LocalMediaLink::GetStats() const {
+    Stats stats;
+    stats.sent = sent_.load(std::memory_order_relaxed);
+    stats.send_dropped = send_dropped_.load(std::memory_order_relaxed);
+    stats.received = received_.load(std::memory_order_relaxed);
+    stats.waits = waits_.load(std::memory_order_relaxed);
+    stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void LocalMediaLink::CheckSocket() {
+    char byte = 0;
+    const auto result = recv(socket_, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (result == 0 || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        connected_ = false;
+    }
+}
+
+LocalAttachment::~LocalAttachment() {
+    if (memory_) {
+        munmap(memory_, memory_size_);
+    }
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+    }
+    if (connection_ >= 0) {
+        close(connection_);
+    }
+}
+
+std::unique_ptr<LocalAttachment> LocalAttachment::Offer(int connection, uint32_t id, std::string& error) {
+    std::unique_ptr<LocalAttachment> attachment(new LocalAttachment());
+    attachment->id_ = id;
+    attachment->connection_ = connection;
+    attachment->memory_size_ = TotalSize(kLocalRingBytes);
+
+    const int memory_fd = memfd_create("zvonok-local", MFD_CLOEXEC);
+    if (memory_fd < 0 || ftruncate(memory_fd, static_cast<off_t>(attachment->memory_size_)) != 0) {
+        error = std::string("memfd: ") + std::strerror(errno);
+        if (memory_fd >= 0) {
+            close(memory_fd);
+        }
+        return nullptr;
+    }
+    void* memory = mmap(nullptr, attachment->memory_size_, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    if (memory == MAP_FAILED) {
+        error = std::string("mmap: ") + std::strerror(errno);
+        close(memory_fd);
+        return nullptr;
+    }
+    attachment->memory_ = memory;
+
+    // Свежий memfd заполнен нулями: счетчики колец уже в начальном состоянии
+    auto* segment = static_cast<SegmentHeader*>(memory);
+    segment->magic = kSegmentMagic;
+    segment->version = kSegmentVersion;
+    segment->capacity = kLocalRingBytes;
+
+    attachment->wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (attachment->wake_fd_ < 0) {
+        error = std::string("eventfd: ") + std::strerror(errno);
+        close(memory_fd);
+        return nullptr;
+    }
+
+    AttachMessage message{kSegmentMagic, id, kLocalRingBytes};
+    iovec iov{&message, sizeof(message)};
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] = {};
+    msghdr header{};
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    const int fds[2] = {memory_fd, attachment->wake_fd_};
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    const auto sent = sendmsg(connection, &header, MSG_NOSIGNAL);
+    close(memory_fd);
+    if (sent != static_cast<ssize_t>(sizeof(message))) {
+        error = std::string("sendmsg: ") + std::strerror(errno);
+        return nullptr;
+    }
+
+    // Читатель кольца к ретранслятору - он сам, будить его нужно клиенту;
+    // кольцо к клиенту будит futex
+    auto* base = static_cast<uint8_t*>(memory) + kSegmentHeaderBytes;
+    attachment->uplink_ = LocalRing(base, kLocalRingBytes, -1);
+    attachment->downlink_ = LocalRing(base + LocalRing::SegmentSize(kLocalRingBytes), kLocalRingBytes, -1);
+    return attachment;
+}
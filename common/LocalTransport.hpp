@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Локальный транспорт медиа для процессов на одной машине с
+// ретранслятором (боты, запись, распознавание речи): датаграммы идут
+// через кольца в разделяемой памяти, а не через UDP стек.
+//
+// Подключение - к Unix сокету ретранслятора (--local путь). Ретранслятор
+// создает memfd с двумя кольцами и eventfd и передает их дескрипторы
+// через SCM_RIGHTS; сокет остается открытым, его закрытие - отключение.
+//
+// Кольцо - один писатель и один читатель. Запись: u32 длина и данные,
+// выровненные на 8 байт; если запись не влезает до конца буфера, на
+// хвосте остается метка переноса, а запись начинается с начала. Полное
+// кольцо теряет датаграмму, как переполненный сокет.
+//
+// Будить читателя нужно, только если он уснул: читатель взводит слово
+// sleeping и перепроверяет кольцо, писатель после публикации смотрит на
+// слово. Пока обе стороны заняты, системных вызовов нет. Клиента будит
+// futex на этом слове, ретранслятор - eventfd, который он ждет в epoll
+// вместе с остальными клиентами.
+constexpr size_t kLocalRingBytes = 256 * 1024;
+
+struct LocalRingHeader {
+    alignas(64) std::atomic<uint64_t> head;      // байт записано (писатель)
+    alignas(64) std::atomic<uint64_t> tail;      // байт прочитано (читатель)
+    alignas(64) std::atomic<uint32_t> sleeping;  // читатель ждет; слово futex
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shared memory rings need address-free atomics");
+
+// Вид на кольцо в отображенной памяти. Счетчики своей стороны хранятся
+// локально: вторая сторона может испортить разделяемые, и тогда кольцо
+// помечается испорченным, но за пределы буфера никто не пишет и не читает.
+class LocalRing {
+public:
+    using Handler = std::function<void(const uint8_t* data, size_t size)>;
+
+    LocalRing() = default;
+    // wake_fd - eventfd читателя; -1 - читатель ждет на futex
+    LocalRing(void* memory, size_t capacity, int wake_fd);
+
+    // Писатель. Копия в кольцо; false - места нет или size больше
+    // kMaxMediaDatagram
+    bool Push(const uint8_t* data, size_t size);
+
+    // Читатель. Отдает все записанное; data указывает в разделяемую
+    // память и живет до возврата из handler
+    size_t Drain(const Handler& handler);
+    bool Empty() const;
+    bool Corrupt() const noexcept { return corrupt_; }
+
+    // Читатель перед сном: false - в кольце уже есть данные
+    bool PrepareSleep();
+    void CancelSleep();
+    // Сон на futex до записи или timeout
+    void WaitFutex(std::chrono::microseconds timeout);
+
+    // Системных вызовов писателя на побудку
+    uint64_t Wakeups() const noexcept { return wakeups_; }
+
+    static size_t SegmentSize(size_t capacity);
+
+private:
+    LocalRingHeader* header_{nullptr};
+    uint8_t* data_{nullptr};
+    uint64_t capacity_{0};
+    int wake_fd_{-1};
+    uint64_t position_{0};  // head у писателя, tail у читателя
+    uint64_t wakeups_{0};
+    bool corrupt_{false};
+
+    void Wake();
+};
+
+// Подключение процесса к ретранслятору. Интерфейс - как у UDP пути
+// клиента: Send подходит в transmit MediaSession, Receive кормит
+// MediaSession::OnDatagram. Send и Receive - каждый из одного потока.
+class LocalMediaLink {
+public:
+    using Handler = LocalRing::Handler;
+
+    struct Stats {
+        uint64_t sent{0};
+        uint64_t send_dropped{0};  // кольцо к ретранслятору полно
+        uint64_t received{0};
+        uint64_t waits{0};    // снов на futex
+        uint64_t wakeups{0};  // побудок ретранслятора
+    };
+
+    LocalMediaLink() = default;
+    ~LocalMediaLink();
+
+    LocalMediaLink(const LocalMediaLink&) = delete;
+    LocalMediaLink& operator=(const LocalMediaLink&) = delete;
+
+    bool Connect(const std::string& path, std::string& error);
+    void Close();
+    // false после отключения ретранслятора или порчи кольца
+    bool Connected() const noexcept { return connected_.load(std::memory_order_relaxed); }
+
+    bool Send(const uint8_t* data, size_t size);
+    // Ждет датаграммы до timeout и отдает все накопленные; 0 - проверка
+    // без сна
+    size_t Receive(const Handler& handler, std::chrono::microseconds timeout);
+
+    Stats GetStats() const;
+
+private:
+    int socket_{-1};
+    int wake_fd_{-1};
+    void* memory_{nullptr};
+    size_t memory_size_{0};
+    LocalRing uplink_;
+    LocalRing downlink_;
+    std::atomic<bool> connected_{false};
+
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> send_dropped_{0};
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> waits_{0};
+    std::atomic<uint64_t> wakeups_{0};
+
+    void CheckSocket();
+};
+
+// Сторона ретранслятора: сегмент одного клиента
+class LocalAttachment {
+public:
+    ~LocalAttachment();
+
+    LocalAttachment(const LocalAttachment&) = delete;
+    LocalAttachment& operator=(const LocalAttachment&) = delete;
+
+    // Создает сегмент и передает его клиенту по принятому соединению;
+    // nullptr и error при неудаче, соединение тогда закрыто
+    static std::unique_ptr<LocalAttachment> Offer(int connection, uint32_t id, std::string& error);
+
+    uint32_t Id() const noexcept { return id_; }
+    int Connection() const noexcept { return connection_; }
+    int WakeFd() const noexcept { return wake_fd_; }
+
+    LocalRing& Uplink() noexcept { return uplink_; }
+    LocalRing& Downlink() noexcept { return downlink_; }
+
+private:
+    LocalAttachment() = default;
+
+    uint32_t id_{0};
+    int connection_{-1};
+    int wake_fd_{-1};
+    void* memory_{nullptr};
+    size_t memory_size_{0};
+    LocalRing uplink_;
+    LocalRing downlink_;
+};
@@ -0,0 +1,366 @@
+#include "MediaCrypto.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#if defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kNonceSize = 12;
+constexpr std::string_view kKeyPrefix = "a=crypto:";
+constexpr std::string_view kInlinePrefix = "inline:";
+
+struct SuiteInfo {
+    CipherSuite suite;
+    std::string_view name;
+    std::string_view short_name;
+    size_t key_size;
+};
+
+constexpr SuiteInfo kSuites[] = {
+    {CipherSuite::Aes128Gcm, "AEAD_AES_128_GCM", "aes128gcm", 16},
+    {CipherSuite::Aes256Gcm, "AEAD_AES_256_GCM", "aes256gcm", 32},
+    {CipherSuite::ChaCha20Poly1305, "AEAD_CHACHA20_POLY1305", "chacha20", 32},
+};
+
+const SuiteInfo* FindSuite(CipherSuite suite) {
+    for (const auto& info : kSuites) {
+        if (info.suite == suite) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+const EVP_CIPHER* SuiteCipher(CipherSuite suite) {
+    switch (suite) {
+        case CipherSuite::Aes128Gcm: return EVP_aes_128_gcm();
+        case CipherSuite::Aes256Gcm: return EVP_aes_256_gcm();
+        case CipherSuite::ChaCha20Poly1305: return EVP_chacha20_poly1305();
+    }
+    return nullptr;
+}
+
+void PutU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t GetU32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+           static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+// salt XOR (0, ssrc, индекс): у каждого пакета потока свое число
+void MakeNonce(const std::array<uint8_t, kNonceSize>& salt, uint32_t ssrc, uint32_t index, uint8_t* nonce) {
+    std::memcpy(nonce, salt.data(), kNonceSize);
+    uint8_t value[4];
+    PutU32(value, ssrc);
+    for (size_t i = 0; i < 4; ++i) {
+        nonce[4 + i] ^= value[i];
+    }
+    PutU32(value, index);
+    for (size_t i = 0; i < 4; ++i) {
+        nonce[8 + i] ^= value[i];
+    }
+}
+
+}  // namespace
+
+// Ключ ставится в контекст один раз; на пакет меняется только
+// одноразовое число. AES-GCM в OpenSSL сам выбирает AES-NI/VAES и
+// PCLMULQDQ (на ARM - инструкции AES и PMULL).
+class AeadContext {
+public:
+    AeadContext(const MediaKey& key, bool encrypt) : context_(EVP_CIPHER_CTX_new()), encrypt_(encrypt) {
+        const EVP_CIPHER* cipher = SuiteCipher(key.suite);
+        const SuiteInfo* info = FindSuite(key.suite);
+        if (!context_ || !cipher || !info || key.key.size() != info->key_size ||
+            EVP_CipherInit_ex(context_, cipher, nullptr, nullptr, nullptr, encrypt ? 1 : 0) != 1 ||
+            EVP_CIPHER_CTX_ctrl(context_, EVP_CTRL_AEAD_SET_IVLEN, kNonceSize, nullptr) != 1 ||
+            EVP_CipherInit_ex(context_, nullptr, nullptr, key.key.data(), nullptr, encrypt ? 1 : 0) != 1) {
+            EVP_CIPHER_CTX_free(context_);
+            throw std::runtime_error("Failed to initialize media cipher");
+        }
+    }
+
+    ~AeadContext() { EVP_CIPHER_CTX_free(context_); }
+
+    AeadContext(const AeadContext&) = delete;
+    AeadContext& operator=(const AeadContext&) = delete;
+
+    // Шифрует или расшифровывает payload на месте. AAD - две части:
+    // заголовок и индекс. При расшифровке tag - ожидаемый тег.
+    bool Run(const uint8_t* nonce, const uint8_t* header, size_t header_size, const uint8_t* index,
+             uint8_t* payload, size_t payload_size, uint8_t* tag) {
+        int length = 0;
+        if (EVP_CipherInit_ex(context_, nullptr, nullptr, nullptr, nonce, encrypt_ ? 1 : 0) != 1 ||
+            EVP_CipherUpdate(context_, nullptr, &length, header, static_cast<int>(header_size)) != 1 ||
+            EVP_CipherUpdate(context_, nullptr, &length, index, 4) != 1) {
+            return false;
+        }
+        if (payload_size > 0 &&
+            EVP_CipherUpdate(context_, payload, &length, payload, static_cast<int>(payload_size)) != 1) {
+            return false;
+        }
+        if (!encrypt_ && EVP_CIPHER_CTX_ctrl(context_, EVP_CTRL_AEAD_SET_TAG, kProtectionTagSize, tag) != 1) {
+            return false;
+        }
+        // Потоковые AEAD ничего не дописывают в Final; для расшифровки
+        // здесь проверяется тег
+        uint8_t unused[16];
+        if (EVP_CipherFinal_ex(context_, unused, &length) != 1) {
+            return false;
+        }
+        return !encrypt_ || EVP_CIPHER_CTX_ctrl(context_, EVP_CTRL_AEAD_GET_TAG, kProtectionTagSize, tag) == 1;
+    }
+
+private:
+    EVP_CIPHER_CTX* context_;
+    const bool encrypt_;
+};
+
+bool HasHardwareAes() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul");
+#elif defined(__aarch64__)
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+    return (hwcap & HWCAP_AES) && (hwcap & HWCAP_PMULL);
+#else
+    return false;
+#endif
+}
+
+CipherSuite PreferredCipherSuite() {
+    return HasHardwareAes() ? CipherSuite::Aes128Gcm : CipherSuite::ChaCha20Poly1305;
+}
+
+std::string_view CipherSuiteName(CipherSuite suite) {
+    const SuiteInfo* info = FindSuite(suite);
+    return info ? info->name : std::string_view();
+}
+
+bool ParseCipherSuite(std::string_view name, CipherSuite& suite) {
+    for (const auto& info : kSuites) {
+        if (name == info.name || name == info.short_name) {
+            suite = info.suite;
+            return true;
+        }
+    }
+    return false;
+}
+
+MediaKey GenerateMediaKey(CipherSuite suite) {
+    MediaKey key;
+    key.suite = suite;
+    const SuiteInfo* info = FindSuite(suite);
+    key.key.resize(info ? info->key_size : 0);
+    if (RAND_bytes(key.key.data(), static_cast<int>(key.key.size())) != 1 ||
+        RAND_bytes(key.salt.data(), static_cast<int>(key.salt.size())) != 1) {
+        throw std::runtime_error("Failed to generate media key");
+    }
+    return key;
+}
+
+std::string FormatKeyLine(uint32_t ssrc, const MediaKey& key) {
+    std::vector<uint8_t> material(key.key);
+    material.insert(material.end(), key.salt.begin(), key.salt.end());
+    std::string encoded(4 * ((material.size() + 2) / 3), '\0');
+    EVP_EncodeBlock(reinterpret_cast<unsigned char*>(encoded.data()), material.data(),
+                    static_cast<int>(material.size()));
+
+    std::string line(kKeyPrefix);
+    line += std::to_string(ssrc);
+    line += ' ';
+    line += CipherSuiteName(key.suite);
+    line += ' ';
+    line += kInlinePrefix;
+    line += encoded;
+    return line;
+}
+
+bool ParseKeyLine(std::string_view line, uint32_t& ssrc, MediaKey& key) {
+    if (line.substr(0, kKeyPrefix.size()) != kKeyPrefix) {
+        return false;
+    }
+    line.remove_prefix(kKeyPrefix.size());
+
+    const auto result = std::from_chars(line.data(), line.data() + line.size(), ssrc);
+    if (result.ec != std::errc() || result.ptr == line.data() + line.size() || *result.ptr != ' ') {
+        return false;
+    }
+    line.remove_prefix(static_cast<size_t>(result.ptr - line.data()) + 1);
+
+    const size_t space = line.find(' ');
+    if (space == std::string_view::npos || !ParseCipherSuite(line.substr(0, space), key.suite)) {
+        return false;
+    }
+    line.remove_prefix(space + 1);
+    if (line.substr(0, kInlinePrefix.size()) != kInlinePrefix) {
+        return false;
+    }
+    line.remove_prefix(kInlinePrefix.size());
+
+    const size_t key_size = FindSuite(key.suite)->key_size;
+    const size_t material_size = key_size + key.salt.size();
+    if (line.size() != 4 * ((material_size + 2) / 3)) {
+        return false;
+    }
+    std::vector<uint8_t> material(line.size() / 4 * 3);
+    if (EVP_DecodeBlock(material.data(), reinterpret_cast<const unsigned char*>(line.data()),
+                        static_cast<int>(line.size())) != static_cast<int>(material.size())) {
+        return false;
+    }
+    // DecodeBlock считает и байты дополнения '='
+    key.key.assign(material.begin(), material.begin() + static_cast<ptrdiff_t>(key_size));
+    std::memcpy(key.salt.data(), material.data() + key_size, key.salt.size());
+    return true;
+}
+
+PacketProtector::PacketProtector(uint32_t ssrc, const MediaKey& key)
+    : ssrc_(ssrc), salt_(key.salt), context_(std::make_unique<AeadContext>(key, true)) {}
+
+PacketProtector::~PacketProtector() = default;
+
+size_t PacketProtector::Protect(uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ProtectLocked(data, size);
+}
+
+void PacketProtector::ProtectBatch(CryptoPacket* packets, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < count; ++i) {
+        packets[i].size = ProtectLocked(packets[i].data, packets[i].size);
+    }
+}
+
+uint64_t PacketProtector::Protected() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_index_;
+}
+
+size_t PacketProtector::ProtectLocked(uint8_t* data, size_t size) {
+    // Индекс не должен повториться при том же ключе: дальше нужен новый
+    if (size < MediaHeader::kSize || IsProtected(data, size) || GetU32(data + 8) != ssrc_ ||
+        next_index_ > UINT32_MAX) {
+        return 0;
+    }
+    const auto index = static_cast<uint32_t>(next_index_++);
+
+    data[0] |= kProtectedFlag;
+    uint8_t* trailer = data + size;
+    PutU32(trailer, index);
+    uint8_t nonce[kNonceSize];
+    MakeNonce(salt_, ssrc_, index, nonce);
+    if (!context_->Run(nonce, data, MediaHeader::kSize, trailer, data + MediaHeader::kSize,
+                       size - MediaHeader::kSize, trailer + 4)) {
+        return 0;
+    }
+    return size + kProtectionOverhead;
+}
+
+PacketUnprotector::PacketUnprotector() = default;
+
+PacketUnprotector::~PacketUnprotector() = default;
+
+void PacketUnprotector::SetKey(uint32_t ssrc, const MediaKey& key) {
+    Stream stream;
+    stream.salt = key.salt;
+    stream.context = std::make_unique<AeadContext>(key, false);
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_[ssrc] = std::move(stream);
+}
+
+void PacketUnprotector::RemoveKey(uint32_t ssrc) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.erase(ssrc);
+}
+
+bool PacketUnprotector::HasKey(uint32_t ssrc) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.count(ssrc) != 0;
+}
+
+size_t PacketUnprotector::Unprotect(uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return UnprotectLocked(data, size);
+}
+
+void PacketUnprotector::UnprotectBatch(CryptoPacket* packets, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < count; ++i) {
+        packets[i].size = UnprotectLocked(packets[i].data, packets[i].size);
+    }
+}
+
+PacketUnprotector::Stats PacketUnprotector::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.keys = streams_.size();
+    return stats;
+}
+
+size_t PacketUnprotector::UnprotectLocked(uint8_t* data, size_t size) {
+    if (!IsProtected(data, size)) {
+        ++stats_.unprotected;
+        return 0;
+    }
+    if (size < MediaHeader::kSize + kProtectionOverhead) {
+        ++stats_.auth_failed;
+        return 0;
+    }
+    const uint32_t ssrc = GetU32(data + 8);
+    const auto it = streams_.find(ssrc);
+    if (it == streams_.end()) {
+        ++stats_.unknown_key;
+        return 0;
+    }
+    Stream& stream = it->second;
+
+    // Повтор проверяется до расшифровки, окно сдвигается только после
+    // проверки тега: подделка не может сдвинуть окно
+    uint8_t* trailer = data + size - kProtectionOverhead;
+    const uint32_t index = GetU32(trailer);
+    if (stream.started && index <= stream.highest) {
+        const uint64_t age = stream.highest - index;
+        if (age >= kReplayWindow || (stream.window >> age) & 1) {
+            ++stats_.replayed;
+            return 0;
+        }
+    }
+
+    uint8_t nonce[kNonceSize];
+    MakeNonce(stream.salt, ssrc, index, nonce);
+    const size_t payload_size = size - kProtectionOverhead - MediaHeader::kSize;
+    if (!stream.context->Run(nonce, data, MediaHeader::kSize, trailer, data + MediaHeader::kSize, payload_size,
+                             trailer + 4)) {
+        ++stats_.auth_failed;
+        return 0;
+    }
+
+    if (!stream.started) {
+        stream.started = true;
+        stream.highest = index;
+        stream.window = 1;
+    } else if (index > stream.highest) {
+        const uint64_t shift = index - stream.highest;
+        stream.window = shift >= kReplayWindow ? 1 : (stream.window << shift) | 1;
+        stream.highest = index;
+    } else {
+        stream.window |= uint64_t{1} << (stream.highest - index);
+    }
+
+    data[0] &= static_cast<uint8_t>(~kProtectedFlag);
+    ++stats_.accepted;
+    return size - kProtectionOverhead;
+}
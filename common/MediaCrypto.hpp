@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "MediaPacket.hpp"
+
+// Аутентифицированное шифрование медиа-датаграмм из конца в конец: у
+// каждого потока (ssrc) свой ключ, ретранслятор ключей не знает и
+// пересылает пакеты как есть.
+//
+// Защищенная датаграмма:
+//   | заголовок MediaHeader | шифротекст | u32 индекс | тег 16 байт |
+// Заголовок остается открытым, чтобы ретранслятор мог маршрутизировать по
+// ssrc; в первом байте взведен kProtectedFlag. Индекс - свой счетчик
+// пакетов потока: sequence заголовка у аудио и FEC общий, у отчетов - ноль,
+// и одноразовое число на нем повторялось бы. Заголовок и индекс входят в
+// AAD, одноразовое число - salt XOR (ssrc, индекс).
+//
+// Прием отбрасывает повторы по окну в kReplayWindow индексов.
+enum class CipherSuite : uint8_t {
+    Aes128Gcm = 1,
+    Aes256Gcm = 2,
+    ChaCha20Poly1305 = 3,
+};
+
+constexpr uint8_t kProtectedFlag = 0x80;
+constexpr size_t kProtectionTagSize = 16;
+constexpr size_t kProtectionOverhead = 4 + kProtectionTagSize;
+constexpr size_t kReplayWindow = 64;
+
+// AES-NI/PMULL на этом CPU: тогда AES-GCM быстрее ChaCha20-Poly1305
+bool HasHardwareAes();
+// AES-128-GCM при аппаратном AES, иначе ChaCha20-Poly1305
+CipherSuite PreferredCipherSuite();
+// Имя в строке ключа: AEAD_AES_128_GCM, AEAD_AES_256_GCM, AEAD_CHACHA20_POLY1305
+std::string_view CipherSuiteName(CipherSuite suite);
+// Принимает и имя из строки ключа, и короткое: aes128gcm, aes256gcm, chacha20
+bool ParseCipherSuite(std::string_view name, CipherSuite& suite);
+
+struct MediaKey {
+    CipherSuite suite{CipherSuite::Aes128Gcm};
+    std::vector<uint8_t> key;
+    std::array<uint8_t, 12> salt{};
+};
+
+// Ключ и salt из CSPRNG OpenSSL
+MediaKey GenerateMediaKey(CipherSuite suite);
+
+// Строка ключа потока в духе SDES (RFC 4568):
+//   a=crypto:<ssrc> <набор> inline:<base64 ключа и salt>
+std::string FormatKeyLine(uint32_t ssrc, const MediaKey& key);
+bool ParseKeyLine(std::string_view line, uint32_t& ssrc, MediaKey& key);
+
+inline bool IsProtected(const uint8_t* data, size_t size) noexcept {
+    return size > 0 && (data[0] & kProtectedFlag) != 0;
+}
+
+// Пакет пачки, шифруется и расшифровывается на месте. Буфер вмещает
+// size + kProtectionOverhead байт. После неудачной проверки size = 0.
+struct CryptoPacket {
+    uint8_t* data{nullptr};
+    size_t size{0};
+};
+
+// Контекст шифра OpenSSL с расписанием ключа, подготовленным один раз
+class AeadContext;
+
+// Шифрование своего потока. Вызывается и потоком захвата, и сетевым
+// (отчеты получателя), поэтому под мьютексом; пачка берет его один раз.
+class PacketProtector {
+public:
+    PacketProtector(uint32_t ssrc, const MediaKey& key);
+    ~PacketProtector();
+
+    // Размер защищенного пакета; 0, если пакет не медиа или индексы
+    // ключа исчерпаны
+    size_t Protect(uint8_t* data, size_t size);
+    void ProtectBatch(CryptoPacket* packets, size_t count);
+
+    uint32_t Ssrc() const noexcept { return ssrc_; }
+    uint64_t Protected() const;
+
+private:
+    const uint32_t ssrc_;
+    const std::array<uint8_t, 12> salt_;
+    std::unique_ptr<AeadContext> context_;
+    mutable std::mutex mutex_;
+    uint64_t next_index_{0};
+
+    size_t ProtectLocked(uint8_t* data, size_t size);
+};
+
+// Проверка и расшифровка чужих потоков. Ключи приходят из потока
+// сигналинга, пакеты - из сетевого; пачка берет мьютекс один раз.
+class PacketUnprotector {
+public:
+    struct Stats {
+        uint64_t accepted{0};
+        uint64_t unknown_key{0};    // ключ потока еще не пришел
+        uint64_t unprotected{0};    // открытый пакет там, где ждали защиту
+        uint64_t auth_failed{0};
+        uint64_t replayed{0};
+        size_t keys{0};
+    };
+
+    PacketUnprotector();
+    ~PacketUnprotector();
+
+    // Новый ключ потока сбрасывает его окно повторов
+    void SetKey(uint32_t ssrc, const MediaKey& key);
+    void RemoveKey(uint32_t ssrc);
+    bool HasKey(uint32_t ssrc) const;
+
+    // Размер открытого пакета; 0 - пакет отброшен
+    size_t Unprotect(uint8_t* data, size_t size);
+    void UnprotectBatch(CryptoPacket* packets, size_t count);
+
+    Stats GetStats() const;
+
+private:
+    struct Stream {
+        std::array<uint8_t, 12> salt{};
+        std::unique_ptr<AeadContext> context;
+        // Старший принятый индекс и маска kReplayWindow индексов под ним
+        uint64_t highest{0};
+        uint64_t window{0};
+        bool started{false};
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uint32_t, Stream> streams_;
+    Stats stats_;
+
+    size_t UnprotectLocked(uint8_t* data, size_t size);
+};
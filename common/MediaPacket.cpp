@@ -0,0 +1,93 @@
+#include "MediaPacket.hpp"
+
+#include "ByteBuffer.hpp"
+
+void MediaHeader::Serialize(std::vector<uint8_t>& out) const {
+    ByteWriter writer(out);
+    writer.U8(static_cast<uint8_t>(type));
+    writer.U8(codec);
+    writer.U16(sequence);
+    writer.U32(timestamp);
+    writer.U32(ssrc);
+}
+
+bool MediaHeader::Parse(const uint8_t* data, size_t size, MediaHeader& header) {
+    ByteReader reader(data, size);
+    uint8_t type = 0;
+    if (!reader.U8(type) || !reader.U8(header.codec) || !reader.U16(header.sequence) ||
+        !reader.U32(header.timestamp) || !reader.U32(header.ssrc)) {
+        return false;
+    }
+    header.type = static_cast<PacketType>(type);
+    return true;
+}
+
+std::vector<uint8_t> SenderReport::Serialize() const {
+    std::vector<uint8_t> out;
+    out.reserve(kSize);
+
+    MediaHeader header;
+    header.type = PacketType::SenderReport;
+    header.ssrc = ssrc;
+    header.Serialize(out);
+
+    ByteWriter writer(out);
+    writer.U32(send_time_ms);
+    writer.U32(packet_count);
+    writer.U32(octet_count);
+    return out;
+}
+
+bool SenderReport::Parse(const uint8_t* data, size_t size, SenderReport& report) {
+    MediaHeader header;
+    if (!MediaHeader::Parse(data, size, header) || header.type != PacketType::SenderReport) {
+        return false;
+    }
+    report.ssrc = header.ssrc;
+
+    ByteReader reader(data + MediaHeader::kSize, size - MediaHeader::kSize);
+    return reader.U32(report.send_time_ms) && reader.U32(report.packet_count) && reader.U32(report.octet_count);
+}
+
+std::vector<uint8_t> ReceiverReport::Serialize() const {
+    std::vector<uint8_t> out;
+    out.reserve(kSize);
+
+    MediaHeader header;
+    header.type = PacketType::ReceiverReport;
+    header.ssrc = reporter_ssrc;
+    header.Serialize(out);
+
+    ByteWriter writer(out);
+    writer.U32(media_ssrc);
+    writer.U8(fraction_lost);
+    writer.U8(0);
+    writer.U16(0);
+    writer.U32(cumulative_lost);
+    writer.U32(highest_sequence);
+    writer.U32(jitter);
+    writer.U32(last_sr);
+    writer.U32(delay_since_sr);
+    return out;
+}
+
+bool ReceiverReport::Parse(const uint8_t* data, size_t size, ReceiverReport& report) {
+    MediaHeader header;
+    if (!MediaHeader::Parse(data, size, header) || header.type != PacketType::ReceiverReport) {
+        return false;
+    }
+    report.reporter_ssrc = header.ssrc;
+
+    ByteReader reader(data + MediaHeader::kSize, size - MediaHeader::kSize);
+    return reader.U32(report.media_ssrc) && reader.U8(report.fraction_lost) && reader.Skip(3) &&
+           reader.U32(report.cumulative_lost) && reader.U32(report.highest_sequence) && reader.U32(report.jitter) &&
+           reader.U32(report.last_sr) && reader.U32(report.delay_since_sr);
+}
+
+bool PeekPacketType(const uint8_t* data, size_t size, PacketType& type) {
+    if (size < MediaHeader::kSize) {
+        return false;
+    }
+    type = static_cast<PacketType>(data[0]);
+    return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Формат датаграмм медиа-канала поверх UDP (и поверх WebRTC трека).
+// Все поля - в сетевом порядке байт, заголовок фиксированный, 12 байт:
+//
+//   0      1      2             4                    8                   12
+//   | type | codec| sequence    | timestamp          | ssrc              |
+//
+// timestamp считается в сэмплах на SAMPLE_RATE независимо от кодека.
+// Верхняя граница размера медиа-датаграммы для приемных буферов
+constexpr size_t kMaxMediaDatagram = 2048;
+
+enum class PacketType : uint8_t {
+    Audio = 1,
+    Fec = 2,
+    SenderReport = 3,
+    ReceiverReport = 4,
+    Bundle = 5,  // пачка кадров от ретранслятора, см. ниже
+};
+
+struct MediaHeader {
+    static constexpr size_t kSize = 12;
+
+    PacketType type{PacketType::Audio};
+    uint8_t codec{0};  // для Fec - размер защищаемой группы
+    uint16_t sequence{0};
+    uint32_t timestamp{0};
+    uint32_t ssrc{0};
+
+    void Serialize(std::vector<uint8_t>& out) const;
+    static bool Parse(const uint8_t* data, size_t size, MediaHeader& header);
+};
+
+// Отчет отправителя: нужен получателю, чтобы вернуть отметку времени для RTT
+struct SenderReport {
+    static constexpr size_t kSize = MediaHeader::kSize + 12;
+
+    uint32_t ssrc{0};
+    uint32_t send_time_ms{0};
+    uint32_t packet_count{0};
+    uint32_t octet_count{0};
+
+    std::vector<uint8_t> Serialize() const;
+    static bool Parse(const uint8_t* data, size_t size, SenderReport& report);
+};
+
+// Отчет получателя о потоке media_ssrc в духе RTCP RR
+struct ReceiverReport {
+    static constexpr size_t kSize = MediaHeader::kSize + 28;
+
+    uint32_t reporter_ssrc{0};
+    uint32_t media_ssrc{0};
+    uint8_t fraction_lost{0};  // доля потерь за интервал, Q8
+    uint32_t cumulative_lost{0};
+    uint32_t highest_sequence{0};
+    uint32_t jitter{0};        // в сэмплах
+    uint32_t last_sr{0};       // send_time_ms последнего SenderReport
+    uint32_t delay_since_sr{0};  // мс с момента его получения
+
+    std::vector<uint8_t> Serialize() const;
+    static bool Parse(const uint8_t* data, size_t size, ReceiverReport& report);
+};
+
+bool PeekPacketType(const uint8_t* data, size_t size, PacketType& type);
+
+// Пачка: кадры, которые ретранслятор должен слушателю на одном такте,
+// одной датаграммой вместо отдельной на кадр:
+//
+//   u8 PacketType::Bundle, затем для каждого кадра: u16 длина, кадр
+//
+// Кадр - исходная датаграмма участника как есть, в том числе шифрованная:
+// ретранслятор ее не разбирает. Пачки получает только клиент, который
+// объявил их в приветствии - датаграмме из u8 0 и u8 флагов.
+constexpr uint8_t kHelloAcceptsBundles = 0x01;
+// Пачка не больше пути без фрагментации и с запасом на туннели
+constexpr size_t kMaxBundleSize = 1400;
+constexpr size_t kBundleFrameHeader = 2;
+
+// f(frame, size) для каждого кадра пачки. false - датаграмма не пачка
+// или повреждена; тогда f не вызывается ни разу. Byte - uint8_t или
+// const uint8_t: клиент расшифровывает кадры на месте.
+template <typename Byte, typename F>
+bool ForEachBundled(Byte* data, size_t size, F&& f) {
+    if (size < 1 + kBundleFrameHeader || data[0] != static_cast<uint8_t>(PacketType::Bundle)) {
+        return false;
+    }
+    const auto frame_size = [data](size_t offset) { return size_t{data[offset]} << 8 | data[offset + 1]; };
+    size_t offset = 1;
+    while (offset < size) {
+        if (size - offset < kBundleFrameHeader || frame_size(offset) == 0 ||
+            frame_size(offset) > size - offset - kBundleFrameHeader) {
+            return false;
+        }
+        offset += kBundleFrameHeader + frame_size(offset);
+    }
+    for (offset = 1; offset < size; offset += kBundleFrameHeader + frame_size(offset)) {
+        f(data + offset + kBundleFrameHeader, frame_size(offset));
+    }
+    return true;
+}
@@ -0,0 +1,393 @@
+#include "NetworkImpairment.hpp"
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// Заголовки IPv4 и UDP: полоса ограничивает байты на проводе
+constexpr size_t kWireOverhead = 28;
+
+bool ParseFraction(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str()) {
+        return false;
+    }
+    if (*end == '%') {
+        value /= 100.0;
+        ++end;
+    }
+    return *end == '\0' && value >= 0.0 && value <= 1.0;
+}
+
+bool ParseDuration(const std::string& text, std::chrono::microseconds& value) {
+    char* end = nullptr;
+    const double number = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || number < 0) {
+        return false;
+    }
+    const std::string unit = end;
+    double scale = 0;
+    if (unit.empty() || unit == "ms") {
+        scale = 1e3;
+    } else if (unit == "us") {
+        scale = 1.0;
+    } else if (unit == "s") {
+        scale = 1e6;
+    } else {
+        return false;
+    }
+    value = std::chrono::microseconds(static_cast<int64_t>(number * scale));
+    return true;
+}
+
+bool ParseRate(const std::string& text, uint64_t& value) {
+    char* end = nullptr;
+    const double number = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || number <= 0) {
+        return false;
+    }
+    const std::string unit = end;
+    double scale = 0;
+    if (unit.empty() || unit == "kbit") {
+        scale = 1e3;
+    } else if (unit == "mbit") {
+        scale = 1e6;
+    } else if (unit == "bit") {
+        scale = 1.0;
+    } else {
+        return false;
+    }
+    value = static_cast<uint64_t>(number * scale);
+    return value > 0;
+}
+
+// burst=enter:exit[:loss]
+bool ParseBurst(const std::string& text, ImpairmentConfig& config) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        const size_t colon = text.find(':', start);
+        parts.push_back(text.substr(start, colon - start));
+        if (colon == std::string::npos) {
+            break;
+        }
+        start = colon + 1;
+    }
+    if (parts.size() < 2 || parts.size() > 3) {
+        return false;
+    }
+    return ParseFraction(parts[0], config.burst_enter) && ParseFraction(parts[1], config.burst_exit) &&
+           config.burst_exit > 0 && (parts.size() < 3 || ParseFraction(parts[2], config.burst_loss));
+}
+
+std::string Percent(double fraction) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%g%%", fraction * 100);
+    return text;
+}
+
+}  // namespace
+
+bool ImpairmentConfig::Enabled() const noexcept {
+    return loss > 0 || burst_enter > 0 || delay.count() > 0 || jitter.count() > 0 || reorder > 0 ||
+           duplicate > 0 || rate_bps > 0;
+}
+
+bool ParseImpairment(std::string_view spec, ImpairmentConfig& config, std::string& error) {
+    config = ImpairmentConfig{};
+    if (spec.empty() || spec == "none") {
+        return true;
+    }
+
+    size_t start = 0;
+    while (start <= spec.size()) {
+        const size_t comma = std::min(spec.find(',', start), spec.size());
+        const std::string_view item = spec.substr(start, comma - start);
+        start = comma + 1;
+        if (item.empty()) {
+            continue;
+        }
+
+        const size_t equals = item.find('=');
+        if (equals == std::string_view::npos) {
+            error = "expected key=value: " + std::string(item);
+            return false;
+        }
+        const std::string key(item.substr(0, equals));
+        const std::string value(item.substr(equals + 1));
+
+        bool valid = false;
+        if (key == "loss") {
+            valid = ParseFraction(value, config.loss);
+        } else if (key == "burst") {
+            valid = ParseBurst(value, config);
+        } else if (key == "delay") {
+            valid = ParseDuration(value, config.delay);
+        } else if (key == "jitter") {
+            valid = ParseDuration(value, config.jitter);
+        } else if (key == "reorder") {
+            valid = ParseFraction(value, config.reorder);
+        } else if (key == "dup") {
+            valid = ParseFraction(value, config.duplicate);
+        } else if (key == "rate") {
+            valid = ParseRate(value, config.rate_bps);
+        } else if (key == "queue") {
+            valid = ParseDuration(value, config.queue);
+        } else if (key == "seed") {
+            char* end = nullptr;
+            config.seed = std::strtoull(value.c_str(), &end, 10);
+            valid = !value.empty() && *end == '\0';
+        } else {
+            error = "unknown impairment: " + key;
+            return false;
+        }
+        if (!valid) {
+            error = "invalid " + key + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string DescribeImpairment(const ImpairmentConfig& config) {
+    if (!config.Enabled()) {
+        return "none";
+    }
+
+    std::string text;
+    const auto append = [&](const std::string& part) {
+        text += text.empty() ? part : ", " + part;
+    };
+    if (config.loss > 0) {
+        append("loss " + Percent(config.loss));
+    }
+    if (config.burst_enter > 0) {
+        append("burst " + Percent(config.burst_enter) + "/" + Percent(config.burst_exit) + " loss " +
+               Percent(config.burst_loss));
+    }
+    if (config.delay.count() > 0 || config.jitter.count() > 0) {
+        char part[64];
+        std::snprintf(part, sizeof(part), "delay %g ms +-%g ms", config.delay.count() / 1e3,
+                      config.jitter.count() / 1e3);
+        append(part);
+    }
+    if (config.reorder > 0) {
+        append("reorder " + Percent(config.reorder));
+    }
+    if (config.duplicate > 0) {
+        append("dup " + Percent(config.duplicate));
+    }
+    if (config.rate_bps > 0) {
+        char part[64];
+        std::snprintf(part, sizeof(part), "rate %g kbit/s, queue %g ms", config.rate_bps / 1e3,
+                      config.queue.count() / 1e3);
+        append(part);
+    }
+    append("seed " + std::to_string(config.seed));
+    return text;
+}
+
+NetworkImpairment::NetworkImpairment(const ImpairmentConfig& config) : config_(config), rng_(config.seed) {}
+
+double NetworkImpairment::Uniform() {
+    return static_cast<double>(rng_() >> 11) * 0x1.0p-53;
+}
+
+NetworkImpairment::Clock::duration NetworkImpairment::SampleDelay() {
+    auto delay = std::chrono::duration<double, std::micro>(config_.delay);
+    if (config_.jitter.count() > 0) {
+        delay += std::chrono::duration<double, std::micro>(config_.jitter) * (2.0 * Uniform() - 1.0);
+    }
+    return std::chrono::duration_cast<Clock::duration>(std::max(delay, decltype(delay)::zero()));
+}
+
+void NetworkImpairment::Submit(const uint8_t* data, size_t size, const sockaddr_in& peer, Clock::time_point now) {
+    ++stats_.offered;
+
+    // Gilbert-Elliott: состояние меняется на каждом пакете, в Bad пакет
+    // теряется с вероятностью burst_loss
+    if (config_.burst_enter > 0) {
+        bad_state_ = bad_state_ ? !Chance(config_.burst_exit) : Chance(config_.burst_enter);
+        if (bad_state_ && Chance(config_.burst_loss)) {
+            ++stats_.lost;
+            ++stats_.burst_lost;
+            return;
+        }
+    }
+    if (Chance(config_.loss)) {
+        ++stats_.lost;
+        return;
+    }
+
+    // Полоса: пакет ждет, пока канал передаст предыдущие
+    auto sent = now;
+    if (config_.rate_bps > 0) {
+        link_free_ = std::max(link_free_, now);
+        if (link_free_ - now > config_.queue) {
+            ++stats_.queue_dropped;
+            return;
+        }
+        const double seconds = static_cast<double>((size + kWireOverhead) * 8) / config_.rate_bps;
+        link_free_ += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        sent = link_free_;
+    }
+
+    if (Chance(config_.reorder)) {
+        ++stats_.reordered;
+        Enqueue(sent, data, size, peer, now);
+    } else {
+        Enqueue(sent + SampleDelay(), data, size, peer, now);
+    }
+    if (Chance(config_.duplicate)) {
+        ++stats_.duplicated;
+        Enqueue(sent + SampleDelay(), data, size, peer, now);
+    }
+}
+
+void NetworkImpairment::Enqueue(Clock::time_point due, const uint8_t* data, size_t size, const sockaddr_in& peer,
+                                Clock::time_point now) {
+    Pending pending{due, order_++, Packet{std::vector<uint8_t>(data, data + size), peer, now}};
+    pending_.push_back(std::move(pending));
+    std::push_heap(pending_.begin(), pending_.end());
+}
+
+bool NetworkImpairment::PopDue(Clock::time_point now, Packet& packet) {
+    if (pending_.empty() || pending_.front().due > now) {
+        return false;
+    }
+    std::pop_heap(pending_.begin(), pending_.end());
+    packet = std::move(pending_.back().packet);
+    pending_.pop_back();
+    ++stats_.delivered;
+    return true;
+}
+
+NetworkImpairment::Clock::time_point NetworkImpairment::NextDue() const {
+    return pending_.empty() ? Clock::time_point::max() : pending_.front().due;
+}
+
+bool ParseImpairmentArg(int& index, int argc, char* argv[], ImpairmentOptions& options) {
+    const std::string arg = argv[index];
+    if ((arg != "--impair" && arg != "--impair-in" && arg != "--impair-out") || index + 1 >= argc) {
+        return false;
+    }
+
+    const std::string spec = argv[++index];
+    ImpairmentConfig config;
+    std::string error;
+    if (!ParseImpairment(spec, config, error)) {
+        options.error = arg + " " + spec + ": " + error;
+        return true;
+    }
+    if (arg != "--impair-in") {
+        options.out = config;
+    }
+    if (arg != "--impair-out") {
+        // Направления с одним описанием не должны терять одни и те же пакеты
+        options.in = config;
+        if (arg == "--impair") {
+            options.in.seed = config.seed ^ 0x9e3779b97f4a7c15ULL;
+        }
+    }
+    return true;
+}
+
+const char* ImpairmentUsage() {
+    return "  --impair SPEC        emulate a bad network both ways, e.g. loss=2%,delay=40ms,jitter=10ms\n"
+           "  --impair-in SPEC     received datagrams only\n"
+           "  --impair-out SPEC    sent datagrams only\n"
+           "                       SPEC keys: loss, burst=enter:exit[:loss], delay, jitter, reorder, dup,\n"
+           "                       rate, queue, seed\n";
+}
+
+ImpairedSocket::ImpairedSocket(int socket_fd, const ImpairmentOptions& options)
+    : socket_fd_(socket_fd),
+      impair_in_(options.in.Enabled()),
+      impair_out_(options.out.Enabled()),
+      in_(options.in),
+      out_(options.out) {
+    if (impair_out_) {
+        sender_ = std::thread(&ImpairedSocket::SendLoop, this);
+    }
+}
+
+ImpairedSocket::~ImpairedSocket() {
+    if (!sender_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        stopping_ = true;
+    }
+    out_ready_.notify_one();
+    sender_.join();
+}
+
+void ImpairedSocket::SendTo(const sockaddr_in& to, const uint8_t* data, size_t size) {
+    if (!impair_out_) {
+        sendto(socket_fd_, data, size, 0, (const sockaddr*)&to, sizeof(to));
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        out_.Submit(data, size, to, Clock::now());
+    }
+    out_ready_.notify_one();
+}
+
+void ImpairedSocket::SendLoop() {
+    std::unique_lock<std::mutex> lock(out_mutex_);
+    NetworkImpairment::Packet packet;
+    while (!stopping_) {
+        if (out_.PopDue(Clock::now(), packet)) {
+            lock.unlock();
+            sendto(socket_fd_, packet.data.data(), packet.data.size(), 0, (const sockaddr*)&packet.peer,
+                   sizeof(packet.peer));
+            lock.lock();
+            continue;
+        }
+        const auto due = out_.NextDue();
+        if (due == Clock::time_point::max()) {
+            out_ready_.wait(lock);
+        } else {
+            out_ready_.wait_until(lock, due);
+        }
+    }
+}
+
+void ImpairedSocket::OnReceived(const uint8_t* data, size_t size, const sockaddr_in& from) {
+    std::lock_guard<std::mutex> lock(in_mutex_);
+    in_.Submit(data, size, from, Clock::now());
+}
+
+bool ImpairedSocket::PopReceived(NetworkImpairment::Packet& packet) {
+    std::lock_guard<std::mutex> lock(in_mutex_);
+    return in_.PopDue(Clock::now(), packet);
+}
+
+ImpairedSocket::Clock::duration ImpairedSocket::ReceiveTimeout(Clock::duration max_wait) const {
+    std::lock_guard<std::mutex> lock(in_mutex_);
+    const auto due = in_.NextDue();
+    if (due == Clock::time_point::max()) {
+        return max_wait;
+    }
+    return std::clamp<Clock::duration>(due - Clock::now(), Clock::duration::zero(), max_wait);
+}
+
+ImpairedSocket::Stats ImpairedSocket::GetStats() const {
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(in_mutex_);
+        stats.in = in_.GetStats();
+    }
+    {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        stats.out = out_.GetStats();
+    }
+    return stats;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Параметры плохой сети для одного направления, как у tc netem.
+//
+// Строка описания - пары key=value через запятую:
+//   loss=2%          независимые потери
+//   burst=1%:30%[:80%]  потери пачками (Gilbert-Elliott): переход
+//                    Good->Bad и Bad->Good на пакет, потери в Bad (100%)
+//   delay=40ms       задержка
+//   jitter=10ms      равномерно +-jitter к задержке, пакеты могут обгонять
+//   reorder=1%       пакет уходит без задержки, обгоняя очередь
+//   dup=0.5%         дубликат с собственным джиттером
+//   rate=256kbit     полоса (kbit, mbit, bit; без суффикса kbit)
+//   queue=200ms      очередь перед полосой, лишнее отбрасывается
+//   seed=7           зерно генератора
+// Доли - с % или числом от 0 до 1, время - us, ms (по умолчанию) или s.
+struct ImpairmentConfig {
+    double loss{0.0};
+    double burst_enter{0.0};
+    double burst_exit{1.0};
+    double burst_loss{1.0};
+    std::chrono::microseconds delay{0};
+    std::chrono::microseconds jitter{0};
+    double reorder{0.0};
+    double duplicate{0.0};
+    uint64_t rate_bps{0};
+    std::chrono::microseconds queue{std::chrono::milliseconds(200)};
+    uint64_t seed{1};
+
+    bool Enabled() const noexcept;
+};
+
+bool ParseImpairment(std::string_view spec, ImpairmentConfig& config, std::string& error);
+std::string DescribeImpairment(const ImpairmentConfig& config);
+
+// Модель канала без потоков и часов: решения принимаются при Submit по
+// зерну, поэтому одна и та же последовательность пакетов теряется,
+// дублируется и задерживается одинаково в каждом прогоне.
+class NetworkImpairment {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Packet {
+        std::vector<uint8_t> data;
+        sockaddr_in peer{};
+        Clock::time_point submitted{};
+    };
+
+    struct Stats {
+        uint64_t offered{0};
+        uint64_t delivered{0};
+        uint64_t lost{0};        // случайные и пачками
+        uint64_t burst_lost{0};  // из них в состоянии Bad
+        uint64_t queue_dropped{0};
+        uint64_t duplicated{0};
+        uint64_t reordered{0};
+    };
+
+    explicit NetworkImpairment(const ImpairmentConfig& config);
+
+    void Submit(const uint8_t* data, size_t size, const sockaddr_in& peer, Clock::time_point now);
+    // Достает пакет, время которого пришло; false - таких нет
+    bool PopDue(Clock::time_point now, Packet& packet);
+    // time_point::max(), если очередь пуста
+    Clock::time_point NextDue() const;
+
+    const ImpairmentConfig& Config() const noexcept { return config_; }
+    const Stats& GetStats() const noexcept { return stats_; }
+
+private:
+    struct Pending {
+        Clock::time_point due;
+        uint64_t order;
+        Packet packet;
+
+        // Для кучи с ближайшим сроком наверху; равные сроки уходят в порядке
+        // отправки
+        bool operator<(const Pending& other) const {
+            return due != other.due ? due > other.due : order > other.order;
+        }
+    };
+
+    const ImpairmentConfig config_;
+    std::mt19937_64 rng_;
+    bool bad_state_{false};
+    Clock::time_point link_free_{};
+    uint64_t order_{0};
+    std::vector<Pending> pending_;
+    Stats stats_;
+
+    // std::uniform_real_distribution зависит от стандартной библиотеки,
+    // а прогоны должны совпадать между сборками
+    double Uniform();
+    bool Chance(double probability) { return probability > 0 && Uniform() < probability; }
+    Clock::duration SampleDelay();
+    void Enqueue(Clock::time_point due, const uint8_t* data, size_t size, const sockaddr_in& peer,
+                 Clock::time_point now);
+};
+
+// Ухудшение обоих направлений сокета, флаги --impair/--impair-in/--impair-out
+struct ImpairmentOptions {
+    ImpairmentConfig in;
+    ImpairmentConfig out;
+    std::string error;  // неразобранное описание
+
+    bool Enabled() const noexcept { return in.Enabled() || out.Enabled(); }
+};
+
+bool ParseImpairmentArg(int& index, int argc, char* argv[], ImpairmentOptions& options);
+const char* ImpairmentUsage();
+
+// Обертка UDP-сокета для путей отправки и приема.
+//
+// Отправка: SendTo ставит датаграмму в модель, свой поток отдает ее в
+// sendto в назначенный момент. Прием: владелец цикла передает каждую
+// вычитанную датаграмму в OnReceived и забирает созревшие через
+// PopReceived в своем потоке, ограничивая ожидание ReceiveTimeout, -
+// обработчики сервера продолжают работать в потоке его цикла.
+class ImpairedSocket {
+public:
+    using Clock = NetworkImpairment::Clock;
+
+    struct Stats {
+        NetworkImpairment::Stats in;
+        NetworkImpairment::Stats out;
+    };
+
+    ImpairedSocket(int socket_fd, const ImpairmentOptions& options);
+    ~ImpairedSocket();
+
+    ImpairedSocket(const ImpairedSocket&) = delete;
+    ImpairedSocket& operator=(const ImpairedSocket&) = delete;
+
+    bool ImpairsReceive() const noexcept { return impair_in_; }
+    bool ImpairsSend() const noexcept { return impair_out_; }
+
+    // Потокобезопасно; без ухудшения отправки - сразу sendto
+    void SendTo(const sockaddr_in& to, const uint8_t* data, size_t size);
+
+    void OnReceived(const uint8_t* data, size_t size, const sockaddr_in& from);
+    bool PopReceived(NetworkImpairment::Packet& packet);
+    // Сколько ждать сокет, чтобы не пропустить срок принятой датаграммы
+    Clock::duration ReceiveTimeout(Clock::duration max_wait) const;
+
+    Stats GetStats() const;
+
+private:
+    const int socket_fd_;
+    const bool impair_in_;
+    const bool impair_out_;
+
+    mutable std::mutex in_mutex_;
+    NetworkImpairment in_;
+
+    mutable std::mutex out_mutex_;
+    std::condition_variable out_ready_;
+    NetworkImpairment out_;
+    bool stopping_{false};
+    std::thread sender_;
+
+    void SendLoop();
+};
@@ -0,0 +1,693 @@
+#include "PacketIo.hpp"
+
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#include "Endpoint.hpp"
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// Заголовки без многоразового приема (до 6.0) - только epoll
+#ifdef IORING_RECV_MULTISHOT
+#define PACKET_IO_URING 1
+#endif
+
+namespace {
+
+// Приемный буфер: датаграмма ретранслятора с запасом или склейка GRO
+constexpr size_t kDatagramBuffer = 4096;
+constexpr size_t kGroBuffer = 65536;
+
+// cmsg приема: размер склейки GRO и метка времени ядра
+size_t ReceiveControlSpace(bool gro, bool timestamps) {
+    return (gro ? CMSG_SPACE(sizeof(int)) : 0) + (timestamps ? CMSG_SPACE(sizeof(timespec)) : 0);
+}
+
+uint64_t AddressKey(const sockaddr_in& address) {
+    return static_cast<uint64_t>(address.sin_addr.s_addr) << 16 | address.sin_port;
+}
+
+}  // namespace
+
+const char* IoBackendName(IoBackend backend) {
+    switch (backend) {
+        case IoBackend::Auto:
+            return "auto";
+        case IoBackend::Epoll:
+            return "epoll";
+        case IoBackend::Uring:
+            return "uring";
+    }
+    return "unknown";
+}
+
+bool ParseIoBackend(std::string_view text, IoBackend& backend) {
+    for (IoBackend candidate : {IoBackend::Auto, IoBackend::Epoll, IoBackend::Uring}) {
+        if (text == IoBackendName(candidate)) {
+            backend = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+PacketIo::PacketIo(int socket, bool gso, bool gro, bool timestamps)
+    : socket_(socket), gso_(gso), gro_(gro), timestamps_(timestamps) {}
+
+PacketIo::~PacketIo() = default;
+
+void PacketIo::Send(const sockaddr_in& to, const uint8_t* data, size_t size) {
+    if (!current_) {
+        current_ = &AcquireBatch();
+    }
+    const auto offset = static_cast<uint32_t>(current_->data.size());
+    current_->data.insert(current_->data.end(), data, data + size);
+    current_->pending.push_back({to, offset, static_cast<uint32_t>(size)});
+    ++stats_.datagrams_sent;
+}
+
+void PacketIo::Flush() {
+    if (!current_ || current_->pending.empty()) {
+        return;
+    }
+    SendBatch& batch = *current_;
+    current_ = nullptr;
+    Build(batch);
+    Submit(batch);
+}
+
+PacketIo::SendBatch& PacketIo::AcquireBatch() {
+    for (auto& batch : batches_) {
+        if (batch->inflight == 0) {
+            batch->data.clear();
+            batch->pending.clear();
+            return *batch;
+        }
+    }
+    batches_.push_back(std::make_unique<SendBatch>());
+    batches_.back()->index = static_cast<uint32_t>(batches_.size() - 1);
+    return *batches_.back();
+}
+
+void PacketIo::Build(SendBatch& batch) {
+    auto& pending = batch.pending;
+    // Датаграммы одного адресата должны идти подряд
+    if (gso_) {
+        std::stable_sort(pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+            return AddressKey(a.to) < AddressKey(b.to);
+        });
+    }
+
+    constexpr size_t kControlSpace = CMSG_SPACE(sizeof(uint16_t));
+    batch.iov.clear();
+    batch.messages.clear();
+    batch.iov.reserve(pending.size());
+    batch.messages.reserve(pending.size());
+    batch.control.assign(pending.size() * kControlSpace, 0);
+
+    for (size_t i = 0; i < pending.size();) {
+        const auto& first = pending[i];
+        size_t count = 1;
+        size_t total = first.size;
+        // Сегменты GSO одного размера, короче может быть только последний
+        while (gso_ && i + count < pending.size() && count < kMaxSegments) {
+            const auto& next = pending[i + count];
+            if (!SameEndpoint(next.to, first.to) || next.size > first.size || total + next.size > kMaxGsoBytes) {
+                break;
+            }
+            total += next.size;
+            ++count;
+            if (next.size < first.size) {
+                break;
+            }
+        }
+
+        const size_t first_iov = batch.iov.size();
+        for (size_t k = i; k < i + count; ++k) {
+            batch.iov.push_back({batch.data.data() + pending[k].offset, pending[k].size});
+        }
+
+        mmsghdr message{};
+        message.msg_hdr.msg_name = const_cast<sockaddr_in*>(&first.to);
+        message.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        message.msg_hdr.msg_iov = &batch.iov[first_iov];
+        message.msg_hdr.msg_iovlen = count;
+        if (count > 1) {
+            message.msg_hdr.msg_control = batch.control.data() + batch.messages.size() * kControlSpace;
+            message.msg_hdr.msg_controllen = kControlSpace;
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&message.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            const auto segment = static_cast<uint16_t>(first.size);
+            std::memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+            ++stats_.gso_messages;
+        }
+        batch.messages.push_back(message);
+        i += count;
+    }
+}
+
+void PacketIo::SendFailed(const mmsghdr& message, int error) {
+    if (message.msg_hdr.msg_controllen == 0 || (error != EIO && error != EINVAL)) {
+        return;  // UDP: потерянная датаграмма не повод останавливаться
+    }
+
+    if (gso_) {
+        std::cerr << "UDP GSO rejected by kernel (" << std::strerror(error) << "), sending datagrams one by one"
+                  << std::endl;
+        gso_ = false;
+    }
+    for (size_t i = 0; i < message.msg_hdr.msg_iovlen; ++i) {
+        const iovec& segment = message.msg_hdr.msg_iov[i];
+        sendto(socket_, segment.iov_base, segment.iov_len, 0, static_cast<const sockaddr*>(message.msg_hdr.msg_name),
+               message.msg_hdr.msg_namelen);
+        ++stats_.send_calls;
+    }
+}
+
+void PacketIo::Dispatch(const uint8_t* data, size_t size, const sockaddr_in& from, const msghdr& header,
+                        const Handler& handler) {
+    int segment = 0;
+    receive_ns_ = 0;
+    if (gro_ || timestamps_) {
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&header), cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec stamp{};
+                std::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+                receive_ns_ = static_cast<int64_t>(stamp.tv_sec) * 1000000000 + stamp.tv_nsec;
+            }
+        }
+    }
+
+    if (segment <= 0 || static_cast<size_t>(segment) >= size) {
+        ++stats_.datagrams_received;
+        handler(data, size, from);
+        return;
+    }
+    for (size_t offset = 0; offset < size; offset += segment) {
+        ++stats_.datagrams_received;
+        handler(data + offset, std::min<size_t>(segment, size - offset), from);
+    }
+}
+
+namespace {
+
+// Переносимый путь: по системному вызову на пачку в каждую сторону
+class EpollIo final : public PacketIo {
+public:
+    EpollIo(int socket, bool gso, bool gro, bool timestamps)
+        : PacketIo(socket, gso, gro, timestamps),
+          batch_size_(gro ? 16 : 64),
+          buffer_size_(gro ? kGroBuffer : kDatagramBuffer),
+          control_space_(ReceiveControlSpace(gro, timestamps)),
+          buffers_(batch_size_ * buffer_size_),
+          names_(batch_size_),
+          control_(batch_size_ * control_space_),
+          iov_(batch_size_),
+          messages_(batch_size_) {
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = socket;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, socket, &event);
+    }
+
+    ~EpollIo() override {
+        if (epoll_ >= 0) {
+            close(epoll_);
+        }
+    }
+
+    IoBackend Backend() const noexcept override { return IoBackend::Epoll; }
+
+    bool Wait(int timeout_ms) override {
+        epoll_event event{};
+        return epoll_wait(epoll_, &event, 1, timeout_ms) > 0;
+    }
+
+    void Receive(const Handler& handler) override {
+        for (size_t call = 0; call < kMaxReceiveCalls; ++call) {
+            for (size_t i = 0; i < batch_size_; ++i) {
+                iov_[i] = {buffers_.data() + i * buffer_size_, buffer_size_};
+                msghdr& header = messages_[i].msg_hdr;
+                header.msg_name = &names_[i];
+                header.msg_namelen = sizeof(sockaddr_in);
+                header.msg_iov = &iov_[i];
+                header.msg_iovlen = 1;
+                header.msg_control = control_space_ ? control_.data() + i * control_space_ : nullptr;
+                header.msg_controllen = control_space_;
+                header.msg_flags = 0;
+            }
+
+            const int count = recvmmsg(socket_, messages_.data(), batch_size_, MSG_DONTWAIT, nullptr);
+            ++stats_.receive_calls;
+            if (count <= 0) {
+                return;
+            }
+            for (int i = 0; i < count; ++i) {
+                Dispatch(buffers_.data() + i * buffer_size_, messages_[i].msg_len, names_[i], messages_[i].msg_hdr,
+                         handler);
+            }
+            if (static_cast<size_t>(count) < batch_size_) {
+                return;
+            }
+        }
+    }
+
+protected:
+    void Submit(SendBatch& batch) override {
+        size_t sent = 0;
+        while (sent < batch.messages.size()) {
+            const int count = sendmmsg(socket_, &batch.messages[sent], batch.messages.size() - sent, 0);
+            ++stats_.send_calls;
+            if (count > 0) {
+                sent += count;
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            // sendmmsg останавливается на первой ошибке: пропускаем сообщение
+            SendFailed(batch.messages[sent], errno);
+            ++sent;
+        }
+        batch.inflight = 0;
+    }
+
+private:
+    // Под постоянной нагрузкой сокет не пустеет: Receive отдает не больше
+    // стольких пачек, остаток дождется следующего Wait после Flush
+    static constexpr size_t kMaxReceiveCalls = 4;
+
+    int epoll_{-1};
+    size_t batch_size_;
+    size_t buffer_size_;
+    size_t control_space_;
+    std::vector<uint8_t> buffers_;
+    std::vector<sockaddr_in> names_;
+    std::vector<uint8_t> control_;
+    std::vector<iovec> iov_;
+    std::vector<mmsghdr> messages_;
+};
+
+#ifdef PACKET_IO_URING
+
+// io_uring без liburing: кольца отображаются напрямую. Прием - один
+// многоразовый recvmsg, который сам берет буферы из кольца
+// предоставленных буферов; Receive возвращает их после обработчика.
+// Отправка - по SQE на сообщение, вся пачка одним io_uring_enter.
+// Завершения отправок забираются в Receive, до этого пачка занята.
+class UringIo final : public PacketIo {
+public:
+    static std::unique_ptr<PacketIo> Create(int socket, bool gso, bool gro, bool timestamps, std::string& error) {
+        // Многоразовый recvmsg появился в 6.0, проверить его иначе, чем
+        // по версии, можно только отправив себе датаграмму
+        utsname name{};
+        int major = 0;
+        int minor = 0;
+        if (uname(&name) != 0 || std::sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+            error = "io_uring backend needs Linux 6.0+";
+            return nullptr;
+        }
+
+        std::unique_ptr<UringIo> io(new UringIo(socket, gso, gro, timestamps));
+        if (!io->Setup(error)) {
+            return nullptr;
+        }
+        return io;
+    }
+
+    ~UringIo() override {
+        if (sqes_) {
+            munmap(sqes_, sqes_bytes_);
+        }
+        if (cq_ring_ && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_bytes_);
+        }
+        if (sq_ring_) {
+            munmap(sq_ring_, sq_ring_bytes_);
+        }
+        if (ring_ >= 0) {
+            close(ring_);
+        }
+        if (buffer_ring_) {
+            munmap(buffer_ring_, buffer_ring_bytes_);
+        }
+    }
+
+    IoBackend Backend() const noexcept override { return IoBackend::Uring; }
+
+    bool Wait(int timeout_ms) override {
+        if (HasCompletions()) {
+            return true;
+        }
+
+        __kernel_timespec timeout{};
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        io_uring_getevents_arg arg{};
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        Enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        ++stats_.receive_calls;
+        return HasCompletions();
+    }
+
+    void Receive(const Handler& handler) override {
+        bool returned = false;
+        unsigned head = *cq_head_;
+        while (true) {
+            const unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+            if (head == tail) {
+                break;
+            }
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                if (cqe.user_data == kReceiveTag) {
+                    returned |= OnReceive(cqe, handler);
+                } else {
+                    OnSent(cqe);
+                }
+            }
+            std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+        }
+
+        if (returned) {
+            std::atomic_ref<uint16_t>(buffer_ring_->tail).store(buffer_tail_, std::memory_order_release);
+        }
+        // Прием останавливается без буферов (ENOBUFS) - перевзводим, когда
+        // буферы вернулись
+        if (!receive_armed_ && !receive_failed_) {
+            ArmReceive();
+        }
+        if (sq_tail_ != SqHead()) {
+            Enter(0, 0, nullptr, 0);
+        }
+    }
+
+protected:
+    void Submit(SendBatch& batch) override {
+        size_t queued = 0;
+        for (; queued < batch.messages.size(); ++queued) {
+            io_uring_sqe* sqe = NextSqe();
+            if (!sqe) {
+                break;
+            }
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = socket_;
+            sqe->addr = reinterpret_cast<uint64_t>(&batch.messages[queued].msg_hdr);
+            sqe->len = 1;
+            sqe->user_data = static_cast<uint64_t>(batch.index) << 32 | queued;
+        }
+        batch.inflight = queued;
+        Enter(0, 0, nullptr, 0);
+        ++stats_.send_calls;
+
+        // Кольцо не освободилось: остаток пачки - обычными sendmsg
+        for (size_t i = queued; i < batch.messages.size(); ++i) {
+            if (sendmsg(socket_, &batch.messages[i].msg_hdr, 0) < 0) {
+                SendFailed(batch.messages[i], errno);
+            }
+            ++stats_.send_calls;
+        }
+    }
+
+private:
+    static constexpr unsigned kEntries = 256;
+    static constexpr unsigned kCompletionEntries = 4096;
+    static constexpr uint16_t kBufferGroup = 0;
+    static constexpr uint64_t kReceiveTag = UINT64_MAX;
+    // Попыток отдать ядру полное кольцо отправки до отказа в SQE
+    static constexpr int kMaxEnterAttempts = 3;
+
+    int ring_{-1};
+    void* sq_ring_{nullptr};
+    void* cq_ring_{nullptr};
+    size_t sq_ring_bytes_{0};
+    size_t cq_ring_bytes_{0};
+    size_t sqes_bytes_{0};
+
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_shared_{nullptr};
+    unsigned sq_tail_{0};
+    unsigned sq_mask_{0};
+    unsigned sq_entries_{0};
+    io_uring_sqe* sqes_{nullptr};
+
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+
+    io_uring_buf_ring* buffer_ring_{nullptr};
+    size_t buffer_ring_bytes_{0};
+    unsigned buffer_count_;
+    size_t buffer_size_;
+    uint16_t buffer_tail_{0};
+    std::unique_ptr<uint8_t[]> buffers_;
+
+    // Шаблон для recvmsg: ядро берет из него размеры имени и cmsg
+    msghdr receive_header_{};
+    bool receive_armed_{false};
+    bool receive_failed_{false};
+
+    UringIo(int socket, bool gso, bool gro, bool timestamps)
+        : PacketIo(socket, gso, gro, timestamps),
+          buffer_count_(gro ? 64 : 512),
+          buffer_size_((gro ? kGroBuffer : kDatagramBuffer) + 128) {}
+
+    bool Setup(std::string& error) {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = kCompletionEntries;
+        ring_ = static_cast<int>(syscall(__NR_io_uring_setup, kEntries, &params));
+        if (ring_ < 0 && errno == EINVAL) {
+            params = {};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = kCompletionEntries;
+            ring_ = static_cast<int>(syscall(__NR_io_uring_setup, kEntries, &params));
+        }
+        if (ring_ < 0) {
+            error = std::string("io_uring_setup: ") + std::strerror(errno);
+            return false;
+        }
+        if (!(params.features & IORING_FEAT_EXT_ARG)) {
+            error = "io_uring without IORING_FEAT_EXT_ARG";
+            return false;
+        }
+
+        sq_ring_bytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_bytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_bytes_ = cq_ring_bytes_ = std::max(sq_ring_bytes_, cq_ring_bytes_);
+        }
+        sq_ring_ = Map(sq_ring_bytes_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap ? sq_ring_ : Map(cq_ring_bytes_, IORING_OFF_CQ_RING);
+        sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(Map(sqes_bytes_, IORING_OFF_SQES));
+        if (!sq_ring_ || !cq_ring_ || !sqes_) {
+            error = std::string("io_uring mmap: ") + std::strerror(errno);
+            return false;
+        }
+
+        auto* sq = static_cast<uint8_t*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_shared_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_tail_ = *sq_tail_shared_;
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        // Индексы SQE совпадают с позициями в кольце
+        auto* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries_; ++i) {
+            array[i] = i;
+        }
+
+        auto* cq = static_cast<uint8_t*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        buffer_ring_bytes_ = buffer_count_ * sizeof(io_uring_buf);
+        void* buffer_ring = mmap(nullptr, buffer_ring_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer_ring == MAP_FAILED) {
+            error = std::string("buffer ring mmap: ") + std::strerror(errno);
+            return false;
+        }
+        buffer_ring_ = static_cast<io_uring_buf_ring*>(buffer_ring);
+
+        io_uring_buf_reg registration{};
+        registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+        registration.ring_entries = buffer_count_;
+        registration.bgid = kBufferGroup;
+        if (syscall(__NR_io_uring_register, ring_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+            error = std::string("io_uring buffer ring: ") + std::strerror(errno);
+            return false;
+        }
+
+        buffers_ = std::make_unique<uint8_t[]>(buffer_count_ * buffer_size_);
+        for (unsigned i = 0; i < buffer_count_; ++i) {
+            ReturnBuffer(static_cast<uint16_t>(i));
+        }
+        std::atomic_ref<uint16_t>(buffer_ring_->tail).store(buffer_tail_, std::memory_order_release);
+
+        receive_header_.msg_namelen = sizeof(sockaddr_in);
+        receive_header_.msg_controllen = ReceiveControlSpace(gro_, timestamps_);
+        ArmReceive();
+        Enter(0, 0, nullptr, 0);
+        return true;
+    }
+
+    void* Map(size_t bytes, off_t offset) {
+        void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    unsigned SqHead() const {
+        return std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+    }
+
+    bool HasCompletions() const {
+        return *cq_head_ != std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+    }
+
+    // Отправляет заполненные SQE ядру и, если wait > 0, ждет завершений.
+    // false - вызов не прошел (EINTR, EAGAIN, EBUSY при полной очереди
+    // завершений): SQE остаются в кольце до следующего Enter
+    bool Enter(unsigned wait, unsigned flags, void* arg, size_t arg_size) {
+        std::atomic_ref<unsigned>(*sq_tail_shared_).store(sq_tail_, std::memory_order_release);
+        const unsigned to_submit = sq_tail_ - SqHead();
+        return syscall(__NR_io_uring_enter, ring_, to_submit, wait, flags, arg, arg_size) >= 0;
+    }
+
+    // nullptr - кольцо полно, а ядро его не забрало: SQE под хвостом еще
+    // не отправлен, и писать в него нельзя
+    io_uring_sqe* NextSqe() {
+        for (int attempt = 0; sq_tail_ - SqHead() >= sq_entries_; ++attempt) {
+            if (attempt == kMaxEnterAttempts) {
+                return nullptr;
+            }
+            Enter(0, 0, nullptr, 0);
+        }
+        io_uring_sqe* sqe = &sqes_[sq_tail_ & sq_mask_];
+        std::memset(sqe, 0, sizeof(*sqe));
+        ++sq_tail_;
+        return sqe;
+    }
+
+    void ArmReceive() {
+        io_uring_sqe* sqe = NextSqe();
+        if (!sqe) {
+            return;  // перевзведем в следующем Receive
+        }
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = socket_;
+        sqe->addr = reinterpret_cast<uint64_t>(&receive_header_);
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = kReceiveTag;
+        receive_armed_ = true;
+    }
+
+    void ReturnBuffer(uint16_t id) {
+        // Поле resv первого элемента занято хвостом кольца, его не трогаем.
+        // bufs не используется: в C++ __DECLARE_FLEX_ARRAY сдвигает его на 8 байт
+        auto* entries = reinterpret_cast<io_uring_buf*>(buffer_ring_);
+        io_uring_buf& buffer = entries[buffer_tail_ & (buffer_count_ - 1)];
+        buffer.addr = reinterpret_cast<uint64_t>(buffers_.get() + id * buffer_size_);
+        buffer.len = static_cast<uint32_t>(buffer_size_);
+        buffer.bid = id;
+        ++buffer_tail_;
+    }
+
+    // true, если буфер возвращен в кольцо
+    bool OnReceive(const io_uring_cqe& cqe, const Handler& handler) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            receive_armed_ = false;
+        }
+        if (cqe.res < 0) {
+            if (cqe.res != -ENOBUFS) {
+                std::cerr << "io_uring recvmsg failed: " << std::strerror(-cqe.res) << std::endl;
+                receive_failed_ = cqe.res == -EINVAL;
+            }
+            return false;
+        }
+        if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+            return false;
+        }
+
+        const auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        uint8_t* buffer = buffers_.get() + id * buffer_size_;
+        // Буфер: io_uring_recvmsg_out, имя и cmsg размеров из шаблона, данные
+        const auto* out = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+        const size_t header = sizeof(*out) + receive_header_.msg_namelen + receive_header_.msg_controllen;
+        const size_t received = static_cast<size_t>(cqe.res);
+        if (received >= header && !(out->flags & MSG_TRUNC)) {
+            sockaddr_in from{};
+            std::memcpy(&from, buffer + sizeof(*out), std::min<size_t>(out->namelen, sizeof(from)));
+            msghdr view{};
+            view.msg_control = buffer + sizeof(*out) + receive_header_.msg_namelen;
+            view.msg_controllen = out->controllen;
+            const size_t size = std::min<size_t>(out->payloadlen, received - header);
+            Dispatch(buffer + header, size, from, view, handler);
+        }
+        ReturnBuffer(id);
+        return true;
+    }
+
+    void OnSent(const io_uring_cqe& cqe) {
+        SendBatch& batch = *batches_[cqe.user_data >> 32];
+        if (cqe.res < 0) {
+            SendFailed(batch.messages[cqe.user_data & 0xffffffff], -cqe.res);
+        }
+        --batch.inflight;
+    }
+};
+
+#endif
+
+}  // namespace
+
+std::unique_ptr<PacketIo> PacketIo::Create(int socket, const PacketIoOptions& options, std::string& error) {
+    int value = 0;
+    socklen_t length = sizeof(value);
+    const bool gso = options.gso && getsockopt(socket, SOL_UDP, UDP_SEGMENT, &value, &length) == 0;
+    const int enable = 1;
+    const bool gro = options.gro && setsockopt(socket, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+    const bool timestamps =
+        options.timestamps && setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0;
+
+    if (options.backend != IoBackend::Epoll) {
+#ifdef PACKET_IO_URING
+        if (auto io = UringIo::Create(socket, gso, gro, timestamps, error)) {
+            return io;
+        }
+#else
+        error = "io_uring is not available in this build";
+#endif
+        if (options.backend == IoBackend::Uring) {
+            return nullptr;
+        }
+        error.clear();
+    }
+    return std::make_unique<EpollIo>(socket, gso, gro, timestamps);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Пакетный ввод-вывод UDP сокета для ретрансляторов: прием пачками и
+// отложенная отправка, уходящая одним системным вызовом на Flush.
+//
+//   epoll  переносимый путь: epoll_wait, recvmmsg и sendmmsg
+//   uring  io_uring: многоразовый (multishot) recvmsg в кольцо
+//          предоставленных буферов, отправки пачкой SQE за один
+//          io_uring_enter; нужен Linux 6.0+
+//
+// Оба бэкенда используют UDP_SEGMENT (GSO): подряд идущие датаграммы
+// одному адресату одного размера уходят одним сообщением, ядро режет их
+// само. С UDP_GRO ядро склеивает входящие датаграммы одного потока, и
+// Receive разрезает их обратно. Порядок датаграмм к одному адресату
+// сохраняется, между адресатами - нет.
+enum class IoBackend : uint8_t {
+    Auto,  // uring, если ядро умеет, иначе epoll
+    Epoll,
+    Uring,
+};
+
+const char* IoBackendName(IoBackend backend);
+bool ParseIoBackend(std::string_view text, IoBackend& backend);
+
+struct PacketIoOptions {
+    IoBackend backend{IoBackend::Auto};
+    bool gso{true};
+    bool gro{true};
+    // SO_TIMESTAMPNS: время приема ядром для ReceiveTime
+    bool timestamps{false};
+};
+
+class PacketIo {
+public:
+    using Handler = std::function<void(const uint8_t* data, size_t size, const sockaddr_in& from)>;
+
+    struct Stats {
+        uint64_t datagrams_received{0};
+        uint64_t datagrams_sent{0};
+        uint64_t receive_calls{0};  // системных вызовов на прием
+        uint64_t send_calls{0};     // системных вызовов на отправку
+        uint64_t gso_messages{0};   // сообщений, несущих несколько датаграмм
+    };
+
+    // socket - привязанный UDP сокет, остается за вызывающим.
+    // nullptr и error, если выбранный бэкенд недоступен; Auto падает
+    // на epoll молча.
+    static std::unique_ptr<PacketIo> Create(int socket, const PacketIoOptions& options, std::string& error);
+
+    virtual ~PacketIo();
+
+    PacketIo(const PacketIo&) = delete;
+    PacketIo& operator=(const PacketIo&) = delete;
+
+    virtual IoBackend Backend() const noexcept = 0;
+    bool Gso() const noexcept { return gso_; }
+    bool Gro() const noexcept { return gro_; }
+    // Время приема текущей датаграммы ядром (CLOCK_REALTIME, нс); верно
+    // внутри обработчика Receive, 0 - меток нет
+    int64_t ReceiveTime() const noexcept { return receive_ns_; }
+    const Stats& GetStats() const noexcept { return stats_; }
+
+    // true, если есть что принять
+    virtual bool Wait(int timeout_ms) = 0;
+    // Все принятые датаграммы; handler может вызывать Send
+    virtual void Receive(const Handler& handler) = 0;
+
+    // Данные копируются, отправка - на Flush
+    void Send(const sockaddr_in& to, const uint8_t* data, size_t size);
+    void Flush();
+
+protected:
+    static constexpr size_t kMaxSegments = 64;
+    static constexpr size_t kMaxGsoBytes = 65000;
+
+    // Датаграммы одного Flush и все, что нужно ядру для их отправки.
+    // uring держит пачку до прихода завершений.
+    struct SendBatch {
+        struct Pending {
+            sockaddr_in to;
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        std::vector<uint8_t> data;
+        std::vector<Pending> pending;
+        std::vector<iovec> iov;
+        std::vector<mmsghdr> messages;
+        std::vector<uint8_t> control;
+        uint32_t index{0};  // позиция в batches_
+        size_t inflight{0};
+    };
+
+    PacketIo(int socket, bool gso, bool gro, bool timestamps);
+
+    // Отправить messages пачки; по завершении inflight должен стать 0
+    virtual void Submit(SendBatch& batch) = 0;
+
+    // Ошибка отправки сообщения; если ядро отвергло GSO, оно выключается,
+    // а датаграммы сообщения уходят поштучно
+    void SendFailed(const mmsghdr& message, int error);
+    // Разрезает склеенную GRO датаграмму по размеру из cmsg и запоминает
+    // метку времени
+    void Dispatch(const uint8_t* data, size_t size, const sockaddr_in& from, const msghdr& header,
+                  const Handler& handler);
+
+    int socket_;
+    bool gso_;
+    bool gro_;
+    bool timestamps_;
+    int64_t receive_ns_{0};
+    Stats stats_;
+    std::vector<std::unique_ptr<SendBatch>> batches_;
+
+private:
+    SendBatch* current_{nullptr};
+
+    SendBatch& AcquireBatch();
+    void Build(SendBatch& batch);
+};
@@ -0,0 +1,171 @@
+#include "Planes.hpp"
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+constexpr int kExpeditedTos = 46 << 2;
+// TC_PRIO_INTERACTIVE; значения до 6 разрешены без CAP_NET_ADMIN
+constexpr int kMediaSocketPriority = 6;
+constexpr int kMediaFifoPriority = 50;
+constexpr int kSignalingNice = 10;
+
+}  // namespace
+
+const char* PlaneName(Plane plane) {
+    return plane == Plane::Media ? "media" : "signaling";
+}
+
+bool MarkMediaSocket(int socket, std::string& error) {
+    if (setsockopt(socket, IPPROTO_IP, IP_TOS, &kExpeditedTos, sizeof(kExpeditedTos)) < 0) {
+        error = std::string("IP_TOS: ") + std::strerror(errno);
+        return false;
+    }
+    if (setsockopt(socket, SOL_SOCKET, SO_PRIORITY, &kMediaSocketPriority, sizeof(kMediaSocketPriority)) < 0) {
+        error = std::string("SO_PRIORITY: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+std::string EnterPlaneThread(Plane plane) {
+    if (plane == Plane::Media) {
+        sched_param param{};
+        param.sched_priority = kMediaFifoPriority;
+        const int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (result == 0) {
+            return "SCHED_FIFO " + std::to_string(kMediaFifoPriority);
+        }
+        return std::string("default scheduling (SCHED_FIFO: ") + std::strerror(result) + ")";
+    }
+
+    sched_param param{};
+    std::string applied;
+    if (pthread_setschedparam(pthread_self(), SCHED_BATCH, &param) == 0) {
+        applied = "SCHED_BATCH";
+    }
+    // nice на Linux действует на поток по его tid
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), kSignalingNice) == 0) {
+        applied += (applied.empty() ? "" : ", ") + std::string("nice ") + std::to_string(kSignalingNice);
+    }
+    return applied.empty() ? "default scheduling" : applied;
+}
+
+bool MediaFirstGate::YieldToMedia() noexcept {
+    if (!busy_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    yields_.fetch_add(1, std::memory_order_relaxed);
+    const auto deadline = std::chrono::steady_clock::now() + kMaxYield;
+    while (busy_.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+// До 4 - точно, дальше октава и два следующих за старшим бита
+size_t PlaneHistogram::BucketOf(uint64_t value) noexcept {
+    if (value < 4) {
+        return static_cast<size_t>(value);
+    }
+    const int octave = 63 - __builtin_clzll(value);
+    const auto sub = static_cast<size_t>((value >> (octave - 2)) & 3);
+    return 4 + static_cast<size_t>(octave - 2) * 4 + sub;
+}
+
+// Середина корзины
+double PlaneHistogram::BucketValue(size_t bucket) noexcept {
+    if (bucket < 4) {
+        return static_cast<double>(bucket);
+    }
+    const size_t octave = (bucket - 4) / 4 + 2;
+    const size_t sub = (bucket - 4) % 4;
+    const double low = static_cast<double>(4 + sub) * static_cast<double>(uint64_t{1} << (octave - 2));
+    return low + static_cast<double>(uint64_t{1} << (octave - 2)) / 2;
+}
+
+void PlaneHistogram::Record(uint64_t value) noexcept {
+    buckets_[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+PlaneHistogram::Summary PlaneHistogram::Take() noexcept {
+    std::array<uint64_t, kBuckets> counts{};
+    Summary summary;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        counts[i] = buckets_[i].exchange(0, std::memory_order_relaxed);
+        summary.count += counts[i];
+    }
+    summary.max = static_cast<double>(max_.exchange(0, std::memory_order_relaxed));
+    if (summary.count == 0) {
+        return summary;
+    }
+
+    const auto quantile = [&](double q) {
+        const auto rank = static_cast<uint64_t>(q * static_cast<double>(summary.count - 1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts[i];
+            if (seen > rank) {
+                return std::min(BucketValue(i), summary.max);
+            }
+        }
+        return summary.max;
+    };
+    summary.p50 = quantile(0.50);
+    summary.p99 = quantile(0.99);
+    return summary;
+}
+
+std::string DescribePlaneStats(Plane plane, const PlaneStats& stats) {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(0);
+    out << PlaneName(plane) << " plane: " << stats.packets << " packets, queue p99 " << stats.queue_p99 << " max "
+        << stats.queue_max << ", latency p50 " << stats.latency_p50_us << " us p99 " << stats.latency_p99_us
+        << " us max " << stats.latency_max_us << " us";
+    if (plane == Plane::Signaling) {
+        out << ", " << stats.yields << " yields to media";
+    }
+    return out.str();
+}
+
+int64_t PlaneMetrics::RealtimeNs() noexcept {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void PlaneMetrics::OnHandled(int64_t received_ns, int64_t done_ns) noexcept {
+    if (received_ns > 0 && done_ns > received_ns) {
+        latency_ns_.Record(static_cast<uint64_t>(done_ns - received_ns));
+    }
+}
+
+PlaneStats PlaneMetrics::Take() noexcept {
+    const auto queue = queue_.Take();
+    const auto latency = latency_ns_.Take();
+    PlaneStats stats;
+    stats.packets = latency.count;
+    stats.queue_p99 = queue.p99;
+    stats.queue_max = queue.max;
+    stats.latency_p50_us = latency.p50 / 1000;
+    stats.latency_p99_us = latency.p99 / 1000;
+    stats.latency_max_us = latency.max / 1000;
+    return stats;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Два плана трафика серверов и клиентов. Медиа - датаграммы реального
+// времени: ретранслятор пересылает их, не разбирая, и каждая
+// миллисекунда задержки слышна. Сигналинг - регистрация, комнаты,
+// SDP и ключи: работы на сообщение много, но подождать оно может.
+//
+// Планы разведены по сокетам и портам, медиа помечается DSCP EF, а в
+// процессе, где работают оба (signaling_server --media), поток медиа
+// получает приоритет, а сигналинг уступает ему процессор (MediaFirstGate).
+constexpr int kDefaultMediaPort = 12350;
+constexpr int kDefaultSignalingPort = 12345;
+
+enum class Plane : uint8_t {
+    Media,
+    Signaling,
+};
+
+const char* PlaneName(Plane plane);
+
+// DSCP EF (46) в IP_TOS и SO_PRIORITY 6: очередь с приоритетом в
+// qdisc хоста и на маршрутизаторах, которые доверяют разметке
+bool MarkMediaSocket(int socket, std::string& error);
+
+// Поток плана в процессе с обоими планами. Медиа - SCHED_FIFO, если
+// хватает прав (CAP_SYS_NICE или RLIMIT_RTPRIO); сигналинг - SCHED_BATCH
+// с nice 10, что разрешено без прав и само по себе отдает медиа почти
+// весь процессор при конкуренции. Возвращает, что удалось применить.
+std::string EnterPlaneThread(Plane plane);
+
+// Медиа прежде сигналинга: поток медиа держит окно от пробуждения до
+// отправки пачки, поток сигналинга перед каждой порцией сообщений ждет,
+// пока окно закроется, но не дольше kMaxYield - сигналинг не голодает.
+class MediaFirstGate {
+public:
+    static constexpr auto kMaxYield = std::chrono::milliseconds(2);
+
+    void MediaBusy(bool busy) noexcept { busy_.store(busy, std::memory_order_release); }
+    // true - пришлось уступить
+    bool YieldToMedia() noexcept;
+    uint64_t Yields() const noexcept { return yields_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> busy_{false};
+    std::atomic<uint64_t> yields_{0};
+};
+
+// Распределение за окно: корзины по четверти октавы, запись - один
+// атомарный инкремент из потока плана, Take читает из любого потока и
+// начинает новое окно. Значения выдаются с точностью корзины (~19%).
+class PlaneHistogram {
+public:
+    struct Summary {
+        uint64_t count{0};
+        double p50{0.0};
+        double p99{0.0};
+        double max{0.0};
+    };
+
+    void Record(uint64_t value) noexcept;
+    Summary Take() noexcept;
+
+private:
+    static constexpr size_t kBuckets = 4 + 62 * 4;
+
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> max_{0};
+
+    static size_t BucketOf(uint64_t value) noexcept;
+    static double BucketValue(size_t bucket) noexcept;
+};
+
+// Метрики плана за окно между вызовами Take
+struct PlaneStats {
+    uint64_t packets{0};
+    // Очередь: датаграмм, накопившихся в сокете к пробуждению потока
+    double queue_p99{0.0};
+    double queue_max{0.0};
+    // От приема ядром (SO_TIMESTAMPNS) до конца обработки, включая
+    // отправку ответов или пересылку
+    double latency_p50_us{0.0};
+    double latency_p99_us{0.0};
+    double latency_max_us{0.0};
+    uint64_t yields{0};  // сигналинг уступил медиа
+};
+
+// Строка для периодической статистики серверов
+std::string DescribePlaneStats(Plane plane, const PlaneStats& stats);
+
+class PlaneMetrics {
+public:
+    // Часы меток ядра - CLOCK_REALTIME
+    static int64_t RealtimeNs() noexcept;
+
+    void OnWakeup(size_t queued) noexcept { queue_.Record(queued); }
+    // received_ns - метка ядра, 0 - метки нет
+    void OnHandled(int64_t received_ns, int64_t done_ns) noexcept;
+    PlaneStats Take() noexcept;
+
+private:
+    PlaneHistogram queue_;
+    PlaneHistogram latency_ns_;
+};
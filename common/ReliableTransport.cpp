@@ -0,0 +1,559 @@
+#include "ReliableTransport.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "ByteBuffer.hpp"
+#include "NetworkImpairment.hpp"
+#include "Timeline.hpp"
+#include "TraceFile.hpp"
+
+namespace {
+
+uint32_t GenerateEpoch() {
+    static std::random_device rd;
+    static std::mt19937 gen(rd());
+    static std::uniform_int_distribution<uint32_t> dis(1, UINT32_MAX);
+    return dis(gen);
+}
+
+}  // namespace
+
+ReliableTransport::ReliableTransport(int socket_fd, Deliver deliver, Clock::duration coalesce_delay)
+    : socket_fd_(socket_fd),
+      deliver_(std::move(deliver)),
+      coalesce_delay_(coalesce_delay),
+      receive_buffer_(kMaxReceiveSize) {
+    // Пайп будит цикл приема, когда Send вызван из другого потока
+    if (pipe(wake_pipe_) == 0) {
+        fcntl(wake_pipe_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_pipe_[1], F_SETFL, O_NONBLOCK);
+    }
+}
+
+ReliableTransport::~ReliableTransport() {
+    for (int fd : wake_pipe_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void ReliableTransport::Send(const sockaddr_in& to, std::string message) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& peer = GetPeer(to);
+        ++stats_.messages_sent;
+
+        if (peer.legacy) {
+            SendDatagram(reinterpret_cast<const uint8_t*>(message.data()), message.size(), peer.address);
+            ++stats_.datagrams_sent;
+            return;
+        }
+
+        if (peer.queued.empty()) {
+            peer.queued_since = Clock::now();
+        }
+        peer.queued.push_back(std::move(message));
+        wake = std::this_thread::get_id() != loop_thread_;
+    }
+
+    if (wake && wake_pipe_[1] >= 0) {
+        const char byte = 0;
+        [[maybe_unused]] const auto written = write(wake_pipe_[1], &byte, 1);
+    }
+}
+
+bool ReliableTransport::WaitReadable(std::chrono::milliseconds max_wait) {
+    Clock::duration timeout;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loop_thread_ = std::this_thread::get_id();
+        timeout = std::min<Clock::duration>(max_wait, TimeUntilNextTimer(Clock::now()));
+    }
+    if (impairment_) {
+        timeout = impairment_->ReceiveTimeout(timeout);
+    }
+
+    pollfd fds[2] = {{socket_fd_, POLLIN, 0}, {wake_pipe_[0], POLLIN, 0}};
+    const int nfds = wake_pipe_[0] >= 0 ? 2 : 1;
+    const auto timeout_ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+    if (poll(fds, nfds, static_cast<int>(timeout_ms)) <= 0) {
+        return false;
+    }
+
+    if (nfds > 1 && (fds[1].revents & POLLIN)) {
+        char drain[64];
+        while (read(wake_pipe_[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+    return fds[0].revents & POLLIN;
+}
+
+void ReliableTransport::EnableTimestamps() {
+    const int enable = 1;
+    timestamps_ = setsockopt(socket_fd_, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0;
+}
+
+size_t ReliableTransport::ReceiveAll(size_t max) {
+    sockaddr_in from{};
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(timespec))];
+    iovec iov{receive_buffer_.data(), receive_buffer_.size()};
+    size_t received = 0;
+    while (received < max) {
+        msghdr header{};
+        header.msg_name = &from;
+        header.msg_namelen = sizeof(from);
+        header.msg_iov = &iov;
+        header.msg_iovlen = 1;
+        header.msg_control = timestamps_ ? control : nullptr;
+        header.msg_controllen = timestamps_ ? sizeof(control) : 0;
+        const auto bytes = recvmsg(socket_fd_, &header, MSG_DONTWAIT);
+        if (bytes <= 0) {
+            break;
+        }
+        ++received;
+        receive_ns_ = 0;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec stamp{};
+                std::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+                receive_ns_ = static_cast<int64_t>(stamp.tv_sec) * 1000000000 + stamp.tv_nsec;
+            }
+        }
+        if (capture_) {
+            capture_->Record(receive_buffer_.data(), static_cast<size_t>(bytes), from, Clock::now());
+        }
+        if (impairment_ && impairment_->ImpairsReceive()) {
+            impairment_->OnReceived(receive_buffer_.data(), static_cast<size_t>(bytes), from);
+            continue;
+        }
+        OnDatagram(receive_buffer_.data(), static_cast<size_t>(bytes), from);
+    }
+    receive_ns_ = 0;
+    return received;
+}
+
+void ReliableTransport::DeliverImpaired() {
+    if (!impairment_ || !impairment_->ImpairsReceive()) {
+        return;
+    }
+    NetworkImpairment::Packet packet;
+    while (impairment_->PopReceived(packet)) {
+        OnDatagram(packet.data.data(), packet.data.size(), packet.peer);
+    }
+}
+
+void ReliableTransport::OnDatagram(const uint8_t* data, size_t size, const sockaddr_in& from) {
+    if (size == 0) {
+        return;
+    }
+
+    std::vector<Delivery> delivered;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto now = Clock::now();
+        auto& peer = GetPeer(from);
+        peer.last_activity = now;
+        ++stats_.datagrams_received;
+
+        // Старый протокол: голый JSON в датаграмме
+        if (data[0] == '{') {
+            peer.legacy = true;
+            delivered.push_back({std::string_view(reinterpret_cast<const char*>(data), size), {}, from});
+        } else {
+            ByteReader reader(data, size);
+            uint8_t magic = 0;
+            uint8_t flags = 0;
+            uint32_t epoch = 0;
+            uint32_t seq = 0;
+            uint32_t ack_epoch = 0;
+            uint32_t ack = 0;
+            uint32_t sack = 0;
+            if (!reader.U8(magic) || magic != kMagic || !reader.U8(flags) || !reader.U32(epoch) ||
+                !reader.U32(seq) || !reader.U32(ack_epoch) || !reader.U32(ack) || !reader.U32(sack)) {
+                return;
+            }
+            peer.legacy = false;
+
+            ProcessAck(peer, ack_epoch, ack, sack, now);
+
+            if (flags & kFlagData) {
+                // Пир перезапустился - начинаем прием заново
+                if (epoch != peer.remote_epoch) {
+                    peer.remote_epoch = epoch;
+                    peer.recv_next = 0;
+                    peer.recv_ahead.clear();
+                    peer.deliver_next = 0;
+                    peer.partial.clear();
+                    peer.completed.clear();
+                }
+
+                // Дальше окна приема - без подтверждения, отправитель повторит;
+                // иначе recv_ahead и partial пира растут без предела
+                if (seq >= peer.recv_next && seq - peer.recv_next >= kReceiveWindow) {
+                    return;
+                }
+                peer.ack_pending = true;
+                const bool duplicate = seq < peer.recv_next || peer.recv_ahead.count(seq) > 0;
+                if (!duplicate) {
+                    peer.recv_ahead.insert(seq);
+                    while (!peer.recv_ahead.empty() && *peer.recv_ahead.begin() == peer.recv_next) {
+                        peer.recv_ahead.erase(peer.recv_ahead.begin());
+                        ++peer.recv_next;
+                    }
+                    ProcessChunks(peer, reader.Position(), reader.Remaining(), delivered);
+                }
+            }
+        }
+        stats_.messages_delivered += delivered.size();
+    }
+
+    // Колбэк вызывается без блокировки: обработчик может сразу вызвать Send.
+    // Ссылки в data действительны до выхода из OnDatagram.
+    for (const auto& item : delivered) {
+        deliver_(item.Message(), item.from);
+    }
+}
+
+void ReliableTransport::Poll() {
+    DeliverImpaired();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = Clock::now();
+
+    for (auto it = peers_.begin(); it != peers_.end();) {
+        auto& peer = *it->second;
+
+        if (!peer.queued.empty() && now - peer.queued_since >= coalesce_delay_) {
+            Flush(peer, now);
+        }
+
+        for (auto& [seq, outstanding] : peer.in_flight) {
+            const auto timeout = std::min<Clock::duration>(peer.rto * (1 << outstanding.retransmits), kMaxRto);
+            if (now - outstanding.last_sent < timeout) {
+                continue;
+            }
+            ++outstanding.retransmits;
+            outstanding.last_sent = now;
+            ++stats_.retransmits;
+            Transmit(peer, seq, outstanding.chunks, true);
+        }
+
+        // Пир не отвечает: начинаем с чистого листа в новой эпохе
+        const bool unreachable = std::any_of(peer.in_flight.begin(), peer.in_flight.end(), [](const auto& item) {
+            return item.second.retransmits > kMaxRetransmits;
+        });
+        if (unreachable) {
+            std::cerr << "Signaling peer unreachable, dropping " << peer.in_flight.size() + peer.queued.size()
+                      << " pending datagrams/messages" << std::endl;
+            ResetSendState(peer);
+        }
+
+        if (peer.ack_pending) {
+            SendAck(peer);
+        }
+
+        if (peer.in_flight.empty() && peer.queued.empty() && now - peer.last_activity > kPeerTimeout) {
+            it = peers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ReliableTransport::RemovePeer(const sockaddr_in& address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peers_.erase(AddressKey(address));
+}
+
+bool ReliableTransport::Idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::all_of(peers_.begin(), peers_.end(), [](const auto& item) {
+        return item.second->queued.empty() && item.second->in_flight.empty();
+    });
+}
+
+ReliableTransport::Stats ReliableTransport::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = stats_;
+    stats.peers = peers_.size();
+    return stats;
+}
+
+uint64_t ReliableTransport::AddressKey(const sockaddr_in& address) {
+    return static_cast<uint64_t>(address.sin_addr.s_addr) << 16 | address.sin_port;
+}
+
+ReliableTransport::Peer& ReliableTransport::GetPeer(const sockaddr_in& address) {
+    auto& peer = peers_[AddressKey(address)];
+    if (!peer) {
+        peer = std::make_unique<Peer>();
+        peer->address = address;
+        peer->epoch = GenerateEpoch();
+        peer->last_activity = Clock::now();
+    }
+    return *peer;
+}
+
+void ReliableTransport::ResetSendState(Peer& peer) {
+    peer.epoch = GenerateEpoch();
+    peer.next_seq = 0;
+    peer.next_message_id = 0;
+    peer.queued.clear();
+    peer.in_flight.clear();
+}
+
+void ReliableTransport::SendDatagram(const uint8_t* data, size_t size, const sockaddr_in& to) {
+    TimelineScope scope("transport.send", size);
+    if (impairment_) {
+        impairment_->SendTo(to, data, size);
+        return;
+    }
+    sendto(socket_fd_, data, size, 0, (const sockaddr*)&to, sizeof(to));
+}
+
+void ReliableTransport::Flush(Peer& peer, Clock::time_point now) {
+    constexpr size_t capacity = kMaxDatagram - kHeaderSize;
+    constexpr size_t max_fragment = capacity - kChunkHeaderSize;
+
+    std::vector<uint8_t> chunks;
+    size_t messages_in_datagram = 0;
+
+    auto emit = [&]() {
+        if (chunks.empty()) {
+            return;
+        }
+        const uint32_t seq = peer.next_seq++;
+        Transmit(peer, seq, chunks, true);
+        peer.in_flight.emplace(seq, Outstanding{std::move(chunks), now, now});
+        chunks.clear();
+        messages_in_datagram = 0;
+    };
+
+    while (!peer.queued.empty() && WindowOpen(peer)) {
+        const std::string message = std::move(peer.queued.front());
+        peer.queued.pop_front();
+
+        const uint32_t message_id = peer.next_message_id++;
+        const size_t count = std::max<size_t>(1, (message.size() + max_fragment - 1) / max_fragment);
+
+        for (size_t index = 0; index < count; ++index) {
+            const size_t offset = index * max_fragment;
+            const size_t length = std::min(max_fragment, message.size() - offset);
+            if (chunks.size() + kChunkHeaderSize + length > capacity) {
+                emit();
+            }
+
+            if (index == 0 && messages_in_datagram > 0) {
+                ++stats_.coalesced;
+            }
+            if (index == 0) {
+                ++messages_in_datagram;
+            }
+
+            ByteWriter writer(chunks);
+            writer.U32(message_id);
+            writer.U16(static_cast<uint16_t>(index));
+            writer.U16(static_cast<uint16_t>(count));
+            writer.U16(static_cast<uint16_t>(length));
+            writer.Bytes(message.data() + offset, length);
+        }
+    }
+    emit();
+
+    if (!peer.queued.empty()) {
+        peer.queued_since = now;
+    }
+}
+
+void ReliableTransport::Transmit(Peer& peer, uint32_t seq, const std::vector<uint8_t>& chunks, bool has_data) {
+    std::vector<uint8_t> datagram;
+    datagram.reserve(kHeaderSize + chunks.size());
+
+    // Подтверждения едут попутно с данными
+    uint32_t sack = 0;
+    for (uint32_t ahead : peer.recv_ahead) {
+        const uint32_t bit = ahead - peer.recv_next - 1;
+        if (bit < 32) {
+            sack |= 1u << bit;
+        }
+    }
+
+    ByteWriter writer(datagram);
+    writer.U8(kMagic);
+    writer.U8(has_data ? kFlagData : 0);
+    writer.U32(peer.epoch);
+    writer.U32(seq);
+    writer.U32(peer.remote_epoch);
+    writer.U32(peer.recv_next);
+    writer.U32(sack);
+    writer.Bytes(chunks.data(), chunks.size());
+
+    SendDatagram(datagram.data(), datagram.size(), peer.address);
+    ++stats_.datagrams_sent;
+    peer.ack_pending = false;
+}
+
+void ReliableTransport::SendAck(Peer& peer) {
+    static const std::vector<uint8_t> empty;
+    Transmit(peer, 0, empty, false);
+}
+
+void ReliableTransport::ProcessAck(Peer& peer, uint32_t ack_epoch, uint32_t ack, uint32_t sack, Clock::time_point now) {
+    if (ack_epoch != peer.epoch || peer.in_flight.empty()) {
+        return;
+    }
+
+    uint32_t highest_acked = 0;
+    bool any_acked = false;
+    for (auto it = peer.in_flight.begin(); it != peer.in_flight.end();) {
+        const uint32_t seq = it->first;
+        const uint32_t bit = seq - ack - 1;
+        const bool acked = seq < ack || (seq > ack && bit < 32 && (sack & (1u << bit)));
+        if (!acked) {
+            ++it;
+            continue;
+        }
+
+        // Алгоритм Карна: RTT меряем только по неповторенным датаграммам
+        if (it->second.retransmits == 0) {
+            UpdateRtt(peer, now - it->second.first_sent);
+        }
+        highest_acked = std::max(highest_acked, seq);
+        any_acked = true;
+        it = peer.in_flight.erase(it);
+    }
+
+    // Быстрый ретрансмит: несколько более поздних датаграмм уже дошли
+    if (!any_acked) {
+        return;
+    }
+    for (auto& [seq, outstanding] : peer.in_flight) {
+        if (seq + kFastRetransmitThreshold <= highest_acked && !outstanding.fast_retransmitted) {
+            outstanding.fast_retransmitted = true;
+            outstanding.last_sent = now;
+            ++outstanding.retransmits;
+            ++stats_.retransmits;
+            Transmit(peer, seq, outstanding.chunks, true);
+        }
+    }
+}
+
+void ReliableTransport::ProcessChunks(
+    Peer& peer,
+    const uint8_t* data,
+    size_t size,
+    std::vector<Delivery>& delivered
+) {
+    ByteReader reader(data, size);
+    while (reader.Remaining() >= kChunkHeaderSize) {
+        uint32_t message_id = 0;
+        uint16_t index = 0;
+        uint16_t count = 0;
+        uint16_t length = 0;
+        reader.U32(message_id);
+        reader.U16(index);
+        reader.U16(count);
+        reader.U16(length);
+        if (reader.Remaining() < length || count == 0 || index >= count) {
+            return;
+        }
+        const std::string_view chunk(reinterpret_cast<const char*>(reader.Position()), length);
+        reader.Skip(length);
+
+        if (message_id < peer.deliver_next || peer.completed.count(message_id) > 0) {
+            continue;
+        }
+
+        // Целое сообщение по порядку доставляется без копирования
+        if (count == 1 && message_id == peer.deliver_next && peer.completed.empty()) {
+            delivered.push_back({chunk, {}, peer.address});
+            ++peer.deliver_next;
+            continue;
+        }
+
+        std::string payload(chunk);
+        if (count == 1) {
+            peer.completed.emplace(message_id, std::move(payload));
+            continue;
+        }
+
+        auto& partial = peer.partial[message_id];
+        if (partial.fragments.size() != count) {
+            partial.fragments.assign(count, std::string());
+            partial.received = 0;
+        }
+        if (partial.fragments[index].empty()) {
+            partial.fragments[index] = std::move(payload);
+            ++partial.received;
+        }
+        if (partial.received == count) {
+            std::string message;
+            for (const auto& fragment : partial.fragments) {
+                message += fragment;
+            }
+            peer.completed.emplace(message_id, std::move(message));
+            peer.partial.erase(message_id);
+        }
+    }
+
+    while (!peer.completed.empty() && peer.completed.begin()->first == peer.deliver_next) {
+        delivered.push_back({{}, std::move(peer.completed.begin()->second), peer.address});
+        peer.completed.erase(peer.completed.begin());
+        ++peer.deliver_next;
+    }
+}
+
+void ReliableTransport::UpdateRtt(Peer& peer, Clock::duration sample) {
+    // RFC 6298
+    const double rtt_ms = std::chrono::duration<double, std::milli>(sample).count();
+    if (!peer.have_rtt) {
+        peer.srtt_ms = rtt_ms;
+        peer.rttvar_ms = rtt_ms / 2;
+        peer.have_rtt = true;
+    } else {
+        peer.rttvar_ms = 0.75 * peer.rttvar_ms + 0.25 * std::abs(peer.srtt_ms - rtt_ms);
+        peer.srtt_ms = 0.875 * peer.srtt_ms + 0.125 * rtt_ms;
+    }
+
+    const auto rto = std::chrono::duration<double, std::milli>(peer.srtt_ms + std::max(1.0, 4 * peer.rttvar_ms));
+    peer.rto = std::clamp<Clock::duration>(
+        std::chrono::duration_cast<Clock::duration>(rto), Clock::duration(kMinRto), Clock::duration(kMaxRto)
+    );
+}
+
+bool ReliableTransport::WindowOpen(const Peer& peer) {
+    // Подтвержденные выборочно уходят из in_flight: окно меряется от
+    // старой неподтвержденной, а не числом в полете
+    const uint32_t oldest = peer.in_flight.empty() ? peer.next_seq : peer.in_flight.begin()->first;
+    return peer.next_seq - oldest < kMaxInFlight;
+}
+
+ReliableTransport::Clock::duration ReliableTransport::TimeUntilNextTimer(Clock::time_point now) const {
+    auto next = Clock::time_point::max();
+    for (const auto& [key, peer] : peers_) {
+        if (peer->ack_pending) {
+            return Clock::duration::zero();
+        }
+        if (!peer->queued.empty() && WindowOpen(*peer)) {
+            next = std::min(next, peer->queued_since + coalesce_delay_);
+        }
+        for (const auto& [seq, outstanding] : peer->in_flight) {
+            const auto timeout = std::min<Clock::duration>(peer->rto * (1 << outstanding.retransmits), kMaxRto);
+            next = std::min(next, outstanding.last_sent + timeout);
+        }
+    }
+    if (next == Clock::time_point::max()) {
+        return Clock::duration::max();
+    }
+    return std::max(Clock::duration::zero(), next - now);
+}
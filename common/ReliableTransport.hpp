@@ -0,0 +1,193 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class ImpairedSocket;
+class TraceWriter;
+
+// Тонкий слой надежности для сигналинга поверх UDP-сокета.
+//
+// Датаграмма: заголовок 22 байта + ноль или больше чанков.
+//   u8 magic, u8 flags, u32 epoch, u32 seq,
+//   u32 ack_epoch, u32 ack (следующий ожидаемый seq), u32 sack (биты ack+1..ack+32)
+// Чанк - фрагмент сообщения:
+//   u32 message_id, u16 index, u16 count, u16 length, payload
+//
+// Подтверждаются датаграммы (кумулятивно и выборочно), ретрансмит по RTO
+// из измеренного RTT и быстрый ретрансмит по SACK. Мелкие сообщения
+// склеиваются в одну датаграмму, крупные (SDP) режутся на фрагменты.
+// Сообщения доставляются целиком и по порядку. Эпоха выбирается заново для
+// каждого пира и после отказа от недоставленной датаграммы, так что
+// получатель всегда видит нумерацию с нуля. Датаграммы, начинающиеся
+// с '{', считаются старым протоколом без надежности - такие пиры
+// получают ответы простым JSON.
+class ReliableTransport {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Deliver = std::function<void(std::string_view message, const sockaddr_in& from)>;
+
+    struct Stats {
+        uint64_t datagrams_sent;
+        uint64_t datagrams_received;
+        uint64_t messages_sent;
+        uint64_t messages_delivered;
+        uint64_t retransmits;
+        uint64_t coalesced;  // сообщений, ушедших не первыми в датаграмме
+        size_t peers;
+    };
+
+    static constexpr size_t kMaxDatagram = 1200;
+    static constexpr size_t kMaxReceiveSize = 65536;
+
+    // coalesce_delay - сколько ждать попутных сообщений перед отправкой;
+    // серверу, который отвечает пачкой после разбора входящих, хватает нуля
+    ReliableTransport(int socket_fd, Deliver deliver, Clock::duration coalesce_delay = Clock::duration::zero());
+    ~ReliableTransport();
+
+    ReliableTransport(const ReliableTransport&) = delete;
+    ReliableTransport& operator=(const ReliableTransport&) = delete;
+
+    // Потокобезопасно; сообщение уходит при ближайшем Poll
+    void Send(const sockaddr_in& to, std::string message);
+
+    // Ждет входящую датаграмму не дольше ближайшего таймера и max_wait.
+    // Возвращает true, если сокет готов к чтению.
+    bool WaitReadable(std::chrono::milliseconds max_wait);
+    // Вычитывает датаграммы из сокета без блокировки, не больше max;
+    // возвращает, сколько вычитано
+    size_t ReceiveAll(size_t max = SIZE_MAX);
+    // SO_TIMESTAMPNS на сокете; вызывается до цикла
+    void EnableTimestamps();
+    // Время приема ядром датаграммы, которую сейчас доставляет ReceiveAll
+    // (CLOCK_REALTIME, нс); 0 - меток нет или доставка не из ReceiveAll
+    int64_t ReceiveTime() const noexcept { return receive_ns_; }
+    // Каждая вычитанная датаграмма пишется в trace; вызывается до цикла
+    void SetCapture(TraceWriter* trace) { capture_ = trace; }
+    // Датаграммы идут через эмулятор плохой сети; вызывается до цикла
+    void SetImpairment(ImpairedSocket* impairment) { impairment_ = impairment; }
+    void OnDatagram(const uint8_t* data, size_t size, const sockaddr_in& from);
+    // Таймеры: отправка накопленного, ретрансмиты, подтверждения
+    void Poll();
+
+    void RemovePeer(const sockaddr_in& address);
+    // Все отправленное подтверждено: ни очереди, ни неподтвержденных датаграмм
+    bool Idle() const;
+    Stats GetStats() const;
+
+private:
+    static constexpr uint8_t kMagic = 0x5a;
+    static constexpr uint8_t kFlagData = 0x01;
+    static constexpr size_t kHeaderSize = 22;
+    static constexpr size_t kChunkHeaderSize = 10;
+    static constexpr size_t kMaxInFlight = 128;
+    // С запасом на фрагменты сообщения, начатого у края окна отправки
+    static constexpr uint32_t kReceiveWindow = 4 * kMaxInFlight;
+    static constexpr int kMaxRetransmits = 12;
+    static constexpr int kFastRetransmitThreshold = 3;
+    static constexpr auto kInitialRto = std::chrono::milliseconds(250);
+    static constexpr auto kMinRto = std::chrono::milliseconds(50);
+    static constexpr auto kMaxRto = std::chrono::seconds(3);
+    static constexpr auto kPeerTimeout = std::chrono::seconds(120);
+
+    struct Outstanding {
+        std::vector<uint8_t> chunks;
+        Clock::time_point first_sent;
+        Clock::time_point last_sent;
+        int retransmits{0};
+        bool fast_retransmitted{false};
+    };
+
+    struct Partial {
+        std::vector<std::string> fragments;
+        size_t received{0};
+    };
+
+    // Сообщение к доставке. Целое сообщение, пришедшее по порядку, - ссылка
+    // прямо в датаграмму; собранное из фрагментов или отложенное - копия.
+    struct Delivery {
+        std::string_view view;
+        std::string owned;
+        sockaddr_in from{};
+
+        std::string_view Message() const { return owned.empty() ? view : std::string_view(owned); }
+    };
+
+    struct Peer {
+        sockaddr_in address{};
+        uint32_t epoch{0};
+        bool legacy{false};
+        Clock::time_point last_activity{};
+
+        // Отправка
+        uint32_t next_seq{0};
+        uint32_t next_message_id{0};
+        std::deque<std::string> queued;
+        Clock::time_point queued_since{};
+        std::map<uint32_t, Outstanding> in_flight;
+        double srtt_ms{0.0};
+        double rttvar_ms{0.0};
+        bool have_rtt{false};
+        Clock::duration rto{kInitialRto};
+
+        // Прием
+        uint32_t remote_epoch{0};
+        uint32_t recv_next{0};
+        std::set<uint32_t> recv_ahead;
+        bool ack_pending{false};
+        uint32_t deliver_next{0};
+        std::map<uint32_t, Partial> partial;
+        std::map<uint32_t, std::string> completed;
+    };
+
+    const int socket_fd_;
+    Deliver deliver_;
+    const Clock::duration coalesce_delay_;
+    int wake_pipe_[2]{-1, -1};
+    std::thread::id loop_thread_{};
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, std::unique_ptr<Peer>> peers_;
+    std::vector<uint8_t> receive_buffer_;
+    TraceWriter* capture_{nullptr};
+    ImpairedSocket* impairment_{nullptr};
+    bool timestamps_{false};
+    int64_t receive_ns_{0};
+    Stats stats_{};
+
+    static uint64_t AddressKey(const sockaddr_in& address);
+    Peer& GetPeer(const sockaddr_in& address);
+    void ResetSendState(Peer& peer);
+
+    void SendDatagram(const uint8_t* data, size_t size, const sockaddr_in& to);
+    // Принятые датаграммы, чья задержка в эмуляторе истекла
+    void DeliverImpaired();
+    void Flush(Peer& peer, Clock::time_point now);
+    void Transmit(Peer& peer, uint32_t seq, const std::vector<uint8_t>& chunks, bool has_data);
+    void SendAck(Peer& peer);
+    void ProcessAck(Peer& peer, uint32_t ack_epoch, uint32_t ack, uint32_t sack, Clock::time_point now);
+    void ProcessChunks(
+        Peer& peer,
+        const uint8_t* data,
+        size_t size,
+        std::vector<Delivery>& delivered
+    );
+    void UpdateRtt(Peer& peer, Clock::duration sample);
+    // Отправка новых датаграмм: не дальше kMaxInFlight от неподтвержденной
+    static bool WindowOpen(const Peer& peer);
+    Clock::duration TimeUntilNextTimer(Clock::time_point now) const;
+};
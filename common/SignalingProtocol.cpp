@@ -0,0 +1,902 @@
+#include "SignalingProtocol.hpp"
+
+#include <json/json.h>
+
+#include <array>
+#include <charconv>
+#include <memory>
+
+#include "ByteBuffer.hpp"
+
+namespace {
+
+constexpr std::array<std::string_view, 13> kTypeNames = {
+    "",
+    "hello",
+    "client_registered",
+    "join_room",
+    "leave_room",
+    "offer",
+    "answer",
+    "ice_candidate",
+    "room_snapshot",
+    "roster_delta",
+    "roster_sync",
+    "redirect",
+    "media_key",
+};
+
+// Теги полей бинарной кодировки
+enum Tag : uint8_t {
+    kTagClientId = 1,
+    kTagTarget = 2,
+    kTagSender = 3,
+    kTagRoomId = 4,
+    kTagEncoding = 5,
+    kTagTimestamp = 6,
+    kTagSdp = 7,
+    kTagCandidate = 8,
+    kTagVersion = 9,
+    kTagFromVersion = 10,
+    kTagPage = 11,
+    kTagPages = 12,
+    kTagUser = 13,
+    kTagJoined = 14,
+    kTagLeft = 15,
+    kTagRedirect = 16,
+    kTagAddress = 17,
+};
+
+// Первый байт значения поля-идентификатора
+constexpr uint8_t kIdPacked = 0;
+constexpr uint8_t kIdString = 1;
+
+// Поля пишутся прямо в строку, которую заберет транспорт
+void PutVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void PutString(std::string& out, uint8_t tag, std::string_view value) {
+    if (value.empty()) {
+        return;
+    }
+    out += static_cast<char>(tag);
+    PutVarint(out, value.size());
+    out += value;
+}
+
+void PutNumber(std::string& out, uint8_t tag, uint64_t value) {
+    std::string number;
+    PutVarint(number, value);
+    PutString(out, tag, number);
+}
+
+// Идентификатор клиента: 8 байт вместо 23 символов
+void PutSessionId(std::string& out, uint8_t tag, SessionId id) {
+    out += static_cast<char>(tag);
+    out += static_cast<char>(9);
+    out += static_cast<char>(kIdPacked);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out += static_cast<char>(id >> shift);
+    }
+}
+
+void PutId(std::string& out, uint8_t tag, const std::string& value) {
+    if (value.empty()) {
+        return;
+    }
+    const SessionId id = ParseSessionId(value);
+    if (id != kNoSession) {
+        PutSessionId(out, tag, id);
+        return;
+    }
+    out += static_cast<char>(tag);
+    PutVarint(out, value.size() + 1);
+    out += static_cast<char>(kIdString);
+    out += value;
+}
+
+void PutHeader(std::string& out, SignalType type) {
+    out += static_cast<char>(kBinarySignalMagic);
+    out += static_cast<char>(kBinarySignalVersion);
+    out += static_cast<char>(type);
+}
+
+void AppendSessionId(std::string& out, SessionId id) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    out += "client_";
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        out += kHex[(id >> shift) & 0xf];
+    }
+}
+
+bool GetNumber(const uint8_t* data, size_t size, uint64_t& value) {
+    ByteReader reader(data, size);
+    return reader.Varint(value) && reader.Remaining() == 0;
+}
+
+bool GetId(const uint8_t* data, size_t size, std::string& value) {
+    if (size == 0) {
+        return false;
+    }
+    if (data[0] == kIdPacked) {
+        uint64_t id = 0;
+        ByteReader reader(data + 1, size - 1);
+        if (!reader.U64(id) || reader.Remaining() != 0) {
+            return false;
+        }
+        value = FormatSessionId(id);
+        return true;
+    }
+    value.assign(reinterpret_cast<const char*>(data) + 1, size - 1);
+    return data[0] == kIdString;
+}
+
+void AppendList(Json::Value& root, const char* name, const std::vector<std::string>& values) {
+    Json::Value list(Json::arrayValue);
+    for (const auto& value : values) {
+        list.append(value);
+    }
+    root[name] = list;
+}
+
+void ReadList(const Json::Value& root, const char* name, std::vector<std::string>& values) {
+    const Json::Value& list = root[name];
+    if (!list.isArray()) {
+        return;
+    }
+    values.reserve(list.size());
+    for (const auto& value : list) {
+        values.push_back(value.asString());
+    }
+}
+
+Json::StreamWriterBuilder MakeWriterBuilder() {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return builder;
+}
+
+}  // namespace
+
+std::string FormatSessionId(SessionId id) {
+    // Без snprintf: строка собирается на каждый идентификатор в снимках
+    std::string text;
+    text.reserve(23);
+    AppendSessionId(text, id);
+    return text;
+}
+
+SessionId ParseSessionId(std::string_view text) {
+    constexpr std::string_view prefix = "client_";
+    if (text.size() != prefix.size() + 16 || text.substr(0, prefix.size()) != prefix) {
+        return kNoSession;
+    }
+
+    SessionId id = 0;
+    for (char c : text.substr(prefix.size())) {
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            return kNoSession;
+        }
+        id = (id << 4) | static_cast<SessionId>(digit);
+    }
+    return id;
+}
+
+std::string_view SignalTypeName(SignalType type) {
+    const auto index = static_cast<size_t>(type);
+    return index < kTypeNames.size() ? kTypeNames[index] : std::string_view();
+}
+
+SignalType SignalTypeFromName(std::string_view name) {
+    for (size_t i = 1; i < kTypeNames.size(); ++i) {
+        if (kTypeNames[i] == name) {
+            return static_cast<SignalType>(i);
+        }
+    }
+    return SignalType::Unknown;
+}
+
+std::string EncodeSignal(const SignalingMessage& message, SignalEncoding encoding) {
+    return encoding == SignalEncoding::Binary ? EncodeBinarySignal(message) : EncodeJsonSignal(message);
+}
+
+bool DecodeSignal(std::string_view payload, SignalingMessage& message) {
+    return IsBinarySignal(payload) ? DecodeBinarySignal(payload, message) : DecodeJsonSignal(payload, message);
+}
+
+std::string EncodeJsonSignal(const SignalingMessage& message) {
+    Json::Value root;
+    root["type"] = std::string(SignalTypeName(message.type));
+
+    auto put = [&root](const char* name, const std::string& value) {
+        if (!value.empty()) {
+            root[name] = value;
+        }
+    };
+    put("client_id", message.client_id);
+    put("target", message.target);
+    put("sender", message.sender);
+    put("room_id", message.room_id);
+    put("encoding", message.encoding);
+    put("address", message.address);
+    if (message.redirect) {
+        root["redirect"] = true;
+    }
+    if (message.timestamp != 0) {
+        root["timestamp"] = static_cast<Json::Int64>(message.timestamp);
+    }
+
+    if (!message.sdp.empty()) {
+        root["data"]["sdp"] = message.sdp;
+    }
+    if (!message.candidate.empty()) {
+        root["data"]["candidate"] = message.candidate;
+    }
+
+    switch (message.type) {
+        case SignalType::RoomSnapshot:
+            root["version"] = static_cast<Json::UInt64>(message.version);
+            root["page"] = message.page;
+            root["pages"] = message.pages;
+            AppendList(root, "users", message.users);
+            break;
+        case SignalType::RosterDelta:
+            root["from_version"] = static_cast<Json::UInt64>(message.from_version);
+            root["version"] = static_cast<Json::UInt64>(message.version);
+            AppendList(root, "joined", message.joined);
+            AppendList(root, "left", message.left);
+            break;
+        case SignalType::RosterSync:
+            if (message.has_version) {
+                root["version"] = static_cast<Json::UInt64>(message.version);
+            }
+            break;
+        default:
+            break;
+    }
+
+    static const Json::StreamWriterBuilder builder = MakeWriterBuilder();
+    return Json::writeString(builder, root);
+}
+
+bool DecodeJsonSignal(std::string_view payload, SignalingMessage& message) {
+    static const Json::CharReaderBuilder builder;
+    thread_local std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+
+    Json::Value root;
+    if (!reader->parse(payload.data(), payload.data() + payload.size(), &root, nullptr) || !root.isObject()) {
+        return false;
+    }
+
+    message = SignalingMessage{};
+    message.type = SignalTypeFromName(root.get("type", "").asString());
+    message.client_id = root.get("client_id", "").asString();
+    message.target = root.get("target", "").asString();
+    message.sender = root.get("sender", "").asString();
+    message.room_id = root.get("room_id", "").asString();
+    message.encoding = root.get("encoding", "").asString();
+    message.address = root.get("address", "").asString();
+    message.redirect = root["redirect"].isBool() && root["redirect"].asBool();
+    message.timestamp = root.get("timestamp", 0).asInt64();
+
+    const Json::Value& data = root["data"];
+    if (data.isObject()) {
+        message.sdp = data.get("sdp", "").asString();
+        message.candidate = data.get("candidate", "").asString();
+    }
+
+    message.has_version = root.isMember("version");
+    message.version = root.get("version", 0).asUInt64();
+    message.from_version = root.get("from_version", 0).asUInt64();
+    message.page = root.get("page", 0).asUInt();
+    message.pages = root.get("pages", 0).asUInt();
+    ReadList(root, "users", message.users);
+    ReadList(root, "joined", message.joined);
+    ReadList(root, "left", message.left);
+    return true;
+}
+
+std::string EncodeBinarySignal(const SignalingMessage& message) {
+    std::string out;
+    out.reserve(64 + message.sdp.size() + message.candidate.size() +
+                12 * (message.users.size() + message.joined.size() + message.left.size()));
+    PutHeader(out, message.type);
+
+    PutId(out, kTagClientId, message.client_id);
+    PutId(out, kTagTarget, message.target);
+    PutId(out, kTagSender, message.sender);
+    PutString(out, kTagRoomId, message.room_id);
+    PutString(out, kTagEncoding, message.encoding);
+    PutString(out, kTagAddress, message.address);
+    if (message.redirect) {
+        PutNumber(out, kTagRedirect, 1);
+    }
+    if (message.timestamp != 0) {
+        PutNumber(out, kTagTimestamp, static_cast<uint64_t>(message.timestamp));
+    }
+    PutString(out, kTagSdp, message.sdp);
+    PutString(out, kTagCandidate, message.candidate);
+
+    if (message.has_version || message.type == SignalType::RoomSnapshot || message.type == SignalType::RosterDelta) {
+        PutNumber(out, kTagVersion, message.version);
+    }
+    if (message.type == SignalType::RosterDelta) {
+        PutNumber(out, kTagFromVersion, message.from_version);
+    }
+    if (message.type == SignalType::RoomSnapshot) {
+        PutNumber(out, kTagPage, message.page);
+        PutNumber(out, kTagPages, message.pages);
+    }
+    for (const auto& user : message.users) {
+        PutId(out, kTagUser, user);
+    }
+    for (const auto& user : message.joined) {
+        PutId(out, kTagJoined, user);
+    }
+    for (const auto& user : message.left) {
+        PutId(out, kTagLeft, user);
+    }
+
+    return out;
+}
+
+bool DecodeBinarySignal(std::string_view payload, SignalingMessage& message) {
+    ByteReader reader(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+
+    uint8_t magic = 0;
+    uint8_t version = 0;
+    uint8_t type = 0;
+    if (!reader.U8(magic) || !reader.U8(version) || !reader.U8(type) || magic != kBinarySignalMagic ||
+        version != kBinarySignalVersion) {
+        return false;
+    }
+
+    message = SignalingMessage{};
+    message.type = SignalTypeName(static_cast<SignalType>(type)).empty() ? SignalType::Unknown
+                                                                          : static_cast<SignalType>(type);
+
+    while (reader.Remaining() > 0) {
+        uint8_t tag = 0;
+        uint64_t length = 0;
+        if (!reader.U8(tag) || !reader.Varint(length) || length > reader.Remaining()) {
+            return false;
+        }
+        const uint8_t* value = reader.Position();
+        const auto text = [&] { return std::string(reinterpret_cast<const char*>(value), length); };
+        reader.Skip(length);
+
+        uint64_t number = 0;
+        bool ok = true;
+        switch (tag) {
+            case kTagClientId: ok = GetId(value, length, message.client_id); break;
+            case kTagTarget: ok = GetId(value, length, message.target); break;
+            case kTagSender: ok = GetId(value, length, message.sender); break;
+            case kTagRoomId: message.room_id = text(); break;
+            case kTagEncoding: message.encoding = text(); break;
+            case kTagAddress: message.address = text(); break;
+            case kTagRedirect:
+                ok = GetNumber(value, length, number);
+                message.redirect = number != 0;
+                break;
+            case kTagSdp: message.sdp = text(); break;
+            case kTagCandidate: message.candidate = text(); break;
+            case kTagTimestamp:
+                ok = GetNumber(value, length, number);
+                message.timestamp = static_cast<int64_t>(number);
+                break;
+            case kTagVersion:
+                ok = GetNumber(value, length, message.version);
+                message.has_version = true;
+                break;
+            case kTagFromVersion: ok = GetNumber(value, length, message.from_version); break;
+            case kTagPage:
+                ok = GetNumber(value, length, number);
+                message.page = static_cast<uint32_t>(number);
+                break;
+            case kTagPages:
+                ok = GetNumber(value, length, number);
+                message.pages = static_cast<uint32_t>(number);
+                break;
+            case kTagUser: ok = GetId(value, length, message.users.emplace_back()); break;
+            case kTagJoined: ok = GetId(value, length, message.joined.emplace_back()); break;
+            case kTagLeft: ok = GetId(value, length, message.left.emplace_back()); break;
+            default:
+                // Поле из более новой версии протокола
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// Проход по JSON без построения дерева. Строки возвращаются как есть -
+// между кавычками, без раскодирования; ключи сравниваются так же.
+class JsonCursor {
+public:
+    explicit JsonCursor(std::string_view text) : position_(text.data()), end_(text.data() + text.size()) {}
+
+    const char* Position() const noexcept { return position_; }
+
+    void SkipSpace() {
+        while (position_ < end_ && (*position_ == ' ' || *position_ == '\n' || *position_ == '\r' || *position_ == '\t')) {
+            ++position_;
+        }
+    }
+
+    bool Peek(char c) {
+        SkipSpace();
+        return position_ < end_ && *position_ == c;
+    }
+
+    bool Consume(char c) {
+        if (!Peek(c)) {
+            return false;
+        }
+        ++position_;
+        return true;
+    }
+
+    bool String(std::string_view& raw) {
+        if (!Consume('"')) {
+            return false;
+        }
+        const char* start = position_;
+        while (position_ < end_) {
+            if (*position_ == '"') {
+                raw = std::string_view(start, static_cast<size_t>(position_ - start));
+                ++position_;
+                return true;
+            }
+            // Экранированный символ пропускаем вместе с обратной чертой
+            if (*position_ == '\\' && ++position_ == end_) {
+                return false;
+            }
+            ++position_;
+        }
+        return false;
+    }
+
+    // Целое без знака; дробные и отрицательные числа пропускаются с integer = false
+    bool Number(uint64_t& value, bool& integer) {
+        SkipSpace();
+        const auto result = std::from_chars(position_, end_, value);
+        if (!SkipNumber()) {
+            return false;
+        }
+        integer = result.ec == std::errc() && result.ptr == position_;
+        return true;
+    }
+
+    bool SkipValue(int depth = 0) {
+        SkipSpace();
+        if (depth > kMaxDepth || position_ == end_) {
+            return false;
+        }
+        std::string_view unused;
+        switch (*position_) {
+            case '"':
+                return String(unused);
+            case '{':
+                return Object([&](std::string_view) { return SkipValue(depth + 1); });
+            case '[':
+                ++position_;
+                if (Consume(']')) {
+                    return true;
+                }
+                do {
+                    if (!SkipValue(depth + 1)) {
+                        return false;
+                    }
+                } while (Consume(','));
+                return Consume(']');
+            case 't':
+                return Literal("true");
+            case 'f':
+                return Literal("false");
+            case 'n':
+                return Literal("null");
+            default:
+                return SkipNumber();
+        }
+    }
+
+    // on_member(key) должен прочитать значение члена
+    template <typename OnMember>
+    bool Object(OnMember&& on_member) {
+        if (!Consume('{')) {
+            return false;
+        }
+        if (Consume('}')) {
+            return true;
+        }
+        do {
+            std::string_view key;
+            if (!String(key) || !Consume(':') || !on_member(key)) {
+                return false;
+            }
+        } while (Consume(','));
+        return Consume('}');
+    }
+
+private:
+    // Защита стека от вложенности во враждебных сообщениях
+    static constexpr int kMaxDepth = 32;
+
+    const char* position_;
+    const char* end_;
+
+    static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+    bool Literal(std::string_view literal) {
+        if (static_cast<size_t>(end_ - position_) < literal.size() ||
+            std::string_view(position_, literal.size()) != literal) {
+            return false;
+        }
+        position_ += literal.size();
+        return true;
+    }
+
+    void SkipDigits() {
+        while (position_ < end_ && IsDigit(*position_)) {
+            ++position_;
+        }
+    }
+
+    // Число по грамматике JSON: -?(0|[1-9]\d*)(\.\d+)?([eE][+-]?\d+)?.
+    // Пропущенное сервер пересылает как есть, поэтому пропускать можно
+    // только то, что разберет jsoncpp получателя
+    bool SkipNumber() {
+        const char* start = position_;
+        if (position_ < end_ && *position_ == '-') {
+            ++position_;
+        }
+        if (position_ == end_ || !IsDigit(*position_)) {
+            position_ = start;
+            return false;
+        }
+        if (*position_ == '0') {
+            ++position_;
+        } else {
+            SkipDigits();
+        }
+        if (position_ < end_ && *position_ == '.') {
+            ++position_;
+            if (position_ == end_ || !IsDigit(*position_)) {
+                position_ = start;
+                return false;
+            }
+            SkipDigits();
+        }
+        if (position_ < end_ && (*position_ == 'e' || *position_ == 'E')) {
+            ++position_;
+            if (position_ < end_ && (*position_ == '+' || *position_ == '-')) {
+                ++position_;
+            }
+            if (position_ == end_ || !IsDigit(*position_)) {
+                position_ = start;
+                return false;
+            }
+            SkipDigits();
+        }
+        return true;
+    }
+};
+
+bool ReadHex4(std::string_view text, size_t position, uint32_t& code) {
+    if (position + 4 > text.size()) {
+        return false;
+    }
+    const auto result = std::from_chars(text.data() + position, text.data() + position + 4, code, 16);
+    return result.ec == std::errc() && result.ptr == text.data() + position + 4;
+}
+
+// Строка без escape-последовательностей возвращается как есть, иначе
+// раскодируется в арену (результат не длиннее исходной строки)
+bool Unescape(std::string_view raw, Arena& arena, std::string_view& text) {
+    if (raw.find('\\') == std::string_view::npos) {
+        text = raw;
+        return true;
+    }
+
+    char* const begin = arena.Allocate(raw.size(), 1);
+    char* out = begin;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\') {
+            *out++ = raw[i];
+            continue;
+        }
+        if (++i == raw.size()) {
+            return false;
+        }
+        switch (raw[i]) {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/': *out++ = '/'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                uint32_t code = 0;
+                if (!ReadHex4(raw, i + 1, code)) {
+                    return false;
+                }
+                i += 4;
+                // Суррогатная пара UTF-16
+                uint32_t low = 0;
+                if (code >= 0xd800 && code < 0xdc00 && raw.substr(i + 1, 2) == "\\u" && ReadHex4(raw, i + 3, low) &&
+                    low >= 0xdc00 && low < 0xe000) {
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    i += 6;
+                }
+                if (code < 0x80) {
+                    *out++ = static_cast<char>(code);
+                } else if (code < 0x800) {
+                    *out++ = static_cast<char>(0xc0 | code >> 6);
+                    *out++ = static_cast<char>(0x80 | (code & 0x3f));
+                } else if (code < 0x10000) {
+                    *out++ = static_cast<char>(0xe0 | code >> 12);
+                    *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3f));
+                    *out++ = static_cast<char>(0x80 | (code & 0x3f));
+                } else {
+                    *out++ = static_cast<char>(0xf0 | code >> 18);
+                    *out++ = static_cast<char>(0x80 | (code >> 12 & 0x3f));
+                    *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3f));
+                    *out++ = static_cast<char>(0x80 | (code & 0x3f));
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    text = std::string_view(begin, static_cast<size_t>(out - begin));
+    return true;
+}
+
+void AppendEscaped(std::string& out, std::string_view text) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<uint8_t>(c) < 0x20) {
+                    out += "\\u00";
+                    out += kHex[c >> 4];
+                    out += kHex[c & 0xf];
+                } else {
+                    out += c;
+                }
+                break;
+        }
+    }
+}
+
+bool ScanId(const uint8_t* data, size_t size, SessionId& id) {
+    if (size == 0) {
+        return false;
+    }
+    if (data[0] == kIdPacked) {
+        ByteReader reader(data + 1, size - 1);
+        return reader.U64(id) && reader.Remaining() == 0;
+    }
+    id = ParseSessionId(std::string_view(reinterpret_cast<const char*>(data) + 1, size - 1));
+    return data[0] == kIdString;
+}
+
+bool ScanJsonSignal(std::string_view payload, SignalView& view, Arena& arena) {
+    JsonCursor cursor(payload);
+
+    // Строковое поле; значение другого типа пропускается, поле остается пустым
+    auto text_member = [&](std::string_view& text) {
+        std::string_view raw;
+        if (!cursor.Peek('"')) {
+            return cursor.SkipValue();
+        }
+        return cursor.String(raw) && Unescape(raw, arena, text);
+    };
+
+    return cursor.Object([&](std::string_view key) {
+        std::string_view text;
+        if (key == "type") {
+            if (!text_member(text)) {
+                return false;
+            }
+            view.type = SignalTypeFromName(text);
+            return true;
+        }
+        if (key == "client_id" || key == "target") {
+            if (!text_member(text)) {
+                return false;
+            }
+            (key == "target" ? view.target : view.client_id) = ParseSessionId(text);
+            return true;
+        }
+        if (key == "room_id") {
+            return text_member(view.room_id);
+        }
+        if (key == "encoding") {
+            return text_member(view.encoding);
+        }
+        if (key == "redirect") {
+            view.redirect = cursor.Peek('t');
+            return cursor.SkipValue();
+        }
+        if (key == "version") {
+            bool integer = false;
+            if (!cursor.Number(view.version, integer)) {
+                return cursor.SkipValue();
+            }
+            view.has_version = integer;
+            return true;
+        }
+        if (key == "data") {
+            // Значение запоминается целиком для пересылки; внутри - только
+            // границы sdp и candidate, без раскодирования
+            if (!cursor.Peek('{')) {
+                return cursor.SkipValue();
+            }
+            const char* start = cursor.Position();
+            const bool ok = cursor.Object([&](std::string_view inner) {
+                if (inner == "sdp" && cursor.Peek('"')) {
+                    return cursor.String(view.sdp);
+                }
+                if (inner == "candidate" && cursor.Peek('"')) {
+                    return cursor.String(view.candidate);
+                }
+                return cursor.SkipValue(1);
+            });
+            view.data = std::string_view(start, static_cast<size_t>(cursor.Position() - start));
+            return ok;
+        }
+        return cursor.SkipValue();
+    });
+}
+
+bool ScanBinarySignal(std::string_view payload, SignalView& view) {
+    ByteReader reader(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+
+    uint8_t magic = 0;
+    uint8_t version = 0;
+    uint8_t type = 0;
+    if (!reader.U8(magic) || !reader.U8(version) || !reader.U8(type) || magic != kBinarySignalMagic ||
+        version != kBinarySignalVersion) {
+        return false;
+    }
+    view.type = SignalTypeName(static_cast<SignalType>(type)).empty() ? SignalType::Unknown
+                                                                       : static_cast<SignalType>(type);
+
+    while (reader.Remaining() > 0) {
+        uint8_t tag = 0;
+        uint64_t length = 0;
+        if (!reader.U8(tag) || !reader.Varint(length) || length > reader.Remaining()) {
+            return false;
+        }
+        const uint8_t* value = reader.Position();
+        const std::string_view text(reinterpret_cast<const char*>(value), length);
+        reader.Skip(length);
+
+        bool ok = true;
+        switch (tag) {
+            case kTagClientId: ok = ScanId(value, length, view.client_id); break;
+            case kTagTarget: ok = ScanId(value, length, view.target); break;
+            case kTagRoomId: view.room_id = text; break;
+            case kTagEncoding: view.encoding = text; break;
+            case kTagRedirect: {
+                uint64_t number = 0;
+                ok = GetNumber(value, length, number);
+                view.redirect = number != 0;
+                break;
+            }
+            case kTagSdp: view.sdp = text; break;
+            case kTagCandidate: view.candidate = text; break;
+            case kTagVersion:
+                ok = GetNumber(value, length, view.version);
+                view.has_version = true;
+                break;
+            default:
+                // Серверу для маршрутизации не нужно
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool ScanSignal(std::string_view payload, SignalView& view, Arena& arena) {
+    view = SignalView{};
+    if (IsBinarySignal(payload)) {
+        view.source = SignalEncoding::Binary;
+        return ScanBinarySignal(payload, view);
+    }
+    view.source = SignalEncoding::Json;
+    return ScanJsonSignal(payload, view, arena);
+}
+
+std::string EncodeForwardSignal(
+    const SignalView& view,
+    SignalType type,
+    SessionId sender,
+    int64_t timestamp,
+    SignalEncoding encoding,
+    Arena& arena
+) {
+    std::string out;
+    char number[24];
+    const auto timestamp_end = std::to_chars(number, number + sizeof(number), timestamp).ptr;
+
+    if (encoding == SignalEncoding::Json) {
+        const bool splice = view.source == SignalEncoding::Json;
+        out.reserve(96 + (splice ? view.data.size() : (view.sdp.size() + view.candidate.size()) * 9 / 8 + 32));
+        out += "{\"type\":\"";
+        out += SignalTypeName(type);
+        out += "\",\"sender\":\"";
+        AppendSessionId(out, sender);
+        out += "\",\"timestamp\":";
+        out.append(number, timestamp_end);
+
+        if (splice) {
+            // Исходный текст "data" без разбора: клиенты могут класть туда
+            // и поля, о которых сервер не знает
+            if (!view.data.empty()) {
+                out += ",\"data\":";
+                out += view.data;
+            }
+        } else if (!view.sdp.empty() || !view.candidate.empty()) {
+            out += ",\"data\":{";
+            if (!view.sdp.empty()) {
+                out += "\"sdp\":\"";
+                AppendEscaped(out, view.sdp);
+                out += '"';
+            }
+            if (!view.candidate.empty()) {
+                out += view.sdp.empty() ? "\"candidate\":\"" : ",\"candidate\":\"";
+                AppendEscaped(out, view.candidate);
+                out += '"';
+            }
+            out += '}';
+        }
+        out += '}';
+        return out;
+    }
+
+    std::string_view sdp = view.sdp;
+    std::string_view candidate = view.candidate;
+    if (view.source == SignalEncoding::Json &&
+        (!Unescape(view.sdp, arena, sdp) || !Unescape(view.candidate, arena, candidate))) {
+        return std::string();
+    }
+
+    out.reserve(48 + sdp.size() + candidate.size());
+    PutHeader(out, type);
+    PutSessionId(out, kTagSender, sender);
+    if (timestamp != 0) {
+        PutNumber(out, kTagTimestamp, static_cast<uint64_t>(timestamp));
+    }
+    PutString(out, kTagSdp, sdp);
+    PutString(out, kTagCandidate, candidate);
+    return out;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Arena.hpp"
+
+// Набор сообщений сигналинга и две их кодировки: JSON (совместимость,
+// отладка) и компактная бинарная. Кодировка выбирается при регистрации:
+// hello всегда в JSON с полем "encoding": "binary", если клиент ее умеет;
+// client_registered подтверждает выбранную, дальше обе стороны шлют в ней.
+// Принимающая сторона различает кодировки по первому байту.
+//
+// Бинарное сообщение:
+//   u8 magic (0xb5), u8 версия формата, u8 тип, затем поля до конца:
+//   u8 тег, varint длина, значение.
+// Числа - varint внутри значения, списки - повтор тега, неизвестные теги
+// пропускаются. Идентификаторы клиентов вида client_<16 hex> передаются
+// как 8 байт, остальные строки как есть.
+
+// 64-битный идентификатор сессии. Ноль - нет сессии.
+using SessionId = uint64_t;
+inline constexpr SessionId kNoSession = 0;
+
+// Строковая форма для протокола: "client_" + 16 hex цифр
+std::string FormatSessionId(SessionId id);
+// kNoSession, если строка не является идентификатором
+SessionId ParseSessionId(std::string_view text);
+
+enum class SignalType : uint8_t {
+    Unknown = 0,
+    Hello = 1,
+    ClientRegistered = 2,
+    JoinRoom = 3,
+    LeaveRoom = 4,
+    Offer = 5,
+    Answer = 6,
+    IceCandidate = 7,
+    RoomSnapshot = 8,
+    RosterDelta = 9,
+    RosterSync = 10,
+    Redirect = 11,
+    // Ключ медиа-потока UDP клиента (строка a=crypto в поле sdp)
+    MediaKey = 12,
+};
+
+enum class SignalEncoding : uint8_t {
+    Json = 0,
+    Binary = 1,
+};
+
+std::string_view SignalTypeName(SignalType type);
+SignalType SignalTypeFromName(std::string_view name);
+
+struct SignalingMessage {
+    SignalType type{SignalType::Unknown};
+
+    std::string client_id;
+    std::string target;
+    std::string sender;
+    std::string room_id;
+    // hello: кодировка, которую клиент умеет; client_registered: выбранная
+    std::string encoding;
+    int64_t timestamp{0};
+    // hello: клиент умеет переходить на другой узел кластера
+    bool redirect{false};
+    // redirect: host:port узла, обслуживающего room_id
+    std::string address;
+
+    // Полезная нагрузка offer/answer/ice_candidate (поле "data" в JSON)
+    std::string sdp;
+    std::string candidate;
+
+    // Состав комнаты
+    uint64_t version{0};
+    uint64_t from_version{0};
+    bool has_version{false};
+    uint32_t page{0};
+    uint32_t pages{0};
+    std::vector<std::string> users;
+    std::vector<std::string> joined;
+    std::vector<std::string> left;
+};
+
+inline constexpr uint8_t kBinarySignalMagic = 0xb5;
+inline constexpr uint8_t kBinarySignalVersion = 1;
+
+inline bool IsBinarySignal(std::string_view payload) noexcept {
+    return !payload.empty() && static_cast<uint8_t>(payload[0]) == kBinarySignalMagic;
+}
+
+std::string EncodeSignal(const SignalingMessage& message, SignalEncoding encoding);
+// Кодировка определяется по первому байту; false при ошибке формата
+bool DecodeSignal(std::string_view payload, SignalingMessage& message);
+
+std::string EncodeJsonSignal(const SignalingMessage& message);
+bool DecodeJsonSignal(std::string_view payload, SignalingMessage& message);
+std::string EncodeBinarySignal(const SignalingMessage& message);
+bool DecodeBinarySignal(std::string_view payload, SignalingMessage& message);
+
+// Сообщение, разобранное на месте: строки указывают в буфер приема и
+// живут, пока жив он (или арена, если строку пришлось раскодировать).
+// Достаточно серверу для маршрутизации; DOM не строится, полезная
+// нагрузка offer/answer/ice_candidate не разбирается и не копируется.
+struct SignalView {
+    SignalType type{SignalType::Unknown};
+    SignalEncoding source{SignalEncoding::Json};
+
+    SessionId client_id{kNoSession};
+    SessionId target{kNoSession};
+    std::string_view room_id;
+    std::string_view encoding;
+    bool redirect{false};
+
+    uint64_t version{0};
+    bool has_version{false};
+
+    // Из JSON: data - исходный текст значения "data", sdp и candidate -
+    // содержимое строк внутри него как есть, с JSON-экранированием.
+    // Из бинарной кодировки: data пуст, sdp и candidate - сами байты.
+    std::string_view data;
+    std::string_view sdp;
+    std::string_view candidate;
+};
+
+// Кодировка определяется по первому байту; false при ошибке формата.
+// Арена нужна только для строк с escape-последовательностями.
+bool ScanSignal(std::string_view payload, SignalView& view, Arena& arena);
+
+// Пересылаемое сообщение (offer/answer/ice_candidate) от sender с полезной
+// нагрузкой из view. Если кодировки совпадают, нагрузка вклеивается в
+// результат без разбора; иначе перекодируется через арену.
+std::string EncodeForwardSignal(
+    const SignalView& view,
+    SignalType type,
+    SessionId sender,
+    int64_t timestamp,
+    SignalEncoding encoding,
+    Arena& arena
+);
@@ -0,0 +1,266 @@
+#include "Timeline.hpp"
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+// Длительность мгновенного события
+constexpr uint64_t kInstant = UINT64_MAX;
+
+struct Event {
+    std::atomic<uint64_t> start{0};
+    std::atomic<uint64_t> duration{0};
+    std::atomic<uint64_t> name{0};
+    std::atomic<uint64_t> arg{0};
+};
+
+struct EventCopy {
+    uint64_t start;
+    uint64_t duration;
+    const char* name;
+    uint64_t arg;
+};
+
+// Кольцо одного потока: пишет только владелец, Dump читает на ходу
+struct ThreadBuffer {
+    pid_t tid{0};
+    std::string name;  // под registry_mutex
+    std::atomic<uint64_t> head{0};
+    Event events[Timeline::kCapacity];
+};
+
+std::mutex registry_mutex;
+// Кольца живут до конца процесса: дамп нужен и по завершившимся потокам
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+thread_local ThreadBuffer* local_buffer = nullptr;
+// Имя до первого события: кольцо не заводится, пока запись не нужна
+thread_local const char* local_name = nullptr;
+
+std::string dump_path;
+int signal_pipe[2] = {-1, -1};
+
+ThreadBuffer& LocalBuffer() {
+    if (!local_buffer) {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+        if (local_name) {
+            buffer->name = local_name;
+        }
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        local_buffer = buffer.get();
+        registry.push_back(std::move(buffer));
+    }
+    return *local_buffer;
+}
+
+void Record(const char* name, uint64_t start, uint64_t duration, uint64_t arg) {
+    ThreadBuffer& buffer = LocalBuffer();
+    const uint64_t index = buffer.head.load(std::memory_order_relaxed);
+    Event& event = buffer.events[index & (Timeline::kCapacity - 1)];
+    event.start.store(start, std::memory_order_relaxed);
+    event.duration.store(duration, std::memory_order_relaxed);
+    event.name.store(reinterpret_cast<uintptr_t>(name), std::memory_order_relaxed);
+    event.arg.store(arg, std::memory_order_relaxed);
+    buffer.head.store(index + 1, std::memory_order_release);
+}
+
+// Копия кольца без остановки писателя: события, которые он успел затереть
+// за время копирования, отбрасываются
+void Snapshot(const ThreadBuffer& buffer, std::vector<EventCopy>& events) {
+    events.clear();
+    const uint64_t end = buffer.head.load(std::memory_order_acquire);
+    const uint64_t begin = end > Timeline::kCapacity ? end - Timeline::kCapacity : 0;
+    events.reserve(end - begin);
+    for (uint64_t index = begin; index < end; ++index) {
+        const Event& event = buffer.events[index & (Timeline::kCapacity - 1)];
+        events.push_back({event.start.load(std::memory_order_relaxed), event.duration.load(std::memory_order_relaxed),
+                          reinterpret_cast<const char*>(event.name.load(std::memory_order_relaxed)),
+                          event.arg.load(std::memory_order_relaxed)});
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Писатель может быть посреди события after, а его ячейка - та же, что
+    // у after - kCapacity: она тоже под подозрением
+    const uint64_t after = buffer.head.load(std::memory_order_relaxed);
+    const uint64_t valid = after + 1 > Timeline::kCapacity ? after + 1 - Timeline::kCapacity : 0;
+    if (valid > begin) {
+        events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(valid - begin, end - begin)));
+    }
+}
+
+void WriteString(FILE* file, const char* text) {
+    std::fputc('"', file);
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            std::fputc('\\', file);
+        }
+        if (static_cast<unsigned char>(*c) >= 0x20) {
+            std::fputc(*c, file);
+        }
+    }
+    std::fputc('"', file);
+}
+
+void OnSignal(int signal) {
+    const char command = signal == SIGUSR2 ? 't' : 'd';
+    [[maybe_unused]] const auto written = write(signal_pipe[1], &command, 1);
+}
+
+void SignalLoop() {
+    char command = 0;
+    while (true) {
+        const auto bytes = read(signal_pipe[0], &command, 1);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return;
+        }
+        if (command == 't') {
+            Timeline::SetEnabled(!Timeline::Enabled());
+            std::cout << "Timeline recording " << (Timeline::Enabled() ? "on" : "off") << std::endl;
+            continue;
+        }
+        std::string error;
+        if (Timeline::Dump(dump_path, error)) {
+            std::cout << "Timeline written to " << dump_path << std::endl;
+        } else {
+            std::cerr << "Failed to write timeline: " << error << std::endl;
+        }
+    }
+}
+
+}  // namespace
+
+uint64_t Timeline::Now() noexcept {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+void Timeline::Complete(const char* name, uint64_t start_ns, uint64_t arg) {
+    if (!Enabled()) {
+        return;
+    }
+    const uint64_t now = Now();
+    Record(name, start_ns, now > start_ns ? now - start_ns : 0, arg);
+}
+
+void Timeline::Instant(const char* name, uint64_t arg) {
+    if (!Enabled()) {
+        return;
+    }
+    Record(name, Now(), kInstant, arg);
+}
+
+void Timeline::SetThreadName(const char* name) {
+    local_name = name;
+    // После Arm кольцо заводится здесь, а не на первом событии: потоки
+    // называют себя до входа в цикл реального времени
+    if (!dump_path.empty() && !local_buffer) {
+        LocalBuffer();
+        return;
+    }
+    if (local_buffer) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        local_buffer->name = name;
+    }
+}
+
+bool Timeline::Dump(const std::string& path, std::string& error) {
+    // Пишем рядом и переименовываем: просмотрщик не увидит половину файла
+    const std::string temporary = path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "w");
+    if (!file) {
+        error = temporary + ": " + std::strerror(errno);
+        return false;
+    }
+
+    const int pid = getpid();
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":", pid);
+    char process[64] = "process";
+    if (FILE* comm = std::fopen("/proc/self/comm", "r")) {
+        if (std::fgets(process, sizeof(process), comm)) {
+            process[std::strcspn(process, "\n")] = '\0';
+        }
+        std::fclose(comm);
+    }
+    WriteString(file, process);
+    std::fprintf(file, "}}");
+
+    // Кольца копируются по одному; список колец меняется только при
+    // появлении нового потока
+    std::vector<EventCopy> events;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const auto& buffer : registry) {
+        if (!buffer->name.empty()) {
+            std::fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                         pid, buffer->tid);
+            WriteString(file, buffer->name.c_str());
+            std::fprintf(file, "}}");
+        }
+
+        Snapshot(*buffer, events);
+        for (const auto& event : events) {
+            std::fprintf(file, ",\n{\"name\":");
+            WriteString(file, event.name ? event.name : "?");
+            if (event.duration == kInstant) {
+                std::fprintf(file, ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f", event.start / 1e3);
+            } else {
+                std::fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", event.start / 1e3, event.duration / 1e3);
+            }
+            std::fprintf(file, ",\"pid\":%d,\"tid\":%d,\"args\":{\"v\":%llu}}", pid, buffer->tid,
+                         static_cast<unsigned long long>(event.arg));
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+
+    const bool written = std::ferror(file) == 0;
+    if (std::fclose(file) != 0 || !written) {
+        error = temporary + ": write failed";
+        return false;
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Timeline::Arm(const std::string& path, std::string& error) {
+    if (signal_pipe[0] < 0) {
+        if (pipe2(signal_pipe, O_CLOEXEC) != 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        struct sigaction action {};
+        action.sa_handler = OnSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, nullptr);
+        sigaction(SIGUSR2, &action, nullptr);
+        std::thread(SignalLoop).detach();
+    }
+    dump_path = path;
+    SetEnabled(true);
+    return true;
+}
+
+const std::string& Timeline::DumpPath() {
+    return dump_path;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Временная шкала событий по потокам для разбора выбросов задержки.
+//
+// Каждый поток пишет в свое кольцо на kCapacity событий без блокировок:
+// событие - четыре слова и публикация индекса. Кольцо заводится в
+// SetThreadName после Arm, у безымянных потоков - при первом событии;
+// старые события затираются. Dump снимает копию всех колец
+// на ходу и пишет JSON Chrome trace, который открывают chrome://tracing и
+// ui.perfetto.dev.
+//
+// Выключенная запись стоит одной relaxed-загрузки на точку, поэтому точки
+// остаются в сборке. Имена событий - строковые литералы: хранится указатель.
+class Timeline {
+public:
+    static constexpr size_t kCapacity = 1 << 15;
+
+    static bool Enabled() noexcept { return enabled_.load(std::memory_order_relaxed); }
+    static void SetEnabled(bool enabled) noexcept { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // Монотонное время, нс
+    static uint64_t Now() noexcept;
+
+    // Интервал от start_ns до текущего момента
+    static void Complete(const char* name, uint64_t start_ns, uint64_t arg = 0);
+    static void Instant(const char* name, uint64_t arg = 0);
+    // Имя потока в дампе (литерал); после Arm заводит кольцо потока, поэтому
+    // вызывается до цикла реального времени
+    static void SetThreadName(const char* name);
+
+    static bool Dump(const std::string& path, std::string& error);
+
+    // Включает запись; SIGUSR1 пишет дамп в path, SIGUSR2 переключает запись.
+    // Дамп идет из отдельного потока: обработчик сигнала только будит его.
+    static bool Arm(const std::string& path, std::string& error);
+    // Путь из Arm, пустой - не включено
+    static const std::string& DumpPath();
+
+private:
+    inline static std::atomic<bool> enabled_{false};
+};
+
+// Интервал от создания до конца области видимости
+class TimelineScope {
+public:
+    explicit TimelineScope(const char* name, uint64_t arg = 0) noexcept
+        : name_(name), arg_(arg), start_(Timeline::Enabled() ? Timeline::Now() : 0) {}
+    ~TimelineScope() {
+        if (start_ != 0) {
+            Timeline::Complete(name_, start_, arg_);
+        }
+    }
+
+    TimelineScope(const TimelineScope&) = delete;
+    TimelineScope& operator=(const TimelineScope&) = delete;
+
+    void SetArg(uint64_t arg) noexcept { arg_ = arg; }
+
+private:
+    const char* name_;
+    uint64_t arg_;
+    const uint64_t start_;
+};
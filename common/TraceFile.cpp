@@ -0,0 +1,185 @@
+#include "TraceFile.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "ByteBuffer.hpp"
+
+TraceWriter::~TraceWriter() {
+    Close();
+}
+
+bool TraceWriter::Open(const std::string& path, std::string& error) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    const auto start = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    active_.reserve(kChunkSize + 64 * 1024);
+    active_.insert(active_.end(), kTraceMagic.begin(), kTraceMagic.end());
+    ByteWriter writer(active_);
+    writer.U64(static_cast<uint64_t>(start.count()));
+
+    // Время записей отсчитывается от отметки в заголовке
+    last_ = Clock::now();
+    closing_ = false;
+    writer_ = std::thread(&TraceWriter::WriterLoop, this);
+    return true;
+}
+
+void TraceWriter::Close() {
+    if (!writer_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Seal();
+        closing_ = true;
+    }
+    ready_.notify_one();
+    writer_.join();
+
+    close(fd_);
+    fd_ = -1;
+}
+
+void TraceWriter::Record(const uint8_t* data, size_t size, const sockaddr_in& from, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (active_.size() >= kChunkSize) {
+        if (queue_.size() >= kMaxQueued) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Seal();
+        ready_.notify_one();
+    }
+
+    const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - last_).count();
+    // Время записей не убывает, даже если now пришло из разных потоков
+    if (delta > 0) {
+        last_ += std::chrono::microseconds(delta);
+    }
+
+    ByteWriter writer(active_);
+    writer.Varint(static_cast<uint64_t>(delta > 0 ? delta : 0));
+    writer.U32(ntohl(from.sin_addr.s_addr));
+    writer.U16(ntohs(from.sin_port));
+    writer.Varint(size);
+    writer.Bytes(data, size);
+    records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+TraceWriter::Stats TraceWriter::GetStats() const {
+    Stats stats;
+    stats.records = records_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TraceWriter::Seal() {
+    if (active_.empty()) {
+        return;
+    }
+    queue_.push_back(std::move(active_));
+    if (spare_.empty()) {
+        active_ = std::vector<uint8_t>();
+        active_.reserve(kChunkSize + 64 * 1024);
+    } else {
+        active_ = std::move(spare_.back());
+        spare_.pop_back();
+    }
+}
+
+void TraceWriter::WriterLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        // При слабом трафике буфер не ждет заполнения дольше интервала
+        if (!ready_.wait_for(lock, kFlushInterval, [this] { return closing_ || !queue_.empty(); })) {
+            Seal();
+        }
+        if (queue_.empty()) {
+            if (closing_) {
+                return;
+            }
+            continue;
+        }
+
+        std::vector<uint8_t> chunk = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        size_t written = 0;
+        while (written < chunk.size()) {
+            const auto result = write(fd_, chunk.data() + written, chunk.size() - written);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(result);
+        }
+        bytes_.fetch_add(written, std::memory_order_relaxed);
+
+        chunk.clear();
+        lock.lock();
+        spare_.push_back(std::move(chunk));
+    }
+}
+
+bool TraceReader::Open(const std::string& path, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    ByteReader reader(data_.data(), data_.size());
+    char magic[8] = {};
+    if (!reader.Bytes(magic, sizeof(magic)) || std::string_view(magic, sizeof(magic)) != kTraceMagic ||
+        !reader.U64(start_time_)) {
+        error = path + ": not a trace file";
+        return false;
+    }
+    Rewind();
+    return true;
+}
+
+void TraceReader::Rewind() {
+    offset_ = kTraceMagic.size() + sizeof(uint64_t);
+    time_ = std::chrono::microseconds(0);
+}
+
+bool TraceReader::Next(Record& record) {
+    ByteReader reader(data_.data() + offset_, data_.size() - offset_);
+    uint64_t delta = 0;
+    uint32_t address = 0;
+    uint16_t port = 0;
+    uint64_t size = 0;
+    if (!reader.Varint(delta) || !reader.U32(address) || !reader.U16(port) || !reader.Varint(size) ||
+        reader.Remaining() < size) {
+        return false;
+    }
+
+    time_ += std::chrono::microseconds(delta);
+    record.time = time_;
+    record.from = sockaddr_in{};
+    record.from.sin_family = AF_INET;
+    record.from.sin_addr.s_addr = htonl(address);
+    record.from.sin_port = htons(port);
+    record.size = static_cast<size_t>(size);
+    record.data = reader.Position();
+    offset_ = static_cast<size_t>(record.data - data_.data()) + record.size;
+    return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Запись принятых датаграмм для воспроизведения нагрузки (trace_replay).
+//
+// Файл: заголовок 16 байт - "ZVTRACE1" и u64 время начала записи
+// (unix, мкс), затем записи:
+//   varint  мкс от предыдущей записи
+//   u32     IPv4 источника, u16 порт (сетевой порядок, как в sockaddr_in)
+//   varint  длина, данные
+inline constexpr std::string_view kTraceMagic = "ZVTRACE1";
+
+// Запись в файл идет в отдельном потоке: Record только дописывает в буфер
+// в памяти и никогда не ждет диска. Если диск отстал больше, чем на
+// kMaxQueued буферов, новые датаграммы отбрасываются и учитываются в
+// dropped - сервер важнее полноты записи.
+class TraceWriter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t records{0};
+        uint64_t bytes{0};  // записано в файл
+        uint64_t dropped{0};
+    };
+
+    TraceWriter() = default;
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool Open(const std::string& path, std::string& error);
+    // Дописывает накопленное и закрывает файл
+    void Close();
+
+    void Record(const uint8_t* data, size_t size, const sockaddr_in& from, Clock::time_point now);
+    Stats GetStats() const;
+
+private:
+    static constexpr size_t kChunkSize = 256 * 1024;
+    static constexpr size_t kMaxQueued = 64;
+    static constexpr auto kFlushInterval = std::chrono::seconds(1);
+
+    int fd_{-1};
+    std::thread writer_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::vector<uint8_t> active_;
+    std::deque<std::vector<uint8_t>> queue_;
+    std::vector<std::vector<uint8_t>> spare_;
+    bool closing_{false};
+    Clock::time_point last_{};
+
+    std::atomic<uint64_t> records_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    void WriterLoop();
+    // Под mutex_: активный буфер уходит в очередь записи
+    void Seal();
+};
+
+// Файл читается целиком: воспроизведению на максимальной скорости диск
+// мешать не должен
+class TraceReader {
+public:
+    struct Record {
+        std::chrono::microseconds time{0};  // от начала записи
+        sockaddr_in from{};
+        const uint8_t* data{nullptr};
+        size_t size{0};
+    };
+
+    bool Open(const std::string& path, std::string& error);
+    uint64_t StartTime() const noexcept { return start_time_; }
+
+    // false в конце файла или на обрезанной записи
+    bool Next(Record& record);
+    void Rewind();
+
+private:
+    std::vector<uint8_t> data_;
+    size_t offset_{0};
+    uint64_t start_time_{0};
+    std::chrono::microseconds time_{0};
+};
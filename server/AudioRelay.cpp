@@ -0,0 +1,773 @@
+#include "AudioRelay.hpp"
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "ByteBuffer.hpp"
+#include "MediaPacket.hpp"
+
+namespace {
+
+constexpr uint8_t kTrunkSubscribe = 0x10;
+constexpr uint8_t kTrunkAccept = 0x11;
+constexpr uint8_t kTrunkMedia = 0x12;
+constexpr size_t kTrunkMediaHeader = 6;
+
+// Ключ адреса занимает 48 бит, у локальных участников взведен старший
+constexpr uint64_t kLocalKey = uint64_t{1} << 63;
+
+// Метки epoll потока колец: вид дескриптора в старших 32 битах, id - в младших
+constexpr uint64_t kLocalListenerTag = 0;
+constexpr uint64_t kLocalWakeTag = uint64_t{1} << 32;
+constexpr uint64_t kLocalConnectionTag = uint64_t{2} << 32;
+
+uint64_t AddressKey(const sockaddr_in& address) {
+    return static_cast<uint64_t>(address.sin_addr.s_addr) << 16 | address.sin_port;
+}
+
+std::string FormatAddress(const sockaddr_in& address) {
+    char ip[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+double Kbps(uint64_t bytes, std::chrono::duration<double> elapsed) {
+    return elapsed.count() > 0 ? static_cast<double>(bytes) * 8 / 1000 / elapsed.count() : 0.0;
+}
+
+}  // namespace
+
+AudioRelay::AudioRelay(int port, uint32_t relay_id, PacketIoOptions io)
+    : port_(port), id_(relay_id), io_options_(io) {
+    std::random_device rd;
+    while (id_ == 0) {
+        id_ = rd();
+    }
+    trunk_buffer_.reserve(kTrunkMediaHeader + kMaxMediaDatagram);
+}
+
+AudioRelay::~AudioRelay() {
+    Stop();
+}
+
+void AudioRelay::AddUpstream(const sockaddr_in& address, const std::string& name) {
+    Trunk trunk;
+    trunk.address = address;
+    trunk.key = AddressKey(address);
+    trunk.name = name;
+    trunk.upstream = true;
+    trunks_.push_back(std::move(trunk));
+}
+
+bool AudioRelay::Start() {
+    socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_ < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return false;
+    }
+
+    // Пачка датаграмм от многих участников не должна теряться в сокете
+    const int buffer_size = 4 * 1024 * 1024;
+    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port_);
+    address.sin_addr.s_addr = INADDR_ANY;
+    if (bind(socket_, (sockaddr*)&address, sizeof(address)) < 0) {
+        std::cerr << "Failed to bind socket to port " << port_ << std::endl;
+        close(socket_);
+        socket_ = -1;
+        return false;
+    }
+
+    // Медиа-план: EF в заголовке IP; метки приема ядром - для задержки
+    // плана в GetStats
+    std::string error;
+    if (!MarkMediaSocket(socket_, error)) {
+        std::cerr << "Media socket marking failed: " << error << std::endl;
+        error.clear();
+    }
+    io_options_.timestamps = true;
+    // Поток колец отправляет под mutex_, а RelayLoop ждет в Wait без него.
+    // Кольцо отправки io_uring однопоточное (Wait тоже входит в ядро и
+    // публикует SQE), epoll_wait же не трогает состояние отправки
+    if (!local_path_.empty() && io_options_.backend != IoBackend::Epoll) {
+        if (io_options_.backend == IoBackend::Uring) {
+            std::cerr << "io_uring is not available with --local, using epoll" << std::endl;
+        }
+        io_options_.backend = IoBackend::Epoll;
+    }
+    io_ = PacketIo::Create(socket_, io_options_, error);
+    if (!io_) {
+        std::cerr << "Failed to create " << IoBackendName(io_options_.backend) << " I/O: " << error << std::endl;
+        close(socket_);
+        socket_ = -1;
+        return false;
+    }
+
+    if (!local_path_.empty() && !StartLocal()) {
+        io_.reset();
+        close(socket_);
+        socket_ = -1;
+        return false;
+    }
+
+    if (impairment_options_.Enabled()) {
+        impairment_ = std::make_unique<ImpairedSocket>(socket_, impairment_options_);
+        std::cout << "Impaired network: in " << DescribeImpairment(impairment_options_.in) << "; out "
+                  << DescribeImpairment(impairment_options_.out) << std::endl;
+    }
+
+    last_stats_ = Clock::now();
+    is_running_ = true;
+    relay_thread_ = std::thread(&AudioRelay::RelayLoop, this);
+    if (local_listener_ >= 0) {
+        local_thread_ = std::thread(&AudioRelay::LocalLoop, this);
+    }
+
+    std::cout << "Audio relay " << std::hex << id_ << std::dec << " started on port " << port_ << " ("
+              << IoBackendName(io_->Backend()) << (io_->Gso() ? ", GSO" : "") << (io_->Gro() ? ", GRO" : "") << ")"
+              << std::endl;
+    for (const auto& trunk : trunks_) {
+        std::cout << "Subscribing to upstream relay " << trunk.name << std::endl;
+    }
+    if (local_listener_ >= 0) {
+        std::cout << "Local processes attach via " << local_path_ << std::endl;
+    }
+    return true;
+}
+
+bool AudioRelay::StartLocal() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (local_path_.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Local socket path too long: " << local_path_ << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, local_path_.data(), local_path_.size());
+
+    // Сокет, оставшийся от упавшего процесса, мешает bind
+    unlink(local_path_.c_str());
+    local_listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (local_listener_ < 0 || bind(local_listener_, (sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(local_listener_, 16) < 0) {
+        std::cerr << "Failed to listen on " << local_path_ << ": " << std::strerror(errno) << std::endl;
+        if (local_listener_ >= 0) {
+            close(local_listener_);
+            local_listener_ = -1;
+        }
+        return false;
+    }
+
+    local_epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = kLocalListenerTag;
+    epoll_ctl(local_epoll_, EPOLL_CTL_ADD, local_listener_, &event);
+    return true;
+}
+
+void AudioRelay::Stop() {
+    if (!is_running_) {
+        return;
+    }
+    is_running_ = false;
+
+    if (relay_thread_.joinable()) {
+        relay_thread_.join();
+    }
+    if (local_thread_.joinable()) {
+        local_thread_.join();
+    }
+    if (local_listener_ >= 0) {
+        close(local_listener_);
+        local_listener_ = -1;
+        unlink(local_path_.c_str());
+    }
+    while (!locals_.empty()) {
+        DetachLocal(locals_.back()->Id());
+    }
+    if (local_epoll_ >= 0) {
+        close(local_epoll_);
+        local_epoll_ = -1;
+    }
+    impairment_.reset();
+    io_.reset();
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+void AudioRelay::RelayLoop() {
+    if (gate_) {
+        std::cout << "Media plane thread: " << EnterPlaneThread(Plane::Media) << std::endl;
+    }
+    while (is_running_) {
+        Clock::duration wait = kHousekeepingInterval;
+        // Такт пачек наступает и без приема: пачки копит и поток колец
+        if (bundle_tick_ > Clock::duration::zero() && bundle_listeners_.load(std::memory_order_relaxed) > 0) {
+            wait = std::min(wait, bundle_tick_);
+        }
+        if (impairment_) {
+            wait = impairment_->ReceiveTimeout(wait);
+        }
+        const bool readable = io_->Wait(static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(wait).count()));
+        if (readable && gate_) {
+            gate_->MediaBusy(true);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto now = Clock::now();
+        // Вся пачка принятого обрабатывается до отправки: исходящие
+        // датаграммы уходят одним Flush, соседние к одному адресату - через GSO
+        receive_stamps_.clear();
+        if (readable) {
+            io_->Receive([&](const uint8_t* data, size_t size, const sockaddr_in& from) {
+                receive_stamps_.push_back(io_->ReceiveTime());
+                if (capture_) {
+                    capture_->Record(data, size, from, now);
+                }
+                if (impairment_ && impairment_->ImpairsReceive()) {
+                    impairment_->OnReceived(data, size, from);
+                    return;
+                }
+                OnDatagram(data, size, from, now);
+            });
+        }
+        if (impairment_ && impairment_->ImpairsReceive()) {
+            NetworkImpairment::Packet packet;
+            while (impairment_->PopReceived(packet)) {
+                OnDatagram(packet.data.data(), packet.data.size(), packet.peer, now);
+            }
+        }
+
+        if (now - last_housekeeping_ >= kHousekeepingInterval) {
+            Housekeeping(now);
+        }
+        EmitBundles(Clock::now());
+        io_->Flush();
+
+        // Задержка плана - от приема ядром до ухода пересылки в сокет
+        if (!receive_stamps_.empty()) {
+            metrics_.OnWakeup(receive_stamps_.size());
+            const int64_t done = PlaneMetrics::RealtimeNs();
+            for (const int64_t received : receive_stamps_) {
+                metrics_.OnHandled(received, done);
+            }
+        }
+        if (gate_) {
+            gate_->MediaBusy(false);
+        }
+    }
+}
+
+void AudioRelay::LocalLoop() {
+    constexpr int kMaxEvents = 16;
+    epoll_event events[kMaxEvents];
+    auto last_poll = Clock::now();
+    bool busy = false;
+
+    while (is_running_) {
+        // Пока кольца не пустеют, поток читает их без системных вызовов
+        if (!busy || Clock::now() - last_poll >= kLocalPollInterval) {
+            int timeout = 0;
+            if (!busy) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                bool idle = true;
+                for (auto& local : locals_) {
+                    idle = local->Uplink().PrepareSleep() && idle;
+                }
+                timeout = idle ? static_cast<int>(kHousekeepingInterval.count()) : 0;
+            }
+            const int count = epoll_wait(local_epoll_, events, kMaxEvents, timeout);
+            last_poll = Clock::now();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++local_waits_;
+            for (auto& local : locals_) {
+                local->Uplink().CancelSleep();
+            }
+            for (int i = 0; i < count; ++i) {
+                const uint64_t tag = events[i].data.u64;
+                const auto id = static_cast<uint32_t>(tag);
+                if (tag == kLocalListenerTag) {
+                    AttachLocal(last_poll);
+                } else if ((tag & ~uint64_t{UINT32_MAX}) == kLocalConnectionTag && DetachLocal(id)) {
+                    // Клиент в сокет не пишет: событие на нем - отключение
+                    std::cout << "Shared memory participant " << id << " detached (" << locals_.size()
+                              << " attached)" << std::endl;
+                }
+                // Побудка eventfd только будит поток: он edge-triggered, и
+                // счетчик можно не вычитывать
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto now = Clock::now();
+        size_t drained = 0;
+        std::vector<uint32_t> corrupt;
+        for (auto& local : locals_) {
+            const uint32_t* index = participant_index_.Find(kLocalKey | local->Id());
+            if (!index) {
+                continue;
+            }
+            drained += local->Uplink().Drain([&](const uint8_t* data, size_t size) {
+                OnLocalDatagram(data, size, participants_[*index], now);
+            });
+            if (local->Uplink().Corrupt() || local->Downlink().Corrupt()) {
+                corrupt.push_back(local->Id());
+            }
+        }
+        for (uint32_t id : corrupt) {
+            std::cerr << "Shared memory participant " << id << " corrupted its ring, detaching" << std::endl;
+            DetachLocal(id);
+        }
+        busy = drained > 0;
+        if (busy) {
+            EmitBundles(now);
+            io_->Flush();
+        }
+    }
+}
+
+void AudioRelay::AttachLocal(Clock::time_point now) {
+    while (true) {
+        const int connection = accept4(local_listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connection < 0) {
+            return;
+        }
+        const uint32_t id = next_local_id_++;
+        std::string error;
+        auto local = LocalAttachment::Offer(connection, id, error);
+        if (!local) {
+            std::cerr << "Failed to attach shared memory participant: " << error << std::endl;
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.u64 = kLocalWakeTag | id;
+        epoll_ctl(local_epoll_, EPOLL_CTL_ADD, local->WakeFd(), &event);
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = kLocalConnectionTag | id;
+        epoll_ctl(local_epoll_, EPOLL_CTL_ADD, local->Connection(), &event);
+
+        const uint64_t key = kLocalKey | id;
+        participant_index_.Emplace(key, static_cast<uint32_t>(participants_.size()));
+        Participant participant;
+        participant.key = key;
+        participant.last_seen = now;
+        participant.local = local.get();
+        participants_.push_back(std::move(participant));
+        locals_.push_back(std::move(local));
+        std::cout << "Shared memory participant " << id << " attached (" << locals_.size() << " attached)"
+                  << std::endl;
+    }
+}
+
+bool AudioRelay::DetachLocal(uint32_t id) {
+    if (const uint32_t* index = participant_index_.Find(kLocalKey | id)) {
+        RemoveParticipant(*index);
+    }
+    for (size_t i = 0; i < locals_.size(); ++i) {
+        if (locals_[i]->Id() != id) {
+            continue;
+        }
+        // eventfd открыт и у клиента: без явного удаления epoll продолжит
+        // его слушать после нашего close
+        epoll_ctl(local_epoll_, EPOLL_CTL_DEL, locals_[i]->WakeFd(), nullptr);
+        epoll_ctl(local_epoll_, EPOLL_CTL_DEL, locals_[i]->Connection(), nullptr);
+        local_wakeups_ += locals_[i]->Downlink().Wakeups();
+        locals_.erase(locals_.begin() + static_cast<std::ptrdiff_t>(i));
+        return true;
+    }
+    return false;
+}
+
+void AudioRelay::OnLocalDatagram(const uint8_t* data, size_t size, Participant& participant,
+                                 Clock::time_point now) {
+    participant.last_seen = now;
+    ++packets_in_;
+
+    MediaHeader header;
+    if (!MediaHeader::Parse(data, size, header)) {
+        return;
+    }
+    // Пачки собирает только ретранслятор
+    if (header.type == PacketType::Bundle) {
+        ++dropped_;
+        return;
+    }
+    if (!AcceptStream(header.ssrc, participant.key, now)) {
+        ++dropped_;
+        return;
+    }
+    Forward(data, size, participant.key, id_, 0);
+}
+
+void AudioRelay::OnDatagram(const uint8_t* data, size_t size, const sockaddr_in& from, Clock::time_point now) {
+    if (size == 0) {
+        return;
+    }
+    if (data[0] >= kTrunkSubscribe && data[0] <= kTrunkMedia) {
+        OnTrunkPacket(data, size, from, now);
+        return;
+    }
+
+    // Приветствие при запуске клиента только регистрирует его и, с флагом,
+    // включает ему пачки
+    const uint64_t key = AddressKey(from);
+    Participant& participant = TouchParticipant(from, key, now);
+    ++packets_in_;
+    if (size == 2 && data[0] == 0 && bundling_ && !participant.bundles && (data[1] & kHelloAcceptsBundles)) {
+        participant.bundles = true;
+        ++bundle_listeners_;
+        return;
+    }
+
+    MediaHeader header;
+    if (!MediaHeader::Parse(data, size, header)) {
+        return;
+    }
+    if (header.type == PacketType::Bundle) {
+        ++dropped_;
+        return;
+    }
+    if (!AcceptStream(header.ssrc, key, now)) {
+        ++dropped_;
+        return;
+    }
+    Forward(data, size, key, id_, 0);
+}
+
+void AudioRelay::OnTrunkPacket(const uint8_t* data, size_t size, const sockaddr_in& from, Clock::time_point now) {
+    ByteReader reader(data + 1, size - 1);
+    const uint64_t key = AddressKey(from);
+    Trunk* trunk = FindTrunk(key);
+
+    switch (data[0]) {
+        case kTrunkSubscribe: {
+            uint32_t peer_id = 0;
+            if (!reader.U32(peer_id)) {
+                return;
+            }
+            if (peer_id == id_) {
+                std::cerr << "Relay " << FormatAddress(from) << " has our id, subscription ignored" << std::endl;
+                return;
+            }
+            if (!trunk) {
+                Trunk downstream;
+                downstream.address = from;
+                downstream.key = key;
+                downstream.name = FormatAddress(from);
+                trunks_.push_back(std::move(downstream));
+                trunk = &trunks_.back();
+                std::cout << "Relay " << trunk->name << " subscribed" << std::endl;
+            }
+            trunk->peer_id = peer_id;
+            trunk->last_seen = now;
+            SendControl(from, kTrunkAccept);
+            break;
+        }
+        case kTrunkAccept: {
+            uint32_t peer_id = 0;
+            if (!trunk || !reader.U32(peer_id) || peer_id == id_) {
+                return;
+            }
+            if (!IsConnected(*trunk, now)) {
+                std::cout << "Trunk to " << trunk->name << " is up" << std::endl;
+            }
+            trunk->peer_id = peer_id;
+            trunk->last_seen = now;
+            break;
+        }
+        case kTrunkMedia: {
+            uint8_t hops = 0;
+            uint32_t origin = 0;
+            if (!trunk || !IsConnected(*trunk, now) || !reader.U8(hops) || !reader.U32(origin)) {
+                return;
+            }
+            trunk->last_seen = now;
+            ++trunk->counters.packets_in;
+            trunk->counters.bytes_in += size;
+            ++packets_in_;
+
+            const uint8_t* inner = data + kTrunkMediaHeader;
+            const size_t inner_size = size - kTrunkMediaHeader;
+            MediaHeader header;
+            if (origin == id_ || hops > kMaxHops || !MediaHeader::Parse(inner, inner_size, header) ||
+                !AcceptStream(header.ssrc, key, now)) {
+                ++trunk->counters.dropped;
+                ++dropped_;
+                return;
+            }
+            Forward(inner, inner_size, key, origin, hops);
+            break;
+        }
+    }
+}
+
+bool AudioRelay::AcceptStream(uint32_t ssrc, uint64_t ingress, Clock::time_point now) {
+    if (StreamOwner* owner = streams_.Find(ssrc)) {
+        // Поток уже идет с другого входа: это копия по второму пути
+        if (owner->ingress != ingress && now - owner->last_seen < kStreamTimeout) {
+            return false;
+        }
+        owner->ingress = ingress;
+        owner->last_seen = now;
+        return true;
+    }
+    streams_.Emplace(ssrc, StreamOwner{ingress, now});
+    return true;
+}
+
+void AudioRelay::Forward(const uint8_t* data, size_t size, uint64_t ingress, uint32_t origin, uint8_t hops) {
+    for (auto& participant : participants_) {
+        if (participant.key == ingress) {
+            continue;
+        }
+        // Слушателю с пачками - до такта; локальному участнику - копия
+        // прямо в его кольцо
+        if (participant.bundles) {
+            AppendBundled(participant, data, size);
+        } else if (!participant.local) {
+            SendTo(participant.address, data, size);
+        } else if (participant.local->Downlink().Push(data, size)) {
+            ++packets_out_;
+        } else {
+            ++dropped_;
+        }
+    }
+
+    if (trunks_.empty() || hops >= kMaxHops) {
+        return;
+    }
+
+    // Инкапсуляция одна на все транки; буфер заранее зарезервирован
+    trunk_buffer_.clear();
+    ByteWriter writer(trunk_buffer_);
+    writer.U8(kTrunkMedia);
+    writer.U8(static_cast<uint8_t>(hops + 1));
+    writer.U32(origin);
+    writer.Bytes(data, size);
+
+    const auto now = Clock::now();
+    for (auto& trunk : trunks_) {
+        if (trunk.key == ingress || !IsConnected(trunk, now)) {
+            continue;
+        }
+        SendTo(trunk.address, trunk_buffer_.data(), trunk_buffer_.size());
+        ++trunk.counters.packets_out;
+        trunk.counters.bytes_out += trunk_buffer_.size();
+    }
+}
+
+AudioRelay::Participant& AudioRelay::TouchParticipant(const sockaddr_in& from, uint64_t key, Clock::time_point now) {
+    if (const uint32_t* index = participant_index_.Find(key)) {
+        Participant& participant = participants_[*index];
+        participant.last_seen = now;
+        return participant;
+    }
+
+    participant_index_.Emplace(key, static_cast<uint32_t>(participants_.size()));
+    Participant participant;
+    participant.address = from;
+    participant.key = key;
+    participant.last_seen = now;
+    participants_.push_back(std::move(participant));
+    std::cout << "Participant " << FormatAddress(from) << " joined (" << participants_.size() << " local)"
+              << std::endl;
+    return participants_.back();
+}
+
+AudioRelay::Trunk* AudioRelay::FindTrunk(uint64_t key) {
+    for (auto& trunk : trunks_) {
+        if (trunk.key == key) {
+            return &trunk;
+        }
+    }
+    return nullptr;
+}
+
+bool AudioRelay::IsConnected(const Trunk& trunk, Clock::time_point now) const {
+    return trunk.peer_id != 0 && now - trunk.last_seen < kTrunkTimeout;
+}
+
+void AudioRelay::SendControl(const sockaddr_in& to, uint8_t kind) {
+    std::vector<uint8_t> packet;
+    ByteWriter writer(packet);
+    writer.U8(kind);
+    writer.U32(id_);
+    SendTo(to, packet.data(), packet.size());
+}
+
+void AudioRelay::SendTo(const sockaddr_in& to, const uint8_t* data, size_t size) {
+    // Эмулятор отправляет сам в назначенный момент, мимо пачек PacketIo
+    if (impairment_ && impairment_->ImpairsSend()) {
+        impairment_->SendTo(to, data, size);
+    } else {
+        io_->Send(to, data, size);
+    }
+    ++packets_out_;
+}
+
+void AudioRelay::AppendBundled(Participant& participant, const uint8_t* data, size_t size) {
+    if (1 + kBundleFrameHeader + size > kMaxBundleSize) {
+        SendTo(participant.address, data, size);
+        return;
+    }
+    if (participant.bundle.size() + kBundleFrameHeader + size > kMaxBundleSize) {
+        SendBundle(participant);
+    }
+    if (participant.bundle.empty()) {
+        participant.bundle.reserve(kMaxBundleSize);
+        participant.bundle.push_back(static_cast<uint8_t>(PacketType::Bundle));
+    }
+    participant.bundle.push_back(static_cast<uint8_t>(size >> 8));
+    participant.bundle.push_back(static_cast<uint8_t>(size));
+    participant.bundle.insert(participant.bundle.end(), data, data + size);
+    ++participant.bundle_frames;
+}
+
+// Одиночный кадр уходит как есть: пачка из одного только длиннее
+void AudioRelay::SendBundle(Participant& participant) {
+    if (participant.bundle_frames == 1) {
+        SendTo(participant.address, participant.bundle.data() + 1 + kBundleFrameHeader,
+               participant.bundle.size() - 1 - kBundleFrameHeader);
+    } else if (participant.bundle_frames > 1) {
+        SendTo(participant.address, participant.bundle.data(), participant.bundle.size());
+        ++bundles_;
+        bundled_frames_ += participant.bundle_frames;
+    }
+    participant.bundle.clear();
+    participant.bundle_frames = 0;
+}
+
+void AudioRelay::EmitBundles(Clock::time_point now) {
+    if (bundle_listeners_.load(std::memory_order_relaxed) == 0 || now < next_bundle_) {
+        return;
+    }
+    for (auto& participant : participants_) {
+        if (participant.bundle_frames > 0) {
+            SendBundle(participant);
+        }
+    }
+    // Отставший такт не догоняется пачками подряд
+    next_bundle_ = std::max(next_bundle_ + bundle_tick_, now);
+}
+
+// Удаление перестановкой с последним
+void AudioRelay::RemoveParticipant(size_t index) {
+    if (participants_[index].bundles) {
+        --bundle_listeners_;
+    }
+    participant_index_.Erase(participants_[index].key);
+    if (index + 1 != participants_.size()) {
+        participants_[index] = participants_.back();
+        *participant_index_.Find(participants_[index].key) = static_cast<uint32_t>(index);
+    }
+    participants_.pop_back();
+}
+
+void AudioRelay::Housekeeping(Clock::time_point now) {
+    last_housekeeping_ = now;
+
+    if (now - last_subscribe_ >= kSubscribeInterval) {
+        last_subscribe_ = now;
+        for (const auto& trunk : trunks_) {
+            if (trunk.upstream) {
+                SendControl(trunk.address, kTrunkSubscribe);
+            }
+        }
+    }
+
+    // Участник без пакетов дольше таймаута ушел; локальные уходят
+    // закрытием сокета
+    for (size_t i = 0; i < participants_.size();) {
+        if (participants_[i].local || now - participants_[i].last_seen < kParticipantTimeout) {
+            ++i;
+            continue;
+        }
+        std::cout << "Participant " << FormatAddress(participants_[i].address) << " timed out" << std::endl;
+        RemoveParticipant(i);
+    }
+
+    // Подписчик, переставший обновлять подписку, отключается; вышестоящие
+    // транки остаются и продолжают подписываться
+    for (size_t i = 0; i < trunks_.size();) {
+        if (trunks_[i].upstream || now - trunks_[i].last_seen < kTrunkTimeout) {
+            ++i;
+            continue;
+        }
+        std::cout << "Relay " << trunks_[i].name << " unsubscribed" << std::endl;
+        trunks_.erase(trunks_.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+
+    std::vector<uint32_t> stale;
+    streams_.ForEach([&](uint32_t ssrc, const StreamOwner& owner) {
+        if (now - owner.last_seen >= kStreamTimeout) {
+            stale.push_back(ssrc);
+        }
+    });
+    for (uint32_t ssrc : stale) {
+        streams_.Erase(ssrc);
+    }
+}
+
+AudioRelay::Stats AudioRelay::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = Clock::now();
+    const std::chrono::duration<double> elapsed = now - last_stats_;
+    last_stats_ = now;
+
+    Stats stats;
+    stats.participants = participants_.size();
+    stats.local_participants = locals_.size();
+    stats.local_waits = local_waits_;
+    stats.bundle_listeners = bundle_listeners_.load(std::memory_order_relaxed);
+    stats.bundles = bundles_;
+    stats.bundled_frames = bundled_frames_;
+    stats.local_wakeups = local_wakeups_;
+    for (const auto& local : locals_) {
+        stats.local_wakeups += local->Downlink().Wakeups();
+    }
+    stats.streams = streams_.Size();
+    stats.packets_in = packets_in_;
+    stats.packets_out = packets_out_;
+    stats.dropped = dropped_;
+    if (io_) {
+        stats.backend = io_->Backend();
+        stats.gso = io_->Gso();
+        stats.receive_calls = io_->GetStats().receive_calls;
+        stats.send_calls = io_->GetStats().send_calls;
+    }
+
+    for (auto& trunk : trunks_) {
+        TrunkStats result = trunk.counters;
+        result.peer = trunk.name;
+        result.upstream = trunk.upstream;
+        result.connected = IsConnected(trunk, now);
+        result.peer_id = trunk.peer_id;
+        streams_.ForEach([&](uint32_t, const StreamOwner& owner) {
+            result.streams_in += owner.ingress == trunk.key;
+        });
+        result.kbps_in = Kbps(trunk.counters.bytes_in - trunk.reported_bytes_in, elapsed);
+        result.kbps_out = Kbps(trunk.counters.bytes_out - trunk.reported_bytes_out, elapsed);
+        trunk.reported_bytes_in = trunk.counters.bytes_in;
+        trunk.reported_bytes_out = trunk.counters.bytes_out;
+        stats.trunks.push_back(std::move(result));
+    }
+    stats.media = metrics_.Take();
+    return stats;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FlatMap.hpp"
+#include "LocalTransport.hpp"
+#include "NetworkImpairment.hpp"
+#include "PacketIo.hpp"
+#include "Planes.hpp"
+#include "TraceFile.hpp"
+
+// Ретранслятор медиа-потока UDP клиента (client/main.cpp): датаграмма
+// участника уходит всем остальным участникам как есть. Один процесс - одна
+// конференция, комнат в этом формате нет.
+//
+// Каскад: ретранслятор подписывается на вышестоящий (AddUpstream), и между
+// ними появляется транк. По транку каждый поток идет один раз, сколько бы
+// слушателей ни было на той стороне; принявший ретранслятор раздает его
+// своим участникам и дальше по остальным транкам. Транк двусторонний:
+// потоки участников подписчика идут по нему вверх.
+//
+// Пакеты транка отличаются от медиа первым байтом:
+//   Subscribe  u8 0x10, u32 id подписчика      раз в секунду, мягкое состояние
+//   Accept     u8 0x11, u32 id                 ответ на Subscribe
+//   Media      u8 0x12, u8 хопы, u32 id ретранслятора-источника,
+//              затем исходная датаграмма участника
+//
+// Защита от петель: пакет не возвращается в транк, из которого пришел;
+// пакет со своим id источника или с исчерпанными хопами отбрасывается;
+// каждый поток (ssrc) принимается только с одного входа - того, откуда
+// пришел первым, пока тот не замолчит на kStreamTimeout. Последнее
+// отсекает дубли, если транки образуют цикл.
+//
+// Процессы на той же машине подключаются через Unix сокет (SetLocalPath)
+// и обмениваются датаграммами через кольца в разделяемой памяти
+// (LocalTransport.hpp). Для пересылки такой участник не отличается от
+// UDP участника; уходит он закрытием сокета, а не по таймауту, поэтому
+// может только слушать. Кольца к ретранслятору читает отдельный поток.
+//
+// Пачки (SetBundling): кадры для UDP слушателя, объявившего пачки в
+// приветствии, копятся до такта и уходят одной датаграммой (MediaPacket.hpp).
+// При K говорящих слушатель получает датаграмму на такт вместо K на период
+// кадра; такт добавляет задержку до своей длины. Транки и локальные
+// участники пачек не получают.
+class AudioRelay {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct TrunkStats {
+        std::string peer;
+        bool upstream{false};  // мы подписаны на него
+        bool connected{false};
+        uint32_t peer_id{0};
+        size_t streams_in{0};  // потоки, для которых транк - вход
+        uint64_t packets_in{0};
+        uint64_t bytes_in{0};
+        uint64_t packets_out{0};
+        uint64_t bytes_out{0};
+        uint64_t dropped{0};  // отброшено защитой от петель
+        // За время с предыдущего GetStats
+        double kbps_in{0.0};
+        double kbps_out{0.0};
+    };
+
+    struct Stats {
+        size_t participants{0};
+        size_t local_participants{0};  // из них через разделяемую память
+        size_t streams{0};
+        uint64_t packets_in{0};
+        uint64_t packets_out{0};
+        uint64_t dropped{0};
+        // Ввод-вывод: бэкенд и системные вызовы на прием и отправку
+        IoBackend backend{IoBackend::Auto};
+        bool gso{false};
+        uint64_t receive_calls{0};
+        uint64_t send_calls{0};
+        // Системные вызовы локального транспорта: ожидания потока колец
+        // и побудки уснувших клиентов
+        uint64_t local_waits{0};
+        uint64_t local_wakeups{0};
+        // Пачки: датаграммы и кадры в них; слушателей, принимающих пачки
+        size_t bundle_listeners{0};
+        uint64_t bundles{0};
+        uint64_t bundled_frames{0};
+        std::vector<TrunkStats> trunks;
+        // Очередь и задержка UDP приема за время с предыдущего GetStats
+        PlaneStats media;
+    };
+
+    // relay_id 0 - случайный
+    explicit AudioRelay(int port = kDefaultMediaPort, uint32_t relay_id = 0, PacketIoOptions io = {});
+    ~AudioRelay();
+
+    // Вызываются до Start
+    void AddUpstream(const sockaddr_in& address, const std::string& name);
+    // Запись всех принятых датаграмм, включая пакеты транков
+    void SetCapture(TraceWriter* trace) { capture_ = trace; }
+    // Эмуляция плохой сети на сокете ретранслятора; вызывается до Start
+    void SetImpairment(const ImpairmentOptions& options) { impairment_options_ = options; }
+    // Unix сокет для локальных процессов; вызывается до Start
+    void SetLocalPath(const std::string& path) { local_path_ = path; }
+    // Процесс, где работает и сигналинг: поток ретранслятора берет
+    // приоритет медиа и отмечает в gate, когда занят; вызывается до Start
+    void SetPlaneGate(MediaFirstGate* gate) { gate_ = gate; }
+    // Пачки слушателям раз в tick; ноль - кадры одной пачки приема.
+    // Вызывается до Start
+    void SetBundling(Clock::duration tick) {
+        bundling_ = true;
+        bundle_tick_ = tick;
+    }
+
+    bool Start();
+    void Stop();
+
+    uint32_t Id() const noexcept { return id_; }
+    Stats GetStats();
+
+private:
+    static constexpr uint8_t kMaxHops = 8;
+    static constexpr auto kParticipantTimeout = std::chrono::seconds(10);
+    static constexpr auto kTrunkTimeout = std::chrono::seconds(5);
+    static constexpr auto kSubscribeInterval = std::chrono::seconds(1);
+    static constexpr auto kStreamTimeout = std::chrono::seconds(2);
+    static constexpr auto kHousekeepingInterval = std::chrono::milliseconds(100);
+    // Под нагрузкой поток колец не спит; подключения он проверяет не реже
+    static constexpr auto kLocalPollInterval = std::chrono::milliseconds(10);
+
+    struct Participant {
+        sockaddr_in address{};
+        uint64_t key{0};
+        Clock::time_point last_seen{};
+        // Локальный участник; принадлежит locals_
+        LocalAttachment* local{nullptr};
+        // Принимает пачки; кадры до ближайшего такта
+        bool bundles{false};
+        std::vector<uint8_t> bundle;
+        uint32_t bundle_frames{0};
+    };
+
+    struct Trunk {
+        sockaddr_in address{};
+        uint64_t key{0};
+        std::string name;
+        bool upstream{false};
+        uint32_t peer_id{0};
+        Clock::time_point last_seen{};
+        TrunkStats counters;
+        // Снимок счетчиков для скорости между вызовами GetStats
+        uint64_t reported_bytes_in{0};
+        uint64_t reported_bytes_out{0};
+    };
+
+    // Вход, с которого принимается поток
+    struct StreamOwner {
+        uint64_t ingress{0};
+        Clock::time_point last_seen{};
+    };
+
+    int port_;
+    uint32_t id_;
+    PacketIoOptions io_options_;
+    int socket_{-1};
+    std::unique_ptr<PacketIo> io_;
+    TraceWriter* capture_{nullptr};
+    ImpairmentOptions impairment_options_;
+    std::unique_ptr<ImpairedSocket> impairment_;
+    std::atomic<bool> is_running_{false};
+    std::thread relay_thread_;
+    MediaFirstGate* gate_{nullptr};
+    PlaneMetrics metrics_;
+    // Метки ядра датаграмм текущей пачки
+    std::vector<int64_t> receive_stamps_;
+
+    bool bundling_{false};
+    Clock::duration bundle_tick_{};
+    Clock::time_point next_bundle_{};
+    // Читается циклом приема до захвата mutex_
+    std::atomic<size_t> bundle_listeners_{0};
+    uint64_t bundles_{0};
+    uint64_t bundled_frames_{0};
+
+    std::string local_path_;
+    int local_listener_{-1};
+    int local_epoll_{-1};
+    std::thread local_thread_;
+    uint32_t next_local_id_{1};
+    uint64_t local_waits_{0};
+    uint64_t local_wakeups_{0};  // отключившихся участников
+
+    std::mutex mutex_;
+    std::vector<Participant> participants_;
+    FlatMap<uint64_t, uint32_t> participant_index_;
+    // Транков единицы, поиск перебором
+    std::vector<Trunk> trunks_;
+    FlatMap<uint32_t, StreamOwner> streams_;
+    std::vector<std::unique_ptr<LocalAttachment>> locals_;
+    uint64_t packets_in_{0};
+    uint64_t packets_out_{0};
+    uint64_t dropped_{0};
+    Clock::time_point last_subscribe_{};
+    Clock::time_point last_housekeeping_{};
+    Clock::time_point last_stats_{};
+
+    // Буфер инкапсуляции для транков
+    std::vector<uint8_t> trunk_buffer_;
+
+    void RelayLoop();
+    bool StartLocal();
+    void LocalLoop();
+    void AttachLocal(Clock::time_point now);
+    bool DetachLocal(uint32_t id);
+    void OnLocalDatagram(const uint8_t* data, size_t size, Participant& participant, Clock::time_point now);
+    void OnDatagram(const uint8_t* data, size_t size, const sockaddr_in& from, Clock::time_point now);
+    void OnTrunkPacket(const uint8_t* data, size_t size, const sockaddr_in& from, Clock::time_point now);
+    void Forward(const uint8_t* data, size_t size, uint64_t ingress, uint32_t origin, uint8_t hops);
+    bool AcceptStream(uint32_t ssrc, uint64_t ingress, Clock::time_point now);
+    void AppendBundled(Participant& participant, const uint8_t* data, size_t size);
+    void SendBundle(Participant& participant);
+    // Пачки, чей такт наступил
+    void EmitBundles(Clock::time_point now);
+
+    Participant& TouchParticipant(const sockaddr_in& from, uint64_t key, Clock::time_point now);
+    Trunk* FindTrunk(uint64_t key);
+    bool IsConnected(const Trunk& trunk, Clock::time_point now) const;
+    void SendControl(const sockaddr_in& to, uint8_t kind);
+    void SendTo(const sockaddr_in& to, const uint8_t* data, size_t size);
+    void RemoveParticipant(size_t index);
+    void Housekeeping(Clock::time_point now);
+};
@@ -0,0 +1,142 @@
+#include "Cluster.hpp"
+
+#include <algorithm>
+
+#include "ByteBuffer.hpp"
+#include "Endpoint.hpp"
+#include "FlatMap.hpp"
+
+namespace {
+
+// Хеш обязан совпадать на всех узлах, поэтому не std::hash
+uint64_t StableHash(std::string_view text) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : text) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    return MixHash(hash);
+}
+
+}  // namespace
+
+bool ClusterMap::Configure(std::string_view nodes, std::string_view self, uint16_t port, std::string& error) {
+    nodes_.clear();
+    ring_.clear();
+    self_ = kNoNode;
+
+    while (!nodes.empty()) {
+        const size_t comma = nodes.find(',');
+        const std::string_view name = nodes.substr(0, comma);
+        nodes = comma == std::string_view::npos ? std::string_view() : nodes.substr(comma + 1);
+        if (name.empty()) {
+            continue;
+        }
+
+        ClusterNode node;
+        node.name = std::string(name);
+        if (!ParseEndpoint(name, node.address)) {
+            error = "invalid cluster node address: " + node.name;
+            return false;
+        }
+        for (const auto& other : nodes_) {
+            if (SameEndpoint(other.address, node.address)) {
+                error = "duplicate cluster node: " + node.name;
+                return false;
+            }
+        }
+        nodes_.push_back(std::move(node));
+    }
+    if (nodes_.empty() || nodes_.size() >= kNoNode) {
+        error = "cluster node list is empty or too long";
+        nodes_.clear();
+        return false;
+    }
+
+    for (NodeIndex i = 0; i < nodes_.size(); ++i) {
+        const bool match = self.empty() ? ntohs(nodes_[i].address.sin_port) == port : nodes_[i].name == self;
+        if (!match) {
+            continue;
+        }
+        if (self_ != kNoNode) {
+            error = "several cluster nodes match this server, use --cluster-self";
+            nodes_.clear();
+            return false;
+        }
+        self_ = i;
+    }
+    if (self_ == kNoNode) {
+        error = "this server is not in the cluster node list";
+        nodes_.clear();
+        return false;
+    }
+
+    ring_.reserve(nodes_.size() * kVirtualNodes);
+    for (NodeIndex i = 0; i < nodes_.size(); ++i) {
+        const uint64_t base = StableHash(nodes_[i].name);
+        for (int point = 0; point < kVirtualNodes; ++point) {
+            ring_.emplace_back(MixHash(base + static_cast<uint64_t>(point) * 0x9e3779b97f4a7c15ULL), i);
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
+    return true;
+}
+
+NodeIndex ClusterMap::OwnerOf(std::string_view room) const {
+    if (ring_.empty()) {
+        return self_;
+    }
+    const uint64_t hash = StableHash(room);
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(hash, NodeIndex{0}));
+    if (it == ring_.end()) {
+        it = ring_.begin();
+    }
+    return it->second;
+}
+
+NodeIndex ClusterMap::FindNode(const sockaddr_in& address) const {
+    for (NodeIndex i = 0; i < nodes_.size(); ++i) {
+        if (i != self_ && SameEndpoint(nodes_[i].address, address)) {
+            return i;
+        }
+    }
+    return kNoNode;
+}
+
+std::string EncodeNodeMessage(const NodeMessage& message) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(24 + message.room.size() + message.payload.size());
+
+    ByteWriter writer(buffer);
+    writer.U8(kNodeMessageMagic);
+    writer.U8(static_cast<uint8_t>(message.type));
+    writer.U64(message.session);
+    writer.U8(static_cast<uint8_t>(message.encoding));
+    writer.Varint(message.room.size());
+    writer.Bytes(message.room.data(), message.room.size());
+    writer.Bytes(message.payload.data(), message.payload.size());
+    return std::string(buffer.begin(), buffer.end());
+}
+
+bool DecodeNodeMessage(std::string_view payload, NodeMessage& message) {
+    ByteReader reader(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+
+    uint8_t magic = 0;
+    uint8_t type = 0;
+    uint8_t encoding = 0;
+    uint64_t room_size = 0;
+    if (!reader.U8(magic) || magic != kNodeMessageMagic || !reader.U8(type) || !reader.U64(message.session) ||
+        !reader.U8(encoding) || !reader.Varint(room_size) || room_size > reader.Remaining()) {
+        return false;
+    }
+    if (type < static_cast<uint8_t>(NodeMessageType::Join) || type > static_cast<uint8_t>(NodeMessageType::Deliver) ||
+        encoding > static_cast<uint8_t>(SignalEncoding::Binary)) {
+        return false;
+    }
+
+    message.type = static_cast<NodeMessageType>(type);
+    message.encoding = static_cast<SignalEncoding>(encoding);
+    message.room = std::string_view(reinterpret_cast<const char*>(reader.Position()), room_size);
+    reader.Skip(room_size);
+    message.payload = std::string_view(reinterpret_cast<const char*>(reader.Position()), reader.Remaining());
+    return true;
+}
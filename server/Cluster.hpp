@@ -0,0 +1,77 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "SignalingProtocol.hpp"
+
+// Индекс узла в списке кластера
+using NodeIndex = uint16_t;
+inline constexpr NodeIndex kNoNode = UINT16_MAX;
+
+struct ClusterNode {
+    std::string name;  // host:port из конфигурации, его же получают клиенты в redirect
+    sockaddr_in address{};
+};
+
+// Статический состав кластера и распределение комнат по узлам
+// консистентным хешированием: комната принадлежит узлу, чья точка на
+// кольце первая после хеша ее имени. У каждого узла kVirtualNodes точек,
+// поэтому комнаты делятся поровну, а при изменении состава переезжает
+// около 1/N из них. Точки зависят от имени узла, не от его места в
+// списке, так что порядок узлов в конфигурации может различаться.
+class ClusterMap {
+public:
+    // nodes - "host:port,host:port,..." (адреса сигналинга всех узлов,
+    // включая этот); self - свой адрес из списка, по умолчанию - узел с
+    // тем же портом. false и описание в error при ошибке.
+    bool Configure(std::string_view nodes, std::string_view self, uint16_t port, std::string& error);
+
+    bool Enabled() const noexcept { return !nodes_.empty(); }
+    size_t Size() const noexcept { return nodes_.size(); }
+    NodeIndex Self() const noexcept { return self_; }
+    const ClusterNode& Node(NodeIndex node) const { return nodes_[node]; }
+
+    NodeIndex OwnerOf(std::string_view room) const;
+    // Узел по адресу отправителя; kNoNode - отправитель не узел, а клиент
+    NodeIndex FindNode(const sockaddr_in& address) const;
+
+private:
+    static constexpr int kVirtualNodes = 128;
+
+    std::vector<ClusterNode> nodes_;
+    // Точки кольца, отсортированы по хешу
+    std::vector<std::pair<uint64_t, NodeIndex>> ring_;
+    NodeIndex self_{kNoNode};
+};
+
+// Сообщения между узлами. Идут через тот же сокет и ReliableTransport,
+// что и клиентские; узел узнается по адресу отправителя.
+//
+//   u8 magic (0xc7), u8 тип, u64 сессия, u8 кодировка клиента,
+//   varint длина + имя комнаты, остаток - сообщение клиента как есть
+enum class NodeMessageType : uint8_t {
+    Join = 1,     // клиент домашнего узла входит в комнату владельца
+    Leave = 2,    // и выходит из нее
+    Relay = 3,    // сообщение такого клиента для комнаты
+    Deliver = 4,  // готовое сообщение клиенту, которое отдает его домашний узел
+};
+
+struct NodeMessage {
+    NodeMessageType type{NodeMessageType::Relay};
+    SessionId session{kNoSession};
+    SignalEncoding encoding{SignalEncoding::Json};
+    std::string_view room;
+    std::string_view payload;
+};
+
+inline constexpr uint8_t kNodeMessageMagic = 0xc7;
+
+std::string EncodeNodeMessage(const NodeMessage& message);
+// Строки указывают в payload
+bool DecodeNodeMessage(std::string_view payload, NodeMessage& message);
@@ -0,0 +1,290 @@
+#include "FrameScheduler.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "Timeline.hpp"
+
+namespace {
+
+// Доступные процессу ядра: с учетом taskset и cgroup
+std::vector<int> AllowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+}  // namespace
+
+FrameScheduler::FrameScheduler(Options options) : options_(options) {
+    if (options_.workers == 0) {
+        options_.workers = std::max<size_t>(1, AllowedCpus().size());
+    }
+    for (size_t i = 0; i < options_.workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+}
+
+FrameScheduler::~FrameScheduler() {
+    Stop();
+}
+
+void FrameScheduler::Start() {
+    if (is_running_) {
+        return;
+    }
+    is_running_ = true;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->thread = std::thread(&FrameScheduler::WorkerLoop, this, i);
+    }
+}
+
+void FrameScheduler::Stop() {
+    if (!is_running_) {
+        return;
+    }
+    is_running_ = false;
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->wake.notify_all();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+FrameScheduler::RoomId FrameScheduler::AddRoom(Job job) {
+    auto room = std::make_shared<Room>();
+    room->job = std::move(job);
+    RoomId id = 0;
+    {
+        std::lock_guard<std::mutex> lock(rooms_mutex_);
+        id = next_id_++;
+        room->id = id;
+        size_t home = 0;
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            if (workers_[i]->rooms.load(std::memory_order_relaxed) <
+                workers_[home]->rooms.load(std::memory_order_relaxed)) {
+                home = i;
+            }
+        }
+        room->home = home;
+        workers_[home]->rooms.fetch_add(1, std::memory_order_relaxed);
+        rooms_.push_back(room);
+    }
+
+    // Фаза по золотому сечению: соседние id ложатся далеко друг от друга,
+    // и сроки равномерно покрывают период при любом числе комнат
+    const double golden = id * 0.6180339887498949;
+    const auto phase = std::chrono::duration_cast<Clock::duration>(options_.period * (golden - std::floor(golden)));
+    Push({Clock::now() + options_.period + phase, std::move(room)}, true);
+    return id;
+}
+
+void FrameScheduler::RemoveRoom(RoomId id) {
+    std::lock_guard<std::mutex> lock(rooms_mutex_);
+    const auto it = std::find_if(rooms_.begin(), rooms_.end(), [id](const auto& room) { return room->id == id; });
+    if (it == rooms_.end()) {
+        return;
+    }
+    // Кадр в очереди выбросит работник, который его достанет
+    (*it)->removed = true;
+    workers_[(*it)->home]->rooms.fetch_sub(1, std::memory_order_relaxed);
+    rooms_.erase(it);
+}
+
+FrameScheduler::Stats FrameScheduler::GetStats() const {
+    Stats stats;
+    for (const auto& worker : workers_) {
+        WorkerStats item;
+        item.rooms = worker->rooms.load(std::memory_order_relaxed);
+        item.frames = worker->frames.load(std::memory_order_relaxed);
+        item.steals = worker->steals.load(std::memory_order_relaxed);
+        item.busy = std::chrono::nanoseconds(worker->busy_ns.load(std::memory_order_relaxed));
+        stats.workers.push_back(item);
+    }
+
+    std::lock_guard<std::mutex> lock(rooms_mutex_);
+    stats.rooms.reserve(rooms_.size());
+    for (const auto& room : rooms_) {
+        RoomStats item;
+        item.id = room->id;
+        item.worker = room->home;
+        item.frames = room->frames.load(std::memory_order_relaxed);
+        item.misses = room->misses.load(std::memory_order_relaxed);
+        item.skipped = room->skipped.load(std::memory_order_relaxed);
+        item.stolen = room->stolen.load(std::memory_order_relaxed);
+        item.worst_lateness = std::chrono::nanoseconds(room->worst_lateness_ns.load(std::memory_order_relaxed));
+        stats.frames += item.frames;
+        stats.misses += item.misses;
+        stats.rooms.push_back(item);
+    }
+    return stats;
+}
+
+void FrameScheduler::WorkerLoop(size_t index) {
+    Timeline::SetThreadName("room-worker");
+    if (options_.pin) {
+        const std::vector<int> cpus = AllowedCpus();
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[index % cpus.size()], &set);
+            const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (result != 0) {
+                std::cerr << "Frame scheduler: worker " << index << " cannot be pinned (" << std::strerror(result)
+                          << ")" << std::endl;
+            }
+        }
+    }
+
+    // Простаивающий работник заглядывает к соседям не реже, чем раз в
+    // восьмую часть периода: чужой кадр не ждет дольше, чем его хозяин
+    const auto steal_interval = options_.period / 8;
+    Worker& worker = *workers_[index];
+    Entry entry;
+    while (is_running_) {
+        const auto now = Clock::now();
+        if (TakeLocal(worker, now, entry) || (options_.steal && Steal(index, now, entry))) {
+            Run(index, entry);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        auto until = worker.queue.empty() ? now + options_.period : worker.queue.front().deadline - options_.period;
+        if (options_.steal && workers_.size() > 1) {
+            until = std::min(until, now + steal_interval);
+        }
+        if (until > now && is_running_) {
+            worker.wake.wait_until(lock, until);
+        }
+    }
+}
+
+bool FrameScheduler::TakeLocal(Worker& worker, Clock::time_point now, Entry& entry) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    while (!worker.queue.empty()) {
+        Entry& front = worker.queue.front();
+        if (front.deadline - options_.period > now) {
+            return false;
+        }
+        std::pop_heap(worker.queue.begin(), worker.queue.end(), LaterDeadline);
+        entry = std::move(worker.queue.back());
+        worker.queue.pop_back();
+        if (!entry.room->removed.load(std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameScheduler::Steal(size_t thief, Clock::time_point now, Entry& entry) {
+    // Жертва - работник с самым срочным выпущенным кадром. Занятые очереди
+    // не ждем: их владелец или другой вор и так двигают кадры
+    size_t victim = workers_.size();
+    Clock::time_point best = Clock::time_point::max();
+    for (size_t offset = 1; offset < workers_.size(); ++offset) {
+        const size_t index = (thief + offset) % workers_.size();
+        Worker& worker = *workers_[index];
+        std::unique_lock<std::mutex> lock(worker.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || worker.queue.empty()) {
+            continue;
+        }
+        const auto deadline = worker.queue.front().deadline;
+        if (deadline - options_.period <= now && deadline < best) {
+            best = deadline;
+            victim = index;
+        }
+    }
+    if (victim == workers_.size()) {
+        return false;
+    }
+
+    Worker& worker = *workers_[victim];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.queue.empty() || worker.queue.front().deadline - options_.period > now) {
+        return false;
+    }
+    std::pop_heap(worker.queue.begin(), worker.queue.end(), LaterDeadline);
+    entry = std::move(worker.queue.back());
+    worker.queue.pop_back();
+    if (entry.room->removed.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    entry.room->stolen.fetch_add(1, std::memory_order_relaxed);
+    workers_[thief]->steals.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void FrameScheduler::Run(size_t index, Entry& entry) {
+    Room& room = *entry.room;
+    const auto start = Clock::now();
+    {
+        TimelineScope scope("room.frame", room.id);
+        room.job(room.frame);
+    }
+    const auto end = Clock::now();
+
+    Worker& worker = *workers_[index];
+    worker.frames.fetch_add(1, std::memory_order_relaxed);
+    worker.busy_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+                             std::memory_order_relaxed);
+    room.frames.fetch_add(1, std::memory_order_relaxed);
+    if (end > entry.deadline) {
+        room.misses.fetch_add(1, std::memory_order_relaxed);
+        const int64_t lateness = std::chrono::duration_cast<std::chrono::nanoseconds>(end - entry.deadline).count();
+        if (lateness > room.worst_lateness_ns.load(std::memory_order_relaxed)) {
+            room.worst_lateness_ns.store(lateness, std::memory_order_relaxed);
+        }
+    }
+
+    ++room.frame;
+    entry.deadline += options_.period;
+    // Срок следующего кадра уже прошел: он не выпускается, иначе комната
+    // будет догонять пачкой и сорвет сроки соседей
+    while (entry.deadline < end) {
+        ++room.frame;
+        entry.deadline += options_.period;
+        room.skipped.fetch_add(1, std::memory_order_relaxed);
+        room.misses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (room.removed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const bool remote = room.home != index;
+    Push(std::move(entry), remote);
+}
+
+bool FrameScheduler::LaterDeadline(const Entry& a, const Entry& b) {
+    return a.deadline > b.deadline;
+}
+
+void FrameScheduler::Push(Entry entry, bool notify) {
+    Worker& worker = *workers_[entry.room->home];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(std::move(entry));
+        std::push_heap(worker.queue.begin(), worker.queue.end(), LaterDeadline);
+    }
+    if (notify) {
+        worker.wake.notify_one();
+    }
+}
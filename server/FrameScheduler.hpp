@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Параметры FrameScheduler
+struct FrameSchedulerOptions {
+    // 256 сэмплов на 44100 Гц, как у клиента
+    static constexpr std::chrono::nanoseconds kFramePeriod{256 * 1000000000LL / 44100};
+
+    size_t workers{0};  // 0 - по числу доступных ядер
+    std::chrono::steady_clock::duration period{kFramePeriod};
+    bool pin{true};  // работник i - на i-м доступном ядре
+    bool steal{true};
+};
+
+// Покадровые задачи комнат на фиксированном пуле работников: каждой
+// комнате раз в период (буфер клиента, FRAMES_PER_BUFFER / SAMPLE_RATE)
+// нужно смикшировать или разослать кадр, и успеть до следующего.
+//
+// У комнаты есть домашний работник - наименее загруженный на момент
+// добавления. Кадр выпускается в очередь домашнего работника за период до
+// своего срока, очередь упорядочена по сроку. Свободный работник крадет у
+// занятого выпущенный кадр с ближайшим сроком, но после выполнения кадр
+// возвращается в домашнюю очередь: комната остается на своем ядре и в его
+// кешах, а кража лишь сглаживает пики.
+//
+// Сроки комнат разнесены по периоду, чтобы тысячи комнат не просыпались
+// разом. Кадр, закончившийся позже срока, - промах; если работник отстал
+// больше чем на период, пропущенные кадры не догоняются пачкой, а
+// считаются промахами и пропусками.
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    using RoomId = uint32_t;
+    // Задача кадра; frame - номер кадра комнаты с нуля, с учетом пропусков
+    using Job = std::function<void(uint64_t frame)>;
+
+    using Options = FrameSchedulerOptions;
+
+    struct RoomStats {
+        RoomId id{0};
+        size_t worker{0};
+        uint64_t frames{0};
+        uint64_t misses{0};
+        uint64_t skipped{0};  // входят в misses
+        uint64_t stolen{0};
+        Clock::duration worst_lateness{};
+    };
+
+    struct WorkerStats {
+        size_t rooms{0};
+        uint64_t frames{0};
+        uint64_t steals{0};
+        Clock::duration busy{};
+    };
+
+    struct Stats {
+        uint64_t frames{0};
+        uint64_t misses{0};
+        std::vector<WorkerStats> workers;
+        std::vector<RoomStats> rooms;
+    };
+
+    explicit FrameScheduler(FrameSchedulerOptions options = {});
+    ~FrameScheduler();
+
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    void Start();
+    void Stop();
+
+    // Можно вызывать и до Start, и на ходу; первый кадр - в пределах
+    // периода. Задача выполняется не более чем одним работником за раз.
+    RoomId AddRoom(Job job);
+    // Кадр, который уже выполняется, досчитывается
+    void RemoveRoom(RoomId id);
+
+    size_t Workers() const noexcept { return workers_.size(); }
+    Stats GetStats() const;
+
+private:
+    struct Room {
+        RoomId id{0};
+        Job job;
+        size_t home{0};
+        std::atomic<bool> removed{false};
+        // Меняет только работник, у которого кадр на руках
+        uint64_t frame{0};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> skipped{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<int64_t> worst_lateness_ns{0};
+    };
+
+    struct Entry {
+        Clock::time_point deadline;
+        std::shared_ptr<Room> room;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable wake;
+        // Куча по сроку: ближайший - в front
+        std::vector<Entry> queue;
+        std::thread thread;
+        std::atomic<size_t> rooms{0};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<int64_t> busy_ns{0};
+    };
+
+    Options options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> is_running_{false};
+
+    mutable std::mutex rooms_mutex_;
+    std::vector<std::shared_ptr<Room>> rooms_;
+    RoomId next_id_{1};
+
+    void WorkerLoop(size_t index);
+    bool TakeLocal(Worker& worker, Clock::time_point now, Entry& entry);
+    bool Steal(size_t thief, Clock::time_point now, Entry& entry);
+    void Run(size_t index, Entry& entry);
+    void Push(Entry entry, bool notify);
+    static bool LaterDeadline(const Entry& a, const Entry& b);
+};
@@ -0,0 +1,93 @@
+#include "RoomRoster.hpp"
+
+#include <algorithm>
+
+namespace {
+
+bool EraseValue(std::vector<SessionId>& values, SessionId id) {
+    auto it = std::find(values.begin(), values.end(), id);
+    if (it == values.end()) {
+        return false;
+    }
+    *it = values.back();
+    values.pop_back();
+    return true;
+}
+
+void AddValue(std::vector<SessionId>& values, SessionId id) {
+    if (std::find(values.begin(), values.end(), id) == values.end()) {
+        values.push_back(id);
+    }
+}
+
+}  // namespace
+
+void RoomRoster::Touch(Clock::time_point now) {
+    if (!HasPending()) {
+        pending_since_ = now;
+    }
+}
+
+void RoomRoster::Join(SessionId id, Clock::time_point now) {
+    Touch(now);
+    EraseValue(left_, id);
+    AddValue(joined_, id);
+}
+
+void RoomRoster::Leave(SessionId id, Clock::time_point now) {
+    Touch(now);
+    // Вошел и вышел в одном окне - остальные о нем не узнают. Leave все
+    // равно нужен: участник мог быть в комнате и до окна.
+    EraseValue(joined_, id);
+    AddValue(left_, id);
+}
+
+RoomRoster::Delta RoomRoster::Commit() {
+    Delta delta;
+    delta.from_version = version_;
+    delta.version = ++version_;
+    delta.joined.swap(joined_);
+    delta.left.swap(left_);
+
+    if (history_.size() == kHistorySize) {
+        history_.erase(history_.begin());
+    }
+    history_.push_back(delta);
+    return delta;
+}
+
+void RoomRoster::Apply(Delta& into, const Delta& change) {
+    for (SessionId id : change.joined) {
+        EraseValue(into.left, id);
+        AddValue(into.joined, id);
+    }
+    for (SessionId id : change.left) {
+        EraseValue(into.joined, id);
+        AddValue(into.left, id);
+    }
+    into.version = change.version;
+}
+
+bool RoomRoster::DeltaSince(uint64_t version, Delta& out) const {
+    if (version > version_) {
+        return false;
+    }
+
+    out = Delta{};
+    out.from_version = version;
+    out.version = version;
+    if (version == version_) {
+        return true;
+    }
+
+    // История непрерывна: версии идут подряд
+    if (history_.empty() || history_.front().from_version > version) {
+        return false;
+    }
+    for (const auto& delta : history_) {
+        if (delta.from_version >= version) {
+            Apply(out, delta);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "SignalingProtocol.hpp"
+
+// Версионированный состав комнаты. Входы и выходы копятся в окне
+// объединения и фиксируются одной дельтой с новой версией; последние
+// дельты хранятся, чтобы отставший клиент мог догнаться без полного списка.
+//
+// Операции дельты идемпотентны (join уже присутствующего и leave
+// отсутствующего ничего не меняют), поэтому снимок, взятый посреди окна,
+// согласован с дельтой, которая закроет это окно.
+class RoomRoster {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Delta {
+        uint64_t from_version{0};
+        uint64_t version{0};
+        std::vector<SessionId> joined;
+        std::vector<SessionId> left;
+    };
+
+    uint64_t Version() const noexcept { return version_; }
+
+    void Join(SessionId id, Clock::time_point now);
+    void Leave(SessionId id, Clock::time_point now);
+
+    bool HasPending() const noexcept { return !joined_.empty() || !left_.empty(); }
+    Clock::time_point PendingSince() const noexcept { return pending_since_; }
+
+    // Закрывает окно: версия увеличивается на единицу
+    Delta Commit();
+
+    // Все изменения после version одной дельтой. false, если история
+    // уже не покрывает version - тогда нужен полный снимок.
+    bool DeltaSince(uint64_t version, Delta& out) const;
+
+private:
+    static constexpr size_t kHistorySize = 32;
+
+    uint64_t version_{0};
+    std::vector<SessionId> joined_;
+    std::vector<SessionId> left_;
+    Clock::time_point pending_since_{};
+    std::vector<Delta> history_;
+
+    static void Apply(Delta& into, const Delta& change);
+    void Touch(Clock::time_point now);
+};
@@ -0,0 +1,140 @@
+#include "SessionRegistry.hpp"
+
+#include <random>
+
+SessionRegistry::SessionRegistry() {
+    std::random_device rd;
+    for (auto& key : id_key_) {
+        key = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
+}
+
+SessionId SessionRegistry::NextId() {
+    // Сложение с ключом, MixHash и XOR - биекции на 2^64, так что разные
+    // значения счетчика дают разные идентификаторы
+    for (;;) {
+        const SessionId id = MixHash(next_sequence_++ + id_key_[0]) ^ id_key_[1];
+        if (id != kNoSession) {
+            return id;
+        }
+    }
+}
+
+Session& SessionRegistry::Create(const sockaddr_in& address) {
+    const uint32_t index = sessions_.Allocate();
+    Session& session = sessions_[index];
+    session.id = NextId();
+    session.address = address;
+    session_index_.Emplace(session.id, index);
+    return session;
+}
+
+Session& SessionRegistry::Adopt(SessionId id, NodeIndex home) {
+    if (Session* existing = Find(id)) {
+        return *existing;
+    }
+    const uint32_t index = sessions_.Allocate();
+    Session& session = sessions_[index];
+    session.id = id;
+    session.home = home;
+    session_index_.Emplace(id, index);
+    return session;
+}
+
+void SessionRegistry::Remove(SessionId id) {
+    const uint32_t* index = session_index_.Find(id);
+    if (!index) {
+        return;
+    }
+    const uint32_t slot = *index;
+    LeaveRoom(sessions_[slot]);
+    session_index_.Erase(id);
+    sessions_.Free(slot);
+}
+
+Session* SessionRegistry::Find(SessionId id) {
+    const uint32_t* index = session_index_.Find(id);
+    return index ? &sessions_[*index] : nullptr;
+}
+
+uint32_t SessionRegistry::IndexOf(const Session& session) const {
+    return *session_index_.Find(session.id);
+}
+
+uint32_t SessionRegistry::JoinRoom(Session& session, std::string_view room_name) {
+    LeaveRoom(session);
+
+    uint32_t room = FindRoom(room_name);
+    if (room == Session::kNoRoom) {
+        room = rooms_.Allocate();
+        rooms_[room].name = std::string(room_name);
+        room_index_.Emplace(rooms_[room].name, room);
+    }
+
+    auto& members = rooms_[room].members;
+    session.room = room;
+    session.room_slot = static_cast<uint32_t>(members.size());
+    members.push_back(IndexOf(session));
+    return room;
+}
+
+uint32_t SessionRegistry::LeaveRoom(Session& session) {
+    const uint32_t room = session.room;
+    if (room == Session::kNoRoom) {
+        return room;
+    }
+
+    // Удаление перестановкой последнего участника на место уходящего
+    auto& members = rooms_[room].members;
+    const uint32_t last = members.back();
+    members[session.room_slot] = last;
+    sessions_[last].room_slot = session.room_slot;
+    members.pop_back();
+
+    session.room = Session::kNoRoom;
+    session.room_slot = 0;
+
+    if (members.empty()) {
+        room_index_.Erase(rooms_[room].name);
+        rooms_.Free(room);
+    }
+    return room;
+}
+
+uint32_t SessionRegistry::FindRoom(std::string_view room_name) const {
+    const uint32_t* room = room_index_.Find(room_name);
+    return room ? *room : Session::kNoRoom;
+}
+
+size_t SessionRegistry::MemoryUsage() const {
+    size_t bytes = sessions_.MemoryUsage() + session_index_.MemoryUsage() + rooms_.MemoryUsage() +
+                   room_index_.MemoryUsage();
+
+    // Выделенная память внутри комнат: участники и длинные имена
+    // (короткие помещаются в SSO и уже учтены в размере Room)
+    room_index_.ForEach([&](const std::string& name, uint32_t room) {
+        const Room& value = rooms_[room];
+        bytes += value.members.capacity() * sizeof(uint32_t);
+        if (value.name.capacity() > std::string().capacity()) {
+            bytes += value.name.capacity() + 1;
+        }
+        if (name.capacity() > std::string().capacity()) {
+            bytes += name.capacity() + 1;
+        }
+    });
+    return bytes;
+}
+
+void SessionRegistry::Reserve(size_t sessions, size_t rooms) {
+    sessions_.Reserve(sessions);
+    session_index_.Reserve(sessions);
+    rooms_.Reserve(rooms);
+    room_index_.Reserve(rooms);
+}
+
+void SessionRegistry::Clear() {
+    sessions_.Clear();
+    session_index_.Clear();
+    rooms_.Clear();
+    room_index_.Clear();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Cluster.hpp"
+#include "FlatMap.hpp"
+#include "RoomRoster.hpp"
+#include "SignalingProtocol.hpp"
+
+struct Session {
+    static constexpr uint32_t kNoRoom = UINT32_MAX;
+
+    SessionId id{kNoSession};
+    sockaddr_in address{};
+    uint32_t room{kNoRoom};  // индекс комнаты в реестре
+    uint32_t room_slot{0};   // позиция в списке участников комнаты
+    SignalEncoding encoding{SignalEncoding::Json};  // выбрана при регистрации
+    bool redirect{false};                           // клиент умеет переходить на другой узел
+    // Кластер. home - узел, к которому подключен клиент, если не этот
+    // (сессия - участник нашей комнаты, сообщения ему идут через home).
+    // proxy - узел-владелец комнаты, куда проксируется наш клиент.
+    NodeIndex home{kNoNode};
+    NodeIndex proxy{kNoNode};
+};
+
+struct Room {
+    std::string name;
+    // Индексы сессий подряд в одном массиве: рассылка по комнате - проход
+    // по непрерывной памяти без поиска в хеш-таблицах
+    std::vector<uint32_t> members;
+    // Версии состава для инкрементальной синхронизации клиентов
+    RoomRoster roster;
+};
+
+// Реестр сессий и комнат сигналинг-сервера. Сессии и комнаты лежат в
+// пулах (Slab), поиск по идентификатору и имени - через плоские таблицы
+// с открытой адресацией. Не потокобезопасен.
+class SessionRegistry {
+public:
+    SessionRegistry();
+
+    // Идентификаторы не повторяются за время жизни реестра: это
+    // биекция счетчика, перемешанная случайным ключом, поэтому их
+    // нельзя угадать по соседним
+    Session& Create(const sockaddr_in& address);
+    // Сессия с чужим идентификатором - клиент другого узла кластера
+    Session& Adopt(SessionId id, NodeIndex home);
+    void Remove(SessionId id);
+
+    Session* Find(SessionId id);
+    uint32_t IndexOf(const Session& session) const;
+    Session& At(uint32_t index) { return sessions_[index]; }
+
+    // Возвращает индекс комнаты; предыдущую комнату сессия покидает
+    uint32_t JoinRoom(Session& session, std::string_view room_name);
+    // Возвращает индекс покинутой комнаты или Session::kNoRoom.
+    // Пустая комната удаляется.
+    uint32_t LeaveRoom(Session& session);
+
+    uint32_t FindRoom(std::string_view room_name) const;
+    Room* GetRoom(uint32_t room) { return room == Session::kNoRoom ? nullptr : &rooms_[room]; }
+
+    size_t SessionCount() const noexcept { return session_index_.Size(); }
+    size_t RoomCount() const noexcept { return room_index_.Size(); }
+    // Память всех структур реестра, включая списки участников и имена комнат
+    size_t MemoryUsage() const;
+
+    void Reserve(size_t sessions, size_t rooms);
+    void Clear();
+
+private:
+    uint64_t id_key_[2];
+    uint64_t next_sequence_{0};
+
+    Slab<Session> sessions_;
+    FlatMap<SessionId, uint32_t> session_index_;
+    Slab<Room> rooms_;
+    FlatMap<std::string, uint32_t> room_index_;
+
+    SessionId NextId();
+};
@@ -1,10 +1,12 @@
 #include "SignalingServer.hpp"
+#include "Endpoint.hpp"
+#include "Timeline.hpp"
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
-#include <random>
 #include <sstream>
 
 SignalingServer::SignalingServer(int port) 
@@ -14,6 +16,10 @@ SignalingServer::~SignalingServer() {
     Stop();
 }
 
+bool SignalingServer::ConfigureCluster(std::string_view nodes, std::string_view self, std::string& error) {
+    return cluster_.Configure(nodes, self, static_cast<uint16_t>(port_), error);
+}
+
 bool SignalingServer::Start() {
     // Создаем UDP сокет
     server_socket_ = socket(AF_INET, SOCK_DGRAM, 0);
@@ -35,10 +41,31 @@ bool SignalingServer::Start() {
         return false;
     }
     
+    // Надежная доставка, фрагментация и склейка сообщений поверх UDP
+    transport_ = std::make_unique<ReliableTransport>(
+        server_socket_,
+        [this](std::string_view message, const sockaddr_in& from) {
+            receive_stamps_.push_back(transport_->ReceiveTime());
+            HandleMessage(message, from);
+        }
+    );
+    transport_->SetCapture(capture_);
+    transport_->EnableTimestamps();
+    if (impairment_options_.Enabled()) {
+        impairment_ = std::make_unique<ImpairedSocket>(server_socket_, impairment_options_);
+        transport_->SetImpairment(impairment_.get());
+        std::cout << "Impaired network: in " << DescribeImpairment(impairment_options_.in) << "; out "
+                  << DescribeImpairment(impairment_options_.out) << std::endl;
+    }
+    
     is_running_ = true;
     server_thread_ = std::thread(&SignalingServer::ServerLoop, this);
     
     std::cout << "Signaling server started on port " << port_ << std::endl;
+    if (cluster_.Enabled()) {
+        std::cout << "Cluster node " << cluster_.Node(cluster_.Self()).name << " (" << cluster_.Self() + 1 << " of "
+                  << cluster_.Size() << ")" << std::endl;
+    }
     return true;
 }
 
@@ -53,73 +80,151 @@ void SignalingServer::Stop() {
         server_thread_.join();
     }
     
+    transport_.reset();
+    impairment_.reset();
+    
     if (server_socket_ >= 0) {
         close(server_socket_);
         server_socket_ = -1;
     }
     
     std::lock_guard<std::mutex> lock(clients_mutex_);
-    clients_.clear();
-    rooms_.clear();
+    sessions_.Clear();
     
     std::cout << "Signaling server stopped" << std::endl;
 }
 
+PlaneStats SignalingServer::GetPlaneStats() {
+    PlaneStats stats = metrics_.Take();
+    if (gate_) {
+        const uint64_t yields = gate_->Yields();
+        stats.yields = yields - reported_yields_;
+        reported_yields_ = yields;
+    }
+    return stats;
+}
+
 void SignalingServer::ServerLoop() {
-    char buffer[4096];
-    sockaddr_in client_addr{};
-    socklen_t addr_len = sizeof(client_addr);
-    
+    Timeline::SetThreadName("signaling");
+    if (gate_) {
+        std::cout << "Signaling plane thread: " << EnterPlaneThread(Plane::Signaling) << std::endl;
+    }
     while (is_running_) {
-        int bytes_received = recvfrom(server_socket_, buffer, sizeof(buffer) - 1, 0, 
-                                     (sockaddr*)&client_addr, &addr_len);
+        // Дельты составов, чье окно истекло, уходят в том же Poll
+        Clock::duration wait;
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            wait = FlushPresence(Clock::now());
+        }
         
-        if (bytes_received > 0) {
-            buffer[bytes_received] = '\0';
-            std::string message(buffer);
-            HandleMessage(message, client_addr, server_socket_);
+        // Разбираем пачку пришедших датаграмм, затем одним проходом
+        // отправляем накопленные ответы, склеенные по получателям. Пачка
+        // режется на порции: шторм сообщений не держит процессор и ответы
+        size_t received = 0;
+        if (transport_->WaitReadable(std::chrono::ceil<std::chrono::milliseconds>(wait))) {
+            while (is_running_) {
+                if (gate_) {
+                    gate_->YieldToMedia();
+                }
+                const size_t slice = transport_->ReceiveAll(kSignalingSlice);
+                received += slice;
+                if (slice < kSignalingSlice) {
+                    break;
+                }
+                transport_->Poll();
+                FinishSlice(0);
+            }
         }
+        transport_->Poll();
+        FinishSlice(received);
+    }
+}
+
+void SignalingServer::FinishSlice(size_t received) {
+    if (received > 0) {
+        metrics_.OnWakeup(received);
     }
+    if (receive_stamps_.empty()) {
+        return;
+    }
+    const int64_t done = PlaneMetrics::RealtimeNs();
+    for (const int64_t stamp : receive_stamps_) {
+        metrics_.OnHandled(stamp, done);
+    }
+    receive_stamps_.clear();
 }
 
-void SignalingServer::HandleMessage(const std::string& message, const sockaddr_in& client_addr, int socket_fd) {
+void SignalingServer::HandleMessage(std::string_view payload, const sockaddr_in& client_addr) {
+    TimelineScope scope("signal.receive", payload.size());
+    
+    // Узлы кластера говорят через тот же сокет; узнаем их по адресу
+    if (cluster_.Enabled()) {
+        const NodeIndex node = cluster_.FindNode(client_addr);
+        if (node != kNoNode) {
+            HandleNodeMessage(node, payload);
+            return;
+        }
+    }
+    
     try {
-        Json::Value root;
-        Json::Reader reader;
-        
-        if (!reader.parse(message, root)) {
-            std::cerr << "Failed to parse JSON message" << std::endl;
+        // Разбор на месте: строки сообщения указывают в payload, временные
+        // данные - в арене, которая сбрасывается на каждом сообщении
+        arena_.Reset();
+        SignalView message;
+        if (!ScanSignal(payload, message, arena_)) {
+            std::cerr << "Failed to parse signaling message" << std::endl;
             return;
         }
         
-        std::string type = root.get("type", "").asString();
-        std::string client_id = root.get("client_id", "").asString();
+        SessionId client_id = message.client_id;
+        
+        // Ожидание блокировки - отдельный интервал внутри signal.receive
+        const uint64_t lock_start = Timeline::Enabled() ? Timeline::Now() : 0;
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        if (lock_start != 0) {
+            Timeline::Complete("signal.lock", lock_start);
+        }
         
         // Если клиент не зарегистрирован, регистрируем его
-        std::shared_ptr<Client> client;
-        {
-            std::lock_guard<std::mutex> lock(clients_mutex_);
+        Session* client = sessions_.Find(client_id);
+        // Идентификаторы сессий известны всей комнате из составов: сессия
+        // принимает сообщения только со своего адреса
+        if (client && !SameEndpoint(client->address, client_addr)) {
+            std::cerr << "Message for " << FormatSessionId(client_id) << " from another address, dropped" << std::endl;
+            return;
+        }
+        if (!client) {
+            client_id = RegisterClient(client_addr);
+            client = sessions_.Find(client_id);
             
-            if (client_id.empty() || clients_.find(client_id) == clients_.end()) {
-                client_id = RegisterClient(socket_fd, client_addr);
-                client = clients_[client_id];
-                
-                // Отправляем клиенту его ID
-                Json::Value response = CreateMessage("client_registered", Json::Value());
-                response["client_id"] = client_id;
-                SendJsonMessage(socket_fd, client_addr, response);
-            } else {
-                client = clients_[client_id];
+            // Бинарная кодировка - только если клиент сам ее предложил в hello;
+            // подтверждение уходит еще в JSON, который понимают все клиенты
+            SignalingMessage response = CreateMessage(SignalType::ClientRegistered);
+            response.client_id = FormatSessionId(client_id);
+            if (message.type == SignalType::Hello && message.encoding == "binary") {
+                response.encoding = "binary";
+                client->encoding = SignalEncoding::Binary;
             }
+            client->redirect = message.type == SignalType::Hello && message.redirect;
+            transport_->Send(client_addr, EncodeJsonSignal(response));
         }
         
-        if (type == "join_room") {
-            std::string room_id = root.get("room_id", "default").asString();
-            JoinRoom(client_id, room_id);
-        } else if (type == "leave_room") {
+        if (message.type == SignalType::JoinRoom) {
+            const std::string_view room_id = message.room_id.empty() ? std::string_view("default") : message.room_id;
+            const NodeIndex owner = cluster_.OwnerOf(room_id);
+            if (owner == cluster_.Self()) {
+                JoinRoom(client_id, room_id);
+            } else {
+                JoinRemoteRoom(*client, owner, room_id);
+            }
+        } else if (message.type == SignalType::LeaveRoom) {
             LeaveRoom(client_id);
+        } else if (client->proxy != kNoNode && message.type != SignalType::Hello) {
+            // Комнатой клиента управляет другой узел: сообщение уходит туда
+            // как есть, без перекодирования
+            SendToNode(client->proxy, {NodeMessageType::Relay, client_id, client->encoding, {}, payload});
         } else {
-            ProcessSignalingMessage(root, client);
+            ProcessSignalingMessage(message, *client);
         }
         
     } catch (const std::exception& e) {
@@ -127,180 +232,372 @@ void SignalingServer::HandleMessage(const std::string& message, const sockaddr_i
     }
 }
 
-void SignalingServer::ProcessSignalingMessage(const Json::Value& msg, std::shared_ptr<Client> client) {
-    std::string type = msg.get("type", "").asString();
-    
-    if (type == "offer") {
-        HandleOffer(msg, client);
-    } else if (type == "answer") {
-        HandleAnswer(msg, client);
-    } else if (type == "ice_candidate") {
-        HandleIceCandidate(msg, client);
-    } else {
-        std::cout << "Unknown message type: " << type << std::endl;
+void SignalingServer::ProcessSignalingMessage(const SignalView& msg, const Session& client) {
+    switch (msg.type) {
+        case SignalType::Offer:
+            HandleOffer(msg, client);
+            break;
+        case SignalType::Answer:
+            HandleAnswer(msg, client);
+            break;
+        case SignalType::IceCandidate:
+            HandleIceCandidate(msg, client);
+            break;
+        case SignalType::MediaKey:
+            HandleMediaKey(msg, client);
+            break;
+        case SignalType::RosterSync:
+            HandleRosterSync(msg, client);
+            break;
+        case SignalType::Hello:
+            break;
+        default:
+            std::cout << "Unknown message type: " << static_cast<int>(msg.type) << std::endl;
+            break;
     }
 }
 
-std::string SignalingServer::RegisterClient(int socket_fd, const sockaddr_in& address) {
-    std::string client_id = GenerateClientId();
-    auto client = std::make_shared<Client>(client_id, socket_fd, address);
-    clients_[client_id] = client;
+// Управление клиентами и комнатами вызывается под clients_mutex_
+
+SessionId SignalingServer::RegisterClient(const sockaddr_in& address) {
+    SessionId client_id = sessions_.Create(address).id;
     
-    std::cout << "Client registered: " << client_id << std::endl;
+    std::cout << "Client registered: " << FormatSessionId(client_id) << std::endl;
     return client_id;
 }
 
-void SignalingServer::UnregisterClient(const std::string& client_id) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    
-    auto client_it = clients_.find(client_id);
-    if (client_it != clients_.end()) {
+void SignalingServer::UnregisterClient(SessionId client_id) {
+    if (sessions_.Find(client_id)) {
         LeaveRoom(client_id);
-        clients_.erase(client_it);
-        std::cout << "Client unregistered: " << client_id << std::endl;
+        sessions_.Remove(client_id);
+        std::cout << "Client unregistered: " << FormatSessionId(client_id) << std::endl;
     }
 }
 
-void SignalingServer::JoinRoom(const std::string& client_id, const std::string& room_id) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    
-    auto client_it = clients_.find(client_id);
-    if (client_it == clients_.end()) {
+void SignalingServer::JoinRoom(SessionId client_id, std::string_view room_id) {
+    Session* client = sessions_.Find(client_id);
+    if (!client) {
         return;
     }
     
     // Покидаем предыдущую комнату
-    if (!client_it->second->room_id.empty()) {
+    if (client->room != Session::kNoRoom) {
         LeaveRoom(client_id);
     }
     
     // Присоединяемся к новой комнате
-    client_it->second->room_id = room_id;
-    rooms_[room_id].insert(client_id);
+    const uint32_t room = sessions_.JoinRoom(*client, room_id);
+    Room* target = sessions_.GetRoom(room);
+    const bool was_pending = target->roster.HasPending();
+    target->roster.Join(client_id, Clock::now());
+    MarkPresence(room, was_pending);
+    
+    std::cout << "Client " << FormatSessionId(client_id) << " joined room " << room_id << std::endl;
     
-    std::cout << "Client " << client_id << " joined room " << room_id << std::endl;
+    // Новичок получает снимок сразу, остальные - общую дельту по окончании
+    // окна: вход тысячи участников не порождает N^2 уведомлений
+    SendRosterSnapshot(client_id, room);
+}
+
+void SignalingServer::LeaveRoom(SessionId client_id) {
+    Session* client = sessions_.Find(client_id);
+    if (client && client->proxy != kNoNode) {
+        SendToNode(client->proxy, {NodeMessageType::Leave, client_id, client->encoding, {}, {}});
+        client->proxy = kNoNode;
+    }
+    if (!client || client->room == Session::kNoRoom) {
+        return;
+    }
     
-    // Уведомляем всех в комнате о новом участнике
-    Json::Value notification = CreateMessage("user_joined", Json::Value());
-    notification["user_id"] = client_id;
-    BroadcastToRoom(room_id, notification, client_id);
+    Room* current = sessions_.GetRoom(client->room);
+    std::string room_id = current->name;
+    const bool was_pending = current->roster.HasPending();
+    current->roster.Leave(client_id, Clock::now());
     
-    // Отправляем новому участнику список пользователей в комнате
-    Json::Value users_list = CreateMessage("room_users", Json::Value());
-    Json::Value users(Json::arrayValue);
-    for (const auto& user_id : rooms_[room_id]) {
-        if (user_id != client_id) {
-            users.append(user_id);
-        }
+    // Удаляем из комнаты; пустая комната удаляется реестром вместе с составом
+    const uint32_t room = sessions_.LeaveRoom(*client);
+    if (sessions_.FindRoom(room_id) == room) {
+        MarkPresence(room, was_pending);
     }
-    users_list["users"] = users;
-    SendToClient(client_id, users_list);
+    
+    std::cout << "Client " << FormatSessionId(client_id) << " left room " << room_id << std::endl;
 }
 
-void SignalingServer::LeaveRoom(const std::string& client_id) {
-    auto client_it = clients_.find(client_id);
-    if (client_it == clients_.end() || client_it->second->room_id.empty()) {
+void SignalingServer::JoinRemoteRoom(Session& client, NodeIndex owner, std::string_view room_id) {
+    LeaveRoom(client.id);
+    const ClusterNode& node = cluster_.Node(owner);
+    
+    if (client.redirect) {
+        // Клиент переподключится к владельцу комнаты и войдет в нее там
+        SignalingMessage redirect = CreateMessage(SignalType::Redirect);
+        redirect.room_id = std::string(room_id);
+        redirect.address = node.name;
+        SendToClient(client.id, redirect);
+        std::cout << "Client " << FormatSessionId(client.id) << " redirected to " << node.name << " for room "
+                  << room_id << std::endl;
+        // Здесь клиент больше не появится: сессия ему не нужна. client после
+        // этого недействителен
+        UnregisterClient(client.id);
         return;
     }
     
-    std::string room_id = client_it->second->room_id;
+    // Старый клиент остается подключенным к нам, а комнату ведет владелец:
+    // он считает клиента своим участником и шлет ему сообщения через нас
+    client.proxy = owner;
+    SendToNode(owner, {NodeMessageType::Join, client.id, client.encoding, room_id, {}});
+    std::cout << "Client " << FormatSessionId(client.id) << " joined room " << room_id << " via " << node.name
+              << std::endl;
+}
+
+void SignalingServer::HandleNodeMessage(NodeIndex node, std::string_view payload) {
+    NodeMessage link;
+    if (!DecodeNodeMessage(payload, link)) {
+        std::cerr << "Malformed message from node " << cluster_.Node(node).name << std::endl;
+        return;
+    }
     
-    // Удаляем из комнаты
-    auto room_it = rooms_.find(room_id);
-    if (room_it != rooms_.end()) {
-        room_it->second.erase(client_id);
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    Session* client = sessions_.Find(link.session);
+    
+    switch (link.type) {
+        case NodeMessageType::Join: {
+            // Разные списки узлов в конфигурации: комната не наша
+            if (cluster_.OwnerOf(link.room) != cluster_.Self()) {
+                std::cerr << "Node " << cluster_.Node(node).name << " routed room " << link.room
+                          << " here, cluster configs differ" << std::endl;
+                return;
+            }
+            Session& remote = sessions_.Adopt(link.session, node);
+            if (remote.home != node) {
+                return;
+            }
+            remote.encoding = link.encoding;
+            JoinRoom(remote.id, link.room);
+            break;
+        }
+        case NodeMessageType::Leave:
+            if (client && client->home == node) {
+                UnregisterClient(link.session);
+            }
+            break;
+        case NodeMessageType::Relay:
+            // Сообщение участника с другого узла обрабатывается как от своего
+            if (client && client->home == node) {
+                arena_.Reset();
+                SignalView message;
+                if (ScanSignal(link.payload, message, arena_)) {
+                    ProcessSignalingMessage(message, *client);
+                }
+            }
+            break;
+        case NodeMessageType::Deliver:
+            // Только своим клиентам: пересылка дальше могла бы зациклиться
+            if (client && client->home == kNoNode) {
+                transport_->Send(client->address, std::string(link.payload));
+            }
+            break;
+    }
+}
+
+void SignalingServer::SendToNode(NodeIndex node, const NodeMessage& message) {
+    transport_->Send(cluster_.Node(node).address, EncodeNodeMessage(message));
+}
+
+void SignalingServer::MarkPresence(uint32_t room, bool was_pending) {
+    if (!was_pending) {
+        presence_rooms_.push_back(room);
+    }
+}
+
+SignalingServer::Clock::duration SignalingServer::FlushPresence(Clock::time_point now) {
+    Clock::duration wait = std::chrono::milliseconds(100);
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < presence_rooms_.size(); ++i) {
+        const uint32_t index = presence_rooms_[i];
+        Room* room = sessions_.GetRoom(index);
+        if (!room->roster.HasPending()) {
+            continue;
+        }
         
-        // Если комната пустая, удаляем её
-        if (room_it->second.empty()) {
-            rooms_.erase(room_it);
-        } else {
-            // Уведомляем остальных участников
-            Json::Value notification = CreateMessage("user_left", Json::Value());
-            notification["user_id"] = client_id;
-            BroadcastToRoom(room_id, notification, client_id);
+        const auto due = room->roster.PendingSince() + kPresenceWindow;
+        if (due > now) {
+            wait = std::min<Clock::duration>(wait, due - now);
+            presence_rooms_[kept++] = index;
+            continue;
         }
+        
+        const auto delta = room->roster.Commit();
+        BroadcastToRoom(index, CreateRosterDelta(*room, delta));
     }
+    presence_rooms_.resize(kept);
+    return wait;
+}
+
+void SignalingServer::SendRosterSnapshot(SessionId client_id, uint32_t room) {
+    const Room* target = sessions_.GetRoom(room);
+    const auto& members = target->members;
+    const size_t pages = std::max<size_t>(1, (members.size() + kSnapshotPageSize - 1) / kSnapshotPageSize);
     
-    client_it->second->room_id.clear();
-    std::cout << "Client " << client_id << " left room " << room_id << std::endl;
+    // Все страницы одной версии уходят подряд; транспорт доставит их по
+    // порядку, дельты после этой версии придут следом
+    for (size_t page = 0; page < pages; ++page) {
+        SignalingMessage snapshot = CreateMessage(SignalType::RoomSnapshot);
+        snapshot.room_id = target->name;
+        snapshot.version = target->roster.Version();
+        snapshot.page = static_cast<uint32_t>(page);
+        snapshot.pages = static_cast<uint32_t>(pages);
+        
+        const size_t end = std::min(members.size(), (page + 1) * kSnapshotPageSize);
+        snapshot.users.reserve(end - page * kSnapshotPageSize);
+        for (size_t i = page * kSnapshotPageSize; i < end; ++i) {
+            const Session& user = sessions_.At(members[i]);
+            if (user.id != client_id) {
+                snapshot.users.push_back(FormatSessionId(user.id));
+            }
+        }
+        SendToClient(client_id, snapshot);
+    }
 }
 
-void SignalingServer::BroadcastToRoom(const std::string& room_id, const Json::Value& message, const std::string& sender_id) {
-    auto room_it = rooms_.find(room_id);
-    if (room_it == rooms_.end()) {
+SignalingMessage SignalingServer::CreateRosterDelta(const Room& room, const RoomRoster::Delta& delta) {
+    SignalingMessage message = CreateMessage(SignalType::RosterDelta);
+    message.room_id = room.name;
+    message.from_version = delta.from_version;
+    message.version = delta.version;
+    
+    for (SessionId id : delta.joined) {
+        message.joined.push_back(FormatSessionId(id));
+    }
+    for (SessionId id : delta.left) {
+        message.left.push_back(FormatSessionId(id));
+    }
+    return message;
+}
+
+void SignalingServer::HandleRosterSync(const SignalView& message, const Session& sender) {
+    Room* room = sessions_.GetRoom(sender.room);
+    if (!room) {
         return;
     }
     
-    for (const auto& client_id : room_it->second) {
-        if (client_id != sender_id) {
-            SendToClient(client_id, message);
+    // Отставший клиент догоняется одной дельтой от своей версии, если
+    // она еще в истории, иначе получает снимок заново
+    RoomRoster::Delta delta;
+    if (message.has_version && room->roster.DeltaSince(message.version, delta)) {
+        SendToClient(sender.id, CreateRosterDelta(*room, delta));
+    } else {
+        SendRosterSnapshot(sender.id, sender.room);
+    }
+}
+
+template <typename Encode>
+void SignalingServer::SendToRoom(uint32_t room, SessionId sender_id, Encode&& encode) {
+    Room* target = sessions_.GetRoom(room);
+    if (!target) {
+        return;
+    }
+    TimelineScope scope("signal.fanout", target->members.size());
+    
+    // Сериализуем не больше раза на кодировку, дальше - проход по
+    // непрерывному списку участников
+    std::string encoded[2];
+    bool ready[2] = {false, false};
+    for (uint32_t member : target->members) {
+        const Session& client = sessions_.At(member);
+        if (client.id == sender_id) {
+            continue;
+        }
+        const auto index = static_cast<size_t>(client.encoding);
+        if (!ready[index]) {
+            encoded[index] = encode(client.encoding);
+            ready[index] = true;
+        }
+        if (!encoded[index].empty()) {
+            SendPayload(client, encoded[index]);
         }
     }
 }
 
-void SignalingServer::SendToClient(const std::string& client_id, const Json::Value& message) {
-    auto client_it = clients_.find(client_id);
-    if (client_it != clients_.end()) {
-        SendJsonMessage(server_socket_, client_it->second->address, message);
+void SignalingServer::BroadcastToRoom(uint32_t room, const SignalingMessage& message, SessionId sender_id) {
+    SendToRoom(room, sender_id, [&message](SignalEncoding encoding) { return EncodeSignal(message, encoding); });
+}
+
+void SignalingServer::SendToClient(SessionId client_id, const SignalingMessage& message) {
+    if (const Session* client = sessions_.Find(client_id)) {
+        SendPayload(*client, EncodeSignal(message, client->encoding));
     }
 }
 
-void SignalingServer::HandleOffer(const Json::Value& message, std::shared_ptr<Client> sender) {
-    std::string target_id = message.get("target", "").asString();
+void SignalingServer::SendPayload(const Session& client, std::string payload) {
+    if (client.home == kNoNode) {
+        transport_->Send(client.address, std::move(payload));
+    } else {
+        SendToNode(client.home, {NodeMessageType::Deliver, client.id, client.encoding, {}, payload});
+    }
+}
+
+void SignalingServer::ForwardToRoom(uint32_t room, const SignalView& message, SignalType type, SessionId sender_id) {
+    const auto timestamp = static_cast<int64_t>(time(nullptr));
+    SendToRoom(room, sender_id, [&](SignalEncoding encoding) {
+        return EncodeForwardSignal(message, type, sender_id, timestamp, encoding, arena_);
+    });
+}
+
+void SignalingServer::ForwardToClient(SessionId client_id, const SignalView& message, SignalType type, SessionId sender_id) {
+    const Session* client = sessions_.Find(client_id);
+    if (!client) {
+        return;
+    }
     
-    if (target_id.empty()) {
+    // Пусто, если нагрузку не удалось перекодировать
+    std::string payload = EncodeForwardSignal(
+        message, type, sender_id, static_cast<int64_t>(time(nullptr)), client->encoding, arena_
+    );
+    if (!payload.empty()) {
+        SendPayload(*client, std::move(payload));
+    }
+}
+
+void SignalingServer::HandleOffer(const SignalView& message, const Session& sender) {
+    if (message.target == kNoSession) {
         // Broadcast offer to all in room
-        Json::Value offer_msg = CreateMessage("offer", message["data"]);
-        offer_msg["sender"] = sender->id;
-        BroadcastToRoom(sender->room_id, offer_msg, sender->id);
+        ForwardToRoom(sender.room, message, SignalType::Offer, sender.id);
     } else {
         // Send to specific client
-        Json::Value offer_msg = CreateMessage("offer", message["data"]);
-        offer_msg["sender"] = sender->id;
-        SendToClient(target_id, offer_msg);
+        ForwardToClient(message.target, message, SignalType::Offer, sender.id);
     }
 }
 
-void SignalingServer::HandleAnswer(const Json::Value& message, std::shared_ptr<Client> sender) {
-    std::string target_id = message.get("target", "").asString();
-    
-    if (!target_id.empty()) {
-        Json::Value answer_msg = CreateMessage("answer", message["data"]);
-        answer_msg["sender"] = sender->id;
-        SendToClient(target_id, answer_msg);
+void SignalingServer::HandleAnswer(const SignalView& message, const Session& sender) {
+    if (message.target != kNoSession) {
+        ForwardToClient(message.target, message, SignalType::Answer, sender.id);
     }
 }
 
-void SignalingServer::HandleIceCandidate(const Json::Value& message, std::shared_ptr<Client> sender) {
-    std::string target_id = message.get("target", "").asString();
-    
-    if (!target_id.empty()) {
-        Json::Value ice_msg = CreateMessage("ice_candidate", message["data"]);
-        ice_msg["sender"] = sender->id;
-        SendToClient(target_id, ice_msg);
+void SignalingServer::HandleIceCandidate(const SignalView& message, const Session& sender) {
+    if (message.target == kNoSession) {
+        // Кандидаты, собранные до ответа собеседника, рассылаются всей комнате,
+        // как и offer - сбор ICE не ждет завершения обмена SDP
+        ForwardToRoom(sender.room, message, SignalType::IceCandidate, sender.id);
+    } else {
+        ForwardToClient(message.target, message, SignalType::IceCandidate, sender.id);
     }
 }
 
-std::string SignalingServer::GenerateClientId() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(100000, 999999);
-    
-    return "client_" + std::to_string(dis(gen));
+void SignalingServer::HandleMediaKey(const SignalView& message, const Session& sender) {
+    // Ключ пересылается как есть: сервер его не хранит, а вошедшему позже
+    // отправитель сам повторит ключ адресно
+    if (message.target == kNoSession) {
+        ForwardToRoom(sender.room, message, SignalType::MediaKey, sender.id);
+    } else {
+        ForwardToClient(message.target, message, SignalType::MediaKey, sender.id);
+    }
 }
 
-Json::Value SignalingServer::CreateMessage(const std::string& type, const Json::Value& data) {
-    Json::Value message;
-    message["type"] = type;
-    message["data"] = data;
-    message["timestamp"] = static_cast<int64_t>(time(nullptr));
+SignalingMessage SignalingServer::CreateMessage(SignalType type) {
+    SignalingMessage message;
+    message.type = type;
+    message.timestamp = static_cast<int64_t>(time(nullptr));
     return message;
 }
-
-void SignalingServer::SendJsonMessage(int socket_fd, const sockaddr_in& address, const Json::Value& message) {
-    Json::StreamWriterBuilder builder;
-    std::string json_string = Json::writeString(builder, message);
-    
-    sendto(socket_fd, json_string.c_str(), json_string.length(), 0, 
-           (sockaddr*)&address, sizeof(address));
-} 
\ No newline at end of file
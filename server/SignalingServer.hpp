@@ -1,66 +1,129 @@
 #pragma once
 
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <vector>
 #include <memory>
 #include <thread>
 #include <mutex>
-#include <json/json.h>
-
-struct Client {
-    std::string id;
-    std::string room_id;
-    int socket_fd;
-    sockaddr_in address;
-    
-    Client(const std::string& client_id, int sock_fd, const sockaddr_in& addr) 
-        : id(client_id), socket_fd(sock_fd), address(addr) {}
-};
+#include "Arena.hpp"
+#include "Cluster.hpp"
+#include "NetworkImpairment.hpp"
+#include "Planes.hpp"
+#include "ReliableTransport.hpp"
+#include "SessionRegistry.hpp"
+#include "SignalingProtocol.hpp"
 
 class SignalingServer {
 public:
-    SignalingServer(int port = 12345);
+    SignalingServer(int port = kDefaultSignalingPort);
     ~SignalingServer();
 
+    // Режим кластера: вызывается до Start. nodes - адреса всех узлов
+    // через запятую, self - свой адрес из списка (по умолчанию по порту).
+    bool ConfigureCluster(std::string_view nodes, std::string_view self, std::string& error);
+    // Запись всех принятых датаграмм; вызывается до Start
+    void SetCapture(TraceWriter* trace) { capture_ = trace; }
+    // Эмуляция плохой сети на сокете сервера; вызывается до Start
+    void SetImpairment(const ImpairmentOptions& options) { impairment_options_ = options; }
+    // В процессе работает и медиа-план: поток сигналинга понижает свой
+    // приоритет и между порциями сообщений уступает медиа; вызывается до Start
+    void SetPlaneGate(MediaFirstGate* gate) { gate_ = gate; }
+    
     bool Start();
     void Stop();
     
+    // Очередь и задержка сигналинга за время с предыдущего вызова
+    PlaneStats GetPlaneStats();
+    
 private:
     int port_;
     int server_socket_;
-    bool is_running_;
+    std::atomic<bool> is_running_;
     std::thread server_thread_;
+    std::unique_ptr<ReliableTransport> transport_;
+    TraceWriter* capture_{nullptr};
+    ImpairmentOptions impairment_options_;
+    std::unique_ptr<ImpairedSocket> impairment_;
+    MediaFirstGate* gate_{nullptr};
+    PlaneMetrics metrics_;
+    uint64_t reported_yields_{0};
+    // Метки ядра сообщений текущей порции; только в потоке ServerLoop
+    std::vector<int64_t> receive_stamps_;
+    
+    using Clock = std::chrono::steady_clock;
+    
+    // Окно объединения входов/выходов в одну дельту состава комнаты
+    static constexpr auto kPresenceWindow = std::chrono::milliseconds(50);
+    // Участников в одной странице снимка состава
+    static constexpr size_t kSnapshotPageSize = 200;
+    // Датаграмм за порцию: после нее ответы уходят, а медиа получает
+    // процессор, даже если сокет сигналинга не пустеет
+    static constexpr size_t kSignalingSlice = 32;
     
     // Клиенты и комнаты
     std::mutex clients_mutex_;
-    std::unordered_map<std::string, std::shared_ptr<Client>> clients_;
-    std::unordered_map<std::string, std::unordered_set<std::string>> rooms_;
+    SessionRegistry sessions_;
+    // Комнаты с незафиксированными изменениями состава (возможны повторы
+    // и уже удаленные комнаты - их отсеивает FlushPresence)
+    std::vector<uint32_t> presence_rooms_;
+    
+    // Временная память обработки одного сообщения; только в потоке ServerLoop
+    Arena arena_;
+    
+    // Узлы кластера и владельцы комнат; пуст, если сервер работает один
+    ClusterMap cluster_;
     
     // Основной цикл сервера
     void ServerLoop();
+    // Ответы порции ушли: задержки ее сообщений в метрики
+    void FinishSlice(size_t received);
     
     // Обработка сообщений
-    void HandleMessage(const std::string& message, const sockaddr_in& client_addr, int socket_fd);
-    void ProcessSignalingMessage(const Json::Value& msg, std::shared_ptr<Client> client);
+    void HandleMessage(std::string_view payload, const sockaddr_in& client_addr);
+    void ProcessSignalingMessage(const SignalView& msg, const Session& client);
     
     // Управление клиентами и комнатами
-    std::string RegisterClient(int socket_fd, const sockaddr_in& address);
-    void UnregisterClient(const std::string& client_id);
-    void JoinRoom(const std::string& client_id, const std::string& room_id);
-    void LeaveRoom(const std::string& client_id);
+    SessionId RegisterClient(const sockaddr_in& address);
+    void UnregisterClient(SessionId client_id);
+    void JoinRoom(SessionId client_id, std::string_view room_id);
+    void LeaveRoom(SessionId client_id);
+    // Комната другого узла: redirect или проксирование через узел-владелец
+    void JoinRemoteRoom(Session& client, NodeIndex owner, std::string_view room_id);
+    
+    // Кластер: сообщения от других узлов и отправка им
+    void HandleNodeMessage(NodeIndex node, std::string_view payload);
+    void SendToNode(NodeIndex node, const NodeMessage& message);
+    
+    // Состав комнаты: снимок по страницам, дельты по версиям
+    void MarkPresence(uint32_t room, bool was_pending);
+    Clock::duration FlushPresence(Clock::time_point now);
+    void SendRosterSnapshot(SessionId client_id, uint32_t room);
+    SignalingMessage CreateRosterDelta(const Room& room, const RoomRoster::Delta& delta);
+    void HandleRosterSync(const SignalView& message, const Session& sender);
     
     // Пересылка сообщений
-    void BroadcastToRoom(const std::string& room_id, const Json::Value& message, const std::string& sender_id = "");
-    void SendToClient(const std::string& client_id, const Json::Value& message);
+    void BroadcastToRoom(uint32_t room, const SignalingMessage& message, SessionId sender_id = kNoSession);
+    void SendToClient(SessionId client_id, const SignalingMessage& message);
+    // Готовое сообщение клиенту: напрямую или через его домашний узел
+    void SendPayload(const Session& client, std::string payload);
+    template <typename Encode>
+    void SendToRoom(uint32_t room, SessionId sender_id, Encode&& encode);
+    
+    // Пересылка offer/answer/ice_candidate: полезная нагрузка вклеивается
+    // из буфера приема без разбора
+    void ForwardToRoom(uint32_t room, const SignalView& message, SignalType type, SessionId sender_id);
+    void ForwardToClient(SessionId client_id, const SignalView& message, SignalType type, SessionId sender_id);
     
     // Обработка WebRTC сигналинга
-    void HandleOffer(const Json::Value& message, std::shared_ptr<Client> sender);
-    void HandleAnswer(const Json::Value& message, std::shared_ptr<Client> sender);
-    void HandleIceCandidate(const Json::Value& message, std::shared_ptr<Client> sender);
+    void HandleOffer(const SignalView& message, const Session& sender);
+    void HandleAnswer(const SignalView& message, const Session& sender);
+    void HandleIceCandidate(const SignalView& message, const Session& sender);
+    void HandleMediaKey(const SignalView& message, const Session& sender);
     
     // Утилиты
-    std::string GenerateClientId();
-    Json::Value CreateMessage(const std::string& type, const Json::Value& data);
-    void SendJsonMessage(int socket_fd, const sockaddr_in& address, const Json::Value& message);
+    SignalingMessage CreateMessage(SignalType type);
 }; 
\ No newline at end of file
@@ -1,17 +1,45 @@
+#include "AudioRelay.hpp"
 #include "SignalingServer.hpp"
+#include "Timeline.hpp"
+#include "TraceFile.hpp"
 #include <iostream>
 #include <csignal>
+#include <string>
+#include <vector>
 #include <memory>
 #include <thread>
 #include <chrono>
 
 std::unique_ptr<SignalingServer> server;
+std::unique_ptr<AudioRelay> media;
+std::unique_ptr<TraceWriter> capture;
+// Медиа прежде сигналинга, если оба плана в этом процессе
+MediaFirstGate plane_gate;
 
 void signalHandler(int signal) {
     std::cout << "\nReceived signal " << signal << ". Shutting down server..." << std::endl;
     if (server) {
         server->Stop();
     }
+    if (media) {
+        media->Stop();
+    }
+    // Запись дописывается после остановки приема
+    if (capture) {
+        capture->Close();
+        const auto stats = capture->GetStats();
+        std::cout << "Capture: " << stats.records << " datagrams, " << stats.bytes << " bytes, " << stats.dropped
+                  << " dropped" << std::endl;
+    }
+    // Последние секунды перед остановкой тоже попадают во временную шкалу
+    if (!Timeline::DumpPath().empty()) {
+        std::string error;
+        if (Timeline::Dump(Timeline::DumpPath(), error)) {
+            std::cout << "Timeline written to " << Timeline::DumpPath() << std::endl;
+        } else {
+            std::cerr << "Failed to write timeline: " << error << std::endl;
+        }
+    }
     exit(0);
 }
 
@@ -21,20 +49,121 @@ int main(int argc, char* argv[]) {
     signal(SIGTERM, signalHandler);
     
     // Порт по умолчанию
-    int port = 12345;
+    int port = kDefaultSignalingPort;
+    
+    // Медиа-план в том же процессе: ретранслятор на своем порту, 0 - нет
+    int media_port = 0;
+    // Период статистики планов, 0 - не печатать
+    int stats_interval = 0;
+    
+    // Кластер: адреса всех узлов и, если порт не уникален, свой адрес
+    std::string cluster_nodes;
+    std::string cluster_self;
+    
+    // Запись входящего трафика для trace_replay
+    std::string capture_path;
+    
+    // Временная шкала событий: SIGUSR1 пишет дамп, SIGUSR2 приостанавливает запись
+    std::string timeline_path;
+    
+    // Эмуляция плохой сети на сокете сервера
+    ImpairmentOptions impairment;
     
     // Парсим аргументы командной строки
-    if (argc > 1) {
-        port = std::atoi(argv[1]);
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--cluster" && i + 1 < argc) {
+            cluster_nodes = argv[++i];
+        } else if (arg == "--cluster-self" && i + 1 < argc) {
+            cluster_self = argv[++i];
+        } else if (arg == "--capture" && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (arg == "--timeline" && i + 1 < argc) {
+            timeline_path = argv[++i];
+        } else if (arg == "--media" && i + 1 < argc) {
+            media_port = std::atoi(argv[++i]);
+            if (media_port <= 0 || media_port > 65535) {
+                std::cerr << "Invalid media port: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stats" && i + 1 < argc) {
+            stats_interval = std::atoi(argv[++i]);
+        } else if (ParseImpairmentArg(i, argc, argv, impairment)) {
+            continue;
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: " << argv[0] << " [port] [--cluster host:port,host:port,...] [--cluster-self host:port]"
+                      << " [--capture file] [--timeline file] [--impair spec] [--media port] [--stats seconds]\n"
+                      << ImpairmentUsage()
+                      << "  --media PORT         also relay UDP media on PORT (clients use " << kDefaultMediaPort
+                      << "), media first\n"
+                      << "  --stats SECONDS      print queue depth and latency per plane\n";
+            return 0;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (!positional.empty()) {
+        port = std::atoi(positional[0].c_str());
         if (port <= 0 || port > 65535) {
-            std::cerr << "Invalid port number: " << argv[1] << std::endl;
+            std::cerr << "Invalid port number: " << positional[0] << std::endl;
             return 1;
         }
     }
+    if (media_port == port) {
+        std::cerr << "Media and signaling need separate ports" << std::endl;
+        return 1;
+    }
+    if (!impairment.error.empty()) {
+        std::cerr << "Invalid impairment " << impairment.error << std::endl;
+        return 1;
+    }
     
     // Создаем и запускаем сигналинг сервер
     server = std::make_unique<SignalingServer>(port);
     
+    if (!cluster_nodes.empty()) {
+        std::string error;
+        if (!server->ConfigureCluster(cluster_nodes, cluster_self, error)) {
+            std::cerr << "Invalid cluster configuration: " << error << std::endl;
+            return 1;
+        }
+    }
+    
+    server->SetImpairment(impairment);
+    
+    if (!capture_path.empty()) {
+        capture = std::make_unique<TraceWriter>();
+        std::string error;
+        if (!capture->Open(capture_path, error)) {
+            std::cerr << "Failed to open capture file " << error << std::endl;
+            return 1;
+        }
+        server->SetCapture(capture.get());
+        std::cout << "Capturing received datagrams to " << capture_path << std::endl;
+    }
+    
+    if (!timeline_path.empty()) {
+        std::string error;
+        if (!Timeline::Arm(timeline_path, error)) {
+            std::cerr << "Failed to enable timeline: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Timeline recording: SIGUSR1 writes " << timeline_path << ", SIGUSR2 pauses/resumes" << std::endl;
+    }
+    
+    // Планы на разных сокетах и потоках; медиа-поток в приоритете,
+    // сигналинг уступает ему между порциями сообщений
+    if (media_port > 0) {
+        media = std::make_unique<AudioRelay>(media_port);
+        media->SetPlaneGate(&plane_gate);
+        server->SetPlaneGate(&plane_gate);
+        if (!media->Start()) {
+            std::cerr << "Failed to start media relay on port " << media_port << std::endl;
+            return 1;
+        }
+    }
+    
     if (!server->Start()) {
         std::cerr << "Failed to start signaling server on port " << port << std::endl;
         return 1;
@@ -43,9 +172,15 @@ int main(int argc, char* argv[]) {
     std::cout << "WebRTC Signaling Server running on port " << port << std::endl;
     std::cout << "Press Ctrl+C to stop the server" << std::endl;
     
-    // Основной цикл - ждем сигнала завершения
+    // Основной цикл - ждем сигнала завершения, печатая статистику планов
     while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::this_thread::sleep_for(std::chrono::seconds(stats_interval > 0 ? stats_interval : 1));
+        if (stats_interval > 0) {
+            if (media) {
+                std::cout << DescribePlaneStats(Plane::Media, media->GetStats().media) << std::endl;
+            }
+            std::cout << DescribePlaneStats(Plane::Signaling, server->GetPlaneStats()) << std::endl;
+        }
     }
     
     return 0;
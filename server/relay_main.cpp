@@ -0,0 +1,173 @@
+#include "AudioRelay.hpp"
+#include "Endpoint.hpp"
+#include <iostream>
+#include <iomanip>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+std::unique_ptr<AudioRelay> relay;
+std::unique_ptr<TraceWriter> capture;
+
+void signalHandler(int signal) {
+    std::cout << "\nReceived signal " << signal << ". Shutting down relay..." << std::endl;
+    if (relay) {
+        relay->Stop();
+    }
+    // Запись дописывается после остановки приема
+    if (capture) {
+        capture->Close();
+        const auto stats = capture->GetStats();
+        std::cout << "Capture: " << stats.records << " datagrams, " << stats.bytes << " bytes, " << stats.dropped
+                  << " dropped" << std::endl;
+    }
+    exit(0);
+}
+
+void PrintStats(const AudioRelay::Stats& stats) {
+    std::cout << "Relay: " << stats.participants << " local participants, " << stats.streams << " streams, "
+              << stats.packets_in << " packets in, " << stats.packets_out << " out, " << stats.dropped
+              << " dropped; " << IoBackendName(stats.backend) << (stats.gso ? "+GSO" : "") << " "
+              << stats.receive_calls << "/" << stats.send_calls << " syscalls in/out" << std::endl;
+    if (stats.local_waits > 0) {
+        std::cout << "  shared memory: " << stats.local_participants << " participants, " << stats.local_waits
+                  << " waits, " << stats.local_wakeups << " wakeups" << std::endl;
+    }
+    if (stats.bundle_listeners > 0) {
+        std::cout << "  bundles: " << stats.bundle_listeners << " listeners, " << stats.bundles
+                  << " datagrams carrying " << stats.bundled_frames << " frames" << std::endl;
+    }
+    std::cout << "  " << DescribePlaneStats(Plane::Media, stats.media) << std::endl;
+    for (const auto& trunk : stats.trunks) {
+        std::cout << "  trunk " << trunk.peer << (trunk.upstream ? " (upstream)" : " (downstream)")
+                  << (trunk.connected ? "" : " disconnected") << ": " << trunk.streams_in << " streams in, "
+                  << std::fixed << std::setprecision(1) << trunk.kbps_in << " kbps in, " << trunk.kbps_out
+                  << " kbps out, " << trunk.packets_in << "/" << trunk.packets_out << " packets in/out, "
+                  << trunk.dropped << " loop drops" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Устанавливаем обработчик сигналов для graceful shutdown
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    // Порт по умолчанию - медиа-план
+    int port = kDefaultMediaPort;
+    uint32_t relay_id = 0;
+    int stats_interval = 10;
+    PacketIoOptions io;
+    // Запись входящего трафика для trace_replay
+    std::string capture_path;
+    // Эмуляция плохой сети на сокете ретранслятора
+    ImpairmentOptions impairment;
+    // Unix сокет для процессов на этой машине (разделяемая память)
+    std::string local_path;
+    // Такт пачек слушателям в мс; отрицательный - без пачек
+    double bundle_ms = -1;
+
+    // Каскад: вышестоящие ретрансляторы
+    std::vector<std::string> upstreams;
+
+    // Парсим аргументы командной строки
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--upstream" && i + 1 < argc) {
+            upstreams.push_back(argv[++i]);
+        } else if (arg == "--relay-id" && i + 1 < argc) {
+            relay_id = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--stats" && i + 1 < argc) {
+            stats_interval = std::atoi(argv[++i]);
+        } else if (arg == "--io" && i + 1 < argc) {
+            if (!ParseIoBackend(argv[++i], io.backend)) {
+                std::cerr << "Unknown I/O backend: " << argv[i] << " (auto, epoll, uring)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-gso") {
+            io.gso = false;
+        } else if (arg == "--no-gro") {
+            io.gro = false;
+        } else if (arg == "--capture" && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (arg == "--bundle" && i + 1 < argc) {
+            bundle_ms = std::atof(argv[++i]);
+            if (bundle_ms < 0) {
+                std::cerr << "Invalid bundle tick: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--local" && i + 1 < argc) {
+            local_path = argv[++i];
+        } else if (ParseImpairmentArg(i, argc, argv, impairment)) {
+            continue;
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: " << argv[0] << " [port] [--upstream host:port]... [--relay-id N] [--stats seconds]"
+                      << " [--io auto|epoll|uring] [--no-gso] [--no-gro] [--capture file] [--local socket]"
+                      << " [--bundle ms]"
+                      << " [--impair spec]\n"
+                      << ImpairmentUsage();
+            return 0;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (!positional.empty()) {
+        port = std::atoi(positional[0].c_str());
+        if (port <= 0 || port > 65535) {
+            std::cerr << "Invalid port number: " << positional[0] << std::endl;
+            return 1;
+        }
+    }
+    if (!impairment.error.empty()) {
+        std::cerr << "Invalid impairment " << impairment.error << std::endl;
+        return 1;
+    }
+
+    relay = std::make_unique<AudioRelay>(port, relay_id, io);
+    relay->SetImpairment(impairment);
+    relay->SetLocalPath(local_path);
+    if (bundle_ms >= 0) {
+        relay->SetBundling(std::chrono::duration_cast<AudioRelay::Clock::duration>(
+            std::chrono::duration<double, std::milli>(bundle_ms)));
+    }
+
+    for (const auto& upstream : upstreams) {
+        sockaddr_in address{};
+        if (!ParseEndpoint(upstream, address)) {
+            std::cerr << "Invalid upstream address: " << upstream << std::endl;
+            return 1;
+        }
+        relay->AddUpstream(address, upstream);
+    }
+
+    if (!capture_path.empty()) {
+        capture = std::make_unique<TraceWriter>();
+        std::string error;
+        if (!capture->Open(capture_path, error)) {
+            std::cerr << "Failed to open capture file " << error << std::endl;
+            return 1;
+        }
+        relay->SetCapture(capture.get());
+        std::cout << "Capturing received datagrams to " << capture_path << std::endl;
+    }
+
+    if (!relay->Start()) {
+        std::cerr << "Failed to start audio relay on port " << port << std::endl;
+        return 1;
+    }
+
+    std::cout << "Press Ctrl+C to stop the relay" << std::endl;
+
+    // Основной цикл - периодическая статистика по транкам
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(stats_interval > 0 ? stats_interval : 1));
+        if (stats_interval > 0) {
+            PrintStats(relay->GetStats());
+        }
+    }
+
+    return 0;
+}